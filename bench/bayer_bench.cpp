@@ -0,0 +1,535 @@
+/*
+* Bayer decoding benchmark
+*
+* Decodes a random mosaic with every combination of method, tile, depth,
+* frame size and thread count asked for and prints one record per
+* combination, as CSV or as JSON, for the perf lab to collect and compare
+* from build to build. A record holds the median, the fastest and the
+* 99th percentile frame time, the throughput in input megapixels per second computed from the
+* median, the time stamp counter ticks per input pixel (reference
+* cycles, which tick at the nominal clock whatever the core runs at) and
+* the speed-up over the single-threaded run of the same case. One thread
+* times the serial decoders, more threads the band-parallel ones on a
+* pool of that size. A method the library does not implement gets a
+* record with its error code and no times. Depths 10 and 12 stand for
+* mosaics packed as RAW10 and RAW12, decoded by the packed decoders.
+* With --layout the 8- and 16-bit mosaics are decoded into that output
+* layout by the layout decoders instead of into packed RGB; the 16-bit
+* mosaics have no NV12 or I420 and get records with the error code.
+*
+* With --replay the frames come from a .dk2raw capture instead, decoded
+* in turn straight out of the file mapping, with the size, tile and depth
+* the file was recorded with.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+#include "bayer.h"
+#include "dk2raw.h"
+
+static const char *const method_names[DC1394_BAYER_METHOD_NUM] = {
+	"nearest", "simple", "bilinear", "hqlinear", "downsample", "edgesense", "vng", "ahd"
+};
+
+static const char *const tile_names[DC1394_COLOR_FILTER_NUM] = {
+	"rggb", "gbrg", "grbg", "bggr"
+};
+
+static const char *const layout_names[DC1394_BAYER_LAYOUT_NUM] = {
+	"rgb", "rgbx", "planar", "float", "nv12", "i420"
+};
+
+typedef struct {
+	uint32_t sx, sy;
+} bench_size_t;
+
+typedef struct {
+	std::vector<bench_size_t> sizes;
+	std::vector<int> methods;
+	std::vector<int> tiles;
+	std::vector<int> depths;
+	std::vector<uint32_t> threads;
+	uint32_t bits;
+	dc1394bayer_layout_t layout;
+	double min_time;
+	int min_frames;
+	int json;
+	std::string replay;
+} bench_options_t;
+
+typedef struct {
+	int method, tile, depth;
+	bench_size_t size;
+	uint32_t threads;
+	dc1394bayer_isa_t isa;
+	dc1394error_t err;
+	int frames;
+	double ns_median, ns_min, ns_p99, ticks_median;
+} bench_record_t;
+
+static uint64_t
+read_tsc(void)
+{
+#ifdef BENCH_HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int
+find_name(const char *const *names, int n, const std::string &name)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (name == names[i])
+			return i;
+	return -1;
+}
+
+static std::vector<std::string>
+split(const char *list)
+{
+	std::vector<std::string> out;
+	std::string s(list);
+	size_t a = 0, b;
+
+	while ((b = s.find(',', a)) != std::string::npos) {
+		out.push_back(s.substr(a, b - a));
+		a = b + 1;
+	}
+	out.push_back(s.substr(a));
+	return out;
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --sizes WxH,...      frame sizes (752x480,1280x960,1920x1080,2592x1944,4096x3072)\n"
+		"  --methods name,...   nearest simple bilinear hqlinear downsample edgesense vng ahd (all)\n"
+		"  --tiles name,...     rggb gbrg grbg bggr (all)\n"
+		"  --depths 8,10,12,16  mosaic depths, 10 and 12 packed (8,16)\n"
+		"  --bits N             significant bits of 16-bit samples (12)\n"
+		"  --layout name        rgb rgbx planar float nv12 i420, for depths 8 and 16,\n"
+		"                       nv12 and i420 for 8 only (rgb)\n"
+		"  --threads N,...      thread counts (1 and powers of two up to the processors)\n"
+		"  --isa name           cap the kernels at this instruction set\n"
+		"  --min-time S         seconds to time each case for (0.25)\n"
+		"  --min-frames N       frames to time each case for at least (5)\n"
+		"  --format csv|json    output format (csv)\n"
+		"  --quick              one small frame per case, for a smoke test\n"
+		"  --replay FILE        decode the frames of a .dk2raw capture instead\n",
+		argv0);
+}
+
+static int
+parse_options(int argc, char **argv, bench_options_t *opt)
+{
+	static const bench_size_t default_sizes[] = {
+		{ 752, 480 }, { 1280, 960 }, { 1920, 1080 }, { 2592, 1944 }, { 4096, 3072 }
+	};
+	uint32_t n, hw = std::thread::hardware_concurrency();
+	size_t k;
+	int i;
+
+	opt->sizes.assign(default_sizes, default_sizes + sizeof(default_sizes) / sizeof(default_sizes[0]));
+	for (i = 0; i < DC1394_BAYER_METHOD_NUM; i++)
+		opt->methods.push_back(i);
+	for (i = 0; i < DC1394_COLOR_FILTER_NUM; i++)
+		opt->tiles.push_back(i);
+	opt->depths.push_back(8);
+	opt->depths.push_back(16);
+	for (n = 1; n <= std::max(hw, 1u); n *= 2)
+		opt->threads.push_back(n);
+	if (hw > 1 && opt->threads.back() != hw)
+		opt->threads.push_back(hw);
+	opt->bits = 12;
+	opt->layout = DC1394_BAYER_LAYOUT_RGB;
+	opt->min_time = 0.25;
+	opt->min_frames = 5;
+	opt->json = 0;
+
+	for (i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+		std::vector<std::string> list;
+
+		if (arg == "--quick") {
+			opt->sizes.assign(1, default_sizes[0]);
+			opt->threads.resize(std::min<size_t>(opt->threads.size(), 2));
+			opt->min_time = 0;
+			opt->min_frames = 1;
+			continue;
+		}
+		if (arg == "--help" || arg == "-h") {
+			usage(argv[0]);
+			exit(0);
+		}
+		if (!val) {
+			usage(argv[0]);
+			return -1;
+		}
+		i++;
+		list = split(val);
+		if (arg == "--sizes") {
+			opt->sizes.clear();
+			for (k = 0; k < list.size(); k++) {
+				bench_size_t s;
+				if (sscanf(list[k].c_str(), "%ux%u", &s.sx, &s.sy) != 2 || s.sx < 8 || s.sy < 8)
+					return -1;
+				opt->sizes.push_back(s);
+			}
+		}
+		else if (arg == "--methods" || arg == "--tiles") {
+			std::vector<int> &v = arg == "--methods" ? opt->methods : opt->tiles;
+			v.clear();
+			for (k = 0; k < list.size(); k++) {
+				int id = arg == "--methods" ? find_name(method_names, DC1394_BAYER_METHOD_NUM, list[k])
+					: find_name(tile_names, DC1394_COLOR_FILTER_NUM, list[k]);
+				if (id < 0)
+					return -1;
+				v.push_back(id);
+			}
+		}
+		else if (arg == "--depths") {
+			opt->depths.clear();
+			for (k = 0; k < list.size(); k++) {
+				int d = atoi(list[k].c_str());
+				if (d != 8 && d != 10 && d != 12 && d != 16)
+					return -1;
+				opt->depths.push_back(d);
+			}
+		}
+		else if (arg == "--threads") {
+			opt->threads.clear();
+			for (k = 0; k < list.size(); k++) {
+				int t = atoi(list[k].c_str());
+				if (t < 1)
+					return -1;
+				opt->threads.push_back((uint32_t)t);
+			}
+		}
+		else if (arg == "--bits") {
+			opt->bits = (uint32_t)atoi(val);
+			if (opt->bits < 1 || opt->bits > 16)
+				return -1;
+		}
+		else if (arg == "--layout") {
+			int layout = find_name(layout_names, DC1394_BAYER_LAYOUT_NUM, val);
+			if (layout < 0)
+				return -1;
+			opt->layout = (dc1394bayer_layout_t)layout;
+		}
+		else if (arg == "--isa") {
+			int isa;
+			for (isa = DC1394_BAYER_ISA_MIN; isa <= DC1394_BAYER_ISA_MAX; isa++)
+				if (std::string(val) == dc1394_bayer_isa_name((dc1394bayer_isa_t)isa))
+					break;
+			if (isa > DC1394_BAYER_ISA_MAX || dc1394_bayer_set_max_isa((dc1394bayer_isa_t)isa) != DC1394_SUCCESS)
+				return -1;
+		}
+		else if (arg == "--min-time")
+			opt->min_time = atof(val);
+		else if (arg == "--min-frames")
+			opt->min_frames = std::max(atoi(val), 1);
+		else if (arg == "--format") {
+			if (std::string(val) != "csv" && std::string(val) != "json")
+				return -1;
+			opt->json = std::string(val) == "json";
+		}
+		else if (arg == "--replay")
+			opt->replay = val;
+		else {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* xorshift, so that every run decodes the same mosaic */
+static void
+fill_mosaic(uint16_t *p, size_t n, uint32_t mask)
+{
+	uint32_t s = 2463534242u;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		s ^= s << 13;
+		s ^= s >> 17;
+		s ^= s << 5;
+		p[i] = (uint16_t)(s & mask);
+	}
+}
+
+/* the layout decoders' output over out, planes one after another */
+static dc1394error_t
+decode_layout(dc1394bayer_pool_t *pool, const bench_record_t *r, const void *in, void *out, uint32_t bits, dc1394bayer_layout_t layout)
+{
+	dc1394color_filter_t tile = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + r->tile);
+	dc1394bayer_method_t method = (dc1394bayer_method_t)r->method;
+	const int sample = layout == DC1394_BAYER_LAYOUT_PLANAR_FLOAT ? (int)sizeof(float) : r->depth / 8;
+	const uint32_t ox = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? r->size.sx / 2 : r->size.sx;
+	const uint32_t oy = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? r->size.sy / 2 : r->size.sy;
+	dc1394bayer_output_t o;
+	uint8_t *plane = (uint8_t *)out;
+	uint32_t rows;
+	int i;
+
+	memset(&o, 0, sizeof(o));
+	o.layout = layout;
+	o.order = DC1394_BAYER_ORDER_BGR;
+	for (i = 0; i < 3; i++) {
+		o.pitch[i] = (int)ox * sample * (layout == DC1394_BAYER_LAYOUT_RGBX ? 4 : 1);
+		rows = oy;
+		/* subsampled chroma, interleaved for NV12 */
+		if (i && layout >= DC1394_BAYER_LAYOUT_NV12) {
+			o.pitch[i] = (int)(layout == DC1394_BAYER_LAYOUT_NV12 ? 2 : 1) * (int)((ox + 1) / 2);
+			rows = (oy + 1) / 2;
+		}
+		o.plane[i] = plane;
+		plane += (size_t)o.pitch[i] * rows;
+	}
+	if (r->depth == 8)
+		return dc1394_bayer_decoding_8bit_layout_parallel(pool, (const uint8_t *)in, (int)r->size.sx, &o, r->size.sx, r->size.sy, tile, method);
+	return dc1394_bayer_decoding_16bit_layout_parallel(pool, (const uint16_t *)in, (int)(r->size.sx * sizeof(uint16_t)), &o,
+		r->size.sx, r->size.sy, tile, method, bits);
+}
+
+static dc1394error_t
+decode(dc1394bayer_pool_t *pool, const bench_record_t *r, const void *in, void *out, uint32_t bits, dc1394bayer_layout_t layout)
+{
+	dc1394color_filter_t tile = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + r->tile);
+	dc1394bayer_method_t method = (dc1394bayer_method_t)r->method;
+
+	if (layout != DC1394_BAYER_LAYOUT_RGB && (r->depth == 8 || r->depth == 16))
+		return decode_layout(pool, r, in, out, bits, layout);
+
+	if (r->depth == 8)
+		return pool ? dc1394_bayer_decoding_8bit_parallel(pool, (const uint8_t *)in, (uint8_t *)out, r->size.sx, r->size.sy, tile, method)
+			: dc1394_bayer_decoding_8bit((const uint8_t *)in, (uint8_t *)out, r->size.sx, r->size.sy, tile, method);
+	if (r->depth == 10 || r->depth == 12) {
+		dc1394bayer_packing_t packing = r->depth == 10 ? DC1394_BAYER_PACKING_RAW10 : DC1394_BAYER_PACKING_RAW12;
+		int pitch = (int)dc1394_bayer_packed_row_bytes(packing, r->size.sx);
+		int rgb_pitch = 3 * (int)(method == DC1394_BAYER_METHOD_DOWNSAMPLE ? r->size.sx / 2 : r->size.sx) * (int)sizeof(uint16_t);
+
+		return dc1394_bayer_decoding_packed_parallel(pool, (const uint8_t *)in, pitch, (uint16_t *)out, rgb_pitch,
+			r->size.sx, r->size.sy, tile, method, packing, DC1394_BAYER_ORDER_RGB);
+	}
+	return pool ? dc1394_bayer_decoding_16bit_parallel(pool, (const uint16_t *)in, (uint16_t *)out, r->size.sx, r->size.sy, tile, method, bits)
+		: dc1394_bayer_decoding_16bit((const uint16_t *)in, (uint16_t *)out, r->size.sx, r->size.sy, tile, method, bits);
+}
+
+static double
+median(std::vector<double> v)
+{
+	size_t h = v.size() / 2;
+
+	std::sort(v.begin(), v.end());
+	return v.size() & 1 ? v[h] : (v[h - 1] + v[h]) / 2;
+}
+
+/* the time 99% of the frames took at most */
+static double
+p99(std::vector<double> v)
+{
+	size_t k = (v.size() * 99 + 99) / 100 - 1;
+
+	std::nth_element(v.begin(), v.begin() + k, v.end());
+	return v[k];
+}
+
+/*
+* times one case after a warm-up frame, which also reports any error;
+* each timed frame decodes the next of the input mosaics
+*/
+static void
+run_case(dc1394bayer_pool_t *pool, const bench_options_t *opt, const std::vector<const void *> &in, void *out, bench_record_t *r)
+{
+	typedef std::chrono::steady_clock clock;
+	std::vector<double> ns, ticks;
+	clock::time_point start;
+
+	dc1394_bayer_get_kernel_isa((dc1394bayer_method_t)r->method, r->depth == 8 ? 8 : 16, &r->isa);
+	r->frames = 0;
+	r->err = decode(pool, r, in[0], out, opt->bits, opt->layout);
+	if (r->err != DC1394_SUCCESS)
+		return;
+
+	start = clock::now();
+	do {
+		clock::time_point t0 = clock::now();
+		uint64_t c0 = read_tsc();
+
+		decode(pool, r, in[ns.size() % in.size()], out, opt->bits, opt->layout);
+		ticks.push_back((double)(read_tsc() - c0));
+		ns.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+	} while ((int)ns.size() < opt->min_frames
+		|| std::chrono::duration<double>(clock::now() - start).count() < opt->min_time);
+
+	r->frames = (int)ns.size();
+	r->ns_median = median(ns);
+	r->ns_min = *std::min_element(ns.begin(), ns.end());
+	r->ns_p99 = p99(ns);
+	r->ticks_median = median(ticks);
+}
+
+static void
+print_record(const bench_record_t *r, double ns_single, int json, int first)
+{
+	const double pixels = (double)r->size.sx * r->size.sy;
+	const char *isa = dc1394_bayer_isa_name(r->isa);
+
+	if (r->err != DC1394_SUCCESS) {
+		if (json)
+			printf("%s\n    {\"method\": \"%s\", \"tile\": \"%s\", \"depth\": %d, \"width\": %u, \"height\": %u, "
+				"\"threads\": %u, \"isa\": \"%s\", \"status\": %d}", first ? "" : ",",
+				method_names[r->method], tile_names[r->tile], r->depth, r->size.sx, r->size.sy, r->threads, isa, (int)r->err);
+		else
+			printf("%s,%s,%d,%u,%u,%u,%s,%d,,,,,,,\n", method_names[r->method], tile_names[r->tile], r->depth,
+				r->size.sx, r->size.sy, r->threads, isa, (int)r->err);
+		return;
+	}
+
+	if (json)
+		printf("%s\n    {\"method\": \"%s\", \"tile\": \"%s\", \"depth\": %d, \"width\": %u, \"height\": %u, "
+			"\"threads\": %u, \"isa\": \"%s\", \"status\": 0, \"frames\": %d, \"ns_per_frame\": %.0f, "
+			"\"ns_per_frame_min\": %.0f, \"ns_per_frame_p99\": %.0f, \"mpix_per_s\": %.2f, \"cycles_per_pixel\": %.3f, \"speedup\": %.3f}",
+			first ? "" : ",", method_names[r->method], tile_names[r->tile], r->depth, r->size.sx, r->size.sy,
+			r->threads, isa, r->frames, r->ns_median, r->ns_min, r->ns_p99, pixels * 1e3 / r->ns_median,
+			r->ticks_median / pixels, ns_single / r->ns_median);
+	else
+		printf("%s,%s,%d,%u,%u,%u,%s,0,%d,%.0f,%.0f,%.0f,%.2f,%.3f,%.3f\n", method_names[r->method], tile_names[r->tile],
+			r->depth, r->size.sx, r->size.sy, r->threads, isa, r->frames, r->ns_median, r->ns_min, r->ns_p99,
+			pixels * 1e3 / r->ns_median, r->ticks_median / pixels, ns_single / r->ns_median);
+	fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	bench_options_t opt;
+	std::vector<dc1394bayer_pool_t *> pools;
+	std::vector<const void *> replay;
+	dk2raw_reader_t *reader = NULL;
+	size_t s, t;
+	int m, ti, d, first = 1;
+
+	if (parse_options(argc, argv, &opt) < 0) {
+		fprintf(stderr, "%s: invalid arguments, see --help\n", argv[0]);
+		return 2;
+	}
+
+	if (!opt.replay.empty()) {
+		const dk2raw_header_t *h;
+		dk2raw_frame_t frame;
+		uint64_t f, count;
+
+		if (dk2raw_reader_open(opt.replay.c_str(), &reader) != DC1394_SUCCESS) {
+			fprintf(stderr, "%s: cannot read %s\n", argv[0], opt.replay.c_str());
+			return 2;
+		}
+		h = dk2raw_reader_header(reader);
+		opt.sizes.assign(1, bench_size_t());
+		opt.sizes[0].sx = h->width;
+		opt.sizes[0].sy = h->height;
+		opt.tiles.assign(1, (int)h->tile - DC1394_COLOR_FILTER_MIN);
+		opt.depths.assign(1, h->sample_size == 1 ? 8 : 16);
+		opt.bits = h->bits;
+		count = dk2raw_reader_frame_count(reader);
+		dk2raw_reader_prefetch(reader, 0, count);
+		/* a short buffer would make the decoder read past its record */
+		for (f = 0; f < count; f++)
+			if (dk2raw_reader_frame(reader, f, &frame) == DC1394_SUCCESS && frame.size == h->frame_size)
+				replay.push_back(frame.data);
+		if (replay.empty()) {
+			fprintf(stderr, "%s: no complete frames in %s\n", argv[0], opt.replay.c_str());
+			dk2raw_reader_close(reader);
+			return 2;
+		}
+	}
+
+	for (t = 0; t < opt.threads.size(); t++)
+		pools.push_back(opt.threads[t] > 1 ? dc1394_bayer_pool_new(opt.threads[t]) : NULL);
+
+	if (opt.json)
+		printf("{\n  \"cpu_features\": %u,\n  \"max_isa\": \"%s\",\n  \"bits\": %u,\n  \"layout\": \"%s\",\n  \"results\": [",
+			dc1394_bayer_get_cpu_features(), dc1394_bayer_isa_name(dc1394_bayer_get_max_isa()), opt.bits, layout_names[opt.layout]);
+	else
+		printf("method,tile,depth,width,height,threads,isa,status,frames,ns_per_frame,ns_per_frame_min,"
+			"ns_per_frame_p99,mpix_per_s,cycles_per_pixel,speedup\n");
+
+	for (s = 0; s < opt.sizes.size(); s++) {
+		const bench_size_t size = opt.sizes[s];
+		const size_t n = (size_t)size.sx * size.sy;
+		std::vector<uint16_t> mosaic16(n);
+		std::vector<uint8_t> mosaic8(n);
+		std::vector<uint8_t> packed;
+		/* room for three planes of floats */
+		std::vector<uint16_t> out(6 * n);
+		size_t i;
+
+		fill_mosaic(&mosaic16[0], n, 0xffff);
+		for (i = 0; i < n; i++)
+			mosaic8[i] = (uint8_t)mosaic16[i];
+		/* any bytes are a valid packed mosaic, and RAW12 takes the most */
+		packed.assign((const uint8_t *)&mosaic16[0], (const uint8_t *)&mosaic16[0] + n / 2 * 3);
+		fill_mosaic(&mosaic16[0], n, (1u << opt.bits) - 1);
+
+		for (d = 0; d < (int)opt.depths.size(); d++)
+		for (m = 0; m < (int)opt.methods.size(); m++)
+		for (ti = 0; ti < (int)opt.tiles.size(); ti++) {
+			std::vector<const void *> in(1, opt.depths[d] == 8 ? (const void *)&mosaic8[0]
+				: opt.depths[d] == 16 ? (const void *)&mosaic16[0] : (const void *)&packed[0]);
+			double ns_single = 0;
+
+			if (reader)
+				in = replay;
+
+			for (t = 0; t < opt.threads.size(); t++) {
+				bench_record_t r;
+
+				r.method = opt.methods[m];
+				r.tile = opt.tiles[ti];
+				r.depth = opt.depths[d];
+				r.size = size;
+				r.threads = opt.threads[t];
+				run_case(pools[t], &opt, in, &out[0], &r);
+				/* speed-up over the first thread count listed, normally one */
+				if (t == 0)
+					ns_single = r.ns_median;
+				print_record(&r, ns_single, opt.json, first);
+				first = 0;
+			}
+		}
+	}
+
+	if (opt.json)
+		printf("\n  ]\n}\n");
+
+	for (t = 0; t < pools.size(); t++)
+		dc1394_bayer_pool_free(pools[t]);
+	dk2raw_reader_close(reader);
+	return 0;
+}
@@ -1,17 +1,160 @@
 #include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <initguid.h>
 #include <streams.h>
 #include "DK2TransformFilter.h"
 #include "bayer.h"
+#include "blob.h"
+#include "dk2latency.h"
+#include "dk2pipeline.h"
+#include "dk2raw.h"
+
+// LEDs saturate the sensor; the background stays well below this
+static const uint8_t kBlobThreshold = 200;
+// Smaller blobs are single hot pixels, not LEDs
+static const uint32_t kBlobMinArea = 2;
+// The decoder has kernels built for exactly this frame size and takes them
+// whenever a whole frame of it is decoded; any other size runs the generic
+// kernels
+static const uint32_t kSensorWidth = 752;
+static const uint32_t kSensorHeight = 480;
+// Those kernels only store aligned when every output row is
+static const long kBufferAlign = 16;
+// Names the .dk2raw file that receives every input frame, for replaying a
+// session offline; unset, nothing is recorded
+static const char kRecordVariable[] = "DK2_RECORD";
+// Number of worker threads that convert frames off the streaming thread;
+// unset or 0, Transform converts each frame before Receive returns
+static const char kWorkersVariable[] = "DK2_WORKERS";
+static const uint32_t kMaxWorkers = 16;
+// What the workers do when they fall behind: "all" converts every frame
+// and holds up the capture thread when the queue is full, "latest" keeps
+// only the newest frame waiting, "queue:N" the newest N. Setting it
+// without DK2_WORKERS starts one worker.
+static const char kPolicyVariable[] = "DK2_POLICY";
+// Seconds between dumps of the stage times to the debugger output, in
+// builds with DK2_LATENCY; unset, they are only dumped on Stop
+static const char kLatencyDumpVariable[] = "DK2_LATENCY_DUMP";
+// Each thread records its times in a lane of its own: the streaming
+// thread, whichever worker is delivering (one at a time), then the workers
+static const uint32_t kLaneStreaming = 0;
+static const uint32_t kLaneDelivery = 1;
+static const uint32_t kLaneWorkers = 2;
+
+static bool ParsePolicy(const char *szPolicy, dk2pipeline_policy_t *pPolicy, uint32_t *pLimit)
+{
+  *pLimit = 0;
+  if (strcmp(szPolicy, "all") == 0) {
+    *pPolicy = DK2PIPELINE_PROCESS_ALL;
+  } else if (strcmp(szPolicy, "latest") == 0) {
+    *pPolicy = DK2PIPELINE_LATEST;
+  } else if (strncmp(szPolicy, "queue", 5) == 0 && (szPolicy[5] == '\0' || szPolicy[5] == ':')) {
+    *pPolicy = DK2PIPELINE_QUEUE;
+    if (szPolicy[5] == ':') {
+      *pLimit = (uint32_t)atoi(szPolicy + 6);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
 
 STDMETHODIMP DK2TransformFilter::NonDelegatingQueryInterface(REFIID riid, void **ppv)
 {
+  if (riid == IID_IDK2PipelineStats) {
+    return GetInterface((IDK2PipelineStats *)this, ppv);
+  }
+  if (riid == IID_IDK2LatencyStats && m_pLatency != NULL) {
+    return GetInterface((IDK2LatencyStats *)this, ppv);
+  }
   return CBaseFilter::NonDelegatingQueryInterface(riid,ppv);
 }
 
 DK2TransformFilter::DK2TransformFilter(LPUNKNOWN pUnk, HRESULT *phr)
   : CTransformFilter(NAME("DK2 Transform Filter"), pUnk, CLSID_DK2TransformFilter)
-{}
+{
+  // A NULL pool is fine, the decoder then runs on the streaming thread alone
+  m_pBayerPool = dc1394_bayer_pool_new(0);
+  m_pBlobDetector = dc1394_blob_detector_new();
+  if (m_pBlobDetector == NULL) {
+    *phr = E_OUTOFMEMORY;
+  }
+
+  m_pRecorder = NULL;
+  m_nSequence = 0;
+  char szRecordPath[MAX_PATH];
+  DWORD cchRecordPath = GetEnvironmentVariableA(kRecordVariable, szRecordPath, MAX_PATH);
+  if (cchRecordPath > 0 && cchRecordPath < MAX_PATH) {
+    // Recording is a diagnostic; the filter works the same without it
+    if (dk2raw_writer_open(szRecordPath, kSensorWidth, kSensorHeight,
+			   DC1394_COLOR_FILTER_RGGB, 8, &m_pRecorder) != DC1394_SUCCESS) {
+      DbgLog((LOG_ERROR, 0, TEXT("DK2: cannot record to %hs"), szRecordPath));
+    }
+  }
+
+  m_pPipeline = NULL;
+  m_hrDeliver = S_OK;
+  char szWorkers[16];
+  DWORD cchWorkers = GetEnvironmentVariableA(kWorkersVariable, szWorkers, sizeof(szWorkers));
+  uint32_t nWorkers = cchWorkers > 0 && cchWorkers < sizeof(szWorkers) ? (uint32_t)atoi(szWorkers) : 0;
+  if (nWorkers > kMaxWorkers) {
+    nWorkers = kMaxWorkers;
+  }
+  // Frames that cannot be converted in time are skipped by default
+  dk2pipeline_policy_t policy = DK2PIPELINE_QUEUE;
+  uint32_t nLimit = 0;
+  char szPolicy[32];
+  DWORD cchPolicy = GetEnvironmentVariableA(kPolicyVariable, szPolicy, sizeof(szPolicy));
+  if (cchPolicy > 0 && cchPolicy < sizeof(szPolicy)) {
+    if (!ParsePolicy(szPolicy, &policy, &nLimit)) {
+      DbgLog((LOG_ERROR, 0, TEXT("DK2: unknown delivery policy %hs"), szPolicy));
+    } else if (nWorkers == 0) {
+      nWorkers = 1;
+    }
+  }
+  if (nWorkers > 0) {
+    // Blob detectors keep per-frame scratch state, so each worker has its own
+    for (uint32_t i = 0; i < nWorkers; i++) {
+      m_vWorkerDetectors.push_back(dc1394_blob_detector_new());
+      if (m_vWorkerDetectors.back() == NULL) {
+	*phr = E_OUTOFMEMORY;
+      }
+    }
+    dk2pipeline_callbacks_t callbacks = { AcquireBuffer, ReleaseBuffer, ProcessFrame, DeliverFrame, this };
+    // Without a pipeline every frame is converted synchronously, as before
+    m_pPipeline = dk2pipeline_new(kSensorWidth * kSensorHeight, policy, nLimit, nWorkers, &callbacks);
+  }
+
+  m_pLatency = NULL;
+  m_tDumpInterval = 0;
+  m_tNextDump = 0;
+  m_tArrival = 0;
+  m_tConverted = 0;
+#ifdef DK2_LATENCY
+  m_pLatency = dk2latency_new(kLaneWorkers + (m_pPipeline != NULL ? dk2pipeline_get_workers(m_pPipeline) : 0));
+  char szDump[16];
+  DWORD cchDump = GetEnvironmentVariableA(kLatencyDumpVariable, szDump, sizeof(szDump));
+  if (cchDump > 0 && cchDump < sizeof(szDump) && atoi(szDump) > 0) {
+    m_tDumpInterval = (uint64_t)atoi(szDump) * 1000000000u;
+    m_tNextDump = dk2latency_now() + m_tDumpInterval;
+  }
+#endif
+}
+
+DK2TransformFilter::~DK2TransformFilter()
+{
+  // The workers use the detectors and the output pin, so they go first
+  dk2pipeline_free(m_pPipeline);
+  for (size_t i = 0; i < m_vWorkerDetectors.size(); i++) {
+    dc1394_blob_detector_free(m_vWorkerDetectors[i]);
+  }
+  dc1394_bayer_pool_free(m_pBayerPool);
+  dc1394_blob_detector_free(m_pBlobDetector);
+  dk2raw_writer_close(m_pRecorder);
+  dk2latency_free(m_pLatency);
+}
 
 HRESULT DK2TransformFilter::CheckInputType(const CMediaType *mtIn)
 {
@@ -24,29 +167,79 @@ HRESULT DK2TransformFilter::GetMediaType(int iPosition, CMediaType *pMediaType)
     return E_UNEXPECTED;
   }
 
-  if (iPosition > 0) {
+  // 0: bottom-up RGB24, 1: Y800 greyscale for consumers that only need
+  // intensity, at a third of the bandwidth, 2: LED blobs found in the raw
+  // mosaic, for trackers that need no image at all, 3: half-size RGB24
+  // for previews and coarse searches, 4: bottom-up RGB32, whose 4-byte
+  // pixels suit vector code, 5: planar R, G, B, 6: the same planes as
+  // floats from 0 to 1 for the LED classifier, 7: NV12 and 8: I420, the
+  // BT.601 4:2:0 frames video encoders take without a colour converter
+  if (iPosition > 8) {
     return VFW_S_NO_MORE_ITEMS;
   }
+  if (iPosition == 2) {
+    pMediaType->SetType(&MEDIATYPE_Video);
+    pMediaType->SetSubtype(&MEDIASUBTYPE_DK2_BLOBS);
+    pMediaType->SetTemporalCompression(FALSE);
+    pMediaType->SetSampleSize(sizeof(DK2BlobSample));
+    pMediaType->SetFormatType(&FORMAT_None);
+    return S_OK;
+  }
+  const bool bHalf = iPosition == 3;
+  const GUID *pSubtype = &MEDIASUBTYPE_RGB24;
+  DWORD dwCompression = BI_RGB;
+  WORD wBitCount = 24;
+  switch (iPosition) {
+  case 1:
+    pSubtype = &MEDIASUBTYPE_DK2_Y800;
+    dwCompression = MAKEFOURCC('Y', '8', '0', '0');
+    wBitCount = 8;
+    break;
+  case 4:
+    pSubtype = &MEDIASUBTYPE_RGB32;
+    wBitCount = 32;
+    break;
+  case 5:
+    // Three planes of a byte per pixel take as much as one of three bytes
+    pSubtype = &MEDIASUBTYPE_DK2_RGBP;
+    dwCompression = MAKEFOURCC('D', 'K', 'R', 'P');
+    break;
+  case 6:
+    pSubtype = &MEDIASUBTYPE_DK2_RGBF;
+    dwCompression = MAKEFOURCC('D', 'K', 'R', 'F');
+    wBitCount = (WORD)(3 * 8 * sizeof(float));
+    break;
+  case 7:
+    pSubtype = &MEDIASUBTYPE_NV12;
+    dwCompression = MAKEFOURCC('N', 'V', '1', '2');
+    wBitCount = 12;
+    break;
+  case 8:
+    pSubtype = &MEDIASUBTYPE_DK2_I420;
+    dwCompression = MAKEFOURCC('I', '4', '2', '0');
+    wBitCount = 12;
+    break;
+  }
 
   pMediaType->SetType(&MEDIATYPE_Video);
-  pMediaType->SetSubtype(&MEDIASUBTYPE_RGB24);
+  pMediaType->SetSubtype(pSubtype);
   pMediaType->SetTemporalCompression(FALSE);
   pMediaType->bFixedSizeSamples = true;
   pMediaType->bTemporalCompression = false;
-  pMediaType->lSampleSize = 752 * 480 * 3;
   pMediaType->SetFormatType(&FORMAT_VideoInfo);
   ASSERT(pMediaType->formattype == FORMAT_VideoInfo);
 
   VIDEOINFO *pVih = (VIDEOINFO *)pMediaType->AllocFormatBuffer(sizeof(VIDEOINFO));
   ZeroMemory(pVih, sizeof(VIDEOINFO));
 
-  pVih->bmiHeader.biCompression = BI_RGB;
-  pVih->bmiHeader.biBitCount = 24;
+  pVih->bmiHeader.biCompression = dwCompression;
+  pVih->bmiHeader.biBitCount = wBitCount;
   pVih->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-  pVih->bmiHeader.biWidth = 752;
-  pVih->bmiHeader.biHeight = 480;
+  pVih->bmiHeader.biWidth = bHalf ? kSensorWidth / 2 : kSensorWidth;
+  pVih->bmiHeader.biHeight = bHalf ? kSensorHeight / 2 : kSensorHeight;
   pVih->bmiHeader.biPlanes = 1;
   pVih->bmiHeader.biSizeImage = DIBSIZE(pVih->bmiHeader);
+  pMediaType->lSampleSize = pVih->bmiHeader.biSizeImage;
 
   return S_OK;
 }
@@ -65,16 +258,23 @@ HRESULT DK2TransformFilter::DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PR
       return hr;
     }
 
-  ASSERT(mt.formattype == FORMAT_VideoInfo);
-  BITMAPINFOHEADER *pbmi = HEADER(mt.pbFormat);
-  pProp->cbBuffer = 752 * 480 * 3;
-  if (pProp->cbAlign == 0)
+  if (mt.subtype == MEDIASUBTYPE_DK2_BLOBS) {
+    pProp->cbBuffer = sizeof(DK2BlobSample);
+  } else {
+    ASSERT(mt.formattype == FORMAT_VideoInfo);
+    BITMAPINFOHEADER *pbmi = HEADER(mt.pbFormat);
+    pProp->cbBuffer = DIBSIZE(*pbmi);
+  }
+  if (pProp->cbAlign < kBufferAlign)
     {
-      pProp->cbAlign = 1;
+      pProp->cbAlign = kBufferAlign;
     }
-  if (pProp->cBuffers == 0)
+  // Each pipeline worker holds an output buffer while it converts, and
+  // one more is on its way downstream
+  long cBuffersWanted = m_pPipeline != NULL ? (long)dk2pipeline_get_workers(m_pPipeline) + 1 : 1;
+  if (pProp->cBuffers < cBuffersWanted)
     {
-      pProp->cBuffers = 1;
+      pProp->cBuffers = cBuffersWanted;
     }
   // Release the format block.
   FreeMediaType(mt);
@@ -94,34 +294,430 @@ HRESULT DK2TransformFilter::DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PR
   return S_OK;
 }
 
+// Start time and duration of a sample, DK2RAW_NO_TIME and 0 when it has none
+static void GetSampleTime(IMediaSample *pSample, int64_t *pStart, int64_t *pDuration)
+{
+  REFERENCE_TIME tStart, tStop;
+  HRESULT hr = pSample->GetTime(&tStart, &tStop);
+  *pStart = SUCCEEDED(hr) ? tStart : DK2RAW_NO_TIME;
+  *pDuration = hr == S_OK ? tStop - tStart : 0;
+}
+
+// Input buffers hold at most one mosaic; anything past it is not looked at
+static uint32_t InputSize(IMediaSample *pSource)
+{
+  long lSourceSize = pSource->GetActualDataLength();
+  if (lSourceSize < 0) {
+    return 0;
+  }
+  return (uint32_t)lSourceSize < kSensorWidth * kSensorHeight
+    ? (uint32_t)lSourceSize : kSensorWidth * kSensorHeight;
+}
+
+void DK2TransformFilter::Record(IMediaSample *pSource, const BYTE *pBufferIn)
+{
+  if (m_pRecorder == NULL) {
+    return;
+  }
+  // The buffer as it came, before anything reads it
+  int64_t timestamp, duration;
+  GetSampleTime(pSource, &timestamp, &duration);
+  if (dk2raw_writer_append(m_pRecorder, pBufferIn, InputSize(pSource), m_nSequence, timestamp) != DC1394_SUCCESS) {
+    // Most likely a full disk; stop rather than fail the stream
+    DbgLog((LOG_ERROR, 0, TEXT("DK2: recording stopped at frame %I64u"), m_nSequence));
+    dk2raw_writer_close(m_pRecorder);
+    m_pRecorder = NULL;
+  }
+}
+
+void DK2TransformFilter::DumpLatency()
+{
+  char szText[1024];
+  dk2latency_format(m_pLatency, szText, sizeof(szText));
+  OutputDebugStringA("DK2: stage times\n");
+  OutputDebugStringA(szText);
+
+  dk2pipeline_stats_t stats;
+  GetPipelineStats(&stats);
+  sprintf_s(szText, sizeof(szText),
+	    "DK2: %I64u frames delivered, %I64u skipped, %I64u dropped, %I64u failed; %u queued, at most %u\n",
+	    stats.delivered, stats.skipped, stats.dropped, stats.failed, stats.queued, stats.queued_max);
+  OutputDebugStringA(szText);
+}
+
+// Times the streaming thread's part of a frame, and dumps the times
+// every DK2_LATENCY_DUMP seconds
+void DK2TransformFilter::EndReceive(uint64_t tArrival, uint64_t tDone)
+{
+  dk2latency_record(m_pLatency, kLaneStreaming, DK2LATENCY_RECEIVE, tDone - tArrival);
+  if (m_tDumpInterval != 0 && tDone >= m_tNextDump) {
+    DumpLatency();
+    m_tNextDump = tDone + m_tDumpInterval;
+  }
+}
+
+HRESULT DK2TransformFilter::Receive(IMediaSample *pSample)
+{
+  // Stream control samples go the base class way
+  AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
+  if (pProps->dwStreamId != AM_STREAM_MEDIA) {
+    return CTransformFilter::Receive(pSample);
+  }
+#ifdef DK2_LATENCY
+  const uint64_t tArrival = dk2latency_now();
+#endif
+  if (m_pPipeline == NULL) {
+    // The base class calls Transform and then delivers
+#ifdef DK2_LATENCY
+    m_tArrival = tArrival;
+    m_tConverted = 0;
+#endif
+    HRESULT hr = CTransformFilter::Receive(pSample);
+#ifdef DK2_LATENCY
+    const uint64_t tDone = dk2latency_now();
+    if (m_pLatency != NULL) {
+      if (m_tConverted != 0) {
+	dk2latency_record(m_pLatency, kLaneStreaming, DK2LATENCY_AGE, m_tConverted - tArrival);
+	dk2latency_record(m_pLatency, kLaneStreaming, DK2LATENCY_DELIVER, tDone - m_tConverted);
+      }
+      EndReceive(tArrival, tDone);
+    }
+#endif
+    return hr;
+  }
+  // A delivery that failed on a worker stops the stream as it would here
+  HRESULT hr = (HRESULT)m_hrDeliver;
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  BYTE *pBufferIn;
+  hr = pSample->GetPointer(&pBufferIn);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  Record(pSample, pBufferIn);
+
+  // Copies the frame and returns. When every worker is behind, the
+  // default policies skip or drop a frame rather than wait, but
+  // DK2_POLICY=all holds up the capture thread until a slot frees up.
+  // The sample's flags and media times go with the frame, for the output
+  // sample, as InitializeOutputSample would have set them.
+  int64_t timestamp, duration;
+  GetSampleTime(pSample, &timestamp, &duration);
+  dk2pipeline_tags_t tags;
+  tags.flags = pProps->dwSampleFlags;
+  tags.type_flags = pProps->dwTypeSpecificFlags;
+  tags.has_media_time = pSample->GetMediaTime(&tags.media_start, &tags.media_stop) == S_OK;
+  dk2pipeline_push(m_pPipeline, pBufferIn, InputSize(pSample), m_nSequence, timestamp, duration, &tags);
+  m_nSequence++;
+#ifdef DK2_LATENCY
+  if (m_pLatency != NULL) {
+    EndReceive(tArrival, dk2latency_now());
+  }
+#endif
+  return S_OK;
+}
+
+void *DK2TransformFilter::AcquireBuffer(void *ctx, uint32_t worker)
+{
+  DK2TransformFilter *pFilter = (DK2TransformFilter *)ctx;
+
+  // Blocks while downstream holds every buffer; the pipeline only picks
+  // the frame to convert once this returns, so the wait makes it no older
+  IMediaSample *pDest;
+  if (FAILED(pFilter->m_pOutput->GetDeliveryBuffer(&pDest, NULL, NULL, 0))) {
+    // The allocator was decommitted by Stop or a flush
+    return NULL;
+  }
+  return pDest;
+}
+
+void DK2TransformFilter::ReleaseBuffer(void *ctx, void *result)
+{
+  ((IMediaSample *)result)->Release();
+}
+
+// What CTransformFilter::InitializeOutputSample copies from the input
+// sample to the output, from the properties pushed with the frame
+static void SetSampleProps(IMediaSample *pDest, const dk2pipeline_frame_t *frame)
+{
+  REFERENCE_TIME tStart = frame->timestamp;
+  REFERENCE_TIME tStop = frame->timestamp + frame->duration;
+  const DWORD dwFlags = frame->tags.flags;
+  IMediaSample2 *pDest2;
+
+  if (SUCCEEDED(pDest->QueryInterface(IID_IMediaSample2, (void **)&pDest2))) {
+    AM_SAMPLE2_PROPERTIES props;
+    if (SUCCEEDED(pDest2->GetProperties(FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, tStart), (PBYTE)&props))) {
+      // A type change comes from the allocator, not the input
+      props.dwTypeSpecificFlags = frame->tags.type_flags;
+      props.dwSampleFlags = (props.dwSampleFlags & AM_SAMPLE_TYPECHANGED) | (dwFlags & ~AM_SAMPLE_TYPECHANGED);
+      props.tStart = tStart;
+      props.tStop = tStop;
+      props.cbData = FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, dwStreamId);
+      pDest2->SetProperties(FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, dwStreamId), (PBYTE)&props);
+    }
+    pDest2->Release();
+  } else {
+    if (dwFlags & AM_SAMPLE_TIMEVALID) {
+      pDest->SetTime(&tStart, (dwFlags & AM_SAMPLE_STOPVALID) ? &tStop : NULL);
+    }
+    pDest->SetSyncPoint((dwFlags & AM_SAMPLE_SPLICEPOINT) != 0);
+    pDest->SetDiscontinuity((dwFlags & AM_SAMPLE_DATADISCONTINUITY) != 0);
+    pDest->SetPreroll((dwFlags & AM_SAMPLE_PREROLL) != 0);
+  }
+  if (frame->tags.has_media_time) {
+    LONGLONG tMediaStart = frame->tags.media_start, tMediaStop = frame->tags.media_stop;
+    pDest->SetMediaTime(&tMediaStart, &tMediaStop);
+  }
+}
+
+void DK2TransformFilter::ProcessFrame(void *ctx, uint32_t worker, dk2pipeline_frame_t *frame)
+{
+  DK2TransformFilter *pFilter = (DK2TransformFilter *)ctx;
+  IMediaSample *pDest = (IMediaSample *)frame->result;
+
+  if (pDest == NULL) {
+    // No buffer to convert into; the frame is lost, and counts as failed
+    return;
+  }
+  SetSampleProps(pDest, frame);
+  // Each worker decodes on its own thread; they already run in parallel
+#ifdef DK2_LATENCY
+  const uint64_t tConvert = dk2latency_now();
+#endif
+  HRESULT hr = pFilter->Convert(frame->data, pDest, NULL, pFilter->m_vWorkerDetectors[worker]);
+#ifdef DK2_LATENCY
+  // The frame arrived when it was pushed, on the same clock
+  if (pFilter->m_pLatency != NULL) {
+    dk2latency_record(pFilter->m_pLatency, kLaneWorkers + worker, DK2LATENCY_WAIT, tConvert - frame->pushed_ns);
+    dk2latency_record(pFilter->m_pLatency, kLaneWorkers + worker, DK2LATENCY_CONVERT, dk2latency_now() - tConvert);
+  }
+#endif
+  if (FAILED(hr)) {
+    pDest->Release();
+    frame->result = NULL;
+  }
+}
+
+void DK2TransformFilter::DeliverFrame(void *ctx, dk2pipeline_frame_t *frame)
+{
+  DK2TransformFilter *pFilter = (DK2TransformFilter *)ctx;
+  // Frames left without a sample count as failed and never get here
+  IMediaSample *pDest = (IMediaSample *)frame->result;
+
+#ifdef DK2_LATENCY
+  const uint64_t tDeliver = dk2latency_now();
+#endif
+  HRESULT hr = pFilter->m_pOutput->Deliver(pDest);
+#ifdef DK2_LATENCY
+  // Deliveries never overlap, so they share a lane
+  if (pFilter->m_pLatency != NULL) {
+    dk2latency_record(pFilter->m_pLatency, kLaneDelivery, DK2LATENCY_AGE, frame->age_ns);
+    dk2latency_record(pFilter->m_pLatency, kLaneDelivery, DK2LATENCY_DELIVER, dk2latency_now() - tDeliver);
+  }
+#endif
+  pDest->Release();
+  if (FAILED(hr)) {
+    InterlockedExchange(&pFilter->m_hrDeliver, hr);
+  }
+}
+
+HRESULT DK2TransformFilter::EndOfStream()
+{
+  // Every frame received goes downstream ahead of the end of stream
+  if (m_pPipeline != NULL) {
+    dk2pipeline_flush(m_pPipeline, DC1394_FALSE);
+  }
+  return CTransformFilter::EndOfStream();
+}
+
+HRESULT DK2TransformFilter::BeginFlush()
+{
+  // Downstream rejects samples from here on, so a worker blocked in
+  // GetDeliveryBuffer or Deliver returns and the queue drains
+  HRESULT hr = CTransformFilter::BeginFlush();
+  if (m_pPipeline != NULL) {
+    dk2pipeline_flush(m_pPipeline, DC1394_TRUE);
+  }
+  return hr;
+}
+
+HRESULT DK2TransformFilter::EndFlush()
+{
+  InterlockedExchange(&m_hrDeliver, S_OK);
+  return CTransformFilter::EndFlush();
+}
+
+STDMETHODIMP DK2TransformFilter::GetPipelineStats(dk2pipeline_stats_t *pStats)
+{
+  CheckPointer(pStats, E_POINTER);
+  if (m_pPipeline != NULL) {
+    dk2pipeline_get_stats(m_pPipeline, pStats);
+  } else {
+    // Synchronous conversion handles every frame it receives
+    ZeroMemory(pStats, sizeof(*pStats));
+    pStats->pushed = m_nSequence;
+    pStats->delivered = m_nSequence;
+  }
+  return S_OK;
+}
+
+STDMETHODIMP DK2TransformFilter::GetLatency(dk2latency_stage_t stage, dk2latency_summary_t *pSummary)
+{
+  CheckPointer(pSummary, E_POINTER);
+  if (m_pLatency == NULL) {
+    return E_NOTIMPL;
+  }
+  if (stage < 0 || stage >= DK2LATENCY_STAGES) {
+    return E_INVALIDARG;
+  }
+  dk2latency_summarize(m_pLatency, stage, pSummary);
+  return S_OK;
+}
+
+STDMETHODIMP DK2TransformFilter::Stop()
+{
+  // Stopping decommits the allocators first, which releases any worker
+  // waiting for an output buffer
+  HRESULT hr = CTransformFilter::Stop();
+  if (m_pPipeline != NULL) {
+    dk2pipeline_flush(m_pPipeline, DC1394_TRUE);
+    dk2pipeline_stats_t stats;
+    dk2pipeline_get_stats(m_pPipeline, &stats);
+    DbgLog((LOG_TRACE, 1, TEXT("DK2: %I64u frames delivered, %I64u skipped, %I64u dropped, %I64u failed, age max %I64u us"),
+	    stats.delivered, stats.skipped, stats.dropped, stats.failed, stats.age_max_ns / 1000));
+  }
+  if (m_pLatency != NULL) {
+    DumpLatency();
+  }
+  InterlockedExchange(&m_hrDeliver, S_OK);
+  return hr;
+}
+
 HRESULT DK2TransformFilter::Transform(IMediaSample *pSource, IMediaSample *pDest)
 {
-  // Get pointers to the underlying buffers.
-  BYTE *pBufferIn, *pBufferOut;
+  BYTE *pBufferIn;
   HRESULT hr = pSource->GetPointer(&pBufferIn);
   if (FAILED(hr))
     {
       return hr;
     }
-  hr = pDest->GetPointer(&pBufferOut);
+  Record(pSource, pBufferIn);
+  m_nSequence++;
+#ifdef DK2_LATENCY
+  const uint64_t tConvert = dk2latency_now();
+#endif
+  hr = Convert(pBufferIn, pDest, m_pBayerPool, m_pBlobDetector);
+#ifdef DK2_LATENCY
+  // Receive takes the rest once the base class has delivered
+  if (m_pLatency != NULL && SUCCEEDED(hr)) {
+    m_tConverted = dk2latency_now();
+    dk2latency_record(m_pLatency, kLaneStreaming, DK2LATENCY_WAIT, tConvert - m_tArrival);
+    dk2latency_record(m_pLatency, kLaneStreaming, DK2LATENCY_CONVERT, m_tConverted - tConvert);
+  }
+#endif
+  return hr;
+}
+
+// Decodes one mosaic into pDest in the output pin's format; runs on the
+// streaming thread, or on a pipeline worker with its own detector
+HRESULT DK2TransformFilter::Convert(const BYTE *pBufferIn, IMediaSample *pDest,
+				    dc1394bayer_pool_t *pPool, dc1394blob_detector_t *pDetector)
+{
+  BYTE *pBufferOut;
+  HRESULT hr = pDest->GetPointer(&pBufferOut);
   if (FAILED(hr))
     {
       return hr;
     }
-  // Process the data.
-  long lSourceSize = pSource->GetActualDataLength();
 
-#ifdef DEBUG
-  long lDestSize = pDest->GetSize();
-  ASSERT(lDestSize >= lSourceSize);
-#endif
+  const CMediaType &mtOut = m_pOutput->CurrentMediaType();
 
-  dc1394_bayer_Bilinear(pBufferIn, pBufferOut, 752, 480, DC1394_COLOR_FILTER_RGGB);
+  if (mtOut.subtype == MEDIASUBTYPE_DK2_BLOBS) {
+    // Straight from the mosaic, nothing is demosaiced
+    DK2BlobSample *pBlobs = (DK2BlobSample *)pBufferOut;
+    if (pDest->GetSize() < (long)sizeof(DK2BlobSample)) {
+      return E_FAIL;
+    }
+    if (dc1394_blob_detect(pDetector, pBufferIn, kSensorWidth, kSensorHeight, kSensorWidth,
+			   kBlobThreshold, kBlobMinArea, pBlobs->aBlobs,
+			   DK2_MAX_BLOBS, &pBlobs->nFound) != DC1394_SUCCESS) {
+      return E_FAIL;
+    }
+    pBlobs->nBlobs = pBlobs->nFound < DK2_MAX_BLOBS ? pBlobs->nFound : DK2_MAX_BLOBS;
+    pDest->SetActualDataLength(sizeof(DK2BlobSample));
+    pDest->SetSyncPoint(TRUE);
+    return S_OK;
+  }
 
-  
-  ASSERT((752 * 480 * 3) <= pDest->GetSize());
+  const BITMAPINFOHEADER *pbmi = HEADER(mtOut.Format());
+  const int iStride = (int)DIBWIDTHBYTES(*pbmi);
+  // A pipeline worker may still hold a sample allocated for an earlier
+  // media type
+  if (pDest->GetSize() < (long)DIBSIZE(*pbmi)) {
+    return E_FAIL;
+  }
 
-  pDest->SetActualDataLength(752 * 480 * 3);
+  if (mtOut.subtype == MEDIASUBTYPE_DK2_Y800) {
+    // Y800 rows run top-down
+    if (dc1394_bayer_decoding_luma8_parallel(pPool, pBufferIn, pBufferOut, iStride,
+					     kSensorWidth, kSensorHeight, DC1394_COLOR_FILTER_RGGB) != DC1394_SUCCESS) {
+      return E_FAIL;
+    }
+  } else if (mtOut.subtype == MEDIASUBTYPE_RGB24) {
+    // The output is a bottom-up RGB24 DIB (positive biHeight, B,G,R bytes),
+    // so the decoder starts at the last buffer row and walks upwards. The
+    // half-size type makes one pixel of each 2x2 cell of the mosaic.
+    const bool bHalf = pbmi->biWidth == (LONG)kSensorWidth / 2;
+    if (dc1394_bayer_decoding_8bit_pitch_parallel(pPool, pBufferIn,
+						  pBufferOut + (pbmi->biHeight - 1) * iStride, -iStride,
+						  kSensorWidth, kSensorHeight, DC1394_COLOR_FILTER_RGGB,
+						  bHalf ? DC1394_BAYER_METHOD_DOWNSAMPLE : DC1394_BAYER_METHOD_BILINEAR,
+						  DC1394_BAYER_ORDER_BGR) != DC1394_SUCCESS) {
+      return E_FAIL;
+    }
+  } else {
+    // RGB32 is bottom-up like RGB24, its fourth byte 255; the planar types
+    // run top-down, one kSensorWidth wide plane after another, and so do
+    // NV12 and I420 with their half-height chroma after the Y plane. The
+    // decoder lays each strip out as it goes, so there is no RGB24 frame in
+    // between.
+    dc1394bayer_output_t out;
+    ZeroMemory(&out, sizeof(out));
+    out.order = DC1394_BAYER_ORDER_BGR;
+    if (mtOut.subtype == MEDIASUBTYPE_RGB32) {
+      out.layout = DC1394_BAYER_LAYOUT_RGBX;
+      out.plane[0] = pBufferOut + (pbmi->biHeight - 1) * iStride;
+      out.pitch[0] = -iStride;
+    } else if (mtOut.subtype == MEDIASUBTYPE_NV12 || mtOut.subtype == MEDIASUBTYPE_DK2_I420) {
+      const bool bNV12 = mtOut.subtype == MEDIASUBTYPE_NV12;
+      const int iChromaStride = (int)(bNV12 ? kSensorWidth : kSensorWidth / 2);
+      out.layout = bNV12 ? DC1394_BAYER_LAYOUT_NV12 : DC1394_BAYER_LAYOUT_I420;
+      out.plane[0] = pBufferOut;
+      out.pitch[0] = (int)kSensorWidth;
+      for (int i = 1; i < (bNV12 ? 2 : 3); i++) {
+	out.plane[i] = pBufferOut + kSensorWidth * kSensorHeight + (i - 1) * iChromaStride * (kSensorHeight / 2);
+	out.pitch[i] = iChromaStride;
+      }
+    } else {
+      const bool bFloat = mtOut.subtype == MEDIASUBTYPE_DK2_RGBF;
+      const int iPlaneStride = (int)(kSensorWidth * (bFloat ? sizeof(float) : 1));
+      out.layout = bFloat ? DC1394_BAYER_LAYOUT_PLANAR_FLOAT : DC1394_BAYER_LAYOUT_PLANAR;
+      for (int i = 0; i < 3; i++) {
+	out.plane[i] = pBufferOut + i * iPlaneStride * kSensorHeight;
+	out.pitch[i] = iPlaneStride;
+      }
+    }
+    if (dc1394_bayer_decoding_8bit_layout_parallel(pPool, pBufferIn, kSensorWidth, &out,
+						   kSensorWidth, kSensorHeight, DC1394_COLOR_FILTER_RGGB,
+						   DC1394_BAYER_METHOD_BILINEAR) != DC1394_SUCCESS) {
+      return E_FAIL;
+    }
+  }
+
+  pDest->SetActualDataLength(DIBSIZE(*pbmi));
   pDest->SetSyncPoint(TRUE);
   return S_OK;
 }
@@ -143,10 +739,16 @@ const AMOVIESETUP_MEDIATYPE sudPinTypes =
     &MEDIASUBTYPE_YUY2
   };
 
-const AMOVIESETUP_MEDIATYPE sudOutPinTypes = 
+const AMOVIESETUP_MEDIATYPE sudOutPinTypes[] = 
   {
-    &MEDIATYPE_Video,
-    &MEDIASUBTYPE_RGB24
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_DK2_Y800 },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_DK2_BLOBS },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB32 },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_DK2_RGBP },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_DK2_RGBF },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_NV12 },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_DK2_I420 }
   };
 
 const AMOVIESETUP_PIN sudpPins[] =
@@ -168,8 +770,8 @@ const AMOVIESETUP_PIN sudpPins[] =
       FALSE,
       &CLSID_NULL,
       NULL,
-      1,
-      &sudOutPinTypes
+      8,
+      sudOutPinTypes
     }
   };
 
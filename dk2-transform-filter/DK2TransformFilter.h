@@ -1,22 +1,99 @@
 #include <Amfilter.h>
 #include <transfrm.h>
+#include <vector>
+#include "bayer.h"
+#include "blob.h"
+#include "dk2latency.h"
+#include "dk2pipeline.h"
+#include "dk2raw.h"
 
 
 // {2B761529-21EC-4c1c-BDF5-0AAC8FC3EA0E}
 DEFINE_GUID(CLSID_DK2TransformFilter,
 	    0x2b761529, 0x21ec, 0x4c1c, 0xbd, 0xf5, 0xa, 0xac, 0x8f, 0xc3, 0xea, 0xe);
 
+// Y800, 8-bit greyscale; older SDKs' uuids.h do not declare it
+// {30303859-0000-0010-8000-00AA00389B71}
+DEFINE_GUID(MEDIASUBTYPE_DK2_Y800,
+	    0x30303859, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
 
-class DK2TransformFilter : public CTransformFilter {
+// Planar R, G and B, 8 bits, each plane top-down and one after the other
+// {50524B44-0000-0010-8000-00AA00389B71}
+DEFINE_GUID(MEDIASUBTYPE_DK2_RGBP,
+	    0x50524b44, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+
+// The same planes as 32-bit floats from 0 to 1
+// {46524B44-0000-0010-8000-00AA00389B71}
+DEFINE_GUID(MEDIASUBTYPE_DK2_RGBF,
+	    0x46524b44, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+
+// I420, 8-bit Y plane then the Cb and Cr planes at half size; uuids.h
+// has it only as IYUV
+// {30323449-0000-0010-8000-00AA00389B71}
+DEFINE_GUID(MEDIASUBTYPE_DK2_I420,
+	    0x30323449, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+
+// Blob list instead of an image: one DK2BlobSample per frame
+// {6F2D3A41-8C1E-4B7A-9E52-1D0B7C4F9A63}
+DEFINE_GUID(MEDIASUBTYPE_DK2_BLOBS,
+	    0x6f2d3a41, 0x8c1e, 0x4b7a, 0x9e, 0x52, 0x1d, 0xb, 0x7c, 0x4f, 0x9a, 0x63);
+
+// Counters of the asynchronous pipeline, to watch frames being skipped
+// and how old the delivered ones are
+// {9C4E2B17-5A3D-4F60-8B21-7E6D0C3A5F48}
+DEFINE_GUID(IID_IDK2PipelineStats,
+	    0x9c4e2b17, 0x5a3d, 0x4f60, 0x8b, 0x21, 0x7e, 0x6d, 0xc, 0x3a, 0x5f, 0x48);
+
+DECLARE_INTERFACE_(IDK2PipelineStats, IUnknown)
+{
+  // Totals since the filter was created; with synchronous conversion
+  // every frame received counts as pushed and delivered
+  STDMETHOD(GetPipelineStats)(THIS_ dk2pipeline_stats_t *pStats) PURE;
+};
+
+// Per-stage times of the frames, to tell where jitter comes from; only
+// builds with DK2_LATENCY defined answer it
+// {4A7D1C93-2E58-4B0F-A6C3-91D5E8F2B604}
+DEFINE_GUID(IID_IDK2LatencyStats,
+	    0x4a7d1c93, 0x2e58, 0x4b0f, 0xa6, 0xc3, 0x91, 0xd5, 0xe8, 0xf2, 0xb6, 0x4);
+
+DECLARE_INTERFACE_(IDK2LatencyStats, IUnknown)
+{
+  // Times since the filter was created, over all of its threads
+  STDMETHOD(GetLatency)(THIS_ dk2latency_stage_t stage, dk2latency_summary_t *pSummary) PURE;
+};
+
+#define DK2_MAX_BLOBS 64
+
+struct DK2BlobSample {
+  uint32_t nBlobs;  // entries used in aBlobs
+  uint32_t nFound;  // blobs in the frame, may exceed DK2_MAX_BLOBS
+  dc1394blob_t aBlobs[DK2_MAX_BLOBS];
+};
+
+
+class DK2TransformFilter : public CTransformFilter, public IDK2PipelineStats,
+			   public IDK2LatencyStats {
 
 
  public:
   DECLARE_IUNKNOWN;
   STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void **ppv);
   static CUnknown * WINAPI CreateInstance(LPUNKNOWN punk, HRESULT *phr);
+  ~DK2TransformFilter();
 
   // Overrriden from CTransformFilter base class
   HRESULT Transform(IMediaSample *pIn, IMediaSample *pOut);
+  HRESULT Receive(IMediaSample *pSample);
+  HRESULT EndOfStream();
+  HRESULT BeginFlush();
+  HRESULT EndFlush();
+  STDMETHODIMP Stop();
+
+  // IDK2PipelineStats
+  STDMETHODIMP GetPipelineStats(dk2pipeline_stats_t *pStats);
+  // IDK2LatencyStats
+  STDMETHODIMP GetLatency(dk2latency_stage_t stage, dk2latency_summary_t *pSummary);
   HRESULT CheckInputType(const CMediaType *mtIn);
   HRESULT CheckTransform(const CMediaType *mtIn, const CMediaType *mtOut);
   HRESULT DecideBufferSize(IMemAllocator *pAlloc,
@@ -25,4 +102,35 @@ class DK2TransformFilter : public CTransformFilter {
 private:
   DK2TransformFilter(LPUNKNOWN punk, HRESULT *phr);
   DWORD DK2TransformFilter::EncodeFrame(BYTE* pBufferIn, BYTE* pBufferOut);
+  HRESULT Convert(const BYTE *pBufferIn, IMediaSample *pDest,
+		  dc1394bayer_pool_t *pPool, dc1394blob_detector_t *pDetector);
+  void Record(IMediaSample *pSource, const BYTE *pBufferIn);
+  void EndReceive(uint64_t tArrival, uint64_t tDone);
+  void DumpLatency();
+  static void *AcquireBuffer(void *ctx, uint32_t worker);
+  static void ReleaseBuffer(void *ctx, void *result);
+  static void ProcessFrame(void *ctx, uint32_t worker, dk2pipeline_frame_t *frame);
+  static void DeliverFrame(void *ctx, dk2pipeline_frame_t *frame);
+
+  // Worker threads for the demosaic, kept for the filter's lifetime
+  dc1394bayer_pool_t *m_pBayerPool;
+  // Scratch state for the blob output
+  dc1394blob_detector_t *m_pBlobDetector;
+  // Raw input frames are appended here when DK2_RECORD names a file
+  dk2raw_writer_t *m_pRecorder;
+  uint64_t m_nSequence;
+  // Converts frames on worker threads when DK2_WORKERS or DK2_POLICY is
+  // set, else NULL
+  dk2pipeline_t *m_pPipeline;
+  std::vector<dc1394blob_detector_t *> m_vWorkerDetectors;
+  // First failure of a delivery from a worker, returned by Receive
+  volatile LONG m_hrDeliver;
+  // Stage times, kept when built with DK2_LATENCY, else NULL
+  dk2latency_t *m_pLatency;
+  uint64_t m_tDumpInterval;
+  uint64_t m_tNextDump;
+  // Arrival and conversion of the frame the streaming thread is on, in
+  // synchronous mode
+  uint64_t m_tArrival;
+  uint64_t m_tConverted;
 };
@@ -25,8 +25,10 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
 //#include "conversions.h"
 #include "bayer.h"
+#include "bayer_internal.h"
 
 
 #define CLIP(in, out)\
@@ -39,54 +41,170 @@
    in = in > ((1<<bits)-1) ? ((1<<bits)-1) : in;\
    out=in;
 
-void
-ClearBorders(uint8_t *rgb, int sx, int sy, int w)
+/*
+* Pattern phase at compile time. The OpenCV-derived kernels below walk a
+* row with the blue offset (+1 when blue is to the right of green in the
+* output, -1 when to the left) and with start_with_green set when the
+* row opens on a green pixel, and both flip from one row to the next.
+* Their row bodies are class templates on the pair, so neither is tested
+* inside a row; bayer_walk_rows() picks the instantiation for the first
+* row once and alternates from there.
+*/
+template <template <typename, int, int> class Row, typename T, int BLUE, int START_WITH_GREEN>
+static void
+walk_rows(const T *bayer, T *rgb, int bayerStep, int rgbStep, int width, int height, int bits)
 {
-	int i, j;
-	// black edges are added with a width w:
-	i = 3 * sx * w - 1;
-	j = 3 * sx * sy - 1;
-	while (i >= 0) {
-		rgb[i--] = 0;
-		rgb[j--] = 0;
+	for (; height >= 2; height -= 2, bayer += 2 * bayerStep, rgb += 2 * rgbStep) {
+		Row<T, BLUE, START_WITH_GREEN>::run(bayer, rgb, bayerStep, width, bits);
+		Row<T, -BLUE, 1 - START_WITH_GREEN>::run(bayer + bayerStep, rgb + rgbStep, bayerStep, width, bits);
 	}
+	if (height)
+		Row<T, BLUE, START_WITH_GREEN>::run(bayer, rgb, bayerStep, width, bits);
+}
 
-	int low = sx * (w - 1) * 3 - 1 + w * 3;
-	i = low + sx * (sy - w * 2 + 1) * 3;
-	while (i > low) {
-		j = 6 * w;
-		while (j > 0) {
-			rgb[i--] = 0;
-			j--;
-		}
-		i -= (sx - 2 * w) * 3;
+template <template <typename, int, int> class Row, typename T>
+static void
+bayer_walk_rows(const T *bayer, T *rgb, int bayerStep, int rgbStep, int width, int height, int blue, int start_with_green, int bits)
+{
+	if (blue > 0) {
+		if (start_with_green)
+			walk_rows<Row, T, 1, 1>(bayer, rgb, bayerStep, rgbStep, width, height, bits);
+		else
+			walk_rows<Row, T, 1, 0>(bayer, rgb, bayerStep, rgbStep, width, height, bits);
+	}
+	else {
+		if (start_with_green)
+			walk_rows<Row, T, -1, 1>(bayer, rgb, bayerStep, rgbStep, width, height, bits);
+		else
+			walk_rows<Row, T, -1, 0>(bayer, rgb, bayerStep, rgbStep, width, height, bits);
 	}
 }
 
-void
-ClearBorders_uint16(uint16_t * rgb, int sx, int sy, int w)
+/*
+* Border pixels. A row template decodes the pixel at (x, y) from the
+* square window of LO + HI + 1 mosaic rows and columns starting LO above
+* and left of it, so the first LO and the last HI rows and columns have no
+* window inside the frame. Their window is gathered from the mosaic
+* mirrored about the first and last row and column, which are not
+* repeated: a mirrored sample lies an even number of sites from the one
+* it stands for and so has its colour, and the pixel is decoded by the
+* same template as the interior. The kernels fill these pixels of their
+* output rows along with the interior, and nothing is written twice.
+*/
+static inline int
+bayer_mirror(int i, int n)
 {
+	if (i < 0)
+		i = -i;
+	if (i >= n)
+		i = 2 * (n - 1) - i;
+	/* only a frame narrower than the window is left outside it */
+	return i < 0 ? 0 : i >= n ? n - 1 : i;
+}
+
+template <typename T, int LO, int HI>
+static void
+mirror_window(const T *bayer, int bayerStep, int sx, int sy, int x, int y, T *win)
+{
+	const int k = LO + HI + 1;
 	int i, j;
 
-	// black edges:
-	i = 3 * sx * w - 1;
-	j = 3 * sx * sy - 1;
-	while (i >= 0) {
-		rgb[i--] = 0;
-		rgb[j--] = 0;
+	for (i = 0; i < k; i++) {
+		const T *row = bayer + bayer_mirror(y - LO + i, sy) * bayerStep;
+
+		for (j = 0; j < k; j++)
+			win[i * k + j] = row[bayer_mirror(x - LO + j, sx)];
 	}
+}
+
+/* calls px(x, y) on the pixels of the rows [y0, y1) less than lo from the
+   top or left edge or less than hi from the bottom or right one */
+template <class Pixel>
+static void
+border_pixels(int sx, int sy, int lo, int hi, int y0, int y1, Pixel &px)
+{
+	int x, y;
+
+	for (y = y0; y < y1; y++) {
+		/* columns [a, b) are the kernel's own */
+		int a = sx, b = sx;
 
-	int low = sx * (w - 1) * 3 - 1 + w * 3;
-	i = low + sx * (sy - w * 2 + 1) * 3;
-	while (i > low) {
-		j = 6 * w;
-		while (j > 0) {
-			rgb[i--] = 0;
-			j--;
+		if (y >= lo && y < sy - hi && lo < sx - hi) {
+			a = lo;
+			b = sx - hi;
 		}
-		i -= (sx - 2 * w) * 3;
+		for (x = 0; x < a; x++)
+			px(x, y);
+		for (x = b; x < sx; x++)
+			px(x, y);
 	}
+}
 
+/* one pixel of Row from a packed window whose first site has the phase
+   blue, start_with_green */
+template <template <typename, int, int> class Row, typename T>
+static void
+row_pixel(const T *win, T *rgb, int step, int blue, int start_with_green, int bits)
+{
+	if (blue > 0) {
+		if (start_with_green)
+			Row<T, 1, 1>::run(win, rgb + 1, step, 1, bits);
+		else
+			Row<T, 1, 0>::run(win, rgb + 1, step, 1, bits);
+	}
+	else {
+		if (start_with_green)
+			Row<T, -1, 1>::run(win, rgb + 1, step, 1, bits);
+		else
+			Row<T, -1, 0>::run(win, rgb + 1, step, 1, bits);
+	}
+}
+
+/* blue and start_with_green are the phase of the window of the pixel at
+   (LO, LO), as passed to bayer_walk_rows() for the first row */
+template <template <typename, int, int> class Row, typename T, int LO, int HI>
+struct row_border {
+	const T *bayer;
+	T *rgb;
+	int sx, sy, bayerStep, rgbStep, blue, start_with_green, bits;
+
+	void
+	pixel(int x, int y, T *out) const
+	{
+		T win[(LO + HI + 1) * (LO + HI + 1)];
+		int odd_row = (y - LO) & 1;
+
+		mirror_window<T, LO, HI>(bayer, bayerStep, sx, sy, x, y, win);
+		row_pixel<Row>(win, out, LO + HI + 1, odd_row ? -blue : blue,
+			start_with_green ^ odd_row ^ ((x - LO) & 1), bits);
+	}
+
+	void
+	operator()(int x, int y) const
+	{
+		pixel(x, y, rgb + y * rgbStep + 3 * x);
+	}
+};
+
+template <template <typename, int, int> class Row, int LO, int HI, typename T>
+static void
+mirror_borders(const T *bayer, T *rgb, int sx, int sy, int bayerStep, int rgbStep, int blue, int start_with_green, int bits, int y0, int y1)
+{
+	row_border<Row, T, LO, HI> px = { bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, bits };
+
+	border_pixels(sx, sy, LO, HI, y0, y1, px);
+}
+
+/* phase of the pixel at (0, 0) in the terms of the row templates */
+static void
+walk_phase(int tile, int order, int *blue, int *start_with_green)
+{
+	*blue = tile == DC1394_COLOR_FILTER_BGGR
+		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
+	*start_with_green = tile == DC1394_COLOR_FILTER_GBRG
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+	if (order == DC1394_BAYER_ORDER_BGR)
+		*blue = -*blue;
 }
 
 /**************************************************************
@@ -101,97 +219,141 @@ ClearBorders_uint16(uint16_t * rgb, int sx, int sy, int w)
 /* 8-bits versions */
 /* insprired by OpenCV's Bayer decoding */
 
+/* one row: rgb and bayer point at the first output pixel and the mosaic
+   pixel above-left of it */
+template <typename T, int BLUE, int START_WITH_GREEN>
+struct nearest_row {
+	static void
+	run(const T *bayer, T *rgb, int bayerStep, int width, int bits)
+	{
+		const T *bayerEnd = bayer + width;
+
+		if (START_WITH_GREEN) {
+			rgb[-BLUE] = bayer[1];
+			rgb[0] = bayer[bayerStep + 1];
+			rgb[BLUE] = bayer[bayerStep];
+			bayer++;
+			rgb += 3;
+		}
+
+		for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
+			rgb[-BLUE] = bayer[0];
+			rgb[0] = bayer[1];
+			rgb[BLUE] = bayer[bayerStep + 1];
+
+			rgb[3 - BLUE] = bayer[2];
+			rgb[3] = bayer[bayerStep + 2];
+			rgb[3 + BLUE] = bayer[bayerStep + 1];
+		}
+
+		if (bayer < bayerEnd) {
+			rgb[-BLUE] = bayer[0];
+			rgb[0] = bayer[1];
+			rgb[BLUE] = bayer[bayerStep + 1];
+		}
+	}
+};
+
 dc1394error_t
-dc1394_bayer_NearestNeighbor(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_NearestNeighbor_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
 	int width = sx;
 	int height = sy;
 	int blue = tile == DC1394_COLOR_FILTER_BGGR
 		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
 	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
 		|| tile == DC1394_COLOR_FILTER_GRBG;
-	int i, imax, iinc;
+	int first = y0;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
 
 	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
 
-	/* add black border */
-	imax = sx * sy * 3;
-	for (i = sx * (sy - 1) * 3; i < imax; i++) {
-		rgb[i] = 0;
-	}
-	iinc = (sx - 1) * 3;
-	for (i = (sx - 1) * 3; i < imax; i += iinc) {
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-	}
+	/* B,G,R output is the same walk with the blue offset mirrored */
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
 
-	rgb += 1;
+	/* the last row and column pair with the ones before them */
+	mirror_borders<nearest_row, 0, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, 8, y0, y1);
+	if (first >= last)
+		return DC1394_SUCCESS;
+
+	/* rows 0 .. sy-2 are interpolated; the pattern phase flips on odd rows */
+	if (first & 1) {
+		blue = -blue;
+		start_with_green = !start_with_green;
+	}
+	bayer += first * bayerStep;
+	rgb += first * rgbStep + 1;
 	width -= 1;
-	height -= 1;
+	height = last - first;
+
+	bayer_walk_rows<nearest_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, 8);
+
+	return DC1394_SUCCESS;
+}
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		//int t0, t1;
-		const uint8_t *bayerEnd = bayer + width;
+dc1394error_t
+dc1394_bayer_NearestNeighbor(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_NearestNeighbor_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+template <typename T, int BLUE, int START_WITH_GREEN>
+struct bilinear_row {
+	static void
+	run(const T *bayer, T *rgb, int bayerStep, int width, int bits)
+	{
+		const T *bayerEnd = bayer + width;
+		int t0, t1;
 
-		if (start_with_green) {
-			rgb[-blue] = bayer[1];
+		if (START_WITH_GREEN) {
+			/* OpenCV has a bug in the next line, which was
+			t0 = (bayer[0] + bayer[bayerStep * 2] + 1) >> 1; */
+			t0 = (bayer[1] + bayer[bayerStep * 2 + 1] + 1) >> 1;
+			t1 = (bayer[bayerStep] + bayer[bayerStep + 2] + 1) >> 1;
+			rgb[-BLUE] = (T)t0;
 			rgb[0] = bayer[bayerStep + 1];
-			rgb[blue] = bayer[bayerStep];
+			rgb[BLUE] = (T)t1;
 			bayer++;
 			rgb += 3;
 		}
 
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[-1] = bayer[0];
-				rgb[0] = bayer[1];
-				rgb[1] = bayer[bayerStep + 1];
-
-				rgb[2] = bayer[2];
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[4] = bayer[bayerStep + 1];
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[1] = bayer[0];
-				rgb[0] = bayer[1];
-				rgb[-1] = bayer[bayerStep + 1];
-
-				rgb[4] = bayer[2];
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[2] = bayer[bayerStep + 1];
-			}
+		for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
+			t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
+				bayer[bayerStep * 2 + 2] + 2) >> 2;
+			t1 = (bayer[1] + bayer[bayerStep] +
+				bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
+				2) >> 2;
+			rgb[-BLUE] = (T)t0;
+			rgb[0] = (T)t1;
+			rgb[BLUE] = bayer[bayerStep + 1];
+
+			t0 = (bayer[2] + bayer[bayerStep * 2 + 2] + 1) >> 1;
+			t1 = (bayer[bayerStep + 1] + bayer[bayerStep + 3] +
+				1) >> 1;
+			rgb[3 - BLUE] = (T)t0;
+			rgb[3] = bayer[bayerStep + 2];
+			rgb[3 + BLUE] = (T)t1;
 		}
 
 		if (bayer < bayerEnd) {
-			rgb[-blue] = bayer[0];
-			rgb[0] = bayer[1];
-			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
+			t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
+				bayer[bayerStep * 2 + 2] + 2) >> 2;
+			t1 = (bayer[1] + bayer[bayerStep] +
+				bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
+				2) >> 2;
+			rgb[-BLUE] = (T)t0;
+			rgb[0] = (T)t1;
+			rgb[BLUE] = bayer[bayerStep + 1];
 		}
-
-		bayer -= width;
-		rgb -= width * 3;
-
-		blue = -blue;
-		start_with_green = !start_with_green;
 	}
-
-	return DC1394_SUCCESS;
-}
+};
 
 /* OpenCV's Bayer decoding */
 dc1394error_t
-dc1394_bayer_Bilinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_Bilinear_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
 	int width = sx;
 	int height = sy;
 	/*
@@ -211,125 +373,119 @@ dc1394_bayer_Bilinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int
 	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
 		|| tile == DC1394_COLOR_FILTER_GRBG;
 
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+
 	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
 
-	ClearBorders(rgb, sx, sy, 1);
-	rgb += rgbStep + 3 + 1;
-	height -= 2;
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
+
+	mirror_borders<bilinear_row, 1, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, 8, y0, y1);
+	/* a frame narrower than the 3x3 neighbourhood is all border */
+	if (first >= last || sx < 3)
+		return DC1394_SUCCESS;
+
+	/* interior rows are 1 .. sy-2; the pattern phase flips on odd rows */
+	if ((first - 1) & 1) {
+		blue = -blue;
+		start_with_green = !start_with_green;
+	}
+	bayer += (first - 1) * bayerStep;
+	rgb += first * rgbStep + 3 + 1;
+	height = last - first;
 	width -= 2;
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		int t0, t1;
-		const uint8_t *bayerEnd = bayer + width;
+	bayer_walk_rows<bilinear_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, 8);
+	return DC1394_SUCCESS;
+}
 
-		if (start_with_green) {
-			/* OpenCV has a bug in the next line, which was
-			t0 = (bayer[0] + bayer[bayerStep * 2] + 1) >> 1; */
-			t0 = (bayer[1] + bayer[bayerStep * 2 + 1] + 1) >> 1;
-			t1 = (bayer[bayerStep] + bayer[bayerStep + 2] + 1) >> 1;
-			rgb[-blue] = (uint8_t)t0;
-			rgb[0] = bayer[bayerStep + 1];
-			rgb[blue] = (uint8_t)t1;
-			bayer++;
-			rgb += 3;
-		}
+dc1394error_t
+dc1394_bayer_Bilinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_Bilinear_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
 
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-					bayer[bayerStep * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[bayerStep] +
-					bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-					2) >> 2;
-				rgb[-1] = (uint8_t)t0;
-				rgb[0] = (uint8_t)t1;
-				rgb[1] = bayer[bayerStep + 1];
-
-				t0 = (bayer[2] + bayer[bayerStep * 2 + 2] + 1) >> 1;
-				t1 = (bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					1) >> 1;
-				rgb[2] = (uint8_t)t0;
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[4] = (uint8_t)t1;
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-					bayer[bayerStep * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[bayerStep] +
-					bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-					2) >> 2;
-				rgb[1] = (uint8_t)t0;
-				rgb[0] = (uint8_t)t1;
-				rgb[-1] = bayer[bayerStep + 1];
-
-				t0 = (bayer[2] + bayer[bayerStep * 2 + 2] + 1) >> 1;
-				t1 = (bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					1) >> 1;
-				rgb[4] = (uint8_t)t0;
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[2] = (uint8_t)t1;
-			}
-		}
+void
+dc1394_bayer_Bilinear_border_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int blue, start_with_green;
 
-		if (bayer < bayerEnd) {
-			t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-				bayer[bayerStep * 2 + 2] + 2) >> 2;
-			t1 = (bayer[1] + bayer[bayerStep] +
-				bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-				2) >> 2;
-			rgb[-blue] = (uint8_t)t0;
-			rgb[0] = (uint8_t)t1;
-			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
-		}
+	walk_phase(tile, order, &blue, &start_with_green);
+	mirror_borders<bilinear_row, 1, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, 8, y0, y1);
+}
 
-		bayer -= width;
-		rgb -= width * 3;
+/* luma of the Bilinear border colours */
+struct luma_border {
+	row_border<bilinear_row, uint8_t, 1, 1> colour;
+	uint8_t *luma;
+	int lumaStep;
 
-		blue = -blue;
-		start_with_green = !start_with_green;
+	void
+	operator()(int x, int y) const
+	{
+		uint8_t rgb[3];
+
+		colour.pixel(x, y, rgb);
+		luma[y * lumaStep + x] = bayer_luma(rgb[0], rgb[1], rgb[2]);
 	}
-	return DC1394_SUCCESS;
+};
+
+void
+dc1394_bayer_Bilinear_luma_border_rows(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int y0, int y1)
+{
+	luma_border px = { { bayer, NULL, sx, sy, bayerStep, 0, 0, 0, 8 }, luma, lumaStep };
+
+	walk_phase(tile, DC1394_BAYER_ORDER_RGB, &px.colour.blue, &px.colour.start_with_green);
+	border_pixels(sx, sy, 1, 1, y0, y1, px);
 }
 
-/* High-Quality Linear Interpolation For Demosaicing Of
-Bayer-Patterned Color Images, by Henrique S. Malvar, Li-wei He, and
-Ross Cutler, in ICASSP'04 */
+/* BT.601 luma of the Bilinear colours, one byte per pixel, without
+   going through RGB */
 dc1394error_t
-dc1394_bayer_HQLinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_Bilinear_luma_rows(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
-	int width = sx;
-	int height = sy;
-	int blue = tile == DC1394_COLOR_FILTER_BGGR
-		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
-	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
-		|| tile == DC1394_COLOR_FILTER_GRBG;
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
 
 	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
 
-	ClearBorders(rgb, sx, sy, 2);
-	rgb += 2 * rgbStep + 6 + 1;
-	height -= 4;
-	width -= 4;
+	dc1394_bayer_Bilinear_luma_border_rows(bayer, luma, sx, sy, tile, bayerStep, lumaStep, y0, y1);
 
-	/* We begin with a (+1 line,+1 column) offset with respect to bilinear decoding, so start_with_green is the same, but blue is opposite */
-	blue = -blue;
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = luma + y * lumaStep;
+		int green_x, red_row;
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		int t0, t1;
-		const uint8_t *bayerEnd = bayer + width;
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		for (x = 1; x < sx - 1; x++)
+			out[x] = bayer_bilinear_luma_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile)
+{
+	return dc1394_bayer_Bilinear_luma_rows(bayer, luma, sx, sy, tile, sx, sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+template <typename T, int BLUE, int START_WITH_GREEN>
+struct hqlinear_row {
+	static void
+	run(const T *bayer, T *rgb, int bayerStep, int width, int bits)
+	{
+		const T *bayerEnd = bayer + width;
 		const int bayerStep2 = bayerStep * 2;
 		const int bayerStep3 = bayerStep * 3;
 		const int bayerStep4 = bayerStep * 4;
+		int t0, t1;
 
-		if (start_with_green) {
+		if (START_WITH_GREEN) {
 			/* at green pixel */
 			rgb[0] = bayer[bayerStep2 + 2];
 			t0 = rgb[0] * 5
@@ -351,119 +507,65 @@ dc1394_bayer_HQLinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int
 				- bayer[bayerStep2 + 4]
 				+ ((bayer[2] + bayer[bayerStep4 + 2] + 1) >> 1);
 			t0 = (t0 + 4) >> 3;
-			CLIP(t0, rgb[-blue]);
+			CLIP16(t0, rgb[-BLUE], bits);
 			t1 = (t1 + 4) >> 3;
-			CLIP(t1, rgb[blue]);
+			CLIP16(t1, rgb[BLUE], bits);
 			bayer++;
 			rgb += 3;
 		}
 
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				/* B at B */
-				rgb[1] = bayer[bayerStep2 + 2];
-				/* R at B */
-				t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
-					-
-					(((bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 +
-					2]) * 3 + 1) >> 1)
-					+ rgb[1] * 6;
-				/* G at B */
-				t1 = ((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
-					bayer[bayerStep2 + 3] + bayer[bayerStep3 + 2]) << 1)
-					- (bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-					+ (rgb[1] << 2);
-				t0 = (t0 + 4) >> 3;
-				CLIP(t0, rgb[-1]);
-				t1 = (t1 + 4) >> 3;
-				CLIP(t1, rgb[0]);
-				/* at green pixel */
-				rgb[3] = bayer[bayerStep2 + 3];
-				t0 = rgb[3] * 5
-					+ ((bayer[bayerStep + 3] + bayer[bayerStep3 + 3]) << 2)
-					- bayer[3]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep4 + 3]
-					+
-					((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 5] +
-					1) >> 1);
-				t1 = rgb[3] * 5 +
-					((bayer[bayerStep2 + 2] + bayer[bayerStep2 + 4]) << 2)
-					- bayer[bayerStep2 + 1]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep2 + 5]
-					+ ((bayer[3] + bayer[bayerStep4 + 3] + 1) >> 1);
-				t0 = (t0 + 4) >> 3;
-				CLIP(t0, rgb[2]);
-				t1 = (t1 + 4) >> 3;
-				CLIP(t1, rgb[4]);
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				/* R at R */
-				rgb[-1] = bayer[bayerStep2 + 2];
-				/* B at R */
-				t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
-					-
-					(((bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 +
-					2]) * 3 + 1) >> 1)
-					+ rgb[-1] * 6;
-				/* G at R */
-				t1 = ((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
-					bayer[bayerStep2 + 3] + bayer[bayerStep * 3 +
-					2]) << 1)
-					- (bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-					+ (rgb[-1] << 2);
-				t0 = (t0 + 4) >> 3;
-				CLIP(t0, rgb[1]);
-				t1 = (t1 + 4) >> 3;
-				CLIP(t1, rgb[0]);
-
-				/* at green pixel */
-				rgb[3] = bayer[bayerStep2 + 3];
-				t0 = rgb[3] * 5
-					+ ((bayer[bayerStep + 3] + bayer[bayerStep3 + 3]) << 2)
-					- bayer[3]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep4 + 3]
-					+
-					((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 5] +
-					1) >> 1);
-				t1 = rgb[3] * 5 +
-					((bayer[bayerStep2 + 2] + bayer[bayerStep2 + 4]) << 2)
-					- bayer[bayerStep2 + 1]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep2 + 5]
-					+ ((bayer[3] + bayer[bayerStep4 + 3] + 1) >> 1);
-				t0 = (t0 + 4) >> 3;
-				CLIP(t0, rgb[4]);
-				t1 = (t1 + 4) >> 3;
-				CLIP(t1, rgb[2]);
-			}
+		for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
+			/* B at B, or R at R */
+			rgb[BLUE] = bayer[bayerStep2 + 2];
+			/* R at B, or B at R */
+			t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
+				bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
+				-
+				(((bayer[2] + bayer[bayerStep2] +
+				bayer[bayerStep2 + 4] + bayer[bayerStep4 +
+				2]) * 3 + 1) >> 1)
+				+ rgb[BLUE] * 6;
+			/* G at B or R */
+			t1 = ((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
+				bayer[bayerStep2 + 3] + bayer[bayerStep3 + 2]) << 1)
+				- (bayer[2] + bayer[bayerStep2] +
+				bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
+				+ (rgb[BLUE] << 2);
+			t0 = (t0 + 4) >> 3;
+			CLIP16(t0, rgb[-BLUE], bits);
+			t1 = (t1 + 4) >> 3;
+			CLIP16(t1, rgb[0], bits);
+			/* at green pixel */
+			rgb[3] = bayer[bayerStep2 + 3];
+			t0 = rgb[3] * 5
+				+ ((bayer[bayerStep + 3] + bayer[bayerStep3 + 3]) << 2)
+				- bayer[3]
+				- bayer[bayerStep + 2]
+				- bayer[bayerStep + 4]
+				- bayer[bayerStep3 + 2]
+				- bayer[bayerStep3 + 4]
+				- bayer[bayerStep4 + 3]
+				+
+				((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 5] +
+				1) >> 1);
+			t1 = rgb[3] * 5 +
+				((bayer[bayerStep2 + 2] + bayer[bayerStep2 + 4]) << 2)
+				- bayer[bayerStep2 + 1]
+				- bayer[bayerStep + 2]
+				- bayer[bayerStep + 4]
+				- bayer[bayerStep3 + 2]
+				- bayer[bayerStep3 + 4]
+				- bayer[bayerStep2 + 5]
+				+ ((bayer[3] + bayer[bayerStep4 + 3] + 1) >> 1);
+			t0 = (t0 + 4) >> 3;
+			CLIP16(t0, rgb[3 - BLUE], bits);
+			t1 = (t1 + 4) >> 3;
+			CLIP16(t1, rgb[3 + BLUE], bits);
 		}
 
 		if (bayer < bayerEnd) {
 			/* B at B */
-			rgb[blue] = bayer[bayerStep2 + 2];
+			rgb[BLUE] = bayer[bayerStep2 + 2];
 			/* R at B */
 			t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
 				bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
@@ -471,282 +573,262 @@ dc1394_bayer_HQLinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int
 				(((bayer[2] + bayer[bayerStep2] +
 				bayer[bayerStep2 + 4] + bayer[bayerStep4 +
 				2]) * 3 + 1) >> 1)
-				+ rgb[blue] * 6;
+				+ rgb[BLUE] * 6;
 			/* G at B */
 			t1 = (((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
 				bayer[bayerStep2 + 3] + bayer[bayerStep3 + 2])) << 1)
 				- (bayer[2] + bayer[bayerStep2] +
 				bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-				+ (rgb[blue] << 2);
+				+ (rgb[BLUE] << 2);
 			t0 = (t0 + 4) >> 3;
-			CLIP(t0, rgb[-blue]);
+			CLIP16(t0, rgb[-BLUE], bits);
 			t1 = (t1 + 4) >> 3;
-			CLIP(t1, rgb[0]);
-			bayer++;
-			rgb += 3;
+			CLIP16(t1, rgb[0], bits);
 		}
+	}
+};
+
+/* High-Quality Linear Interpolation For Demosaicing Of
+Bayer-Patterned Color Images, by Henrique S. Malvar, Li-wei He, and
+Ross Cutler, in ICASSP'04 */
+dc1394error_t
+dc1394_bayer_HQLinear_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int width = sx;
+	int height = sy;
+	int blue = tile == DC1394_COLOR_FILTER_BGGR
+		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
+	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
+
+	/* We begin with a (+1 line,+1 column) offset with respect to bilinear decoding, so start_with_green is the same, but blue is opposite */
+	blue = -blue;
 
-		bayer -= width;
-		rgb -= width * 3;
+	mirror_borders<hqlinear_row, 2, 2>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, 8, y0, y1);
+	/* a frame narrower than the 5x5 neighbourhood is all border */
+	if (first >= last || sx < 5)
+		return DC1394_SUCCESS;
 
+	/* interior rows are 2 .. sy-3; the pattern phase flips on odd rows */
+	if (first & 1) {
 		blue = -blue;
 		start_with_green = !start_with_green;
 	}
+	bayer += (first - 2) * bayerStep;
+	rgb += first * rgbStep + 6 + 1;
+	height = last - first;
+	width -= 4;
+
+	bayer_walk_rows<hqlinear_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, 8);
 
 	return DC1394_SUCCESS;
 
 }
 
+dc1394error_t
+dc1394_bayer_HQLinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_HQLinear_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+void
+dc1394_bayer_HQLinear_border_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int blue, start_with_green;
+
+	walk_phase(tile, order, &blue, &start_with_green);
+	mirror_borders<hqlinear_row, 2, 2>(bayer, rgb, sx, sy, bayerStep, rgbStep, -blue, start_with_green, 8, y0, y1);
+}
+
 /* coriander's Bayer decoding */
 /* Edge Sensing Interpolation II from http://www-ise.stanford.edu/~tingchen/ */
 /*   (Laroche,Claude A.  "Apparatus and method for adaptively
 interpolating a full color image utilizing chrominance gradients"
 U.S. Patent 5,373,322) */
 dc1394error_t
-dc1394_bayer_EdgeSense(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_EdgeSense_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
 	/* Removed due to patent concerns */
 	return DC1394_FUNCTION_NOT_SUPPORTED;
 }
 
+dc1394error_t
+dc1394_bayer_EdgeSense(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_EdgeSense_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
 /* coriander's Bayer decoding */
 dc1394error_t
-dc1394_bayer_Downsample(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_Downsample_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	uint8_t *outR, *outG, *outB;
-	register int i, j;
-	int tmp;
+	int last = y1 < sy ? y1 : sy;
+	int green_first, r_out;
+	int x, y;
 
-	switch (tile) {
-	case DC1394_COLOR_FILTER_GRBG:
-	case DC1394_COLOR_FILTER_BGGR:
-		outR = &rgb[0];
-		outG = &rgb[1];
-		outB = &rgb[2];
-		break;
-	case DC1394_COLOR_FILTER_GBRG:
-	case DC1394_COLOR_FILTER_RGGB:
-		outR = &rgb[2];
-		outG = &rgb[1];
-		outB = &rgb[0];
-		break;
-	default:
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
-	}
 
-	switch (tile) {
-	case DC1394_COLOR_FILTER_GRBG:        //---------------------------------------------------------
-	case DC1394_COLOR_FILTER_GBRG:
-		for (i = 0; i < sy*sx; i += (sx << 1)) {
-			for (j = 0; j < sx; j += 2) {
-				tmp = ((bayer[i + j] + bayer[i + sx + j + 1]) >> 1);
-				CLIP(tmp, outG[((i >> 2) + (j >> 1)) * 3]);
-				tmp = bayer[i + sx + j + 1];
-				CLIP(tmp, outR[((i >> 2) + (j >> 1)) * 3]);
-				tmp = bayer[i + sx + j];
-				CLIP(tmp, outB[((i >> 2) + (j >> 1)) * 3]);
-			}
-		}
-		break;
-	case DC1394_COLOR_FILTER_BGGR:        //---------------------------------------------------------
-	case DC1394_COLOR_FILTER_RGGB:
-		for (i = 0; i < sy*sx; i += (sx << 1)) {
-			for (j = 0; j < sx; j += 2) {
-				tmp = ((bayer[i + sx + j] + bayer[i + j + 1]) >> 1);
-				CLIP(tmp, outG[((i >> 2) + (j >> 1)) * 3]);
-				tmp = bayer[i + sx + j + 1];
-				CLIP(tmp, outR[((i >> 2) + (j >> 1)) * 3]);
-				tmp = bayer[i + j];
-				CLIP(tmp, outB[((i >> 2) + (j >> 1)) * 3]);
-			}
-		}
-		break;
+	bayer_downsample_phase(tile, order, &green_first, &r_out);
+
+	/* y0 and y1 are mosaic rows and must be even */
+	for (y = y0; y < last; y += 2) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + (y >> 1) * rgbStep;
+
+		for (x = 0; x < sx; x += 2)
+			bayer_downsample_pixel(cur + x, bayerStep, green_first, r_out, out + 3 * (x >> 1));
 	}
 
 	return DC1394_SUCCESS;
-
 }
 
-/* this is the method used inside AVT cameras. See AVT docs. */
 dc1394error_t
-dc1394_bayer_Simple(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+dc1394_bayer_Downsample(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
-	int width = sx;
-	int height = sy;
-	int blue = tile == DC1394_COLOR_FILTER_BGGR
-		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
-	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
-		|| tile == DC1394_COLOR_FILTER_GRBG;
-	int i, imax, iinc;
-
-	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
-		return DC1394_INVALID_COLOR_FILTER;
-
-	/* add black border */
-	imax = sx * sy * 3;
-	for (i = sx * (sy - 1) * 3; i < imax; i++) {
-		rgb[i] = 0;
-	}
-	iinc = (sx - 1) * 3;
-	for (i = (sx - 1) * 3; i < imax; i += iinc) {
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-	}
-
-	rgb += 1;
-	width -= 1;
-	height -= 1;
+	return dc1394_bayer_Downsample_rows(bayer, rgb, sx, sy, tile, sx, 3 * (sx / 2), DC1394_BAYER_ORDER_RGB, 0, sy);
+}
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		const uint8_t *bayerEnd = bayer + width;
+template <typename T, int BLUE, int START_WITH_GREEN>
+struct simple_row {
+	static void
+	run(const T *bayer, T *rgb, int bayerStep, int width, int bits)
+	{
+		const T *bayerEnd = bayer + width;
 
-		if (start_with_green) {
-			rgb[-blue] = bayer[1];
+		if (START_WITH_GREEN) {
+			rgb[-BLUE] = bayer[1];
 			rgb[0] = (bayer[0] + bayer[bayerStep + 1] + 1) >> 1;
-			rgb[blue] = bayer[bayerStep];
+			rgb[BLUE] = bayer[bayerStep];
 			bayer++;
 			rgb += 3;
 		}
 
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[-1] = bayer[0];
-				rgb[0] = (bayer[1] + bayer[bayerStep] + 1) >> 1;
-				rgb[1] = bayer[bayerStep + 1];
+		for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
+			rgb[-BLUE] = bayer[0];
+			rgb[0] = (bayer[1] + bayer[bayerStep] + 1) >> 1;
+			rgb[BLUE] = bayer[bayerStep + 1];
 
-				rgb[2] = bayer[2];
-				rgb[3] = (bayer[1] + bayer[bayerStep + 2] + 1) >> 1;
-				rgb[4] = bayer[bayerStep + 1];
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[1] = bayer[0];
-				rgb[0] = (bayer[1] + bayer[bayerStep] + 1) >> 1;
-				rgb[-1] = bayer[bayerStep + 1];
-
-				rgb[4] = bayer[2];
-				rgb[3] = (bayer[1] + bayer[bayerStep + 2] + 1) >> 1;
-				rgb[2] = bayer[bayerStep + 1];
-			}
+			rgb[3 - BLUE] = bayer[2];
+			rgb[3] = (bayer[1] + bayer[bayerStep + 2] + 1) >> 1;
+			rgb[3 + BLUE] = bayer[bayerStep + 1];
 		}
 
 		if (bayer < bayerEnd) {
-			rgb[-blue] = bayer[0];
+			rgb[-BLUE] = bayer[0];
 			rgb[0] = (bayer[1] + bayer[bayerStep] + 1) >> 1;
-			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
+			rgb[BLUE] = bayer[bayerStep + 1];
 		}
+	}
+};
+
+/* this is the method used inside AVT cameras. See AVT docs. */
+dc1394error_t
+dc1394_bayer_Simple_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int width = sx;
+	int height = sy;
+	int blue = tile == DC1394_COLOR_FILTER_BGGR
+		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
+	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+	int first = y0;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
 
-		bayer -= width;
-		rgb -= width * 3;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
+
+	/* the last row and column pair with the ones before them */
+	mirror_borders<simple_row, 0, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, 8, y0, y1);
+	if (first >= last)
+		return DC1394_SUCCESS;
 
+	/* rows 0 .. sy-2 are interpolated; the pattern phase flips on odd rows */
+	if (first & 1) {
 		blue = -blue;
 		start_with_green = !start_with_green;
 	}
+	bayer += first * bayerStep;
+	rgb += first * rgbStep + 1;
+	width -= 1;
+	height = last - first;
+
+	bayer_walk_rows<simple_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, 8);
 
 	return DC1394_SUCCESS;
 
 }
 
+dc1394error_t
+dc1394_bayer_Simple(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_Simple_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
 /* 16-bits versions */
 
 /* insprired by OpenCV's Bayer decoding */
 dc1394error_t
-dc1394_bayer_NearestNeighbor_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_NearestNeighbor_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
 	int width = sx;
 	int height = sy;
 	int blue = tile == DC1394_COLOR_FILTER_BGGR
 		|| tile == DC1394_COLOR_FILTER_GBRG ? -1 : 1;
 	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
 		|| tile == DC1394_COLOR_FILTER_GRBG;
-	int i, iinc, imax;
+	int first = y0;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
 
 	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
 
-	/* add black border */
-	imax = sx * sy * 3;
-	for (i = sx * (sy - 1) * 3; i < imax; i++) {
-		rgb[i] = 0;
-	}
-	iinc = (sx - 1) * 3;
-	for (i = (sx - 1) * 3; i < imax; i += iinc) {
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-	}
-
-	rgb += 1;
-	height -= 1;
-	width -= 1;
-
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		//int t0, t1;
-		const uint16_t *bayerEnd = bayer + width;
-
-		if (start_with_green) {
-			rgb[-blue] = bayer[1];
-			rgb[0] = bayer[bayerStep + 1];
-			rgb[blue] = bayer[bayerStep];
-			bayer++;
-			rgb += 3;
-		}
-
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[-1] = bayer[0];
-				rgb[0] = bayer[1];
-				rgb[1] = bayer[bayerStep + 1];
-
-				rgb[2] = bayer[2];
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[4] = bayer[bayerStep + 1];
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				rgb[1] = bayer[0];
-				rgb[0] = bayer[1];
-				rgb[-1] = bayer[bayerStep + 1];
-
-				rgb[4] = bayer[2];
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[2] = bayer[bayerStep + 1];
-			}
-		}
-
-		if (bayer < bayerEnd) {
-			rgb[-blue] = bayer[0];
-			rgb[0] = bayer[1];
-			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
-		}
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
 
-		bayer -= width;
-		rgb -= width * 3;
+	/* the last row and column pair with the ones before them */
+	mirror_borders<nearest_row, 0, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, bits, y0, y1);
+	if (first >= last)
+		return DC1394_SUCCESS;
 
+	/* rows 0 .. sy-2 are interpolated; the pattern phase flips on odd rows */
+	if (first & 1) {
 		blue = -blue;
 		start_with_green = !start_with_green;
 	}
+	bayer += first * bayerStep;
+	rgb += first * rgbStep + 1;
+	width -= 1;
+	height = last - first;
+
+	bayer_walk_rows<nearest_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, bits);
 
 	return DC1394_SUCCESS;
 
 }
+
+dc1394error_t
+dc1394_bayer_NearestNeighbor_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_NearestNeighbor_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
 /* OpenCV's Bayer decoding */
 dc1394error_t
-dc1394_bayer_Bilinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_Bilinear_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
 	int width = sx;
 	int height = sy;
 	int blue = tile == DC1394_COLOR_FILTER_BGGR
@@ -754,100 +836,57 @@ dc1394_bayer_Bilinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int
 	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
 		|| tile == DC1394_COLOR_FILTER_GRBG;
 
-	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
-		return DC1394_INVALID_COLOR_FILTER;
-
-	rgb += rgbStep + 3 + 1;
-	height -= 2;
-	width -= 2;
-
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		int t0, t1;
-		const uint16_t *bayerEnd = bayer + width;
-
-		if (start_with_green) {
-			/* OpenCV has a bug in the next line, which was
-			t0 = (bayer[0] + bayer[bayerStep * 2] + 1) >> 1; */
-			t0 = (bayer[1] + bayer[bayerStep * 2 + 1] + 1) >> 1;
-			t1 = (bayer[bayerStep] + bayer[bayerStep + 2] + 1) >> 1;
-			rgb[-blue] = (uint16_t)t0;
-			rgb[0] = bayer[bayerStep + 1];
-			rgb[blue] = (uint16_t)t1;
-			bayer++;
-			rgb += 3;
-		}
-
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-					bayer[bayerStep * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[bayerStep] +
-					bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-					2) >> 2;
-				rgb[-1] = (uint16_t)t0;
-				rgb[0] = (uint16_t)t1;
-				rgb[1] = bayer[bayerStep + 1];
-
-				t0 = (bayer[2] + bayer[bayerStep * 2 + 2] + 1) >> 1;
-				t1 = (bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					1) >> 1;
-				rgb[2] = (uint16_t)t0;
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[4] = (uint16_t)t1;
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-					bayer[bayerStep * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[bayerStep] +
-					bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-					2) >> 2;
-				rgb[1] = (uint16_t)t0;
-				rgb[0] = (uint16_t)t1;
-				rgb[-1] = bayer[bayerStep + 1];
-
-				t0 = (bayer[2] + bayer[bayerStep * 2 + 2] + 1) >> 1;
-				t1 = (bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					1) >> 1;
-				rgb[4] = (uint16_t)t0;
-				rgb[3] = bayer[bayerStep + 2];
-				rgb[2] = (uint16_t)t1;
-			}
-		}
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
 
-		if (bayer < bayerEnd) {
-			t0 = (bayer[0] + bayer[2] + bayer[bayerStep * 2] +
-				bayer[bayerStep * 2 + 2] + 2) >> 2;
-			t1 = (bayer[1] + bayer[bayerStep] +
-				bayer[bayerStep + 2] + bayer[bayerStep * 2 + 1] +
-				2) >> 2;
-			rgb[-blue] = (uint16_t)t0;
-			rgb[0] = (uint16_t)t1;
-			rgb[blue] = bayer[bayerStep + 1];
-			bayer++;
-			rgb += 3;
-		}
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
 
-		bayer -= width;
-		rgb -= width * 3;
+	mirror_borders<bilinear_row, 1, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, bits, y0, y1);
+	/* a frame narrower than the 3x3 neighbourhood is all border */
+	if (first >= last || sx < 3)
+		return DC1394_SUCCESS;
 
+	/* interior rows are 1 .. sy-2; the pattern phase flips on odd rows */
+	if ((first - 1) & 1) {
 		blue = -blue;
 		start_with_green = !start_with_green;
 	}
+	bayer += (first - 1) * bayerStep;
+	rgb += first * rgbStep + 3 + 1;
+	height = last - first;
+	width -= 2;
+
+	bayer_walk_rows<bilinear_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, bits);
 
 	return DC1394_SUCCESS;
 
 }
 
+dc1394error_t
+dc1394_bayer_Bilinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_Bilinear_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+void
+dc1394_bayer_Bilinear_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int blue, start_with_green;
+
+	walk_phase(tile, order, &blue, &start_with_green);
+	mirror_borders<bilinear_row, 1, 1>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, bits, y0, y1);
+}
+
 /* High-Quality Linear Interpolation For Demosaicing Of
 Bayer-Patterned Color Images, by Henrique S. Malvar, Li-wei He, and
 Ross Cutler, in ICASSP'04 */
 dc1394error_t
-dc1394_bayer_HQLinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_HQLinear_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	const int bayerStep = sx;
-	const int rgbStep = 3 * sx;
 	int width = sx;
 	int height = sy;
 	/*
@@ -867,208 +906,78 @@ dc1394_bayer_HQLinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int
 	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
 		|| tile == DC1394_COLOR_FILTER_GRBG;
 
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+
 	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
 		return DC1394_INVALID_COLOR_FILTER;
 
-	ClearBorders_uint16(rgb, sx, sy, 2);
-	rgb += 2 * rgbStep + 6 + 1;
-	height -= 4;
-	width -= 4;
+	if (order == DC1394_BAYER_ORDER_BGR)
+		blue = -blue;
 
 	/* We begin with a (+1 line,+1 column) offset with respect to bilinear decoding, so start_with_green is the same, but blue is opposite */
 	blue = -blue;
 
-	for (; height--; bayer += bayerStep, rgb += rgbStep) {
-		int t0, t1;
-		const uint16_t *bayerEnd = bayer + width;
-		const int bayerStep2 = bayerStep * 2;
-		const int bayerStep3 = bayerStep * 3;
-		const int bayerStep4 = bayerStep * 4;
-
-		if (start_with_green) {
-			/* at green pixel */
-			rgb[0] = bayer[bayerStep2 + 2];
-			t0 = rgb[0] * 5
-				+ ((bayer[bayerStep + 2] + bayer[bayerStep3 + 2]) << 2)
-				- bayer[2]
-				- bayer[bayerStep + 1]
-				- bayer[bayerStep + 3]
-				- bayer[bayerStep3 + 1]
-				- bayer[bayerStep3 + 3]
-				- bayer[bayerStep4 + 2]
-				+ ((bayer[bayerStep2] + bayer[bayerStep2 + 4] + 1) >> 1);
-			t1 = rgb[0] * 5 +
-				((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 3]) << 2)
-				- bayer[bayerStep2]
-				- bayer[bayerStep + 1]
-				- bayer[bayerStep + 3]
-				- bayer[bayerStep3 + 1]
-				- bayer[bayerStep3 + 3]
-				- bayer[bayerStep2 + 4]
-				+ ((bayer[2] + bayer[bayerStep4 + 2] + 1) >> 1);
-			t0 = (t0 + 4) >> 3;
-			CLIP16(t0, rgb[-blue], bits);
-			t1 = (t1 + 4) >> 3;
-			CLIP16(t1, rgb[blue], bits);
-			bayer++;
-			rgb += 3;
-		}
-
-		if (blue > 0) {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				/* B at B */
-				rgb[1] = bayer[bayerStep2 + 2];
-				/* R at B */
-				t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
-					-
-					(((bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 +
-					2]) * 3 + 1) >> 1)
-					+ rgb[1] * 6;
-				/* G at B */
-				t1 = ((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
-					bayer[bayerStep2 + 3] + bayer[bayerStep * 3 +
-					2]) << 1)
-					- (bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-					+ (rgb[1] << 2);
-				t0 = (t0 + 4) >> 3;
-				CLIP16(t0, rgb[-1], bits);
-				t1 = (t1 + 4) >> 3;
-				CLIP16(t1, rgb[0], bits);
-				/* at green pixel */
-				rgb[3] = bayer[bayerStep2 + 3];
-				t0 = rgb[3] * 5
-					+ ((bayer[bayerStep + 3] + bayer[bayerStep3 + 3]) << 2)
-					- bayer[3]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep4 + 3]
-					+
-					((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 5] +
-					1) >> 1);
-				t1 = rgb[3] * 5 +
-					((bayer[bayerStep2 + 2] + bayer[bayerStep2 + 4]) << 2)
-					- bayer[bayerStep2 + 1]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep2 + 5]
-					+ ((bayer[3] + bayer[bayerStep4 + 3] + 1) >> 1);
-				t0 = (t0 + 4) >> 3;
-				CLIP16(t0, rgb[2], bits);
-				t1 = (t1 + 4) >> 3;
-				CLIP16(t1, rgb[4], bits);
-			}
-		}
-		else {
-			for (; bayer <= bayerEnd - 2; bayer += 2, rgb += 6) {
-				/* R at R */
-				rgb[-1] = bayer[bayerStep2 + 2];
-				/* B at R */
-				t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-					bayer[bayerStep * 3 + 1] + bayer[bayerStep3 +
-					3]) << 1)
-					-
-					(((bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 +
-					2]) * 3 + 1) >> 1)
-					+ rgb[-1] * 6;
-				/* G at R */
-				t1 = ((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
-					bayer[bayerStep2 + 3] + bayer[bayerStep3 + 2]) << 1)
-					- (bayer[2] + bayer[bayerStep2] +
-					bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-					+ (rgb[-1] << 2);
-				t0 = (t0 + 4) >> 3;
-				CLIP16(t0, rgb[1], bits);
-				t1 = (t1 + 4) >> 3;
-				CLIP16(t1, rgb[0], bits);
-
-				/* at green pixel */
-				rgb[3] = bayer[bayerStep2 + 3];
-				t0 = rgb[3] * 5
-					+ ((bayer[bayerStep + 3] + bayer[bayerStep3 + 3]) << 2)
-					- bayer[3]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep4 + 3]
-					+
-					((bayer[bayerStep2 + 1] + bayer[bayerStep2 + 5] +
-					1) >> 1);
-				t1 = rgb[3] * 5 +
-					((bayer[bayerStep2 + 2] + bayer[bayerStep2 + 4]) << 2)
-					- bayer[bayerStep2 + 1]
-					- bayer[bayerStep + 2]
-					- bayer[bayerStep + 4]
-					- bayer[bayerStep3 + 2]
-					- bayer[bayerStep3 + 4]
-					- bayer[bayerStep2 + 5]
-					+ ((bayer[3] + bayer[bayerStep4 + 3] + 1) >> 1);
-				t0 = (t0 + 4) >> 3;
-				CLIP16(t0, rgb[4], bits);
-				t1 = (t1 + 4) >> 3;
-				CLIP16(t1, rgb[2], bits);
-			}
-		}
-
-		if (bayer < bayerEnd) {
-			/* B at B */
-			rgb[blue] = bayer[bayerStep2 + 2];
-			/* R at B */
-			t0 = ((bayer[bayerStep + 1] + bayer[bayerStep + 3] +
-				bayer[bayerStep3 + 1] + bayer[bayerStep3 + 3]) << 1)
-				-
-				(((bayer[2] + bayer[bayerStep2] +
-				bayer[bayerStep2 + 4] + bayer[bayerStep4 +
-				2]) * 3 + 1) >> 1)
-				+ rgb[blue] * 6;
-			/* G at B */
-			t1 = (((bayer[bayerStep + 2] + bayer[bayerStep2 + 1] +
-				bayer[bayerStep2 + 3] + bayer[bayerStep3 + 2])) << 1)
-				- (bayer[2] + bayer[bayerStep2] +
-				bayer[bayerStep2 + 4] + bayer[bayerStep4 + 2])
-				+ (rgb[blue] << 2);
-			t0 = (t0 + 4) >> 3;
-			CLIP16(t0, rgb[-blue], bits);
-			t1 = (t1 + 4) >> 3;
-			CLIP16(t1, rgb[0], bits);
-			bayer++;
-			rgb += 3;
-		}
-
-		bayer -= width;
-		rgb -= width * 3;
+	mirror_borders<hqlinear_row, 2, 2>(bayer, rgb, sx, sy, bayerStep, rgbStep, blue, start_with_green, bits, y0, y1);
+	/* a frame narrower than the 5x5 neighbourhood is all border */
+	if (first >= last || sx < 5)
+		return DC1394_SUCCESS;
 
+	/* interior rows are 2 .. sy-3; the pattern phase flips on odd rows */
+	if (first & 1) {
 		blue = -blue;
 		start_with_green = !start_with_green;
 	}
+	bayer += (first - 2) * bayerStep;
+	rgb += first * rgbStep + 6 + 1;
+	height = last - first;
+	width -= 4;
+
+	bayer_walk_rows<hqlinear_row>(bayer, rgb, bayerStep, rgbStep, width, height, blue, start_with_green, bits);
 
 	return DC1394_SUCCESS;
 }
 
+dc1394error_t
+dc1394_bayer_HQLinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_HQLinear_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+void
+dc1394_bayer_HQLinear_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int blue, start_with_green;
+
+	walk_phase(tile, order, &blue, &start_with_green);
+	mirror_borders<hqlinear_row, 2, 2>(bayer, rgb, sx, sy, bayerStep, rgbStep, -blue, start_with_green, bits, y0, y1);
+}
+
 /* coriander's Bayer decoding */
 dc1394error_t
-dc1394_bayer_EdgeSense_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_EdgeSense_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
 	/* Removed due to patent concerns */
 	return DC1394_FUNCTION_NOT_SUPPORTED;
 }
 
+dc1394error_t
+dc1394_bayer_EdgeSense_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_EdgeSense_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
 /* coriander's Bayer decoding */
 dc1394error_t
-dc1394_bayer_Downsample_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_Downsample_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
 	uint16_t *outR, *outG, *outB;
-	register int i, j;
+	int i, j;
 	int tmp;
+	int last = y1 < sy ? y1 : sy;
+	int i0, o;
 
+	/* y0 and y1 are mosaic rows and must be even */
 	switch (tile) {
 	case DC1394_COLOR_FILTER_GRBG:
 	case DC1394_COLOR_FILTER_BGGR:
@@ -1086,32 +995,42 @@ dc1394_bayer_Downsample_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, i
 		return DC1394_INVALID_COLOR_FILTER;
 	}
 
+	if (order == DC1394_BAYER_ORDER_BGR) {
+		uint16_t *tmpR = outR;
+		outR = outB;
+		outB = tmpR;
+	}
+
 	switch (tile) {
 	case DC1394_COLOR_FILTER_GRBG:        //---------------------------------------------------------
 	case DC1394_COLOR_FILTER_GBRG:
-		for (i = 0; i < sy*sx; i += (sx << 1)) {
+		for (i = y0; i < last; i += 2) {
+			i0 = i * bayerStep;
+			o = (i >> 1) * rgbStep;
 			for (j = 0; j < sx; j += 2) {
 				tmp =
-					((bayer[i + j] + bayer[i + sx + j + 1]) >> 1);
-				CLIP16(tmp, outG[((i >> 2) + (j >> 1)) * 3], bits);
-				tmp = bayer[i + sx + j + 1];
-				CLIP16(tmp, outR[((i >> 2) + (j >> 1)) * 3], bits);
-				tmp = bayer[i + sx + j];
-				CLIP16(tmp, outB[((i >> 2) + (j >> 1)) * 3], bits);
+					((bayer[i0 + j] + bayer[i0 + bayerStep + j + 1]) >> 1);
+				CLIP16(tmp, outG[o + (j >> 1) * 3], bits);
+				tmp = bayer[i0 + bayerStep + j + 1];
+				CLIP16(tmp, outR[o + (j >> 1) * 3], bits);
+				tmp = bayer[i0 + bayerStep + j];
+				CLIP16(tmp, outB[o + (j >> 1) * 3], bits);
 			}
 		}
 		break;
 	case DC1394_COLOR_FILTER_BGGR:        //---------------------------------------------------------
 	case DC1394_COLOR_FILTER_RGGB:
-		for (i = 0; i < sy*sx; i += (sx << 1)) {
+		for (i = y0; i < last; i += 2) {
+			i0 = i * bayerStep;
+			o = (i >> 1) * rgbStep;
 			for (j = 0; j < sx; j += 2) {
 				tmp =
-					((bayer[i + sx + j] + bayer[i + j + 1]) >> 1);
-				CLIP16(tmp, outG[((i >> 2) + (j >> 1)) * 3], bits);
-				tmp = bayer[i + sx + j + 1];
-				CLIP16(tmp, outR[((i >> 2) + (j >> 1)) * 3], bits);
-				tmp = bayer[i + j];
-				CLIP16(tmp, outB[((i >> 2) + (j >> 1)) * 3], bits);
+					((bayer[i0 + bayerStep + j] + bayer[i0 + j + 1]) >> 1);
+				CLIP16(tmp, outG[o + (j >> 1) * 3], bits);
+				tmp = bayer[i0 + bayerStep + j + 1];
+				CLIP16(tmp, outR[o + (j >> 1) * 3], bits);
+				tmp = bayer[i0 + j];
+				CLIP16(tmp, outB[o + (j >> 1) * 3], bits);
 			}
 		}
 		break;
@@ -1121,13 +1040,54 @@ dc1394_bayer_Downsample_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, i
 
 }
 
+dc1394error_t
+dc1394_bayer_Downsample_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_Downsample_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * (sx / 2), DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+/* the last row and column of dc1394_bayer_Simple_uint16: the cell of a
+   pixel has its greens averaged and its red and blue copied */
+struct simple_uint16_border {
+	const uint16_t *bayer;
+	uint16_t *rgb;
+	int sx, sy, bayerStep, rgbStep, tile, bits, order;
+
+	void
+	operator()(int x, int y) const
+	{
+		uint16_t win[4];
+		uint16_t *out = rgb + y * rgbStep + 3 * x;
+		int green_x, red_row, g, own, opp;
+
+		mirror_window<uint16_t, 0, 1>(bayer, bayerStep, sx, sy, x, y, win);
+		bayer_row_phase(bayer_shift_tile(tile, x, y), 0, &green_x, &red_row);
+		if (green_x == 0) {
+			g = (win[0] + win[3]) >> 1;
+			own = win[1];
+			opp = win[2];
+		}
+		else {
+			g = (win[1] + win[2]) >> 1;
+			own = win[0];
+			opp = win[3];
+		}
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		CLIP16(own, out[red_row ? 0 : 2], bits);
+		CLIP16(g, out[1], bits);
+		CLIP16(opp, out[red_row ? 2 : 0], bits);
+	}
+};
+
 /* coriander's Bayer decoding */
 dc1394error_t
-dc1394_bayer_Simple_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+dc1394_bayer_Simple_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
 	uint16_t *outR, *outG, *outB;
-	register int i, j;
+	int i, j;
 	int tmp, base;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int even = y0 + (y0 & 1), odd = y0 | 1;
 
 	// sx and sy should be even
 	switch (tile) {
@@ -1167,117 +1127,129 @@ dc1394_bayer_Simple_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int s
 		break;
 	}
 
+	if (order == DC1394_BAYER_ORDER_BGR) {
+		uint16_t *tmpR = outR;
+		outR = outB;
+		outB = tmpR;
+	}
+
 	switch (tile) {
 	case DC1394_COLOR_FILTER_GRBG:        //---------------------------------------------------------
 	case DC1394_COLOR_FILTER_GBRG:
-		for (i = 0; i < sy - 1; i += 2) {
+		for (i = even; i < last; i += 2) {
 			for (j = 0; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base] + bayer[base + sx + 1]) >> 1);
-				CLIP16(tmp, outG[base * 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base] + bayer[base + bayerStep + 1]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
 				tmp = bayer[base + 1];
-				CLIP16(tmp, outR[base * 3], bits);
-				tmp = bayer[base + sx];
-				CLIP16(tmp, outB[base * 3], bits);
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep];
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 0; i < sy - 1; i += 2) {
+		for (i = even; i < last; i += 2) {
 			for (j = 1; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base + 1] + bayer[base + sx]) >> 1);
-				CLIP16(tmp, outG[(base)* 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base + 1] + bayer[base + bayerStep]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
 				tmp = bayer[base];
-				CLIP16(tmp, outR[(base)* 3], bits);
-				tmp = bayer[base + 1 + sx];
-				CLIP16(tmp, outB[(base)* 3], bits);
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + 1 + bayerStep];
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 1; i < sy - 1; i += 2) {
+		for (i = odd; i < last; i += 2) {
 			for (j = 0; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base + sx] + bayer[base + 1]) >> 1);
-				CLIP16(tmp, outG[base * 3], bits);
-				tmp = bayer[base + sx + 1];
-				CLIP16(tmp, outR[base * 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base + bayerStep] + bayer[base + 1]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep + 1];
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
 				tmp = bayer[base];
-				CLIP16(tmp, outB[base * 3], bits);
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 1; i < sy - 1; i += 2) {
+		for (i = odd; i < last; i += 2) {
 			for (j = 1; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base] + bayer[base + 1 + sx]) >> 1);
-				CLIP16(tmp, outG[(base)* 3], bits);
-				tmp = bayer[base + sx];
-				CLIP16(tmp, outR[(base)* 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base] + bayer[base + 1 + bayerStep]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep];
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
 				tmp = bayer[base + 1];
-				CLIP16(tmp, outB[(base)* 3], bits);
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
 		break;
 	case DC1394_COLOR_FILTER_BGGR:        //---------------------------------------------------------
 	case DC1394_COLOR_FILTER_RGGB:
-		for (i = 0; i < sy - 1; i += 2) {
+		for (i = even; i < last; i += 2) {
 			for (j = 0; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base + sx] + bayer[base + 1]) >> 1);
-				CLIP16(tmp, outG[base * 3], bits);
-				tmp = bayer[base + sx + 1];
-				CLIP16(tmp, outR[base * 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base + bayerStep] + bayer[base + 1]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep + 1];
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
 				tmp = bayer[base];
-				CLIP16(tmp, outB[base * 3], bits);
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 1; i < sy - 1; i += 2) {
+		for (i = odd; i < last; i += 2) {
 			for (j = 0; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base] + bayer[base + 1 + sx]) >> 1);
-				CLIP16(tmp, outG[(base)* 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base] + bayer[base + 1 + bayerStep]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
 				tmp = bayer[base + 1];
-				CLIP16(tmp, outR[(base)* 3], bits);
-				tmp = bayer[base + sx];
-				CLIP16(tmp, outB[(base)* 3], bits);
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep];
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 0; i < sy - 1; i += 2) {
+		for (i = even; i < last; i += 2) {
 			for (j = 1; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base] + bayer[base + sx + 1]) >> 1);
-				CLIP16(tmp, outG[base * 3], bits);
-				tmp = bayer[base + sx];
-				CLIP16(tmp, outR[base * 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base] + bayer[base + bayerStep + 1]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + bayerStep];
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
 				tmp = bayer[base + 1];
-				CLIP16(tmp, outB[base * 3], bits);
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
-		for (i = 1; i < sy - 1; i += 2) {
+		for (i = odd; i < last; i += 2) {
 			for (j = 1; j < sx - 1; j += 2) {
-				base = i * sx + j;
-				tmp = ((bayer[base + 1] + bayer[base + sx]) >> 1);
-				CLIP16(tmp, outG[(base)* 3], bits);
+				base = i * bayerStep + j;
+				tmp = ((bayer[base + 1] + bayer[base + bayerStep]) >> 1);
+				CLIP16(tmp, outG[i * rgbStep + j * 3], bits);
 				tmp = bayer[base];
-				CLIP16(tmp, outR[(base)* 3], bits);
-				tmp = bayer[base + 1 + sx];
-				CLIP16(tmp, outB[(base)* 3], bits);
+				CLIP16(tmp, outR[i * rgbStep + j * 3], bits);
+				tmp = bayer[base + 1 + bayerStep];
+				CLIP16(tmp, outB[i * rgbStep + j * 3], bits);
 			}
 		}
 		break;
 	}
 
-	/* add black border */
-	for (i = sx * (sy - 1) * 3; i < sx * sy * 3; i++) {
-		rgb[i] = 0;
-	}
-	for (i = (sx - 1) * 3; i < sx * sy * 3; i += (sx - 1) * 3) {
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-		rgb[i++] = 0;
-	}
+	simple_uint16_border px = { bayer, rgb, sx, sy, bayerStep, rgbStep, tile, bits, order };
+	border_pixels(sx, sy, 0, 1, y0, y1, px);
 
 	return DC1394_SUCCESS;
 
 }
 
+dc1394error_t
+dc1394_bayer_Simple_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_Simple_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+void
+dc1394_bayer_Simple_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	simple_uint16_border px = { bayer, rgb, sx, sy, bayerStep, rgbStep, tile, bits, order };
+	border_pixels(sx, sy, 0, 1, y0, y1, px);
+}
+
 /* Variable Number of Gradients, from dcraw <http://www.cybercom.net/~dcoffin/dcraw/> */
 /* Ported to libdc1394 by Frederic Devernay */
 
@@ -1313,7 +1285,7 @@ described in http://www-ise.stanford.edu/~tingchen/algodep/vargra.html
 I've extended the basic idea to work with non-Bayer filter arrays.
 Gradients are numbered clockwise from NW=0 to W=7.
 */
-static const signed char bayervng_terms[] = {
+static const short bayervng_terms[] = {
 	-2, -2, +0, -1, 0, 0x01, -2, -2, +0, +0, 1, 0x01, -2, -1, -1, +0, 0, 0x01,
 	-2, -1, +0, -1, 0, 0x02, -2, -1, +0, +0, 0, 0x03, -2, -1, +0, +1, 1, 0x01,
 	-2, +0, +0, -1, 0, 0x06, -2, +0, +0, +0, 1, 0x02, -2, +0, +0, +1, 0, 0x03,
@@ -1336,13 +1308,260 @@ static const signed char bayervng_terms[] = {
 	+0, +1, +2, +1, 0, 0x20, +0, +1, +2, +2, 0, 0x10, +1, -2, +1, +0, 0, 0x80,
 	+1, -1, +1, +1, 0, 0x88, +1, +0, +1, +2, 0, 0x08, +1, +0, +2, -1, 0, 0x40,
 	+1, +0, +2, +1, 0, 0x10
-}, bayervng_chood[] = { -1, -1, -1, 0, -1, +1, 0, +1, +1, +1, +1, 0, +1, -1, 0, -1 };
+};
+static const signed char bayervng_chood[] = { -1, -1, -1, 0, -1, +1, 0, +1, +1, +1, +1, 0, +1, -1, 0, -1 };
+
+/* output rows per pass, so that the bilinear rows VNG reads stay in cache */
+#define VNG_BAND 32
+#define VNG_CODE_SIZE 320
+
+/* dcraw's filters word for each tile, see FC() */
+static int
+dcraw_filters(int tile, unsigned long *filters)
+{
+	switch (tile) {
+	case DC1394_COLOR_FILTER_BGGR:
+		*filters = 0x16161616;
+		return 1;
+	case DC1394_COLOR_FILTER_GRBG:
+		*filters = 0x61616161;
+		return 1;
+	case DC1394_COLOR_FILTER_RGGB:
+		*filters = 0x94949494;
+		return 1;
+	case DC1394_COLOR_FILTER_GBRG:
+		*filters = 0x49494949;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* FC() as an int, for comparing with colours */
+static inline int
+filter_color(unsigned long filters, int row, int col)
+{
+	return (int)FC(row, col);
+}
+
+/*
+* Turn the term and neighbour tables into offset code for each of the
+* four sites of the pattern, for pixels step elements apart vertically.
+* This is done once per call rather than per pixel, as in dcraw.
+*/
+static void
+vng_build_code(unsigned long filters, int step, int code[2][2][VNG_CODE_SIZE])
+{
+	const short *cp;
+	const signed char *hp;
+	int *ip;
+	int row, col, t, g, x, y, x1, x2, y1, y2, weight, grads, color, diag;
+
+	for (row = 0; row < 2; row++) {
+		for (col = 0; col < 2; col++) {
+			ip = code[row][col];
+			for (cp = bayervng_terms, t = 0; t < 64; t++) {
+				y1 = *cp++;  x1 = *cp++;
+				y2 = *cp++;  x2 = *cp++;
+				weight = *cp++;
+				grads = *cp++;
+				color = filter_color(filters, row + y1, col + x1);
+				if (filter_color(filters, row + y2, col + x2) != color)
+					continue;
+				diag = (filter_color(filters, row, col + 1) == color && filter_color(filters, row + 1, col) == color) ? 2 : 1;
+				if (abs(y1 - y2) == diag && abs(x1 - x2) == diag)
+					continue;
+				*ip++ = y1 * step + x1 * 3 + color;
+				*ip++ = y2 * step + x2 * 3 + color;
+				*ip++ = weight;
+				for (g = 0; g < 8; g++)
+					if (grads & 1 << g)
+						*ip++ = g;
+				*ip++ = -1;
+			}
+			*ip++ = INT_MAX;
+			for (hp = bayervng_chood, g = 0; g < 8; g++) {
+				y = *hp++;  x = *hp++;
+				*ip++ = y * step + x * 3;
+				color = filter_color(filters, row, col);
+				if (filter_color(filters, row + y, col + x) != color && filter_color(filters, row + y * 2, col + x * 2) == color)
+					*ip++ = 2 * (y * step + x * 3) + color;
+				else
+					*ip++ = 0;
+			}
+		}
+	}
+}
+
+/* copy n bilinear pixels to the output in the requested channel order */
+template <typename T>
+static void
+vng_copy(const T *src, T *dst, int n, int order)
+{
+	int i;
+
+	if (order != DC1394_BAYER_ORDER_BGR) {
+		memcpy(dst, src, 3 * n * sizeof(*dst));
+		return;
+	}
+	for (i = 0; i < n; i++, src += 3, dst += 3) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+	}
+}
+
+/* one VNG pixel; pix points at its bilinear colours, ip at its site's code */
+template <typename T>
+static inline void
+vng_pixel(const T *pix, const int *ip, int color, int maxval, int order, T *out)
+{
+	int gval[8], gmin, gmax, thold, sum[3], num, g, c, t, diff;
+
+	memset(gval, 0, sizeof(gval));
+	while ((g = ip[0]) != INT_MAX) {		/* Calculate gradients */
+		diff = ABS(pix[g] - pix[ip[1]]) << ip[2];
+		gval[ip[3]] += diff;
+		ip += 5;
+		if ((g = ip[-1]) == -1)
+			continue;
+		gval[g] += diff;
+		while ((g = *ip++) != -1)
+			gval[g] += diff;
+	}
+	ip++;
+	gmin = gmax = gval[0];			/* Choose a threshold */
+	for (g = 1; g < 8; g++) {
+		if (gmin > gval[g])
+			gmin = gval[g];
+		if (gmax < gval[g])
+			gmax = gval[g];
+	}
+	if (gmax == 0) {
+		vng_copy(pix, out, 1, order);
+		return;
+	}
+	thold = gmin + (gmax >> 1);
+	memset(sum, 0, sizeof(sum));
+	for (num = g = 0; g < 8; g++, ip += 2) {		/* Average the neighbors */
+		if (gval[g] <= thold) {
+			FORC3
+				if (c == color && ip[1])
+					sum[c] += (pix[c] + pix[ip[1]]) >> 1;
+				else
+					sum[c] += pix[ip[0] + c];
+			num++;
+		}
+	}
+	FORC3 {
+		t = pix[color];
+		if (c != color)
+			t += (sum[c] - sum[color]) / num;
+		out[order == DC1394_BAYER_ORDER_BGR ? 2 - c : c] = (T)LIM(t, 0, maxval);
+	}
+}
+
+/* bilinear rows through the registry, as VNG and AHD start from them */
+static dc1394error_t
+bilinear_rows(const uint8_t *bayer, uint8_t *rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return dc1394_bayer_get_kernel8(DC1394_BAYER_METHOD_BILINEAR, NULL)(bayer, rgb, sx, sy, tile, bayerStep, rgbStep, order, y0, y1);
+}
+
+static dc1394error_t
+bilinear_rows(const uint16_t *bayer, uint16_t *rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return dc1394_bayer_get_kernel16(DC1394_BAYER_METHOD_BILINEAR, NULL)(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+}
+
+/*
+* VNG refines the bilinear result, reading it two pixels around each
+* output pixel. Output rows are produced VNG_BAND at a time from the
+* bilinear decode of just the mosaic rows they need, three more on each
+* side, which is decoded as a frame of its own: its first and last rows
+* are then borders, but they are never read unless they are the frame's.
+* Rows and columns within two pixels of the frame edge keep their
+* bilinear colours.
+*/
+template <typename T>
+static dc1394error_t
+vng_rows(const T * bayer, T * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	const int maxval = (1 << bits) - 1;
+	const int bilStep = 3 * sx;
+	int code[2][2][VNG_CODE_SIZE];
+	unsigned long filters;
+	dc1394error_t err = DC1394_SUCCESS;
+	T *bil;
+	int a, b;
+
+	if (!dcraw_filters(tile, &filters))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	vng_build_code(filters, bilStep, code);
+
+	bil = (T *)malloc((VNG_BAND + 6) * bilStep * sizeof(T));
+	if (!bil)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+	for (a = y0; a < y1; a = b) {
+		int s0 = a - 3 > 0 ? a - 3 : 0;
+		int s1, row, col;
+
+		b = a + VNG_BAND < y1 ? a + VNG_BAND : y1;
+		s1 = b + 3 < sy ? b + 3 : sy;
+		err = bilinear_rows(bayer + s0 * bayerStep, bil, sx, s1 - s0, bayer_shift_tile(tile, 0, s0), bits, bayerStep, bilStep, DC1394_BAYER_ORDER_RGB, 0, s1 - s0);
+		if (err != DC1394_SUCCESS)
+			break;
+
+		for (row = a; row < b; row++) {
+			const T *src = bil + (row - s0) * bilStep;
+			T *dst = rgb + row * rgbStep;
+
+			if (row < 2 || row >= sy - 2 || sx < 5) {
+				vng_copy(src, dst, sx, order);
+				continue;
+			}
+			vng_copy(src, dst, 2, order);
+			for (col = 2; col < sx - 2; col++)
+				vng_pixel(src + 3 * col, code[row & 1][col & 1], filter_color(filters, row, col), maxval, order, dst + 3 * col);
+			vng_copy(src + 3 * (sx - 2), dst + 3 * (sx - 2), 2, order);
+		}
+	}
+
+	free(bil);
+	return err;
+}
+
+/* Variable Number of Gradients */
+dc1394error_t
+dc1394_bayer_VNG_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return vng_rows(bayer, rgb, sx, sy, tile, 8, bayerStep, rgbStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_VNG(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_VNG_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+dc1394error_t
+dc1394_bayer_VNG_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return vng_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_VNG_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_VNG_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
 
 
 
 
 /* AHD interpolation ported from dcraw to libdc1394 by Samuel Audet */
-static dc1394bool_t ahd_inited = DC1394_FALSE; /* WARNING: not multi-processor safe */
 
 #define CLIPOUT(x)        LIM(x,0,255)
 #define CLIPOUT16(x,bits) LIM(x,0,((1<<bits)-1))
@@ -1353,55 +1572,231 @@ static const double xyz_rgb[3][3] = {                        /* XYZ from RGB */
 		{ 0.019334, 0.119193, 0.950227 } };
 static const float d65_white[3] = { 0.950456, 1, 1.088754 };
 
+/*
+* CIELab in fixed point. Camera values are scaled to 16 bits and taken
+* to XYZ with AHD_XYZ_SHIFT fractional bits, and the cube root is looked
+* up with AHD_CBRT_SHIFT fractional bits. The tables are filled once,
+* by whichever thread first needs them.
+*/
+#define AHD_XYZ_SHIFT 14
+#define AHD_CBRT_SHIFT 14
+
+static int ahd_xyz_cam[3][3];
+static uint16_t ahd_cbrt[0x10000];
+static std::once_flag ahd_once;
+
+static void
+ahd_init_tables(void)
+{
+	int i, j;
+
+	for (i = 0; i < 0x10000; i++) {
+		double r = i / 65535.0;
+		double f = r > 0.008856 ? pow(r, 1 / 3.0) : 7.787 * r + 16 / 116.0;
+		ahd_cbrt[i] = (uint16_t)(f * (1 << AHD_CBRT_SHIFT) + 0.5);
+	}
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			ahd_xyz_cam[i][j] = (int)(xyz_rgb[i][j] / d65_white[i] * (1 << AHD_XYZ_SHIFT) + 0.5);
+}
+
+/* Lab times 64, as dcraw keeps it in shorts */
+template <typename T>
+static inline void
+ahd_cielab(const T cam[3], int shift, short lab[3])
+{
+	int xyz[3], c, v;
+
+	FORC3 {
+		v = (ahd_xyz_cam[c][0] * (cam[0] << shift) + ahd_xyz_cam[c][1] * (cam[1] << shift)
+			+ ahd_xyz_cam[c][2] * (cam[2] << shift) + (1 << (AHD_XYZ_SHIFT - 1))) >> AHD_XYZ_SHIFT;
+		xyz[c] = ahd_cbrt[CLIPOUT16(v, 16)];
+	}
+	lab[0] = (short)((116 * 64 * xyz[1] >> AHD_CBRT_SHIFT) - 16 * 64);
+	lab[1] = (short)(500 * 64 * (xyz[0] - xyz[1]) >> AHD_CBRT_SHIFT);
+	lab[2] = (short)(200 * 64 * (xyz[1] - xyz[2]) >> AHD_CBRT_SHIFT);
+}
+
 /*
 Adaptive Homogeneity-Directed interpolation is based on
 the work of Keigo Hirakawa, Thomas Parks, and Paul Lee.
 */
-#define TS 256                /* Tile Size */
+#define TS 128                /* Tile Size, so that a tile's buffers fit in L2 */
 
-dc1394error_t
-dc1394_bayer_decoding_8bit(const uint8_t * bayer, uint8_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method)
+template <typename T>
+struct ahd_tile_t {
+	T rgb[2][TS][TS][3];		/* horizontal and vertical interpolation */
+	short lab[2][TS][TS][3];
+	char homo[2][TS][TS];
+};
+
+/*
+* One tile: output rows [a, b), a >= 5, of the columns from left + 3 but
+* at least 5, worked out in a window whose first row is top = a - 3.
+* Green is only interpolated two pixels in from the frame's edges, so
+* the Lab images are right from the third pixel in, their homogeneity
+* from the fourth and the combined result from the fifth, as in dcraw.
+* Every read is of a pixel's own colour, so the mosaic is read directly.
+* A pixel's result only depends on its place in the frame, not on the
+* tiling.
+*/
+template <typename T>
+static void
+ahd_tile(const T *bayer, int step, T *out, int sx, int sy, unsigned long filters, int maxval, int shift, int outStep, int order, int top, int left, int b, ahd_tile_t<T> *t)
 {
-	switch (method) {
-	case DC1394_BAYER_METHOD_NEAREST:
-		return dc1394_bayer_NearestNeighbor(bayer, rgb, sx, sy, tile);
-	case DC1394_BAYER_METHOD_SIMPLE:
-		return dc1394_bayer_Simple(bayer, rgb, sx, sy, tile);
-	case DC1394_BAYER_METHOD_BILINEAR:
-		return dc1394_bayer_Bilinear(bayer, rgb, sx, sy, tile);
-	case DC1394_BAYER_METHOD_HQLINEAR:
-		return dc1394_bayer_HQLinear(bayer, rgb, sx, sy, tile);
-	case DC1394_BAYER_METHOD_DOWNSAMPLE:
-		return dc1394_bayer_Downsample(bayer, rgb, sx, sy, tile);
-	case DC1394_BAYER_METHOD_EDGESENSE:
-		return dc1394_bayer_EdgeSense(bayer, rgb, sx, sy, tile);
-	default:
-		return DC1394_INVALID_BAYER_METHOD;
+	static const int dir[4] = { -1, 1, -TS, TS };
+	/* rows the combined rows depend on */
+	const int rows = b + 3 - top;
+	const T *pix;
+	T (*rix)[3];
+	short (*lix)[3];
+	unsigned ldiff[2][4], abdiff[2][4], leps, abeps;
+	int i, j, row, col, tr, tc, c, d, val, hm[2];
+
+	for (d = 0; d < 2; d++)
+		memset(t->rgb[d], 0, rows * sizeof(t->rgb[d][0]));
+
+	/*  Interpolate green horizontally and vertically:                */
+	for (row = top < 2 ? 2 : top; row < top + rows && row < sy - 2; row++) {
+		col = left + (filter_color(filters, row, left) == 1);
+		if (col < 2) col += 2;
+		for (; col < left + TS && col < sx - 2; col += 2) {
+			pix = bayer + row * step + col;
+			val = ((pix[-1] + pix[0] + pix[1]) * 2 - pix[-2] - pix[2]) >> 2;
+			t->rgb[0][row - top][col - left][1] = ULIM(val, pix[-1], pix[1]);
+			val = ((pix[-step] + pix[0] + pix[step]) * 2 - pix[-2 * step] - pix[2 * step]) >> 2;
+			t->rgb[1][row - top][col - left][1] = ULIM(val, pix[-step], pix[step]);
+		}
+	}
+	/*  Interpolate red and blue, and convert to CIELab:                */
+	for (d = 0; d < 2; d++)
+		for (row = top + 1; row < top + rows - 1 && row < sy - 1; row++)
+			for (col = left + 1; col < left + TS - 1 && col < sx - 1; col++) {
+				pix = bayer + row * step + col;
+				rix = &t->rgb[d][row - top][col - left];
+				if ((c = 2 - filter_color(filters, row, col)) == 1) {
+					c = filter_color(filters, row + 1, col);
+					val = pix[0] + ((pix[-1] + pix[1] - rix[-1][1] - rix[1][1]) >> 1);
+					rix[0][2 - c] = LIM(val, 0, maxval);
+					val = pix[0] + ((pix[-step] + pix[step] - rix[-TS][1] - rix[TS][1]) >> 1);
+				} else
+					val = rix[0][1] + ((pix[-step - 1] + pix[-step + 1] + pix[step - 1] + pix[step + 1]
+						- rix[-TS - 1][1] - rix[-TS + 1][1] - rix[TS - 1][1] - rix[TS + 1][1] + 1) >> 2);
+				rix[0][c] = LIM(val, 0, maxval);
+				rix[0][filter_color(filters, row, col)] = pix[0];
+				ahd_cielab(rix[0], shift, t->lab[d][row - top][col - left]);
+			}
+	/*  Build homogeneity maps from the CIELab images:                */
+	for (d = 0; d < 2; d++)
+		memset(t->homo[d], 0, rows * sizeof(t->homo[d][0]));
+	for (row = top + 2; row < top + rows - 2 && row < sy - 2; row++) {
+		tr = row - top;
+		for (col = left + 2; col < left + TS - 2 && col < sx - 2; col++) {
+			tc = col - left;
+			for (d = 0; d < 2; d++) {
+				lix = &t->lab[d][tr][tc];
+				for (i = 0; i < 4; i++)
+					ldiff[d][i] = ABS(lix[0][0] - lix[dir[i]][0]);
+			}
+			leps = MIN(MAX(ldiff[0][0], ldiff[0][1]),
+				MAX(ldiff[1][2], ldiff[1][3]));
+			for (d = 0; d < 2; d++) {
+				lix = &t->lab[d][tr][tc];
+				for (i = 0; i < 4; i++)
+					if (i >> 1 == d || ldiff[d][i] <= leps)
+						abdiff[d][i] = SQR(lix[0][1] - lix[dir[i]][1])
+						+ SQR(lix[0][2] - lix[dir[i]][2]);
+			}
+			abeps = MIN(MAX(abdiff[0][0], abdiff[0][1]),
+				MAX(abdiff[1][2], abdiff[1][3]));
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
+						t->homo[d][tr][tc]++;
+		}
+	}
+	/*  Combine the most homogenous pixels for the final result:        */
+	for (row = top + 3; row < b; row++) {
+		T *dst = out + row * outStep;
+
+		tr = row - top;
+		for (col = MAX(left + 3, 5); col < left + TS - 3 && col < sx - 5; col++) {
+			tc = col - left;
+			for (d = 0; d < 2; d++)
+				for (hm[d] = 0, i = tr - 1; i <= tr + 1; i++)
+					for (j = tc - 1; j <= tc + 1; j++)
+						hm[d] += t->homo[d][i][j];
+			FORC3 {
+				if (hm[0] != hm[1])
+					val = t->rgb[hm[1] > hm[0]][tr][tc][c];
+				else
+					val = (t->rgb[0][tr][tc][c] + t->rgb[1][tr][tc][c]) >> 1;
+				dst[3 * col + (order == DC1394_BAYER_ORDER_BGR ? 2 - c : c)] = (T)val;
+			}
+		}
+	}
+}
+
+/*
+* The outer five pixels of the frame keep their bilinear colours. Rows
+* are combined up to TS - 6 at a time, across the frame in tiles that
+* overlap by six columns.
+*/
+template <typename T>
+static dc1394error_t
+ahd_rows(const T * bayer, T * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	unsigned long filters;
+	ahd_tile_t<T> *t;
+	dc1394error_t err;
+	int a, b, left;
+
+	if (!dcraw_filters(tile, &filters))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	err = bilinear_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+	if (err != DC1394_SUCCESS)
+		return err;
+
+	std::call_once(ahd_once, ahd_init_tables);
+	t = (ahd_tile_t<T> *)malloc(sizeof(*t));
+	if (!t)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+	y0 = MAX(y0, 5);
+	y1 = MIN(y1, sy - 5);
+	for (a = y0; a < y1; a = b) {
+		b = MIN(a + TS - 6, y1);
+		for (left = 0; left < sx - 6; left += TS - 6)
+			ahd_tile(bayer, bayerStep, rgb, sx, sy, filters, (1 << bits) - 1, 16 - bits, rgbStep, order, a - 3, left, b, t);
 	}
 
+	free(t);
+	return DC1394_SUCCESS;
 }
 
 dc1394error_t
-dc1394_bayer_decoding_16bit(const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+dc1394_bayer_AHD_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
 {
-	switch (method) {
-	case DC1394_BAYER_METHOD_NEAREST:
-		return dc1394_bayer_NearestNeighbor_uint16(bayer, rgb, sx, sy, tile, bits);
-	case DC1394_BAYER_METHOD_SIMPLE:
-		return dc1394_bayer_Simple_uint16(bayer, rgb, sx, sy, tile, bits);
-	case DC1394_BAYER_METHOD_BILINEAR:
-		return dc1394_bayer_Bilinear_uint16(bayer, rgb, sx, sy, tile, bits);
-	case DC1394_BAYER_METHOD_HQLINEAR:
-		return dc1394_bayer_HQLinear_uint16(bayer, rgb, sx, sy, tile, bits);
-	case DC1394_BAYER_METHOD_DOWNSAMPLE:
-		return dc1394_bayer_Downsample_uint16(bayer, rgb, sx, sy, tile, bits);
-	case DC1394_BAYER_METHOD_EDGESENSE:
-		return dc1394_bayer_EdgeSense_uint16(bayer, rgb, sx, sy, tile, bits);
+	return ahd_rows(bayer, rgb, sx, sy, tile, 8, bayerStep, rgbStep, order, y0, y1);
+}
 
-	default:
-		return DC1394_INVALID_BAYER_METHOD;
-	}
+dc1394error_t
+dc1394_bayer_AHD(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile)
+{
+	return dc1394_bayer_AHD_rows(bayer, rgb, sx, sy, tile, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
+
+dc1394error_t
+dc1394_bayer_AHD_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return ahd_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+}
 
+dc1394error_t
+dc1394_bayer_AHD_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits)
+{
+	return dc1394_bayer_AHD_uint16_rows(bayer, rgb, sx, sy, tile, bits, sx, 3 * sx, DC1394_BAYER_ORDER_RGB, 0, sy);
 }
 
 #if 0
@@ -1,3 +1,7 @@
+#ifndef __DC1394_BAYER_H__
+#define __DC1394_BAYER_H__
+
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
@@ -10,6 +14,9 @@ typedef enum {
 	DC1394_BAYER_METHOD_VNG,
 	DC1394_BAYER_METHOD_AHD
 } dc1394bayer_method_t;
+#define DC1394_BAYER_METHOD_MIN      DC1394_BAYER_METHOD_NEAREST
+#define DC1394_BAYER_METHOD_MAX      DC1394_BAYER_METHOD_AHD
+#define DC1394_BAYER_METHOD_NUM     (DC1394_BAYER_METHOD_MAX - DC1394_BAYER_METHOD_MIN + 1)
 
 typedef enum {
 	DC1394_COLOR_FILTER_RGGB = 512,
@@ -77,6 +84,29 @@ typedef enum {
 	DC1394_TRUE
 } dc1394bool_t;
 
+/**
+* Instruction sets a demosaic kernel can be built for, in ascending order.
+*/
+typedef enum {
+	DC1394_BAYER_ISA_SCALAR = 0,
+	DC1394_BAYER_ISA_SSE2,
+	DC1394_BAYER_ISA_SSSE3,
+	DC1394_BAYER_ISA_SSE41,
+	DC1394_BAYER_ISA_AVX2,
+	DC1394_BAYER_ISA_AVX512BW
+} dc1394bayer_isa_t;
+#define DC1394_BAYER_ISA_MIN         DC1394_BAYER_ISA_SCALAR
+#define DC1394_BAYER_ISA_MAX         DC1394_BAYER_ISA_AVX512BW
+#define DC1394_BAYER_ISA_NUM        (DC1394_BAYER_ISA_MAX - DC1394_BAYER_ISA_MIN + 1)
+
+/* channel order of each output pixel */
+typedef enum {
+	DC1394_BAYER_ORDER_RGB = 0,
+	DC1394_BAYER_ORDER_BGR
+} dc1394bayer_order_t;
+#define DC1394_BAYER_ORDER_MIN       DC1394_BAYER_ORDER_RGB
+#define DC1394_BAYER_ORDER_MAX       DC1394_BAYER_ORDER_BGR
+#define DC1394_BAYER_ORDER_NUM      (DC1394_BAYER_ORDER_MAX - DC1394_BAYER_ORDER_MIN + 1)
 
 
 
@@ -87,5 +117,291 @@ dc1394_bayer_decoding_8bit(const uint8_t * bayer, uint8_t * rgb, uint32_t sx, ui
 dc1394error_t
 dc1394_bayer_Bilinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
 
+/* luma of the Bilinear colours, see dc1394_bayer_decoding_luma8() */
+dc1394error_t
+dc1394_bayer_Bilinear_luma(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit(const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
+
+/*
+* Same as above, but output row y starts rgb_pitch * y bytes after rgb
+* and order sets the channel order. rgb_pitch may be negative, so a
+* bottom-up RGB24 DIB is written directly by passing its last row,
+* -stride and DC1394_BAYER_ORDER_BGR. For DC1394_BAYER_METHOD_DOWNSAMPLE
+* the rows are those of the sx/2 x sy/2 output.
+*/
+dc1394error_t
+dc1394_bayer_decoding_8bit_pitch(const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_pitch(const uint16_t * bayer, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order);
+
+/*
+* Same again with the mosaic laid out like the output: its row y starts
+* bayer_offset + bayer_pitch * y bytes after bayer, and output row y
+* rgb_offset + rgb_pitch * y bytes after rgb. Either image may be a
+* padded or aligned buffer, or a window into a larger one, and is read
+* or written in place. A window's tile is that of its own first pixel,
+* the frame's one when it starts at an even row and column. bayer_pitch
+* may be negative but must span sx pixels; for the 16-bit decoder all
+* pitches and offsets must be whole pixels.
+*/
+dc1394error_t
+dc1394_bayer_decoding_8bit_stride(const uint8_t * bayer, size_t bayer_offset, int bayer_pitch, uint8_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_stride(const uint16_t * bayer, size_t bayer_offset, int bayer_pitch, uint16_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order);
+
+/*
+* Greyscale output: one byte per pixel holding the BT.601 luma
+* (77 R + 150 G + 29 B + 128) >> 8 of the DC1394_BAYER_METHOD_BILINEAR
+* colours, computed straight from the mosaic. Row y starts
+* luma_pitch * y bytes after luma.
+*/
+dc1394error_t
+dc1394_bayer_decoding_luma8(const uint8_t * bayer, uint8_t * luma, int luma_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile);
+
+/*
+* Kernel registry. The decoding functions above go through a per-method,
+* per-depth table of kernels that is filled on first use with the widest
+* variant the CPU supports. The environment variable DC1394_BAYER_MAX_ISA
+* (scalar, sse2, ssse3, sse4.1, avx2, avx512bw) caps the selection at
+* start-up; dc1394_bayer_set_max_isa() does the same at run time, and may
+* be called while other threads are decoding. A decode picks its kernels
+* from the table it loaded when it started, finishes with those, and only
+* the calls made after the switch use the new cap.
+*/
+
+/* bit (1 << isa) is set for every instruction set the CPU and OS support */
+uint32_t
+dc1394_bayer_get_cpu_features(void);
+
+dc1394error_t
+dc1394_bayer_set_max_isa(dc1394bayer_isa_t isa);
+
+dc1394bayer_isa_t
+dc1394_bayer_get_max_isa(void);
+
+/* instruction set of the kernel currently used for method at depth 8 or 16 */
+dc1394error_t
+dc1394_bayer_get_kernel_isa(dc1394bayer_method_t method, uint32_t depth, dc1394bayer_isa_t *isa);
+
+const char *
+dc1394_bayer_isa_name(dc1394bayer_isa_t isa);
+
+/*
+* Band-parallel decoding. A pool keeps threads - 1 worker threads parked
+* between frames; each call cuts the frame into horizontal bands that the
+* workers and the calling thread decode concurrently, and returns once
+* the whole frame is done. The output is identical to the serial
+* functions. threads == 0 takes the count from the DC1394_BAYER_THREADS
+* environment variable, or else the number of processors. One pool may
+* be used from several threads at once; a NULL pool decodes serially.
+*/
+typedef struct dc1394bayer_pool_t dc1394bayer_pool_t;
+
+dc1394bayer_pool_t *
+dc1394_bayer_pool_new(uint32_t threads);
+
+void
+dc1394_bayer_pool_free(dc1394bayer_pool_t *pool);
+
+uint32_t
+dc1394_bayer_pool_get_threads(const dc1394bayer_pool_t *pool);
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_pitch_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_luma8_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * luma, int luma_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_pitch_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_stride_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, size_t bayer_offset, int bayer_pitch, uint8_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_stride_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, size_t bayer_offset, int bayer_pitch, uint16_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order);
+
+/*
+* Region-of-interest decoding: only the pixels inside the rectangles are
+* computed and written, each with exactly the value the whole-frame
+* decoder would give it, so the cost follows the rectangles' area and
+* not the frame size. rgb and rgb_pitch describe the whole output frame
+* as for dc1394_bayer_decoding_8bit_pitch(); rectangles are in output
+* pixels (for DC1394_BAYER_METHOD_DOWNSAMPLE those of the sx/2 x sy/2
+* image), may overlap and must lie inside the frame.
+*/
+typedef struct {
+	uint32_t x, y;
+	uint32_t width, height;
+} dc1394bayer_roi_t;
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_roi(const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order, const dc1394bayer_roi_t *rois, uint32_t num_rois);
+
+/*
+* Packed mosaics, as MIPI CSI-2 sensors send them. RAW10 stores four
+* samples in five bytes: the high eight bits of each, then one byte
+* with their low two bits, the first sample's in bits 1:0. RAW12 stores
+* two samples in three bytes: the high eight bits of each, then one byte
+* with their low four bits, the first sample's in bits 3:0. A row of sx
+* samples takes sx * 5 / 4 or sx * 3 / 2 bytes, and sx must be a
+* multiple of 4 or 2 respectively.
+*/
+typedef enum {
+	DC1394_BAYER_PACKING_RAW10 = 0,
+	DC1394_BAYER_PACKING_RAW12
+} dc1394bayer_packing_t;
+#define DC1394_BAYER_PACKING_MIN     DC1394_BAYER_PACKING_RAW10
+#define DC1394_BAYER_PACKING_MAX     DC1394_BAYER_PACKING_RAW12
+#define DC1394_BAYER_PACKING_NUM    (DC1394_BAYER_PACKING_MAX - DC1394_BAYER_PACKING_MIN + 1)
+
+/* bytes in a packed row of sx samples, 0 when sx does not fit the packing */
+size_t
+dc1394_bayer_packed_row_bytes(dc1394bayer_packing_t packing, uint32_t sx);
+
+/* the samples of a packed mosaic, one per uint16_t, LSB aligned; row y
+   starts packed_pitch * y and out_pitch * y bytes after packed and out */
+dc1394error_t
+dc1394_bayer_unpack(const uint8_t * packed, int packed_pitch, uint16_t * out, int out_pitch, uint32_t sx, uint32_t sy, dc1394bayer_packing_t packing);
+
+/*
+* Same output as dc1394_bayer_unpack() followed by
+* dc1394_bayer_decoding_16bit_pitch() with bits 10 or 12, without the
+* 16-bit frame in between: the mosaic is unpacked a few rows at a time,
+* just ahead of the rows being decoded. Packed row y starts
+* bayer_pitch * y bytes after bayer; either pitch may be negative.
+*/
+dc1394error_t
+dc1394_bayer_decoding_packed(const uint8_t * bayer, int bayer_pitch, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_packing_t packing, dc1394bayer_order_t order);
+
+dc1394error_t
+dc1394_bayer_decoding_packed_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, int bayer_pitch, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_packing_t packing, dc1394bayer_order_t order);
+
+/*
+* Output layouts besides the packed three samples per pixel written by
+* the functions above (DC1394_BAYER_LAYOUT_RGB):
+*   RGBX          four samples per pixel, the fourth opaque (255, or
+*                 (1 << bits) - 1 at 16 bits), so every pixel is one
+*                 aligned 32-bit word (64-bit at 16 bits); with
+*                 DC1394_BAYER_ORDER_BGR this is RGB32 / BGRA
+*   PLANAR        red, green and blue in three planes of one sample
+*                 per pixel
+*   PLANAR_FLOAT  the same planes as floats, each sample divided by 255
+*                 or by (1 << bits) - 1, so 0 .. 1
+*   NV12, I420    8-bit 4:2:0 YCbCr for video encoders, BT.601 with
+*                 studio swing: a Y plane at the output size, and Cb and
+*                 Cr at half the width and height, rounded up, either
+*                 interleaved in one plane (NV12) or in two (I420).
+*                 Y = 16 + ((66 R + 129 G + 25 B + 128) >> 8) per pixel,
+*                 Cb = 128 + ((-38 R - 74 G + 112 B + 512) >> 10) and
+*                 Cr = 128 + ((112 R - 94 G - 18 B + 512) >> 10) with R,
+*                 G and B summed over each 2x2 block of output pixels,
+*                 the last row or column counted twice when the size is
+*                 odd. 8-bit mosaics only.
+*/
+typedef enum {
+	DC1394_BAYER_LAYOUT_RGB = 0,
+	DC1394_BAYER_LAYOUT_RGBX,
+	DC1394_BAYER_LAYOUT_PLANAR,
+	DC1394_BAYER_LAYOUT_PLANAR_FLOAT,
+	DC1394_BAYER_LAYOUT_NV12,
+	DC1394_BAYER_LAYOUT_I420
+} dc1394bayer_layout_t;
+#define DC1394_BAYER_LAYOUT_MIN      DC1394_BAYER_LAYOUT_RGB
+#define DC1394_BAYER_LAYOUT_MAX      DC1394_BAYER_LAYOUT_I420
+#define DC1394_BAYER_LAYOUT_NUM     (DC1394_BAYER_LAYOUT_MAX - DC1394_BAYER_LAYOUT_MIN + 1)
+
+/*
+* Where a layout is written. The packed layouts use plane[0] only, with
+* their samples in order; the planar ones plane[0], plane[1] and
+* plane[2] for red, green and blue, and ignore order; NV12 plane[0] for
+* Y and plane[1] for Cb,Cr pairs, I420 plane[0], plane[1] and plane[2]
+* for Y, Cb and Cr. Row y of plane i
+* starts pitch[i] * y bytes after plane[i]; pitches may be negative and
+* must be whole samples.
+*/
+typedef struct {
+	dc1394bayer_layout_t layout;
+	dc1394bayer_order_t order;
+	void *plane[3];
+	int pitch[3];
+} dc1394bayer_output_t;
+
+/*
+* Same colours as dc1394_bayer_decoding_8bit_stride() and
+* dc1394_bayer_decoding_16bit_stride() in any layout, or, for NV12 and
+* I420, those colours converted as above. The kernel writes a
+* strip of a few rows at a time to a buffer that stays in the cache, and
+* the strip is laid out into the output right away, so the frame is still
+* written once. Mosaic row y starts bayer_pitch * y bytes after bayer.
+*/
+dc1394error_t
+dc1394_bayer_decoding_8bit_layout(const uint8_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_layout(const uint16_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_layout_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method);
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_layout_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
+
+/* Scalar reference kernels, always available */
+
+dc1394error_t
+dc1394_bayer_NearestNeighbor(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
 dc1394error_t
-dc1394_bayer_decoding_16bit(const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
\ No newline at end of file
+dc1394_bayer_HQLinear(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_EdgeSense(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_Downsample(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_Simple(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_VNG(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_AHD(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile);
+
+dc1394error_t
+dc1394_bayer_NearestNeighbor_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_Bilinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_HQLinear_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_EdgeSense_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_Downsample_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_Simple_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_VNG_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+dc1394error_t
+dc1394_bayer_AHD_uint16(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits);
+
+#endif
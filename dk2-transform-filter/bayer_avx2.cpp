@@ -0,0 +1,1175 @@
+/*
+* AVX2 Bayer decoding kernels
+*
+* Thirty-two pixel wide versions of the SSE2 kernels in bayer_sse2.cpp.
+* The arithmetic is the same; only the RGB24 interleave differs, since
+* AVX2 shuffles operate on each 128-bit lane separately.
+* The 16-bit kernels of bayer_sse41.cpp follow at sixteen pixels wide,
+* and the packed-row unpackers of bayer_unpack.cpp and the row
+* converters of bayer_layout.cpp come last.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <immintrin.h>
+#include "bayer_internal.h"
+
+static inline __m256i
+blend_avx2(__m256i mask, __m256i a, __m256i b)
+{
+	return _mm256_blendv_epi8(b, a, mask);
+}
+
+/* (a + b + c + d + 2) >> 2 on unsigned bytes, exact */
+static inline __m256i
+avg4_avx2(__m256i a, __m256i b, __m256i c, __m256i d)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi16(2);
+	__m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)),
+		_mm256_add_epi16(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero)));
+	__m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)),
+		_mm256_add_epi16(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero)));
+	lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+	hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+	return _mm256_packus_epi16(lo, hi);
+}
+
+/* one vector store; the aligned form only needs dst on a 16-byte boundary,
+   which is all a 3-byte pixel row can promise, and never splits a cache line */
+template <bool ALIGNED>
+static inline void
+store_avx2(uint8_t *dst, __m256i v)
+{
+	if (ALIGNED) {
+		_mm_store_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+		_mm_store_si128((__m128i *)(dst + 16), _mm256_extracti128_si256(v, 1));
+	}
+	else
+		_mm256_storeu_si256((__m256i *)dst, v);
+}
+
+/* interleave thirty-two R, G and B bytes into 96 bytes of packed RGB24 */
+template <bool ALIGNED = false>
+static inline void
+store_rgb24_avx2(uint8_t *dst, __m256i r, __m256i g, __m256i b)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m256i rg_lo = _mm256_unpacklo_epi8(r, g);
+	__m256i rg_hi = _mm256_unpackhi_epi8(r, g);
+	__m256i bz_lo = _mm256_unpacklo_epi8(b, zero);
+	__m256i bz_hi = _mm256_unpackhi_epi8(b, zero);
+	/* lane 0 holds pixels 0-15, lane 1 pixels 16-31 */
+	__m256i p0 = _mm256_shuffle_epi8(_mm256_unpacklo_epi16(rg_lo, bz_lo), pack);
+	__m256i p1 = _mm256_shuffle_epi8(_mm256_unpackhi_epi16(rg_lo, bz_lo), pack);
+	__m256i p2 = _mm256_shuffle_epi8(_mm256_unpacklo_epi16(rg_hi, bz_hi), pack);
+	__m256i p3 = _mm256_shuffle_epi8(_mm256_unpackhi_epi16(rg_hi, bz_hi), pack);
+	__m256i o0 = _mm256_or_si256(p0, _mm256_slli_si256(p1, 12));
+	__m256i o1 = _mm256_or_si256(_mm256_srli_si256(p1, 4), _mm256_slli_si256(p2, 8));
+	__m256i o2 = _mm256_or_si256(_mm256_srli_si256(p2, 8), _mm256_slli_si256(p3, 4));
+
+	store_avx2<ALIGNED>(dst, _mm256_permute2x128_si256(o0, o1, 0x20));
+	store_avx2<ALIGNED>(dst + 32, _mm256_permute2x128_si256(o2, o0, 0x30));
+	store_avx2<ALIGNED>(dst + 64, _mm256_permute2x128_si256(o1, o2, 0x31));
+}
+
+/* even and odd bytes of the 64 at p, in order */
+static inline void
+deinterleave_avx2(const uint8_t *p, __m256i *even, __m256i *odd)
+{
+	const __m256i lo = _mm256_set1_epi16(0x00ff);
+	__m256i a = _mm256_loadu_si256((const __m256i *)p);
+	__m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+	/* the packs interleave the lanes of a and b; the permute undoes that */
+	*even = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a, lo), _mm256_and_si256(b, lo)), 0xd8);
+	*odd = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xd8);
+}
+
+/* see avg_floor_sse2() */
+static inline __m256i
+avg_floor_avx2(__m256i a, __m256i b)
+{
+	return _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+/*
+* luma_sse2() with the red and blue products folded into one maddubs:
+* w holds the byte pair (w_own, w_opp), both small enough for its signed
+* operand. Unpack and pack both stay within each lane.
+*/
+static inline __m256i
+luma_avx2(__m256i own, __m256i g, __m256i opp, __m256i w)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i w_g = _mm256_set1_epi16(BAYER_LUMA_G);
+	const __m256i half = _mm256_set1_epi16(128);
+	__m256i lo = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_unpacklo_epi8(own, opp), w),
+		_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(g, zero), w_g), half));
+	__m256i hi = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_unpackhi_epi8(own, opp), w),
+		_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(g, zero), w_g), half));
+	return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+/* see bilinear_sse2() */
+static inline void
+bilinear_avx2(const uint8_t *p, int step, __m256i green, __m256i *own, __m256i *g, __m256i *opp)
+{
+	const uint8_t *above = p - step;
+	const uint8_t *below = p + step;
+	__m256i a = _mm256_loadu_si256((const __m256i *)above);
+	__m256i d = _mm256_loadu_si256((const __m256i *)below);
+	__m256i cl = _mm256_loadu_si256((const __m256i *)(p - 1));
+	__m256i c = _mm256_loadu_si256((const __m256i *)p);
+	__m256i cr = _mm256_loadu_si256((const __m256i *)(p + 1));
+	__m256i diag = avg4_avx2(_mm256_loadu_si256((const __m256i *)(above - 1)),
+		_mm256_loadu_si256((const __m256i *)(above + 1)),
+		_mm256_loadu_si256((const __m256i *)(below - 1)),
+		_mm256_loadu_si256((const __m256i *)(below + 1)));
+	__m256i cross = avg4_avx2(a, d, cl, cr);
+	__m256i vert = _mm256_avg_epu8(a, d);
+	__m256i horiz = _mm256_avg_epu8(cl, cr);
+
+	*own = blend_avx2(green, horiz, c);
+	*g = blend_avx2(green, c, cross);
+	*opp = blend_avx2(green, vert, diag);
+}
+
+/* OpenCV's Bayer decoding, thirty-two pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_border_rows(bayer, rgb, sx, sy, tile, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m256i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = ((1 + green_x) & 1) ? _mm256_set1_epi16((short)0xff00) : _mm256_set1_epi16(0x00ff);
+
+		for (x = 1; x + 32 <= sx - 1; x += 32) {
+			__m256i own, g, opp;
+
+			bilinear_avx2(cur + x, bayerStep, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb24_avx2(out + 3 * x, own, g, opp);
+			else
+				store_rgb24_avx2(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_bilinear_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* dc1394_bayer_Bilinear_luma, thirty-two pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_avx2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_luma_border_rows(bayer, luma, sx, sy, tile, bayerStep, lumaStep, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = luma + y * lumaStep;
+		int green_x, red_row;
+		__m256i green, w;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		green = ((1 + green_x) & 1) ? _mm256_set1_epi16((short)0xff00) : _mm256_set1_epi16(0x00ff);
+		w = _mm256_set1_epi16(red_row ? BAYER_LUMA_R | (BAYER_LUMA_B << 8) : BAYER_LUMA_B | (BAYER_LUMA_R << 8));
+
+		for (x = 1; x + 32 <= sx - 1; x += 32) {
+			__m256i own, g, opp;
+
+			bilinear_avx2(cur + x, bayerStep, green, &own, &g, &opp);
+			_mm256_storeu_si256((__m256i *)(out + x), luma_avx2(own, g, opp, w));
+		}
+
+		for (; x < sx - 1; x++)
+			out[x] = bayer_bilinear_luma_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* see downsample_sse2() */
+static inline void
+downsample_avx2(const uint8_t *p, int step, int green_first, int r_out, uint8_t *out)
+{
+	__m256i e0, o0, e1, o1, g, other;
+
+	deinterleave_avx2(p, &e0, &o0);
+	deinterleave_avx2(p + step, &e1, &o1);
+	if (green_first) {
+		g = avg_floor_avx2(e0, o1);
+		other = e1;
+	}
+	else {
+		g = avg_floor_avx2(e1, o0);
+		other = e0;
+	}
+	if (r_out == 0)
+		store_rgb24_avx2(out, o1, g, other);
+	else
+		store_rgb24_avx2(out, other, g, o1);
+}
+
+/* coriander's Bayer decoding, thirty-two output pixels per step */
+dc1394error_t
+dc1394_bayer_Downsample_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int last = y1 < sy ? y1 : sy;
+	int green_first, r_out;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_downsample_phase(tile, order, &green_first, &r_out);
+
+	for (y = y0; y < last; y += 2) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + (y >> 1) * rgbStep;
+
+		for (x = 0; x + 64 <= sx; x += 64)
+			downsample_avx2(cur + x, bayerStep, green_first, r_out, out + 3 * (x >> 1));
+
+		for (; x < sx; x += 2)
+			bayer_downsample_pixel(cur + x, bayerStep, green_first, r_out, out + 3 * (x >> 1));
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* see hq_sites_sse2_t */
+typedef struct {
+	__m256i n2, nw, n, ne, w2, w, c, e, e2, sw, s, se, s2;
+} hq_sites_avx2_t;
+
+/* bytes 0, 2, .. 30 and 1, 3, .. 31 of the thirty-two at p as 16-bit lanes */
+static inline void
+widen_pairs_avx2(const uint8_t *p, __m256i *even, __m256i *odd)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *)p);
+
+	*even = _mm256_and_si256(v, _mm256_set1_epi16(0x00ff));
+	*odd = _mm256_srli_epi16(v, 8);
+}
+
+static inline void
+hq_sites_avx2(const uint8_t *p, int step, hq_sites_avx2_t *a, hq_sites_avx2_t *b)
+{
+	__m256i l0, l1, m0, m1, r0, r1;
+
+	widen_pairs_avx2(p - 2 * step, &a->n2, &b->n2);
+	widen_pairs_avx2(p + 2 * step, &a->s2, &b->s2);
+
+	widen_pairs_avx2(p - step - 2, &l0, &l1);
+	widen_pairs_avx2(p - step, &m0, &m1);
+	widen_pairs_avx2(p - step + 2, &r0, &r1);
+	a->nw = l1; a->n = m0; a->ne = m1;
+	b->nw = m0; b->n = m1; b->ne = r0;
+
+	widen_pairs_avx2(p + step - 2, &l0, &l1);
+	widen_pairs_avx2(p + step, &m0, &m1);
+	widen_pairs_avx2(p + step + 2, &r0, &r1);
+	a->sw = l1; a->s = m0; a->se = m1;
+	b->sw = m0; b->s = m1; b->se = r0;
+
+	widen_pairs_avx2(p - 2, &l0, &l1);
+	widen_pairs_avx2(p, &m0, &m1);
+	widen_pairs_avx2(p + 2, &r0, &r1);
+	a->w2 = l0; a->w = l1; a->c = m0; a->e = m1; a->e2 = r0;
+	b->w2 = l1; b->w = m0; b->c = m1; b->e = r0; b->e2 = r1;
+}
+
+/* see hq_green_sse2() */
+static inline void
+hq_green_avx2(const hq_sites_avx2_t *q, __m256i *vert, __m256i *horiz)
+{
+	__m256i diag = _mm256_add_epi16(_mm256_add_epi16(q->nw, q->ne), _mm256_add_epi16(q->sw, q->se));
+	__m256i base = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(q->c, 2), q->c), _mm256_set1_epi16(4)), diag);
+	__m256i v = _mm256_add_epi16(base, _mm256_slli_epi16(_mm256_add_epi16(q->n, q->s), 2));
+	__m256i h = _mm256_add_epi16(base, _mm256_slli_epi16(_mm256_add_epi16(q->w, q->e), 2));
+
+	v = _mm256_add_epi16(_mm256_sub_epi16(v, _mm256_add_epi16(q->n2, q->s2)), _mm256_avg_epu16(q->w2, q->e2));
+	h = _mm256_add_epi16(_mm256_sub_epi16(h, _mm256_add_epi16(q->w2, q->e2)), _mm256_avg_epu16(q->n2, q->s2));
+	*vert = _mm256_srai_epi16(v, 3);
+	*horiz = _mm256_srai_epi16(h, 3);
+}
+
+/* see hq_colour_sse2() */
+static inline void
+hq_colour_avx2(const hq_sites_avx2_t *q, __m256i *opp, __m256i *g)
+{
+	__m256i diag = _mm256_add_epi16(_mm256_add_epi16(q->nw, q->ne), _mm256_add_epi16(q->sw, q->se));
+	__m256i cross = _mm256_add_epi16(_mm256_add_epi16(q->n, q->w), _mm256_add_epi16(q->e, q->s));
+	__m256i far = _mm256_add_epi16(_mm256_add_epi16(q->n2, q->w2), _mm256_add_epi16(q->e2, q->s2));
+	__m256i far3 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(far, _mm256_slli_epi16(far, 1)), _mm256_set1_epi16(1)), 1);
+	__m256i c4 = _mm256_add_epi16(_mm256_slli_epi16(q->c, 2), _mm256_set1_epi16(4));
+	__m256i o = _mm256_add_epi16(_mm256_sub_epi16(_mm256_slli_epi16(diag, 1), far3), _mm256_add_epi16(c4, _mm256_slli_epi16(q->c, 1)));
+	__m256i t = _mm256_add_epi16(_mm256_sub_epi16(_mm256_slli_epi16(cross, 1), far), c4);
+
+	*opp = _mm256_srai_epi16(o, 3);
+	*g = _mm256_srai_epi16(t, 3);
+}
+
+/* see interleave_sse2(); pack and unpack both stay within each lane, so
+   the pixels come out in order */
+static inline __m256i
+interleave_avx2(__m256i a, __m256i b)
+{
+	return _mm256_unpacklo_epi8(_mm256_packus_epi16(a, a), _mm256_packus_epi16(b, b));
+}
+
+/* dc1394_bayer_HQLinear_rows_sse2, thirty-two pixels per step */
+dc1394error_t
+dc1394_bayer_HQLinear_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_HQLinear_border_rows(bayer, rgb, sx, sy, tile, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row, own;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		own = (red_row ^ (order == DC1394_BAYER_ORDER_BGR)) ? 0 : 2;
+
+		for (x = 2; x + 32 <= sx - 2; x += 32) {
+			hq_sites_avx2_t a, b;
+			__m256i vert, horiz, opp, g, own_v, opp_v, green_v;
+
+			hq_sites_avx2(cur + x, bayerStep, &a, &b);
+			if (green_x == 0) {
+				hq_green_avx2(&a, &vert, &horiz);
+				hq_colour_avx2(&b, &opp, &g);
+				own_v = interleave_avx2(horiz, b.c);
+				opp_v = interleave_avx2(vert, opp);
+				green_v = interleave_avx2(a.c, g);
+			}
+			else {
+				hq_colour_avx2(&a, &opp, &g);
+				hq_green_avx2(&b, &vert, &horiz);
+				own_v = interleave_avx2(a.c, horiz);
+				opp_v = interleave_avx2(opp, vert);
+				green_v = interleave_avx2(g, b.c);
+			}
+			if (own == 0)
+				store_rgb24_avx2(out + 3 * x, own_v, green_v, opp_v);
+			else
+				store_rgb24_avx2(out + 3 * x, opp_v, green_v, own_v);
+		}
+
+		for (; x < sx - 2; x++)
+			bayer_hqlinear_pixel(cur + x, bayerStep, (x & 1) == green_x, own, 255, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/*
+* See bilinear_rows_fixed_sse2(). A row of thirty-two pixel vectors
+* that does not come out even ends with one that overlaps the previous
+* vector by a multiple of sixteen pixels, so its stores stay aligned.
+*/
+template <int SX, int SY>
+static dc1394error_t
+bilinear_rows_fixed_avx2(const uint8_t * bayer, uint8_t * rgb, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int m0, m1, x, y;
+
+	static_assert(SX % 16 == 0 && SX >= 32, "rows must be whole vectors");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_wrap_rows(SY, y0, y1, &m0, &m1);
+	if (bayerStep != SX || !bayer_aligned16(rgb, rgbStep) || m0 >= m1)
+		return dc1394_bayer_Bilinear_rows_avx2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, y1);
+	dc1394_bayer_Bilinear_rows_avx2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, m0);
+	dc1394_bayer_Bilinear_rows_avx2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, m1, y1);
+
+	for (y = m0; y < m1; y++) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m256i green, own, g, opp;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = green_x ? _mm256_set1_epi16((short)0xff00) : _mm256_set1_epi16(0x00ff);
+
+		for (x = 0; x + 32 <= SX; x += 32) {
+			bilinear_avx2(cur + x, SX, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb24_avx2<true>(out + 3 * x, own, g, opp);
+			else
+				store_rgb24_avx2<true>(out + 3 * x, opp, g, own);
+		}
+		if (SX % 32) {
+			bilinear_avx2(cur + SX - 32, SX, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb24_avx2<true>(out + 3 * (SX - 32), own, g, opp);
+			else
+				store_rgb24_avx2<true>(out + 3 * (SX - 32), opp, g, own);
+		}
+	}
+
+	dc1394_bayer_Bilinear_border_rows(bayer, rgb, SX, SY, tile, SX, rgbStep, order, m0, m1);
+	return DC1394_SUCCESS;
+}
+
+template <int SX, int SY>
+static dc1394error_t
+bilinear_luma_rows_fixed_avx2(const uint8_t * bayer, uint8_t * luma, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	int m0, m1, x, y;
+
+	static_assert(SX % 16 == 0 && SX >= 32, "rows must be whole vectors");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_wrap_rows(SY, y0, y1, &m0, &m1);
+	if (bayerStep != SX || !bayer_aligned16(luma, lumaStep) || m0 >= m1)
+		return dc1394_bayer_Bilinear_luma_rows_avx2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, y0, y1);
+	dc1394_bayer_Bilinear_luma_rows_avx2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, y0, m0);
+	dc1394_bayer_Bilinear_luma_rows_avx2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, m1, y1);
+
+	for (y = m0; y < m1; y++) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = luma + y * lumaStep;
+		int green_x, red_row;
+		__m256i green, w, own, g, opp;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		green = green_x ? _mm256_set1_epi16((short)0xff00) : _mm256_set1_epi16(0x00ff);
+		w = _mm256_set1_epi16(red_row ? BAYER_LUMA_R | (BAYER_LUMA_B << 8) : BAYER_LUMA_B | (BAYER_LUMA_R << 8));
+
+		for (x = 0; x + 32 <= SX; x += 32) {
+			bilinear_avx2(cur + x, SX, green, &own, &g, &opp);
+			store_avx2<true>(out + x, luma_avx2(own, g, opp, w));
+		}
+		if (SX % 32) {
+			bilinear_avx2(cur + SX - 32, SX, green, &own, &g, &opp);
+			store_avx2<true>(out + SX - 32, luma_avx2(own, g, opp, w));
+		}
+	}
+
+	dc1394_bayer_Bilinear_luma_border_rows(bayer, luma, SX, SY, tile, SX, lumaStep, m0, m1);
+	return DC1394_SUCCESS;
+}
+
+template <int SX, int SY>
+static dc1394error_t
+downsample_rows_fixed_avx2(const uint8_t * bayer, uint8_t * rgb, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int last = y1 < SY ? y1 : SY;
+	int green_first, r_out;
+	int x, y;
+
+	static_assert(SX % 2 == 0 && SX >= 64, "rows must hold a vector of cells");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if (bayerStep != SX)
+		return dc1394_bayer_Downsample_rows_avx2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, y1);
+
+	bayer_downsample_phase(tile, order, &green_first, &r_out);
+
+	for (y = y0; y < last; y += 2) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = rgb + (y >> 1) * rgbStep;
+
+		for (x = 0; x + 64 <= SX; x += 64)
+			downsample_avx2(cur + x, SX, green_first, r_out, out + 3 * (x >> 1));
+		if (SX % 64)
+			downsample_avx2(cur + SX - 64, SX, green_first, r_out, out + 3 * ((SX - 64) >> 1));
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* 16-bit mosaics, sixteen pixels per step: see bayer_sse41.cpp */
+
+static inline __m256i
+load16_avx2(const uint16_t *p)
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+/* see avg_floor_sse41() */
+static inline __m256i
+avg_floor16_avx2(__m256i a, __m256i b)
+{
+	return _mm256_sub_epi16(_mm256_avg_epu16(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi16(1)));
+}
+
+/* see avg4_sse41() */
+static inline __m256i
+avg4_16_avx2(__m256i a, __m256i b, __m256i c, __m256i d)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i p = avg_floor16_avx2(a, b);
+	__m256i q = avg_floor16_avx2(c, d);
+	__m256i low = _mm256_and_si256(_mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), one);
+
+	return _mm256_add_epi16(_mm256_avg_epu16(p, q), _mm256_andnot_si256(_mm256_xor_si256(p, q), low));
+}
+
+/*
+* interleave sixteen R, G and B samples into 48 samples of packed RGB48:
+* the shuffles of store_rgb48_sse41() give pixels 0-7 in the lower lanes
+* and 8-15 in the upper ones, which are then stored in order
+*/
+static inline void
+store_rgb48_avx2(uint16_t *dst, __m256i r, __m256i g, __m256i b)
+{
+	const __m256i r0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1));
+	const __m256i g0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5));
+	const __m256i b0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1));
+	const __m256i r1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11));
+	const __m256i g1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1));
+	const __m256i b1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1));
+	const __m256i r2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1));
+	const __m256i g2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1));
+	const __m256i b2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15));
+	__m256i o0 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r0), _mm256_shuffle_epi8(g, g0)), _mm256_shuffle_epi8(b, b0));
+	__m256i o1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r1), _mm256_shuffle_epi8(g, g1)), _mm256_shuffle_epi8(b, b1));
+	__m256i o2 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, r2), _mm256_shuffle_epi8(g, g2)), _mm256_shuffle_epi8(b, b2));
+
+	_mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(o0, o1, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_permute2x128_si256(o2, o0, 0x30));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(o1, o2, 0x31));
+}
+
+/* see green_lanes_sse41() */
+static inline __m256i
+green_lanes16_avx2(int x, int green_x)
+{
+	return ((x + green_x) & 1) ? _mm256_set1_epi32((int)0xffff0000) : _mm256_set1_epi32(0x0000ffff);
+}
+
+/* dc1394_bayer_Simple_uint16_rows_sse41, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_Simple_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	const int maxval = (1 << bits) - 1;
+	const __m256i maxv = _mm256_set1_epi16((short)maxval);
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Simple_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = y0; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m256i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = green_lanes16_avx2(0, green_x);
+
+		for (x = 0; x + 16 <= sx - 1; x += 16) {
+			__m256i a = load16_avx2(cur + x);
+			__m256i b = load16_avx2(cur + x + 1);
+			__m256i c = load16_avx2(cur + bayerStep + x);
+			__m256i d = load16_avx2(cur + bayerStep + x + 1);
+			__m256i g = blend_avx2(green, avg_floor16_avx2(a, d), avg_floor16_avx2(b, c));
+			__m256i own = _mm256_min_epu16(blend_avx2(green, b, a), maxv);
+			__m256i opp = _mm256_min_epu16(blend_avx2(green, c, d), maxv);
+
+			g = _mm256_min_epu16(g, maxv);
+			if (red_row)
+				store_rgb48_avx2(out + 3 * x, own, g, opp);
+			else
+				store_rgb48_avx2(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_simple_uint16_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, maxval, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* see bilinear_sse41() */
+static inline void
+bilinear16_avx2(const uint16_t *p, int step, __m256i green, __m256i *own, __m256i *g, __m256i *opp)
+{
+	const uint16_t *above = p - step;
+	const uint16_t *below = p + step;
+	__m256i a = load16_avx2(above);
+	__m256i d = load16_avx2(below);
+	__m256i cl = load16_avx2(p - 1);
+	__m256i c = load16_avx2(p);
+	__m256i cr = load16_avx2(p + 1);
+	__m256i diag = avg4_16_avx2(load16_avx2(above - 1), load16_avx2(above + 1),
+		load16_avx2(below - 1), load16_avx2(below + 1));
+	__m256i cross = avg4_16_avx2(a, d, cl, cr);
+
+	*own = blend_avx2(green, _mm256_avg_epu16(cl, cr), c);
+	*g = blend_avx2(green, c, cross);
+	*opp = blend_avx2(green, _mm256_avg_epu16(a, d), diag);
+}
+
+/* dc1394_bayer_Bilinear_uint16_rows_sse41, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m256i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = green_lanes16_avx2(1, green_x);
+
+		for (x = 1; x + 16 <= sx - 1; x += 16) {
+			__m256i own, g, opp;
+
+			bilinear16_avx2(cur + x, bayerStep, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb48_avx2(out + 3 * x, own, g, opp);
+			else
+				store_rgb48_avx2(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_bilinear_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* see hq_sites_sse41_t; eight sites of one colour per register */
+typedef struct {
+	__m256i n2, nw, n, ne, w2, w, c, e, e2, sw, s, se, s2;
+} hq_sites16_avx2_t;
+
+/* samples 0, 2, .. 14 and 1, 3, .. 15 of the sixteen at p as 32-bit lanes */
+static inline void
+widen_pairs16_avx2(const uint16_t *p, __m256i *even, __m256i *odd)
+{
+	__m256i v = load16_avx2(p);
+
+	*even = _mm256_blend_epi16(v, _mm256_setzero_si256(), 0xaa);
+	*odd = _mm256_srli_epi32(v, 16);
+}
+
+static inline void
+hq_sites16_avx2(const uint16_t *p, int step, hq_sites16_avx2_t *a, hq_sites16_avx2_t *b)
+{
+	__m256i l0, l1, m0, m1, r0, r1;
+
+	widen_pairs16_avx2(p - 2 * step, &a->n2, &b->n2);
+	widen_pairs16_avx2(p + 2 * step, &a->s2, &b->s2);
+
+	widen_pairs16_avx2(p - step - 2, &l0, &l1);
+	widen_pairs16_avx2(p - step, &m0, &m1);
+	widen_pairs16_avx2(p - step + 2, &r0, &r1);
+	a->nw = l1; a->n = m0; a->ne = m1;
+	b->nw = m0; b->n = m1; b->ne = r0;
+
+	widen_pairs16_avx2(p + step - 2, &l0, &l1);
+	widen_pairs16_avx2(p + step, &m0, &m1);
+	widen_pairs16_avx2(p + step + 2, &r0, &r1);
+	a->sw = l1; a->s = m0; a->se = m1;
+	b->sw = m0; b->s = m1; b->se = r0;
+
+	widen_pairs16_avx2(p - 2, &l0, &l1);
+	widen_pairs16_avx2(p, &m0, &m1);
+	widen_pairs16_avx2(p + 2, &r0, &r1);
+	a->w2 = l0; a->w = l1; a->c = m0; a->e = m1; a->e2 = r0;
+	b->w2 = l1; b->w = m0; b->c = m1; b->e = r0; b->e2 = r1;
+}
+
+/* see hq_green_sse41() */
+static inline void
+hq_green16_avx2(const hq_sites16_avx2_t *q, __m256i *vert, __m256i *horiz)
+{
+	__m256i diag = _mm256_add_epi32(_mm256_add_epi32(q->nw, q->ne), _mm256_add_epi32(q->sw, q->se));
+	__m256i base = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(q->c, 2), q->c), _mm256_set1_epi32(4)), diag);
+	__m256i v = _mm256_add_epi32(base, _mm256_slli_epi32(_mm256_add_epi32(q->n, q->s), 2));
+	__m256i h = _mm256_add_epi32(base, _mm256_slli_epi32(_mm256_add_epi32(q->w, q->e), 2));
+
+	v = _mm256_add_epi32(_mm256_sub_epi32(v, _mm256_add_epi32(q->n2, q->s2)), _mm256_avg_epu16(q->w2, q->e2));
+	h = _mm256_add_epi32(_mm256_sub_epi32(h, _mm256_add_epi32(q->w2, q->e2)), _mm256_avg_epu16(q->n2, q->s2));
+	*vert = _mm256_srai_epi32(v, 3);
+	*horiz = _mm256_srai_epi32(h, 3);
+}
+
+/* see hq_colour_sse41() */
+static inline void
+hq_colour16_avx2(const hq_sites16_avx2_t *q, __m256i *opp, __m256i *g)
+{
+	__m256i diag = _mm256_add_epi32(_mm256_add_epi32(q->nw, q->ne), _mm256_add_epi32(q->sw, q->se));
+	__m256i cross = _mm256_add_epi32(_mm256_add_epi32(q->n, q->w), _mm256_add_epi32(q->e, q->s));
+	__m256i far = _mm256_add_epi32(_mm256_add_epi32(q->n2, q->w2), _mm256_add_epi32(q->e2, q->s2));
+	__m256i far3 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(far, _mm256_slli_epi32(far, 1)), _mm256_set1_epi32(1)), 1);
+	__m256i c4 = _mm256_add_epi32(_mm256_slli_epi32(q->c, 2), _mm256_set1_epi32(4));
+	__m256i o = _mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(diag, 1), far3), _mm256_add_epi32(c4, _mm256_slli_epi32(q->c, 1)));
+	__m256i t = _mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(cross, 1), far), c4);
+
+	*opp = _mm256_srai_epi32(o, 3);
+	*g = _mm256_srai_epi32(t, 3);
+}
+
+static inline __m256i
+clamp16_avx2(__m256i v, __m256i maxv)
+{
+	return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), maxv);
+}
+
+/* see interleave_sse41(); the 32-bit lanes never cross a 128-bit one */
+static inline __m256i
+interleave16_avx2(__m256i a, __m256i b)
+{
+	return _mm256_or_si256(a, _mm256_slli_epi32(b, 16));
+}
+
+/* dc1394_bayer_HQLinear_uint16_rows_sse41, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_HQLinear_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	const int maxval = (1 << bits) - 1;
+	const __m256i maxv = _mm256_set1_epi32(maxval);
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_HQLinear_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row, own;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		own = (red_row ^ (order == DC1394_BAYER_ORDER_BGR)) ? 0 : 2;
+
+		for (x = 2; x + 16 <= sx - 2; x += 16) {
+			hq_sites16_avx2_t a, b;
+			__m256i vert, horiz, opp, g, own_v, opp_v, green_v;
+
+			hq_sites16_avx2(cur + x, bayerStep, &a, &b);
+			if (green_x == 0) {
+				hq_green16_avx2(&a, &vert, &horiz);
+				hq_colour16_avx2(&b, &opp, &g);
+				own_v = interleave16_avx2(clamp16_avx2(horiz, maxv), b.c);
+				opp_v = interleave16_avx2(clamp16_avx2(vert, maxv), clamp16_avx2(opp, maxv));
+				green_v = interleave16_avx2(a.c, clamp16_avx2(g, maxv));
+			}
+			else {
+				hq_colour16_avx2(&a, &opp, &g);
+				hq_green16_avx2(&b, &vert, &horiz);
+				own_v = interleave16_avx2(a.c, clamp16_avx2(horiz, maxv));
+				opp_v = interleave16_avx2(clamp16_avx2(opp, maxv), clamp16_avx2(vert, maxv));
+				green_v = interleave16_avx2(clamp16_avx2(g, maxv), b.c);
+			}
+			if (own == 0)
+				store_rgb48_avx2(out + 3 * x, own_v, green_v, opp_v);
+			else
+				store_rgb48_avx2(out + 3 * x, opp_v, green_v, own_v);
+		}
+
+		for (; x < sx - 2; x++)
+			bayer_hqlinear_pixel(cur + x, bayerStep, (x & 1) == green_x, own, maxval, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* packed rows: each 128-bit lane expands one group of eight samples */
+
+/* the group at packed in the lower lane, the next one in the upper */
+static inline __m256i
+load_groups_avx2(const uint8_t *packed, int group_bytes)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)packed)),
+		_mm_loadu_si128((const __m128i *)(packed + group_bytes)), 1);
+}
+
+/* (high << low_bits) | ((low * mult) >> (8 - low_bits)) & ((1 << low_bits) - 1),
+   where mult moves the sample's low bits to the top of the low byte */
+static inline __m256i
+merge_low_bits_avx2(__m256i bytes, __m256i high_shuf, __m256i low_shuf, __m256i mult, int low_bits)
+{
+	__m256i high = _mm256_shuffle_epi8(bytes, high_shuf);
+	__m256i low = _mm256_mullo_epi16(_mm256_shuffle_epi8(bytes, low_shuf), mult);
+
+	low = _mm256_and_si256(_mm256_srli_epi16(low, 8 - low_bits), _mm256_set1_epi16((short)((1 << low_bits) - 1)));
+	return _mm256_or_si256(_mm256_slli_epi16(high, low_bits), low);
+}
+
+void
+dc1394_bayer_unpack_raw10_avx2(const uint8_t * packed, uint16_t * out, int n)
+{
+	/* sample k of a lane: high bits in byte k + k / 4, low bits in byte 5 * (k / 4) + 4 */
+	const __m256i high_shuf = _mm256_setr_epi8(
+		0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1,
+		0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+	const __m256i low_shuf = _mm256_setr_epi8(
+		4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1,
+		4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+	const __m256i mult = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1);
+	int i;
+
+	/* the upper lane loads 16 bytes from byte 10 of 20, so stop short of the row end */
+	for (i = 0; i + 24 <= n; i += 16, packed += 20)
+		_mm256_storeu_si256((__m256i *)(out + i), merge_low_bits_avx2(load_groups_avx2(packed, 10), high_shuf, low_shuf, mult, 2));
+	dc1394_bayer_unpack_raw10(packed, out + i, n - i);
+}
+
+void
+dc1394_bayer_unpack_raw12_avx2(const uint8_t * packed, uint16_t * out, int n)
+{
+	/* sample k of a lane: high bits in byte k + k / 2, low bits in byte 3 * (k / 2) + 2 */
+	const __m256i high_shuf = _mm256_setr_epi8(
+		0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1,
+		0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+	const __m256i low_shuf = _mm256_setr_epi8(
+		2, -1, 2, -1, 5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1,
+		2, -1, 2, -1, 5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1);
+	const __m256i mult = _mm256_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1);
+	int i;
+
+	/* the upper lane loads 16 bytes from byte 12 of 24 */
+	for (i = 0; i + 20 <= n; i += 16, packed += 24)
+		_mm256_storeu_si256((__m256i *)(out + i), merge_low_bits_avx2(load_groups_avx2(packed, 12), high_shuf, low_shuf, mult, 4));
+	dc1394_bayer_unpack_raw12(packed, out + i, n - i);
+}
+
+/* layout converters: each 128-bit lane handles its own run of pixels */
+
+/* for byte k of channel c, the byte of chunk j of 16 that holds it */
+static const int8_t deinterleave8_masks[3][3][16] = {
+	{ { 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 } },
+	{ { 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 } },
+	{ { 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 } },
+};
+
+/* the same for 16-bit samples, two bytes each */
+static const int8_t deinterleave16_masks[3][3][16] = {
+	{ { 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, 10, 11 } },
+	{ { 2, 3, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, 4, 5, 10, 11, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7, 12, 13 } },
+	{ { 4, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15 } },
+};
+
+/* the three samples of 96 bytes of packed pixels, the first 48 bytes'
+   in the lower lanes and the last 48 bytes' in the upper */
+static inline void
+deinterleave_avx2(const uint8_t *rgb, const int8_t masks[3][3][16], __m256i plane[3])
+{
+	__m256i chunk[3];
+	int c, j;
+
+	for (j = 0; j < 3; j++)
+		chunk[j] = load_groups_avx2(rgb + 16 * j, 48);
+	for (c = 0; c < 3; c++) {
+		__m256i v = _mm256_setzero_si256();
+
+		for (j = 0; j < 3; j++)
+			v = _mm256_or_si256(v, _mm256_shuffle_epi8(chunk[j],
+				_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)masks[c][j]))));
+		plane[c] = v;
+	}
+}
+
+void
+dc1394_bayer_convert_rgbx8_avx2(const uint8_t * rgb, void * const * dst, int n)
+{
+	const __m256i spread = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000u);
+	uint8_t *out = (uint8_t *)dst[0];
+	int i;
+
+	/* four pixels per lane; the last lane loads 16 bytes from byte 36 of 48 */
+	for (i = 0; i + 18 <= n; i += 16, rgb += 48, out += 64) {
+		__m256i lo = load_groups_avx2(rgb, 12), hi = load_groups_avx2(rgb + 24, 12);
+
+		_mm256_storeu_si256((__m256i *)out, _mm256_or_si256(_mm256_shuffle_epi8(lo, spread), alpha));
+		_mm256_storeu_si256((__m256i *)(out + 32), _mm256_or_si256(_mm256_shuffle_epi8(hi, spread), alpha));
+	}
+	{
+		void *tail = out;
+		dc1394_bayer_convert_rgbx8(rgb, &tail, n - i);
+	}
+}
+
+void
+dc1394_bayer_convert_planar8_avx2(const uint8_t * rgb, void * const * dst, int n)
+{
+	uint8_t *out[3] = { (uint8_t *)dst[0], (uint8_t *)dst[1], (uint8_t *)dst[2] };
+	int i, c;
+
+	for (i = 0; i + 32 <= n; i += 32, rgb += 96) {
+		__m256i plane[3];
+
+		deinterleave_avx2(rgb, deinterleave8_masks, plane);
+		for (c = 0; c < 3; c++)
+			_mm256_storeu_si256((__m256i *)(out[c] + i), plane[c]);
+	}
+	{
+		void *tail[3] = { out[0] + i, out[1] + i, out[2] + i };
+		dc1394_bayer_convert_planar8(rgb, tail, n - i);
+	}
+}
+
+void
+dc1394_bayer_convert_float8_avx2(const uint8_t * rgb, void * const * dst, int n)
+{
+	const __m256 scale = _mm256_set1_ps(255.0f);
+	float *out[3] = { (float *)dst[0], (float *)dst[1], (float *)dst[2] };
+	int i, c, k;
+
+	/* divided rather than multiplied by 1/255, to round as the scalar code does */
+	for (i = 0; i + 32 <= n; i += 32, rgb += 96) {
+		__m256i plane[3];
+
+		deinterleave_avx2(rgb, deinterleave8_masks, plane);
+		for (c = 0; c < 3; c++) {
+			__m128i half[2] = { _mm256_castsi256_si128(plane[c]), _mm256_extracti128_si256(plane[c], 1) };
+
+			for (k = 0; k < 4; k++) {
+				__m128i bytes = k & 1 ? _mm_srli_si128(half[k >> 1], 8) : half[k >> 1];
+				__m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+
+				_mm256_storeu_ps(out[c] + i + 8 * k, _mm256_div_ps(v, scale));
+			}
+		}
+	}
+	{
+		void *tail[3] = { out[0] + i, out[1] + i, out[2] + i };
+		dc1394_bayer_convert_float8(rgb, tail, n - i);
+	}
+}
+
+void
+dc1394_bayer_convert_rgbx16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	const __m256i spread = _mm256_setr_epi8(
+		0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1,
+		0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+	const __m256i alpha = _mm256_set1_epi64x((int64_t)(uint16_t)maxval << 48);
+	uint16_t *out = (uint16_t *)dst[0];
+	int i;
+
+	/* two pixels per lane; the last lane loads 16 bytes from byte 36 of 48 */
+	for (i = 0; i + 9 <= n; i += 8, rgb += 24, out += 32) {
+		__m256i lo = load_groups_avx2((const uint8_t *)rgb, 12), hi = load_groups_avx2((const uint8_t *)(rgb + 12), 12);
+
+		_mm256_storeu_si256((__m256i *)out, _mm256_or_si256(_mm256_shuffle_epi8(lo, spread), alpha));
+		_mm256_storeu_si256((__m256i *)(out + 16), _mm256_or_si256(_mm256_shuffle_epi8(hi, spread), alpha));
+	}
+	{
+		void *tail = out;
+		dc1394_bayer_convert_rgbx16(rgb, &tail, n - i, maxval);
+	}
+}
+
+void
+dc1394_bayer_convert_planar16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	uint16_t *out[3] = { (uint16_t *)dst[0], (uint16_t *)dst[1], (uint16_t *)dst[2] };
+	int i, c;
+
+	for (i = 0; i + 16 <= n; i += 16, rgb += 48) {
+		__m256i plane[3];
+
+		deinterleave_avx2((const uint8_t *)rgb, deinterleave16_masks, plane);
+		for (c = 0; c < 3; c++)
+			_mm256_storeu_si256((__m256i *)(out[c] + i), plane[c]);
+	}
+	{
+		void *tail[3] = { out[0] + i, out[1] + i, out[2] + i };
+		dc1394_bayer_convert_planar16(rgb, tail, n - i, maxval);
+	}
+}
+
+void
+dc1394_bayer_convert_float16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	const __m256 scale = _mm256_set1_ps((float)maxval);
+	float *out[3] = { (float *)dst[0], (float *)dst[1], (float *)dst[2] };
+	int i, c;
+
+	for (i = 0; i + 16 <= n; i += 16, rgb += 48) {
+		__m256i plane[3];
+
+		deinterleave_avx2((const uint8_t *)rgb, deinterleave16_masks, plane);
+		for (c = 0; c < 3; c++) {
+			__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(plane[c])));
+			__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(plane[c], 1)));
+
+			_mm256_storeu_ps(out[c] + i, _mm256_div_ps(lo, scale));
+			_mm256_storeu_ps(out[c] + i + 8, _mm256_div_ps(hi, scale));
+		}
+	}
+	{
+		void *tail[3] = { out[0] + i, out[1] + i, out[2] + i };
+		dc1394_bayer_convert_float16(rgb, tail, n - i, maxval);
+	}
+}
+
+/* 16 + ((66 R + 129 G + 25 B + 128) >> 8) for 32 pixels; the sum fits
+   16 bits unsigned */
+static inline __m256i
+studio_luma_avx2(const __m256i rgb[3])
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i y[2];
+	int h;
+
+	for (h = 0; h < 2; h++) {
+		__m256i r = h ? _mm256_unpackhi_epi8(rgb[0], zero) : _mm256_unpacklo_epi8(rgb[0], zero);
+		__m256i g = h ? _mm256_unpackhi_epi8(rgb[1], zero) : _mm256_unpacklo_epi8(rgb[1], zero);
+		__m256i b = h ? _mm256_unpackhi_epi8(rgb[2], zero) : _mm256_unpacklo_epi8(rgb[2], zero);
+		__m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+			_mm256_mullo_epi16(g, _mm256_set1_epi16(129))),
+			_mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(25)), _mm256_set1_epi16(128)));
+
+		y[h] = _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+	}
+	return _mm256_packus_epi16(y[0], y[1]);
+}
+
+/* 128 + ((kr R + kg G + kb B + 512) >> 10) on sixteen 2x2 sums */
+static inline __m256i
+studio_chroma_avx2(__m256i r, __m256i g, __m256i b, int kr, int kg, int kb)
+{
+	const __m256i krg = _mm256_set1_epi32((int)((uint32_t)(uint16_t)kg << 16 | (uint16_t)kr));
+	const __m256i kb0 = _mm256_set1_epi32((uint16_t)kb);
+	const __m256i offset = _mm256_set1_epi32((128 << 10) + 512);
+	__m256i lo = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), krg),
+		_mm256_madd_epi16(_mm256_unpacklo_epi16(b, _mm256_setzero_si256()), kb0)), offset);
+	__m256i hi = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), krg),
+		_mm256_madd_epi16(_mm256_unpackhi_epi16(b, _mm256_setzero_si256()), kb0)), offset);
+
+	return _mm256_packs_epi32(_mm256_srli_epi32(lo, 10), _mm256_srli_epi32(hi, 10));
+}
+
+void
+dc1394_bayer_convert_yuv_avx2(const uint8_t * rgb0, const uint8_t * rgb1, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, int uv_inc, int n)
+{
+	const __m256i ones = _mm256_set1_epi8(1);
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i top[3], bottom[3], sum[3], uv;
+		__m128i cb, cr;
+		int c;
+
+		deinterleave_avx2(rgb0 + 3 * i, deinterleave8_masks, top);
+		deinterleave_avx2(rgb1 + 3 * i, deinterleave8_masks, bottom);
+		_mm256_storeu_si256((__m256i *)(y0 + i), studio_luma_avx2(top));
+		if (y1)
+			_mm256_storeu_si256((__m256i *)(y1 + i), studio_luma_avx2(bottom));
+
+		/* maddubs by ones adds each pair of neighbours */
+		for (c = 0; c < 3; c++)
+			sum[c] = _mm256_add_epi16(_mm256_maddubs_epi16(top[c], ones), _mm256_maddubs_epi16(bottom[c], ones));
+		uv = _mm256_packus_epi16(studio_chroma_avx2(sum[0], sum[1], sum[2], -38, -74, 112),
+			studio_chroma_avx2(sum[0], sum[1], sum[2], 112, -94, -18));
+		/* Cb 0-7, Cr 0-7 | Cb 8-15, Cr 8-15 -> Cb 0-15 | Cr 0-15 */
+		uv = _mm256_permute4x64_epi64(uv, _MM_SHUFFLE(3, 1, 2, 0));
+		cb = _mm256_castsi256_si128(uv);
+		cr = _mm256_extracti128_si256(uv, 1);
+		if (uv_inc == 2) {
+			_mm_storeu_si128((__m128i *)(u + i), _mm_unpacklo_epi8(cb, cr));
+			_mm_storeu_si128((__m128i *)(u + i + 16), _mm_unpackhi_epi8(cb, cr));
+		}
+		else {
+			_mm_storeu_si128((__m128i *)(u + i / 2), cb);
+			_mm_storeu_si128((__m128i *)(v + i / 2), cr);
+		}
+	}
+	dc1394_bayer_convert_yuv(rgb0 + 3 * i, rgb1 + 3 * i, y0 + i, y1 ? y1 + i : NULL,
+		u + i / 2 * uv_inc, v + i / 2 * uv_inc, uv_inc, n - i);
+}
+
+/* the DK2 sensor */
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_752x480_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return bilinear_rows_fixed_avx2<752, 480>(bayer, rgb, tile, bayerStep, rgbStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_752x480_avx2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	return bilinear_luma_rows_fixed_avx2<752, 480>(bayer, luma, tile, bayerStep, lumaStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_752x480_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return downsample_rows_fixed_avx2<752, 480>(bayer, rgb, tile, bayerStep, rgbStep, order, y0, y1);
+}
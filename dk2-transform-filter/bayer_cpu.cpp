@@ -0,0 +1,92 @@
+/*
+* CPU feature detection for the vectorized Bayer decoders
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <mutex>
+#include "bayer_internal.h"
+
+static void
+cpuid(int leaf, int subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* XCR0: which register states the OS saves on context switch */
+static uint64_t
+xgetbv0(void)
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static uint32_t
+detect_features(void)
+{
+	uint32_t regs[4];
+	uint32_t features = 0;
+	int max_leaf;
+
+	cpuid(0, 0, regs);
+	max_leaf = (int)regs[0];
+	if (max_leaf < 1)
+		return 1u << DC1394_BAYER_ISA_SCALAR;
+
+	cpuid(1, 0, regs);
+	if (regs[3] & (1u << 26))
+		features |= 1u << DC1394_BAYER_ISA_SSE2;
+	if (regs[2] & (1u << 9))
+		features |= 1u << DC1394_BAYER_ISA_SSSE3;
+	if (regs[2] & (1u << 19))
+		features |= 1u << DC1394_BAYER_ISA_SSE41;
+
+	/* AVX state must be enabled by the OS (OSXSAVE and XCR0 bits 1-2) */
+	if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && max_leaf >= 7) {
+		uint64_t xcr0 = xgetbv0();
+
+		cpuid(7, 0, regs);
+		if ((xcr0 & 0x6) == 0x6 && (regs[1] & (1u << 5)))
+			features |= 1u << DC1394_BAYER_ISA_AVX2;
+		/* AVX-512 also needs the opmask and upper ZMM state (XCR0 bits 5-7) */
+		if ((xcr0 & 0xe6) == 0xe6 && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30)))
+			features |= 1u << DC1394_BAYER_ISA_AVX512BW;
+	}
+
+	return features | (1u << DC1394_BAYER_ISA_SCALAR);
+}
+
+static std::once_flag detected;
+static uint32_t features;
+
+static void
+detect_once(void)
+{
+	features = detect_features();
+}
+
+uint32_t
+dc1394_bayer_get_cpu_features(void)
+{
+	std::call_once(detected, detect_once);
+	return features;
+}
@@ -0,0 +1,518 @@
+/*
+* Bayer decoding kernel registry
+*
+* Every kernel variant is listed once below together with the method,
+* depth and instruction set it implements. On first use the registry
+* fills one function pointer per method and depth with the widest
+* variant the CPU supports, capped by dc1394_bayer_set_max_isa() or the
+* DC1394_BAYER_MAX_ISA environment variable, and the decoding entry
+* points call through that table. Kernels built for one frame size are
+* listed separately and replace the generic kernel of the same method
+* and instruction set when a whole frame of that size is decoded.
+* The row unpackers of packed mosaics are chosen the same way, one per
+* packing, and so are the converters into the other output layouts, one
+* per layout and depth, and the one into YCbCr.
+*
+* A table is never changed once built: there is one per instruction set
+* cap, each built once, and the decoders read the current one through
+* an atomic pointer, so a thread that is decoding while the cap changes
+* finishes with the kernels it started with.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "bayer.h"
+#include "bayer_internal.h"
+
+typedef struct {
+	dc1394bayer_method_t method;
+	dc1394bayer_isa_t isa;
+	dc1394bayer_kernel8_t kernel;
+} kernel8_entry_t;
+
+typedef struct {
+	dc1394bayer_method_t method;
+	dc1394bayer_isa_t isa;
+	dc1394bayer_kernel16_t kernel;
+} kernel16_entry_t;
+
+typedef struct {
+	dc1394bayer_method_t method;
+	dc1394bayer_isa_t isa;
+	uint32_t sx, sy;
+	dc1394bayer_kernel8_t kernel;
+} frame_kernel8_entry_t;
+
+typedef struct {
+	dc1394bayer_packing_t packing;
+	dc1394bayer_isa_t isa;
+	dc1394bayer_unpack_t unpack;
+} unpack_entry_t;
+
+typedef struct {
+	dc1394bayer_layout_t layout;
+	dc1394bayer_isa_t isa;
+	dc1394bayer_convert8_t convert;
+} convert8_entry_t;
+
+typedef struct {
+	dc1394bayer_layout_t layout;
+	dc1394bayer_isa_t isa;
+	dc1394bayer_convert16_t convert;
+} convert16_entry_t;
+
+typedef struct {
+	dc1394bayer_isa_t isa;
+	dc1394bayer_convert_yuv_t convert;
+} convert_yuv_entry_t;
+
+/* mosaic rows each method reads above and below an output row */
+static const int method_halo[DC1394_BAYER_METHOD_NUM] = {
+	1,	/* NEAREST */
+	1,	/* SIMPLE */
+	1,	/* BILINEAR */
+	2,	/* HQLINEAR */
+	0,	/* DOWNSAMPLE */
+	0,	/* EDGESENSE */
+	3,	/* VNG, on top of the bilinear pass */
+	5	/* AHD, three for homogeneity and two for green */
+};
+
+static const kernel8_entry_t kernels_8bit[] = {
+	{ DC1394_BAYER_METHOD_NEAREST, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_NearestNeighbor_rows },
+	{ DC1394_BAYER_METHOD_SIMPLE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Simple_rows },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Bilinear_rows },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SSE2, dc1394_bayer_Bilinear_rows_sse2 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_Bilinear_rows_avx2 },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_HQLinear_rows },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_SSE2, dc1394_bayer_HQLinear_rows_sse2 },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_HQLinear_rows_avx2 },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Downsample_rows },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_SSE2, dc1394_bayer_Downsample_rows_sse2 },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_AVX2, dc1394_bayer_Downsample_rows_avx2 },
+	{ DC1394_BAYER_METHOD_EDGESENSE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_EdgeSense_rows },
+	{ DC1394_BAYER_METHOD_VNG, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_VNG_rows },
+	{ DC1394_BAYER_METHOD_AHD, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_AHD_rows },
+};
+
+static const kernel16_entry_t kernels_16bit[] = {
+	{ DC1394_BAYER_METHOD_NEAREST, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_NearestNeighbor_uint16_rows },
+	{ DC1394_BAYER_METHOD_SIMPLE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Simple_uint16_rows },
+	{ DC1394_BAYER_METHOD_SIMPLE, DC1394_BAYER_ISA_SSE41, dc1394_bayer_Simple_uint16_rows_sse41 },
+	{ DC1394_BAYER_METHOD_SIMPLE, DC1394_BAYER_ISA_AVX2, dc1394_bayer_Simple_uint16_rows_avx2 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Bilinear_uint16_rows },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SSE41, dc1394_bayer_Bilinear_uint16_rows_sse41 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_Bilinear_uint16_rows_avx2 },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_HQLinear_uint16_rows },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_SSE41, dc1394_bayer_HQLinear_uint16_rows_sse41 },
+	{ DC1394_BAYER_METHOD_HQLINEAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_HQLinear_uint16_rows_avx2 },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Downsample_uint16_rows },
+	{ DC1394_BAYER_METHOD_EDGESENSE, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_EdgeSense_uint16_rows },
+	{ DC1394_BAYER_METHOD_VNG, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_VNG_uint16_rows },
+	{ DC1394_BAYER_METHOD_AHD, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_AHD_uint16_rows },
+};
+
+/* greyscale output, method is unused */
+static const kernel8_entry_t kernels_luma8[] = {
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_Bilinear_luma_rows },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SSE2, dc1394_bayer_Bilinear_luma_rows_sse2 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_Bilinear_luma_rows_avx2 },
+};
+
+static const frame_kernel8_entry_t frame_kernels_8bit[] = {
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SSE2, 752, 480, dc1394_bayer_Bilinear_rows_752x480_sse2 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_AVX2, 752, 480, dc1394_bayer_Bilinear_rows_752x480_avx2 },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_SSE2, 752, 480, dc1394_bayer_Downsample_rows_752x480_sse2 },
+	{ DC1394_BAYER_METHOD_DOWNSAMPLE, DC1394_BAYER_ISA_AVX2, 752, 480, dc1394_bayer_Downsample_rows_752x480_avx2 },
+};
+
+static const frame_kernel8_entry_t frame_kernels_luma8[] = {
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_SSE2, 752, 480, dc1394_bayer_Bilinear_luma_rows_752x480_sse2 },
+	{ DC1394_BAYER_METHOD_BILINEAR, DC1394_BAYER_ISA_AVX2, 752, 480, dc1394_bayer_Bilinear_luma_rows_752x480_avx2 },
+};
+
+static const unpack_entry_t unpackers[] = {
+	{ DC1394_BAYER_PACKING_RAW10, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_unpack_raw10 },
+	{ DC1394_BAYER_PACKING_RAW10, DC1394_BAYER_ISA_AVX2, dc1394_bayer_unpack_raw10_avx2 },
+	{ DC1394_BAYER_PACKING_RAW12, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_unpack_raw12 },
+	{ DC1394_BAYER_PACKING_RAW12, DC1394_BAYER_ISA_AVX2, dc1394_bayer_unpack_raw12_avx2 },
+};
+
+/* packed RGB needs no converter */
+static const convert8_entry_t converters_8bit[] = {
+	{ DC1394_BAYER_LAYOUT_RGBX, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_rgbx8 },
+	{ DC1394_BAYER_LAYOUT_RGBX, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_rgbx8_avx2 },
+	{ DC1394_BAYER_LAYOUT_PLANAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_planar8 },
+	{ DC1394_BAYER_LAYOUT_PLANAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_planar8_avx2 },
+	{ DC1394_BAYER_LAYOUT_PLANAR_FLOAT, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_float8 },
+	{ DC1394_BAYER_LAYOUT_PLANAR_FLOAT, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_float8_avx2 },
+};
+
+static const convert16_entry_t converters_16bit[] = {
+	{ DC1394_BAYER_LAYOUT_RGBX, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_rgbx16 },
+	{ DC1394_BAYER_LAYOUT_RGBX, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_rgbx16_avx2 },
+	{ DC1394_BAYER_LAYOUT_PLANAR, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_planar16 },
+	{ DC1394_BAYER_LAYOUT_PLANAR, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_planar16_avx2 },
+	{ DC1394_BAYER_LAYOUT_PLANAR_FLOAT, DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_float16 },
+	{ DC1394_BAYER_LAYOUT_PLANAR_FLOAT, DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_float16_avx2 },
+};
+
+/* NV12 and I420 */
+static const convert_yuv_entry_t converters_yuv[] = {
+	{ DC1394_BAYER_ISA_SCALAR, dc1394_bayer_convert_yuv },
+	{ DC1394_BAYER_ISA_AVX2, dc1394_bayer_convert_yuv_avx2 },
+};
+
+#define NUM_ENTRIES(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static const char *isa_names[DC1394_BAYER_ISA_NUM] = {
+	"scalar", "sse2", "ssse3", "sse4.1", "avx2", "avx512bw"
+};
+
+typedef struct {
+	dc1394bayer_isa_t max_isa;
+	dc1394bayer_kernel8_t kernel8[DC1394_BAYER_METHOD_NUM];
+	dc1394bayer_isa_t isa8[DC1394_BAYER_METHOD_NUM];
+	dc1394bayer_kernel16_t kernel16[DC1394_BAYER_METHOD_NUM];
+	dc1394bayer_isa_t isa16[DC1394_BAYER_METHOD_NUM];
+	dc1394bayer_kernel8_t luma8;
+	dc1394bayer_isa_t isa_luma8;
+	/* one frame size per method; NULL when none matches the ISA above */
+	const frame_kernel8_entry_t *frame8[DC1394_BAYER_METHOD_NUM];
+	const frame_kernel8_entry_t *frame_luma8;
+	dc1394bayer_unpack_t unpack[DC1394_BAYER_PACKING_NUM];
+	dc1394bayer_convert8_t convert8[DC1394_BAYER_LAYOUT_NUM];
+	dc1394bayer_convert16_t convert16[DC1394_BAYER_LAYOUT_NUM];
+	dc1394bayer_convert_yuv_t convert_yuv;
+} kernel_table_t;
+
+static kernel_table_t tables[DC1394_BAYER_ISA_NUM];
+static std::once_flag tables_built[DC1394_BAYER_ISA_NUM];
+static std::once_flag default_chosen;
+static std::atomic<const kernel_table_t *> current(NULL);
+
+static void
+build_table(kernel_table_t *t, dc1394bayer_isa_t max_isa)
+{
+	uint32_t usable = dc1394_bayer_get_cpu_features() & ((2u << max_isa) - 1);
+	int i;
+
+	memset(t, 0, sizeof(*t));
+	t->max_isa = max_isa;
+
+	/* entries are listed in ascending ISA order, so the last usable one wins */
+	for (i = 0; i < NUM_ENTRIES(kernels_8bit); i++) {
+		const kernel8_entry_t *e = &kernels_8bit[i];
+		if (usable & (1u << e->isa)) {
+			t->kernel8[e->method] = e->kernel;
+			t->isa8[e->method] = e->isa;
+		}
+	}
+	for (i = 0; i < NUM_ENTRIES(kernels_16bit); i++) {
+		const kernel16_entry_t *e = &kernels_16bit[i];
+		if (usable & (1u << e->isa)) {
+			t->kernel16[e->method] = e->kernel;
+			t->isa16[e->method] = e->isa;
+		}
+	}
+	for (i = 0; i < NUM_ENTRIES(kernels_luma8); i++) {
+		if (usable & (1u << kernels_luma8[i].isa)) {
+			t->luma8 = kernels_luma8[i].kernel;
+			t->isa_luma8 = kernels_luma8[i].isa;
+		}
+	}
+	for (i = 0; i < NUM_ENTRIES(unpackers); i++) {
+		if (usable & (1u << unpackers[i].isa))
+			t->unpack[unpackers[i].packing] = unpackers[i].unpack;
+	}
+	for (i = 0; i < NUM_ENTRIES(converters_8bit); i++) {
+		if (usable & (1u << converters_8bit[i].isa))
+			t->convert8[converters_8bit[i].layout] = converters_8bit[i].convert;
+	}
+	for (i = 0; i < NUM_ENTRIES(converters_16bit); i++) {
+		if (usable & (1u << converters_16bit[i].isa))
+			t->convert16[converters_16bit[i].layout] = converters_16bit[i].convert;
+	}
+	for (i = 0; i < NUM_ENTRIES(converters_yuv); i++) {
+		if (usable & (1u << converters_yuv[i].isa))
+			t->convert_yuv = converters_yuv[i].convert;
+	}
+
+	/* a frame-size kernel must not trade the generic kernel's ISA for a narrower one */
+	for (i = 0; i < NUM_ENTRIES(frame_kernels_8bit); i++) {
+		const frame_kernel8_entry_t *e = &frame_kernels_8bit[i];
+		if (t->kernel8[e->method] && t->isa8[e->method] == e->isa)
+			t->frame8[e->method] = e;
+	}
+	for (i = 0; i < NUM_ENTRIES(frame_kernels_luma8); i++) {
+		if (t->isa_luma8 == frame_kernels_luma8[i].isa)
+			t->frame_luma8 = &frame_kernels_luma8[i];
+	}
+}
+
+static int
+parse_isa(const char *name, dc1394bayer_isa_t *isa)
+{
+	int i;
+
+	for (i = 0; i < DC1394_BAYER_ISA_NUM; i++) {
+		if (strcmp(name, isa_names[i]) == 0) {
+			*isa = (dc1394bayer_isa_t)i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static dc1394bayer_isa_t
+default_max_isa(void)
+{
+	dc1394bayer_isa_t isa = DC1394_BAYER_ISA_MAX;
+#if defined(_MSC_VER)
+	char *env = NULL;
+	size_t len;
+
+	if (_dupenv_s(&env, &len, "DC1394_BAYER_MAX_ISA") == 0 && env) {
+		parse_isa(env, &isa);
+		free(env);
+	}
+#else
+	const char *env = getenv("DC1394_BAYER_MAX_ISA");
+
+	if (env)
+		parse_isa(env, &isa);
+#endif
+	return isa;
+}
+
+/* the table for cap isa, built by whichever thread first asks for it */
+static const kernel_table_t *
+table_for(dc1394bayer_isa_t isa)
+{
+	std::call_once(tables_built[isa], build_table, &tables[isa], isa);
+	return &tables[isa];
+}
+
+/* installs the default table unless dc1394_bayer_set_max_isa() was first */
+static void
+choose_default(void)
+{
+	const kernel_table_t *none = NULL;
+
+	current.compare_exchange_strong(none, table_for(default_max_isa()), std::memory_order_acq_rel);
+}
+
+static const kernel_table_t *
+get_table(void)
+{
+	const kernel_table_t *t = current.load(std::memory_order_acquire);
+
+	if (!t) {
+		std::call_once(default_chosen, choose_default);
+		t = current.load(std::memory_order_acquire);
+	}
+	return t;
+}
+
+dc1394error_t
+dc1394_bayer_set_max_isa(dc1394bayer_isa_t isa)
+{
+	if ((isa > DC1394_BAYER_ISA_MAX) || (isa < DC1394_BAYER_ISA_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	current.store(table_for(isa), std::memory_order_release);
+	return DC1394_SUCCESS;
+}
+
+dc1394bayer_isa_t
+dc1394_bayer_get_max_isa(void)
+{
+	return get_table()->max_isa;
+}
+
+dc1394error_t
+dc1394_bayer_get_kernel_isa(dc1394bayer_method_t method, uint32_t depth, dc1394bayer_isa_t *isa)
+{
+	const kernel_table_t *t = get_table();
+
+	if ((method > DC1394_BAYER_METHOD_MAX) || (method < DC1394_BAYER_METHOD_MIN))
+		return DC1394_INVALID_BAYER_METHOD;
+
+	switch (depth) {
+	case 8:
+		if (!t->kernel8[method])
+			return DC1394_INVALID_BAYER_METHOD;
+		*isa = t->isa8[method];
+		return DC1394_SUCCESS;
+	case 16:
+		if (!t->kernel16[method])
+			return DC1394_INVALID_BAYER_METHOD;
+		*isa = t->isa16[method];
+		return DC1394_SUCCESS;
+	default:
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	}
+}
+
+const char *
+dc1394_bayer_isa_name(dc1394bayer_isa_t isa)
+{
+	if ((isa > DC1394_BAYER_ISA_MAX) || (isa < DC1394_BAYER_ISA_MIN))
+		return "unknown";
+	return isa_names[isa];
+}
+
+dc1394bayer_kernel8_t
+dc1394_bayer_get_kernel8(dc1394bayer_method_t method, int *halo)
+{
+	if ((method > DC1394_BAYER_METHOD_MAX) || (method < DC1394_BAYER_METHOD_MIN))
+		return NULL;
+	if (halo)
+		*halo = method_halo[method];
+	return get_table()->kernel8[method];
+}
+
+dc1394bayer_kernel16_t
+dc1394_bayer_get_kernel16(dc1394bayer_method_t method, int *halo)
+{
+	if ((method > DC1394_BAYER_METHOD_MAX) || (method < DC1394_BAYER_METHOD_MIN))
+		return NULL;
+	if (halo)
+		*halo = method_halo[method];
+	return get_table()->kernel16[method];
+}
+
+dc1394bayer_unpack_t
+dc1394_bayer_get_unpack(dc1394bayer_packing_t packing)
+{
+	if ((packing > DC1394_BAYER_PACKING_MAX) || (packing < DC1394_BAYER_PACKING_MIN))
+		return NULL;
+	return get_table()->unpack[packing];
+}
+
+dc1394bayer_convert8_t
+dc1394_bayer_get_convert8(dc1394bayer_layout_t layout)
+{
+	if ((layout > DC1394_BAYER_LAYOUT_MAX) || (layout < DC1394_BAYER_LAYOUT_MIN))
+		return NULL;
+	return get_table()->convert8[layout];
+}
+
+dc1394bayer_convert16_t
+dc1394_bayer_get_convert16(dc1394bayer_layout_t layout)
+{
+	if ((layout > DC1394_BAYER_LAYOUT_MAX) || (layout < DC1394_BAYER_LAYOUT_MIN))
+		return NULL;
+	return get_table()->convert16[layout];
+}
+
+dc1394bayer_convert_yuv_t
+dc1394_bayer_get_convert_yuv(void)
+{
+	return get_table()->convert_yuv;
+}
+
+dc1394bayer_kernel8_t
+dc1394_bayer_get_luma_kernel(int *halo)
+{
+	if (halo)
+		*halo = method_halo[DC1394_BAYER_METHOD_BILINEAR];
+	return get_table()->luma8;
+}
+
+dc1394bayer_kernel8_t
+dc1394_bayer_get_frame_kernel8(dc1394bayer_method_t method, uint32_t sx, uint32_t sy, int *halo)
+{
+	const frame_kernel8_entry_t *e;
+
+	if ((method > DC1394_BAYER_METHOD_MAX) || (method < DC1394_BAYER_METHOD_MIN))
+		return NULL;
+	e = get_table()->frame8[method];
+	if (e && e->sx == sx && e->sy == sy) {
+		if (halo)
+			*halo = method_halo[method];
+		return e->kernel;
+	}
+	return dc1394_bayer_get_kernel8(method, halo);
+}
+
+dc1394bayer_kernel8_t
+dc1394_bayer_get_frame_luma_kernel(uint32_t sx, uint32_t sy, int *halo)
+{
+	const frame_kernel8_entry_t *e = get_table()->frame_luma8;
+
+	if (e && e->sx == sx && e->sy == sy) {
+		if (halo)
+			*halo = method_halo[DC1394_BAYER_METHOD_BILINEAR];
+		return e->kernel;
+	}
+	return dc1394_bayer_get_luma_kernel(halo);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit(const uint8_t * bayer, uint8_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method)
+{
+	return dc1394_bayer_decoding_8bit_pitch(bayer, rgb, bayer_packed_step(method, sx), sx, sy, tile, method, DC1394_BAYER_ORDER_RGB);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit(const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+{
+	return dc1394_bayer_decoding_16bit_pitch(bayer, rgb, bayer_packed_step(method, sx) * sizeof(uint16_t), sx, sy, tile, method, bits, DC1394_BAYER_ORDER_RGB);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_pitch(const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order)
+{
+	return dc1394_bayer_decoding_8bit_stride(bayer, 0, (int)sx, rgb, 0, rgb_pitch, sx, sy, tile, method, order);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_pitch(const uint16_t * bayer, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order)
+{
+	return dc1394_bayer_decoding_16bit_stride(bayer, 0, (int)(sx * sizeof(uint16_t)), rgb, 0, rgb_pitch, sx, sy, tile, method, bits, order);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_stride(const uint8_t * bayer, size_t bayer_offset, int bayer_pitch, uint8_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order)
+{
+	dc1394bayer_kernel8_t kernel = dc1394_bayer_get_frame_kernel8(method, sx, sy, NULL);
+
+	if (!kernel)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!bayer_valid_stride(bayer_pitch, bayer_offset, rgb_pitch, rgb_offset, sx, sizeof(uint8_t)))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	return kernel(bayer + bayer_offset, rgb + rgb_offset, sx, sy, tile, bayer_pitch, rgb_pitch, order, 0, sy);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_stride(const uint16_t * bayer, size_t bayer_offset, int bayer_pitch, uint16_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order)
+{
+	dc1394bayer_kernel16_t kernel = dc1394_bayer_get_kernel16(method, NULL);
+
+	if (!kernel)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!bayer_valid_stride(bayer_pitch, bayer_offset, rgb_pitch, rgb_offset, sx, sizeof(uint16_t)))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	return kernel((const uint16_t *)((const uint8_t *)bayer + bayer_offset), (uint16_t *)((uint8_t *)rgb + rgb_offset), sx, sy, tile, bits,
+		bayer_pitch / (int)sizeof(uint16_t), rgb_pitch / (int)sizeof(uint16_t), order, 0, sy);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_luma8(const uint8_t * bayer, uint8_t * luma, int luma_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile)
+{
+	return dc1394_bayer_get_frame_luma_kernel(sx, sy, NULL)(bayer, luma, sx, sy, tile, sx, luma_pitch, DC1394_BAYER_ORDER_RGB, 0, sy);
+}
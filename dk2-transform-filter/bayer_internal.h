@@ -0,0 +1,548 @@
+/*
+* Internal declarations shared by the Bayer decoders.
+*
+* Every kernel has a row-range form that produces only the output rows
+* [y0, y1) of the full sx x sy result, border rows included, reading the
+* neighbouring mosaic rows it needs straight from the input frame. The
+* registry in bayer_dispatch.cpp calls these, so that a frame can be cut
+* into bands that are decoded independently (bayer_parallel.cpp). For
+* DC1394_BAYER_METHOD_DOWNSAMPLE y0 and y1 count mosaic rows and must
+* be even. Output row y starts at rgb + y * rgbStep elements, rgbStep
+* may be negative, and order is a dc1394bayer_order_t.
+*
+* The SIMD kernels live in their own translation units so that each one
+* can be built with the instruction set it needs (bayer_sse2.cpp,
+* bayer_sse41.cpp, bayer_avx2.cpp) while the rest of the filter stays
+* baseline x86. They produce byte-identical output to the scalar
+* reference functions in bayer.cpp and must only be called when
+* dc1394_bayer_get_cpu_features() reports the matching extension;
+* bayer_dispatch.cpp takes care of that.
+*/
+
+#ifndef __DC1394_BAYER_INTERNAL_H__
+#define __DC1394_BAYER_INTERNAL_H__
+
+#include "bayer.h"
+
+typedef dc1394error_t(*dc1394bayer_kernel8_t)(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+typedef dc1394error_t(*dc1394bayer_kernel16_t)(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* kernel chosen by the registry for method, or NULL; halo receives the
+   number of mosaic rows it reads above and below each output row */
+dc1394bayer_kernel8_t
+dc1394_bayer_get_kernel8(dc1394bayer_method_t method, int *halo);
+
+dc1394bayer_kernel16_t
+dc1394_bayer_get_kernel16(dc1394bayer_method_t method, int *halo);
+
+/* expands the n samples of one packed row, n a multiple of the packing's
+   group, into out */
+typedef void(*dc1394bayer_unpack_t)(const uint8_t * packed, uint16_t * out, int n);
+
+/* row unpacker chosen by the registry for packing, or NULL */
+dc1394bayer_unpack_t
+dc1394_bayer_get_unpack(dc1394bayer_packing_t packing);
+
+/* lays out the n packed pixels of one decoded row into the rows dst[]
+   of the planes of a dc1394bayer_output_t; maxval is the opaque or the
+   full-scale sample */
+typedef void(*dc1394bayer_convert8_t)(const uint8_t * rgb, void * const * dst, int n);
+typedef void(*dc1394bayer_convert16_t)(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+/* converts two decoded RGB rows of n pixels, rgb0 above rgb1, into the
+   Y rows y0 and y1 and one row of Cb and Cr samples uv_inc bytes apart
+   (2 and v = u + 1 for NV12); a lone last row comes with rgb1 == rgb0 and
+   y1 NULL */
+typedef void(*dc1394bayer_convert_yuv_t)(const uint8_t * rgb0, const uint8_t * rgb1, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, int uv_inc, int n);
+
+/* row converter chosen by the registry for layout, or NULL for
+   DC1394_BAYER_LAYOUT_RGB, which needs none, and the YCbCr layouts */
+dc1394bayer_convert8_t
+dc1394_bayer_get_convert8(dc1394bayer_layout_t layout);
+
+dc1394bayer_convert16_t
+dc1394_bayer_get_convert16(dc1394bayer_layout_t layout);
+
+/* YCbCr converter chosen by the registry, for NV12 and I420 */
+dc1394bayer_convert_yuv_t
+dc1394_bayer_get_convert_yuv(void);
+
+/* luma kernel chosen by the registry; it has the halo of the Bilinear method */
+dc1394bayer_kernel8_t
+dc1394_bayer_get_luma_kernel(int *halo);
+
+/* as above for decoding whole sx x sy frames: a kernel built for that
+   frame size when the registry has one, the generic kernel otherwise */
+dc1394bayer_kernel8_t
+dc1394_bayer_get_frame_kernel8(dc1394bayer_method_t method, uint32_t sx, uint32_t sy, int *halo);
+
+dc1394bayer_kernel8_t
+dc1394_bayer_get_frame_luma_kernel(uint32_t sx, uint32_t sy, int *halo);
+
+/* run fn(ctx, 0) .. fn(ctx, count - 1) on the pool's threads and the
+   calling thread, returning when all of them have finished */
+void
+dc1394_bayer_pool_run(dc1394bayer_pool_t *pool, int count, void(*fn)(void *ctx, int index), void *ctx);
+
+/* even band height giving each of the pool's threads one band of an sy
+   row frame, but never much less than the halo */
+int
+dc1394_bayer_band_rows(dc1394bayer_pool_t *pool, int sy, int halo);
+
+/* row step in elements of the packed output the plain decoders write */
+static inline int
+bayer_packed_step(dc1394bayer_method_t method, int sx)
+{
+	return method == DC1394_BAYER_METHOD_DOWNSAMPLE ? 3 * (sx / 2) : 3 * sx;
+}
+
+/* whether the pitches and offsets, in bytes, of a mosaic with sx samples
+   of elem bytes per row and of its output are whole samples, and the
+   mosaic rows do not overlap */
+static inline int
+bayer_valid_stride(int bayer_pitch, size_t bayer_offset, int rgb_pitch, size_t rgb_offset, uint32_t sx, size_t elem)
+{
+	if ((bayer_pitch | rgb_pitch) % (int)elem || (bayer_offset | rgb_offset) % elem)
+		return 0;
+	return (bayer_pitch < 0 ? -(int64_t)bayer_pitch : (int64_t)bayer_pitch) >= (int64_t)sx * (int64_t)elem;
+}
+
+/* whether every row of an image at p with the given byte step starts on
+   a 16-byte boundary */
+static inline int
+bayer_aligned16(const void *p, int step)
+{
+	return (((uintptr_t)p | (uintptr_t)(intptr_t)step) & 15) == 0;
+}
+
+/* the rows [*m0, *m1) of [y0, y1) at least two rows away from the top and
+   bottom of an sy row frame, where a 3x3 neighbourhood read across the row
+   ends stays inside the frame */
+static inline void
+bayer_wrap_rows(int sy, int y0, int y1, int *m0, int *m1)
+{
+	*m0 = y0 > 2 ? y0 : 2;
+	*m1 = y1 < sy - 2 ? y1 : sy - 2;
+}
+
+/* the kernels are not meant for windows of fewer rows or columns */
+#define BAYER_MIN_WINDOW 8
+
+/*
+* Mosaic span [*a, *b) a kernel with the given halo reads to decode the
+* output span [*a, *b): grown by the halo on both sides, clipped to
+* [0, n) and, when that leaves fewer than BAYER_MIN_WINDOW, widened
+* again inside [0, n). The strip decoders and the ROI decoder size their
+* windows with it, rows or columns alike.
+*/
+static inline void
+bayer_window(int *a, int *b, int halo, int n)
+{
+	*a = *a > halo ? *a - halo : 0;
+	*b = *b < n - halo ? *b + halo : n;
+	if (halo && *b - *a < BAYER_MIN_WINDOW) {
+		*b = *a + BAYER_MIN_WINDOW < n ? *a + BAYER_MIN_WINDOW : n;
+		*a = *b > BAYER_MIN_WINDOW ? *b - BAYER_MIN_WINDOW : 0;
+	}
+}
+
+/* output rows per strip, a multiple of cell, when budget_rows mosaic
+   rows fit in the strip's budget */
+static inline int
+bayer_strip_rows(int budget_rows, int halo, int cell)
+{
+	int rows = budget_rows - 2 * halo;
+
+	return (rows > BAYER_MIN_WINDOW ? rows : BAYER_MIN_WINDOW) / cell * cell;
+}
+
+/* the most rows bayer_window() gives for strips of strip_rows out of a
+   span of span_rows */
+static inline int
+bayer_strip_capacity(int strip_rows, int span_rows, int halo)
+{
+	int rows = (strip_rows < span_rows ? strip_rows : span_rows) + 2 * halo;
+
+	return rows > BAYER_MIN_WINDOW ? rows : BAYER_MIN_WINDOW;
+}
+
+/*
+* Colour layout of mosaic row y: green_x is the parity of the green
+* columns, red_row is non-zero when the other sites of the row are red.
+*/
+static inline void
+bayer_row_phase(int tile, int y, int *green_x, int *red_row)
+{
+	int start_with_green = tile == DC1394_COLOR_FILTER_GBRG
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+	int red_first = tile == DC1394_COLOR_FILTER_RGGB
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+
+	*green_x = (start_with_green ? 0 : 1) ^ (y & 1);
+	*red_row = red_first ^ (y & 1);
+}
+
+/* tile of the mosaic seen from column x, row y of a frame with tile */
+static inline int
+bayer_shift_tile(int tile, int x, int y)
+{
+	/* an odd column swaps RGGB with GRBG and GBRG with BGGR, an odd row
+	   RGGB with GBRG and GRBG with BGGR */
+	return DC1394_COLOR_FILTER_MIN + ((tile - DC1394_COLOR_FILTER_MIN) ^ ((x & 1) << 1) ^ (y & 1));
+}
+
+/*
+* One interior pixel of dc1394_bayer_Bilinear or of its 16-bit version,
+* which does not clamp either, used for the row tails the vector loops do
+* not cover. p points at the mosaic site, out at the packed RGB triplet.
+*/
+template <typename T>
+static inline void
+bayer_bilinear_pixel(const T *p, int step, int is_green, int red_row, T *out)
+{
+	int c = p[0];
+
+	if (is_green) {
+		int h = (p[-1] + p[1] + 1) >> 1;
+		int v = (p[-step] + p[step] + 1) >> 1;
+		out[0] = (T)(red_row ? h : v);
+		out[1] = (T)c;
+		out[2] = (T)(red_row ? v : h);
+	}
+	else {
+		int cross = (p[-step] + p[-1] + p[1] + p[step] + 2) >> 2;
+		int diag = (p[-step - 1] + p[-step + 1] +
+			p[step - 1] + p[step + 1] + 2) >> 2;
+		out[0] = (T)(red_row ? c : diag);
+		out[1] = (T)cross;
+		out[2] = (T)(red_row ? diag : c);
+	}
+}
+
+static inline int
+bayer_clip(int v, int maxval)
+{
+	return v < 0 ? 0 : v > maxval ? maxval : v;
+}
+
+/*
+* One interior pixel of dc1394_bayer_HQLinear (Malvar, He and Cutler's
+* 5x5 filters in eighths), for the row tails the vector loops do not
+* cover. own is the output channel (0 or 2) of the colour sampled at the
+* row's non-green sites; the filtered values are clamped to maxval, 255
+* for 8-bit samples and (1 << bits) - 1 for 16-bit ones.
+*/
+template <typename T>
+static inline void
+bayer_hqlinear_pixel(const T *p, int step, int is_green, int own, int maxval, T *out)
+{
+	const int step2 = 2 * step;
+	int c = p[0];
+	int diag = p[-step - 1] + p[-step + 1] + p[step - 1] + p[step + 1];
+
+	if (is_green) {
+		/* colours of the vertical and the horizontal neighbours */
+		int vert = c * 5 + ((p[-step] + p[step]) << 2) - p[-step2] - diag - p[step2]
+			+ ((p[-2] + p[2] + 1) >> 1);
+		int horiz = c * 5 + ((p[-1] + p[1]) << 2) - p[-2] - diag - p[2]
+			+ ((p[-step2] + p[step2] + 1) >> 1);
+
+		out[2 - own] = (T)bayer_clip((vert + 4) >> 3, maxval);
+		out[1] = (T)c;
+		out[own] = (T)bayer_clip((horiz + 4) >> 3, maxval);
+	}
+	else {
+		int far = p[-step2] + p[-2] + p[2] + p[step2];
+		int opp = (diag << 1) - ((far * 3 + 1) >> 1) + c * 6;
+		int g = ((p[-step] + p[-1] + p[1] + p[step]) << 1) - far + (c << 2);
+
+		out[2 - own] = (T)bayer_clip((opp + 4) >> 3, maxval);
+		out[1] = (T)bayer_clip((g + 4) >> 3, maxval);
+		out[own] = (T)c;
+	}
+}
+
+/*
+* One pixel of dc1394_bayer_Simple_uint16 away from the last row and
+* column, for the row tails: the greens of the 2x2 cell at p averaged
+* (rounding down), its red and blue copied, all clamped to maxval.
+* is_green is set when p itself is a green site.
+*/
+static inline void
+bayer_simple_uint16_pixel(const uint16_t *p, int step, int is_green, int red_row, int maxval, uint16_t *out)
+{
+	int g, own, opp;
+
+	if (is_green) {
+		g = (p[0] + p[step + 1]) >> 1;
+		own = p[1];
+		opp = p[step];
+	}
+	else {
+		g = (p[1] + p[step]) >> 1;
+		own = p[0];
+		opp = p[step + 1];
+	}
+	out[red_row ? 0 : 2] = (uint16_t)bayer_clip(own, maxval);
+	out[1] = (uint16_t)bayer_clip(g, maxval);
+	out[red_row ? 2 : 0] = (uint16_t)bayer_clip(opp, maxval);
+}
+
+/*
+* Layout of a dc1394_bayer_Downsample cell: green_first is non-zero when
+* the greens sit on the cell's diagonal rather than its anti-diagonal,
+* r_out is the output channel (0 or 2) the lower right site goes to.
+*/
+static inline void
+bayer_downsample_phase(int tile, int order, int *green_first, int *r_out)
+{
+	*green_first = tile == DC1394_COLOR_FILTER_GBRG
+		|| tile == DC1394_COLOR_FILTER_GRBG;
+	*r_out = tile == DC1394_COLOR_FILTER_GRBG
+		|| tile == DC1394_COLOR_FILTER_BGGR ? 0 : 2;
+	if (order == DC1394_BAYER_ORDER_BGR)
+		*r_out = 2 - *r_out;
+}
+
+/* one output pixel of dc1394_bayer_Downsample from the 2x2 cell at p */
+static inline void
+bayer_downsample_pixel(const uint8_t *p, int step, int green_first, int r_out, uint8_t *out)
+{
+	if (green_first) {
+		out[1] = (uint8_t)((p[0] + p[step + 1]) >> 1);
+		out[2 - r_out] = p[step];
+	}
+	else {
+		out[1] = (uint8_t)((p[step] + p[1]) >> 1);
+		out[2 - r_out] = p[0];
+	}
+	out[r_out] = p[step + 1];
+}
+
+/* BT.601 luma weights in 1/256; they sum to 256 */
+#define BAYER_LUMA_R  77
+#define BAYER_LUMA_G 150
+#define BAYER_LUMA_B  29
+
+static inline uint8_t
+bayer_luma(int r, int g, int b)
+{
+	return (uint8_t)((BAYER_LUMA_R * r + BAYER_LUMA_G * g + BAYER_LUMA_B * b + 128) >> 8);
+}
+
+/* luma of the bayer_bilinear_pixel() colours */
+static inline uint8_t
+bayer_bilinear_luma_pixel(const uint8_t *p, int step, int is_green, int red_row)
+{
+	uint8_t rgb[3];
+
+	bayer_bilinear_pixel(p, step, is_green, red_row, rgb);
+	return bayer_luma(rgb[0], rgb[1], rgb[2]);
+}
+
+/* scalar reference kernels, bayer.cpp */
+
+/* the pixels of the output rows [y0, y1) that a Bilinear (one-pixel
+   frame) or HQLinear (two-pixel frame) kernel has no mosaic window for,
+   decoded from the mosaic mirrored about its edges; the vector kernels
+   leave them to these */
+void
+dc1394_bayer_Bilinear_border_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+void
+dc1394_bayer_Bilinear_luma_border_rows(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int y0, int y1);
+
+void
+dc1394_bayer_HQLinear_border_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* as above for the 16-bit Simple (last row and column), Bilinear and
+   HQLinear kernels */
+void
+dc1394_bayer_Simple_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+void
+dc1394_bayer_Bilinear_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+void
+dc1394_bayer_HQLinear_uint16_border_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_NearestNeighbor_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Simple_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* one luma byte per pixel; order is ignored */
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_EdgeSense_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_VNG_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_AHD_rows(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_NearestNeighbor_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Simple_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_EdgeSense_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_VNG_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_AHD_uint16_rows(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* row unpackers, bayer_unpack.cpp */
+
+void
+dc1394_bayer_unpack_raw10(const uint8_t * packed, uint16_t * out, int n);
+
+void
+dc1394_bayer_unpack_raw12(const uint8_t * packed, uint16_t * out, int n);
+
+/* row converters, bayer_layout.cpp; the packed rows they read are in
+   the output's order for RGBX and in R,G,B order for the planar layouts */
+
+void
+dc1394_bayer_convert_rgbx8(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_planar8(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_float8(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_rgbx16(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_planar16(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_float16(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_yuv(const uint8_t * rgb0, const uint8_t * rgb1, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, int uv_inc, int n);
+
+/* SSE2, bayer_sse2.cpp */
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_sse2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* for 752 x 480 frames only, whatever sx and sy say */
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_752x480_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_752x480_sse2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_752x480_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* SSE4.1, bayer_sse41.cpp */
+
+dc1394error_t
+dc1394_bayer_Simple_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+/* AVX2, bayer_avx2.cpp */
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_avx2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_rows_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_752x480_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_752x480_avx2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_752x480_avx2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Simple_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_Bilinear_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+dc1394error_t
+dc1394_bayer_HQLinear_uint16_rows_avx2(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1);
+
+void
+dc1394_bayer_convert_rgbx8_avx2(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_planar8_avx2(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_float8_avx2(const uint8_t * rgb, void * const * dst, int n);
+
+void
+dc1394_bayer_convert_rgbx16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_planar16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_float16_avx2(const uint16_t * rgb, void * const * dst, int n, int maxval);
+
+void
+dc1394_bayer_convert_yuv_avx2(const uint8_t * rgb0, const uint8_t * rgb1, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, int uv_inc, int n);
+
+void
+dc1394_bayer_unpack_raw10_avx2(const uint8_t * packed, uint16_t * out, int n);
+
+void
+dc1394_bayer_unpack_raw12_avx2(const uint8_t * packed, uint16_t * out, int n);
+
+#endif
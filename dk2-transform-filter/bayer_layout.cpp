@@ -0,0 +1,423 @@
+/*
+* Bayer decoding into other output layouts
+*
+* The kernels only write packed three-sample pixels. To get RGBX or
+* planar output without a second pass over a whole RGB frame, the
+* output rows are decoded in strips into a buffer sized to stay in the
+* cache, and each strip is laid out into the output as soon as it is
+* decoded. As in bayer_unpack.cpp the kernel sees the mosaic rows of the
+* strip, halo included, as a frame of its own, whose first and last rows
+* are far enough from the strip's to leave them as in the whole frame.
+* For NV12 and I420 the strips start on even output rows, so that each
+* pair of rows, and the chroma row made from it, is in the same strip.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include "bayer.h"
+#include "bayer_internal.h"
+
+/* decoded strip a band aims for, in bytes */
+#define LAYOUT_STRIP_BYTES (1024 << 10)
+
+typedef struct {
+	dc1394bayer_kernel8_t kernel8;
+	dc1394bayer_kernel16_t kernel16;
+	dc1394bayer_convert8_t convert8;
+	dc1394bayer_convert16_t convert16;
+	dc1394bayer_convert_yuv_t convert_yuv;
+	const uint8_t *bayer;
+	int bayerPitch;
+	dc1394bayer_output_t out;
+	int planes;
+	int sx, sy, tile, bits;
+	int order;	/* of the decoded strips */
+	int halo;
+	int out_shift;	/* output rows are mosaic rows >> out_shift */
+	int strip_rows;
+	int band_rows;
+	std::atomic<int> err;
+} layout_job_t;
+
+void
+dc1394_bayer_convert_rgbx8(const uint8_t * rgb, void * const * dst, int n)
+{
+	uint8_t *out = (uint8_t *)dst[0];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3, out += 4) {
+		out[0] = rgb[0];
+		out[1] = rgb[1];
+		out[2] = rgb[2];
+		out[3] = 255;
+	}
+}
+
+void
+dc1394_bayer_convert_planar8(const uint8_t * rgb, void * const * dst, int n)
+{
+	uint8_t *r = (uint8_t *)dst[0], *g = (uint8_t *)dst[1], *b = (uint8_t *)dst[2];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3) {
+		r[i] = rgb[0];
+		g[i] = rgb[1];
+		b[i] = rgb[2];
+	}
+}
+
+void
+dc1394_bayer_convert_float8(const uint8_t * rgb, void * const * dst, int n)
+{
+	float *r = (float *)dst[0], *g = (float *)dst[1], *b = (float *)dst[2];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3) {
+		r[i] = rgb[0] / 255.0f;
+		g[i] = rgb[1] / 255.0f;
+		b[i] = rgb[2] / 255.0f;
+	}
+}
+
+void
+dc1394_bayer_convert_rgbx16(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	uint16_t *out = (uint16_t *)dst[0];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3, out += 4) {
+		out[0] = rgb[0];
+		out[1] = rgb[1];
+		out[2] = rgb[2];
+		out[3] = (uint16_t)maxval;
+	}
+}
+
+void
+dc1394_bayer_convert_planar16(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	uint16_t *r = (uint16_t *)dst[0], *g = (uint16_t *)dst[1], *b = (uint16_t *)dst[2];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3) {
+		r[i] = rgb[0];
+		g[i] = rgb[1];
+		b[i] = rgb[2];
+	}
+}
+
+void
+dc1394_bayer_convert_float16(const uint16_t * rgb, void * const * dst, int n, int maxval)
+{
+	const float scale = (float)maxval;
+	float *r = (float *)dst[0], *g = (float *)dst[1], *b = (float *)dst[2];
+	int i;
+
+	for (i = 0; i < n; i++, rgb += 3) {
+		r[i] = rgb[0] / scale;
+		g[i] = rgb[1] / scale;
+		b[i] = rgb[2] / scale;
+	}
+}
+
+static inline uint8_t
+studio_luma(const uint8_t *p)
+{
+	return (uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+}
+
+void
+dc1394_bayer_convert_yuv(const uint8_t * rgb0, const uint8_t * rgb1, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, int uv_inc, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		y0[i] = studio_luma(rgb0 + 3 * i);
+		if (y1)
+			y1[i] = studio_luma(rgb1 + 3 * i);
+	}
+
+	/* the offsets keep the sums positive, so the shifts round down */
+	for (i = 0; i < n; i += 2, u += uv_inc, v += uv_inc) {
+		const int a = 3 * i, b = i + 1 < n ? a + 3 : a;
+		int r = rgb0[a] + rgb0[b] + rgb1[a] + rgb1[b];
+		int g = rgb0[a + 1] + rgb0[b + 1] + rgb1[a + 1] + rgb1[b + 1];
+		int bl = rgb0[a + 2] + rgb0[b + 2] + rgb1[a + 2] + rgb1[b + 2];
+
+		*u = (uint8_t)((-38 * r - 74 * g + 112 * bl + (128 << 10) + 512) >> 10);
+		*v = (uint8_t)((112 * r - 94 * g - 18 * bl + (128 << 10) + 512) >> 10);
+	}
+}
+
+static int
+yuv_layout(dc1394bayer_layout_t layout)
+{
+	return layout == DC1394_BAYER_LAYOUT_NV12 || layout == DC1394_BAYER_LAYOUT_I420;
+}
+
+static int
+layout_planes(dc1394bayer_layout_t layout)
+{
+	switch (layout) {
+	case DC1394_BAYER_LAYOUT_RGB:
+	case DC1394_BAYER_LAYOUT_RGBX:
+		return 1;
+	case DC1394_BAYER_LAYOUT_NV12:
+		return 2;
+	default:
+		return 3;
+	}
+}
+
+/* bytes of one sample of layout at the given depth in bytes */
+static int
+sample_bytes(dc1394bayer_layout_t layout, int depth)
+{
+	return layout == DC1394_BAYER_LAYOUT_PLANAR_FLOAT ? (int)sizeof(float) : depth;
+}
+
+/* bytes in a row of plane i of layout for sx pixels */
+static int64_t
+plane_row_bytes(dc1394bayer_layout_t layout, int i, uint32_t sx, int depth)
+{
+	const int64_t chroma = ((int64_t)sx + 1) / 2;
+
+	switch (layout) {
+	case DC1394_BAYER_LAYOUT_RGB:
+		return 3 * (int64_t)sx * depth;
+	case DC1394_BAYER_LAYOUT_RGBX:
+		return 4 * (int64_t)sx * depth;
+	case DC1394_BAYER_LAYOUT_NV12:
+		return i ? 2 * chroma : sx;
+	case DC1394_BAYER_LAYOUT_I420:
+		return i ? chroma : sx;
+	default:
+		return (int64_t)sx * sample_bytes(layout, depth);
+	}
+}
+
+/* whether the planes of out can take rows of sx pixels */
+static int
+valid_output(const dc1394bayer_output_t *out, int planes, uint32_t sx, int depth)
+{
+	const int elem = sample_bytes(out->layout, depth);
+	int i;
+
+	for (i = 0; i < planes; i++) {
+		int64_t pitch = out->pitch[i];
+		int64_t row_bytes = plane_row_bytes(out->layout, i, sx, depth);
+
+		if (!out->plane[i] || pitch % elem || (uintptr_t)out->plane[i] % elem)
+			return 0;
+		if ((pitch < 0 ? -pitch : pitch) < row_bytes)
+			return 0;
+	}
+	return 1;
+}
+
+/* output rows per strip: as many as keep the strip within its budget,
+   a multiple of cell so that strips start on a Downsample cell and, for
+   NV12 and I420, on a pair of output rows */
+static int
+strip_rows(int sx, int elem, int halo, int cell)
+{
+	return bayer_strip_rows(LAYOUT_STRIP_BYTES / (3 * sx * elem), halo, cell);
+}
+
+static dc1394error_t
+run_kernel(const layout_job_t *j, const uint8_t *bayer, uint8_t *rgb, int sy, int tile, int rgbStep, int y0, int y1)
+{
+	return j->kernel8(bayer, rgb, j->sx, sy, tile, j->bayerPitch, rgbStep, j->order, y0, y1);
+}
+
+static dc1394error_t
+run_kernel(const layout_job_t *j, const uint16_t *bayer, uint16_t *rgb, int sy, int tile, int rgbStep, int y0, int y1)
+{
+	return j->kernel16(bayer, rgb, j->sx, sy, tile, j->bits, j->bayerPitch / (int)sizeof(uint16_t), rgbStep, j->order, y0, y1);
+}
+
+static void
+run_convert(const layout_job_t *j, const uint8_t *rgb, void * const *dst, int n)
+{
+	j->convert8(rgb, dst, n);
+}
+
+static void
+run_convert(const layout_job_t *j, const uint16_t *rgb, void * const *dst, int n)
+{
+	j->convert16(rgb, dst, n, (1 << j->bits) - 1);
+}
+
+/* the decoded output rows [oy0, oy1), oy0 even, from rgb on as Y rows and
+   one chroma row per pair */
+static void
+lay_out_yuv(const layout_job_t *j, const uint8_t *rgb, int oy0, int oy1)
+{
+	const int out_sx = j->sx >> j->out_shift;
+	const int step = 3 * out_sx;
+	const int nv12 = j->out.layout == DC1394_BAYER_LAYOUT_NV12;
+	int oy;
+
+	for (oy = oy0; oy < oy1; oy += 2, rgb += 2 * step) {
+		const int pair = oy + 1 < oy1;
+		uint8_t *luma = (uint8_t *)j->out.plane[0] + (ptrdiff_t)oy * j->out.pitch[0];
+		uint8_t *u = (uint8_t *)j->out.plane[1] + (ptrdiff_t)(oy / 2) * j->out.pitch[1];
+		uint8_t *v = nv12 ? u + 1 : (uint8_t *)j->out.plane[2] + (ptrdiff_t)(oy / 2) * j->out.pitch[2];
+
+		j->convert_yuv(rgb, pair ? rgb + step : rgb, luma, pair ? luma + j->out.pitch[0] : NULL, u, v, nv12 ? 2 : 1, out_sx);
+	}
+}
+
+/* decode the output rows [y0, y1) a strip at a time */
+template <typename T>
+static dc1394error_t
+decode_span(const layout_job_t *j, int y0, int y1)
+{
+	const int out_sx = j->sx >> j->out_shift;
+	const int out_sy = j->sy >> j->out_shift;
+	const int step = 3 * out_sx;
+	int capacity = bayer_strip_capacity(j->strip_rows, y1 - y0, j->halo);
+	T *strip = (T *)malloc(((size_t)(capacity >> j->out_shift) + 1) * step * sizeof(T));
+	int s0, s1;
+	dc1394error_t err = DC1394_SUCCESS;
+
+	if (!strip)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+	for (s0 = y0; s0 < y1 && err == DC1394_SUCCESS; s0 = s1) {
+		int r0, r1, y;
+
+		s1 = std::min(s0 + j->strip_rows, y1);
+		r0 = s0;
+		r1 = s1;
+		bayer_window(&r0, &r1, j->halo, j->sy);
+
+		err = run_kernel(j, (const T *)(j->bayer + (ptrdiff_t)r0 * j->bayerPitch), strip, r1 - r0,
+			bayer_shift_tile(j->tile, 0, r0), step, s0 - r0, s1 - r0);
+
+		if (err == DC1394_SUCCESS && j->convert_yuv) {
+			lay_out_yuv(j, (const uint8_t *)(strip + (size_t)((s0 - r0) >> j->out_shift) * step),
+				s0 >> j->out_shift, std::min((s1 + (1 << j->out_shift) - 1) >> j->out_shift, out_sy));
+			continue;
+		}
+		for (y = s0; y < s1 && err == DC1394_SUCCESS; y += 1 << j->out_shift) {
+			int oy = y >> j->out_shift;
+			void *dst[3];
+			int i;
+
+			/* an odd last mosaic row has no Downsample output row */
+			if (oy >= out_sy)
+				break;
+			for (i = 0; i < j->planes; i++)
+				dst[i] = (uint8_t *)j->out.plane[i] + (ptrdiff_t)oy * j->out.pitch[i];
+			run_convert(j, strip + (size_t)((y - r0) >> j->out_shift) * step, dst, out_sx);
+		}
+	}
+
+	free(strip);
+	return err;
+}
+
+static void
+decode_band(void *ctx, int index)
+{
+	layout_job_t *j = (layout_job_t *)ctx;
+	int y0 = index * j->band_rows;
+	int y1 = std::min(y0 + j->band_rows, j->sy);
+	dc1394error_t err = j->kernel8 ? decode_span<uint8_t>(j, y0, y1) : decode_span<uint16_t>(j, y0, y1);
+
+	if (err != DC1394_SUCCESS)
+		j->err = err;
+}
+
+/* both depths; depth is 1 or 2 bytes, bits the 16-bit samples' */
+static dc1394error_t
+decode_layout(dc1394bayer_pool_t *pool, const uint8_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, int depth, uint32_t bits)
+{
+	layout_job_t j;
+	const uint32_t out_sx = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sx / 2 : sx;
+	int cell;
+
+	if (depth == 1) {
+		j.kernel8 = dc1394_bayer_get_kernel8(method, &j.halo);
+		j.kernel16 = NULL;
+	}
+	else {
+		j.kernel8 = NULL;
+		j.kernel16 = dc1394_bayer_get_kernel16(method, &j.halo);
+	}
+	if (!j.kernel8 && !j.kernel16)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if (!out || (out->layout > DC1394_BAYER_LAYOUT_MAX) || (out->layout < DC1394_BAYER_LAYOUT_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if ((out->order > DC1394_BAYER_ORDER_MAX) || (out->order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!bayer_valid_stride(bayer_pitch, 0, 0, 0, sx, depth))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	/* packed RGB is what the kernels write anyway */
+	if (out->layout == DC1394_BAYER_LAYOUT_RGB) {
+		if (depth == 1)
+			return dc1394_bayer_decoding_8bit_stride_parallel(pool, bayer, 0, bayer_pitch, (uint8_t *)out->plane[0], 0, out->pitch[0], sx, sy, tile, method, out->order);
+		return dc1394_bayer_decoding_16bit_stride_parallel(pool, (const uint16_t *)bayer, 0, bayer_pitch, (uint16_t *)out->plane[0], 0, out->pitch[0], sx, sy, tile, method, bits, out->order);
+	}
+
+	j.planes = layout_planes(out->layout);
+	if (!valid_output(out, j.planes, out_sx, depth))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	j.convert8 = depth == 1 ? dc1394_bayer_get_convert8(out->layout) : NULL;
+	j.convert16 = depth == 1 ? NULL : dc1394_bayer_get_convert16(out->layout);
+	j.convert_yuv = depth == 1 && yuv_layout(out->layout) ? dc1394_bayer_get_convert_yuv() : NULL;
+	if (!j.convert8 && !j.convert16 && !j.convert_yuv)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	j.bayer = bayer;
+	j.bayerPitch = bayer_pitch;
+	j.out = *out;
+	j.sx = sx;
+	j.sy = sy;
+	j.tile = tile;
+	j.bits = depth == 1 ? 8 : bits;
+	/* the planar and YCbCr converters take their strips in R,G,B order */
+	j.order = out->layout == DC1394_BAYER_LAYOUT_RGBX ? out->order : DC1394_BAYER_ORDER_RGB;
+	j.out_shift = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? 1 : 0;
+	/* in mosaic rows: a Downsample cell, or a pair of output rows */
+	cell = j.convert_yuv ? 2 << j.out_shift : 2;
+	j.strip_rows = strip_rows(sx, depth, j.halo, cell);
+	j.band_rows = (dc1394_bayer_band_rows(pool, sy, j.halo) + cell - 1) / cell * cell;
+	j.err = DC1394_SUCCESS;
+	dc1394_bayer_pool_run(pool, (sy + j.band_rows - 1) / j.band_rows, decode_band, &j);
+	return (dc1394error_t)j.err.load();
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_layout(const uint8_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method)
+{
+	return decode_layout(NULL, bayer, bayer_pitch, out, sx, sy, tile, method, 1, 8);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_layout(const uint16_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+{
+	return decode_layout(NULL, (const uint8_t *)bayer, bayer_pitch, out, sx, sy, tile, method, 2, bits);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_layout_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method)
+{
+	return decode_layout(pool, bayer, bayer_pitch, out, sx, sy, tile, method, 1, 8);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_layout_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, int bayer_pitch, const dc1394bayer_output_t * out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+{
+	return decode_layout(pool, (const uint8_t *)bayer, bayer_pitch, out, sx, sy, tile, method, 2, bits);
+}
@@ -0,0 +1,350 @@
+/*
+* Band-parallel Bayer decoding
+*
+* A pool owns a fixed set of worker threads, started when the pool is
+* created and parked on a condition variable between frames. To decode a
+* frame the caller cuts it into horizontal bands of even height, queues
+* one job whose items are the bands, and then works on the bands itself
+* alongside the workers until all of them are done. Each band runs the
+* row-range form of the kernel the registry picked, which reads the halo
+* rows it needs above and below the band directly from the shared input
+* frame and writes only its own output rows, so the result is identical
+* to the serial decoders.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "bayer.h"
+#include "bayer_internal.h"
+
+#define POOL_MAX_THREADS 256
+
+typedef struct {
+	void(*fn)(void *ctx, int index);
+	void *ctx;
+	int count;
+	int next;	/* next item to hand out, guarded by the pool lock */
+	int done;	/* items finished, guarded by the pool lock */
+} pool_job_t;
+
+struct dc1394bayer_pool_t {
+	std::mutex lock;
+	std::condition_variable work;		/* a job was queued, or the pool is stopping */
+	std::condition_variable finished;	/* an item of some job finished */
+	std::deque<pool_job_t *> jobs;
+	std::vector<std::thread> workers;
+	uint32_t threads;
+	bool stopping;
+};
+
+/* hand out the next item of job; the caller holds the pool lock */
+static int
+claim_item(dc1394bayer_pool_t *pool, pool_job_t *job)
+{
+	int index = job->next++;
+
+	if (job->next == job->count)
+		pool->jobs.erase(std::find(pool->jobs.begin(), pool->jobs.end(), job));
+	return index;
+}
+
+static void
+worker_main(dc1394bayer_pool_t *pool)
+{
+	std::unique_lock<std::mutex> guard(pool->lock);
+
+	for (;;) {
+		pool_job_t *job;
+		int index;
+
+		if (pool->jobs.empty()) {
+			if (pool->stopping)
+				return;
+			pool->work.wait(guard);
+			continue;
+		}
+
+		job = pool->jobs.front();
+		index = claim_item(pool, job);
+		guard.unlock();
+		job->fn(job->ctx, index);
+		guard.lock();
+		if (++job->done == job->count)
+			pool->finished.notify_all();
+	}
+}
+
+static uint32_t
+default_threads(void)
+{
+	unsigned long threads = 0;
+#if defined(_MSC_VER)
+	char *env = NULL;
+	size_t len;
+
+	if (_dupenv_s(&env, &len, "DC1394_BAYER_THREADS") == 0 && env) {
+		threads = strtoul(env, NULL, 10);
+		free(env);
+	}
+#else
+	const char *env = getenv("DC1394_BAYER_THREADS");
+
+	if (env)
+		threads = strtoul(env, NULL, 10);
+#endif
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	return threads ? (uint32_t)threads : 1;
+}
+
+dc1394bayer_pool_t *
+dc1394_bayer_pool_new(uint32_t threads)
+{
+	dc1394bayer_pool_t *pool = new (std::nothrow) dc1394bayer_pool_t;
+	uint32_t i;
+
+	if (!pool)
+		return NULL;
+	if (threads == 0)
+		threads = default_threads();
+	if (threads > POOL_MAX_THREADS)
+		threads = POOL_MAX_THREADS;
+
+	pool->stopping = false;
+	/* the thread that submits a job works on it too; if the system runs
+	   out of threads, make do with the workers already started */
+	try {
+		pool->workers.reserve(threads - 1);
+		for (i = 1; i < threads; i++)
+			pool->workers.push_back(std::thread(worker_main, pool));
+	}
+	catch (const std::system_error &) {
+	}
+	catch (const std::bad_alloc &) {
+	}
+	pool->threads = (uint32_t)pool->workers.size() + 1;
+	return pool;
+}
+
+void
+dc1394_bayer_pool_free(dc1394bayer_pool_t *pool)
+{
+	size_t i;
+
+	if (!pool)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(pool->lock);
+		pool->stopping = true;
+	}
+	pool->work.notify_all();
+	for (i = 0; i < pool->workers.size(); i++)
+		pool->workers[i].join();
+	delete pool;
+}
+
+uint32_t
+dc1394_bayer_pool_get_threads(const dc1394bayer_pool_t *pool)
+{
+	return pool ? pool->threads : 1;
+}
+
+void
+dc1394_bayer_pool_run(dc1394bayer_pool_t *pool, int count, void(*fn)(void *ctx, int index), void *ctx)
+{
+	pool_job_t job;
+	int i;
+
+	if (!pool || pool->workers.empty() || count < 2) {
+		for (i = 0; i < count; i++)
+			fn(ctx, i);
+		return;
+	}
+
+	job.fn = fn;
+	job.ctx = ctx;
+	job.count = count;
+	job.next = 0;
+	job.done = 0;
+
+	std::unique_lock<std::mutex> guard(pool->lock);
+	pool->jobs.push_back(&job);
+	pool->work.notify_all();
+
+	while (job.next < job.count) {
+		int index = claim_item(pool, &job);
+		guard.unlock();
+		fn(ctx, index);
+		guard.lock();
+		++job.done;
+	}
+	/* job is off the queue now; wait for the items still running elsewhere */
+	while (job.done < job.count)
+		pool->finished.wait(guard);
+}
+
+typedef struct {
+	dc1394bayer_kernel8_t kernel8;
+	dc1394bayer_kernel16_t kernel16;
+	const void *bayer;
+	void *rgb;
+	int sx, sy, tile, bits;
+	int bayerStep, rgbStep, order;
+	int band_rows;
+	std::atomic<int> err;
+} band_job_t;
+
+static void
+decode_band(void *ctx, int index)
+{
+	band_job_t *b = (band_job_t *)ctx;
+	int y0 = index * b->band_rows;
+	int y1 = std::min(y0 + b->band_rows, b->sy);
+	dc1394error_t err;
+
+	if (b->kernel8)
+		err = b->kernel8((const uint8_t *)b->bayer, (uint8_t *)b->rgb, b->sx, b->sy, b->tile, b->bayerStep, b->rgbStep, b->order, y0, y1);
+	else
+		err = b->kernel16((const uint16_t *)b->bayer, (uint16_t *)b->rgb, b->sx, b->sy, b->tile, b->bits, b->bayerStep, b->rgbStep, b->order, y0, y1);
+	if (err != DC1394_SUCCESS)
+		b->err = err;
+}
+
+int
+dc1394_bayer_band_rows(dc1394bayer_pool_t *pool, int sy, int halo)
+{
+	int threads = (int)dc1394_bayer_pool_get_threads(pool);
+	int rows = (sy + threads - 1) / threads;
+	int min_rows = std::max(8, 4 * halo);
+
+	rows = std::max(rows, min_rows);
+	return (rows + 1) & ~1;
+}
+
+static dc1394error_t
+decode_bands(dc1394bayer_pool_t *pool, band_job_t *b, int halo)
+{
+	b->band_rows = dc1394_bayer_band_rows(pool, b->sy, halo);
+	b->err = DC1394_SUCCESS;
+	dc1394_bayer_pool_run(pool, (b->sy + b->band_rows - 1) / b->band_rows, decode_band, b);
+	return (dc1394error_t)b->err.load();
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method)
+{
+	return dc1394_bayer_decoding_8bit_pitch_parallel(pool, bayer, rgb, bayer_packed_step(method, sx), sx, sy, tile, method, DC1394_BAYER_ORDER_RGB);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, uint16_t * rgb, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+{
+	return dc1394_bayer_decoding_16bit_pitch_parallel(pool, bayer, rgb, bayer_packed_step(method, sx) * sizeof(uint16_t), sx, sy, tile, method, bits, DC1394_BAYER_ORDER_RGB);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_pitch_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order)
+{
+	return dc1394_bayer_decoding_8bit_stride_parallel(pool, bayer, 0, (int)sx, rgb, 0, rgb_pitch, sx, sy, tile, method, order);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_pitch_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order)
+{
+	return dc1394_bayer_decoding_16bit_stride_parallel(pool, bayer, 0, (int)(sx * sizeof(uint16_t)), rgb, 0, rgb_pitch, sx, sy, tile, method, bits, order);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_stride_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, size_t bayer_offset, int bayer_pitch, uint8_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order)
+{
+	band_job_t b;
+	int halo;
+
+	b.kernel8 = dc1394_bayer_get_frame_kernel8(method, sx, sy, &halo);
+	if (!b.kernel8)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!bayer_valid_stride(bayer_pitch, bayer_offset, rgb_pitch, rgb_offset, sx, sizeof(uint8_t)))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	b.kernel16 = NULL;
+	b.bayer = bayer + bayer_offset;
+	b.rgb = rgb + rgb_offset;
+	b.sx = sx;
+	b.sy = sy;
+	b.tile = tile;
+	b.bits = 8;
+	b.bayerStep = bayer_pitch;
+	b.rgbStep = rgb_pitch;
+	b.order = order;
+	return decode_bands(pool, &b, halo);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_luma8_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, uint8_t * luma, int luma_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile)
+{
+	band_job_t b;
+	int halo;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	b.kernel8 = dc1394_bayer_get_frame_luma_kernel(sx, sy, &halo);
+	b.kernel16 = NULL;
+	b.bayer = bayer;
+	b.rgb = luma;
+	b.sx = sx;
+	b.sy = sy;
+	b.tile = tile;
+	b.bits = 8;
+	b.bayerStep = sx;
+	b.rgbStep = luma_pitch;
+	b.order = DC1394_BAYER_ORDER_RGB;
+	return decode_bands(pool, &b, halo);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_16bit_stride_parallel(dc1394bayer_pool_t *pool, const uint16_t * bayer, size_t bayer_offset, int bayer_pitch, uint16_t * rgb, size_t rgb_offset, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits, dc1394bayer_order_t order)
+{
+	band_job_t b;
+	int halo;
+
+	b.kernel8 = NULL;
+	b.kernel16 = dc1394_bayer_get_kernel16(method, &halo);
+	if (!b.kernel16)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!bayer_valid_stride(bayer_pitch, bayer_offset, rgb_pitch, rgb_offset, sx, sizeof(uint16_t)))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	b.bayer = (const uint8_t *)bayer + bayer_offset;
+	b.rgb = (uint8_t *)rgb + rgb_offset;
+	b.sx = sx;
+	b.sy = sy;
+	b.tile = tile;
+	b.bits = bits;
+	b.bayerStep = bayer_pitch / (int)sizeof(uint16_t);
+	b.rgbStep = rgb_pitch / (int)sizeof(uint16_t);
+	b.order = order;
+	return decode_bands(pool, &b, halo);
+}
@@ -0,0 +1,109 @@
+/*
+* Region-of-interest Bayer decoding
+*
+* Each rectangle is decoded on its own. The mosaic under it, grown by
+* the method's halo and clipped to the frame, is copied to a small
+* scratch image whose tile is that of the frame seen from the copy's
+* origin. The row-range kernel then decodes the rectangle's rows of the
+* copy and the rectangle's pixels are copied out. Where the rectangle
+* reaches the frame edge the copy ends there too, so the kernel treats
+* the border exactly as it does for the whole frame.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "bayer.h"
+#include "bayer_internal.h"
+
+/* mosaic window a rectangle of output pixels is decoded from */
+static void
+roi_window(const dc1394bayer_roi_t *roi, int scale, int halo, int sx, int sy, int *x0, int *x1, int *y0, int *y1)
+{
+	*x0 = roi->x * scale;
+	*x1 = (roi->x + roi->width) * scale;
+	*y0 = roi->y * scale;
+	*y1 = (roi->y + roi->height) * scale;
+	bayer_window(x0, x1, halo, sx);
+	bayer_window(y0, y1, halo, sy);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_8bit_roi(const uint8_t * bayer, uint8_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_order_t order, const dc1394bayer_roi_t *rois, uint32_t num_rois)
+{
+	int halo;
+	dc1394bayer_kernel8_t kernel = dc1394_bayer_get_kernel8(method, &halo);
+	/* Downsample rectangles are in half-resolution pixels */
+	const int scale = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? 2 : 1;
+	const uint32_t out_sx = sx / scale;
+	const uint32_t out_sy = sy / scale;
+	size_t scratch_size = 0;
+	uint8_t *scratch;
+	dc1394error_t err = DC1394_SUCCESS;
+	uint32_t i;
+
+	if (!kernel)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (num_rois && !rois)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	/* check every rectangle before writing any, and size the scratch
+	   image for the largest window */
+	for (i = 0; i < num_rois; i++) {
+		const dc1394bayer_roi_t *r = &rois[i];
+		int x0, x1, y0, y1;
+
+		if ((r->x > out_sx) || (r->width > out_sx - r->x) || (r->y > out_sy) || (r->height > out_sy - r->y))
+			return DC1394_INVALID_ARGUMENT_VALUE;
+		if (!r->width || !r->height)
+			continue;
+		roi_window(r, scale, halo, sx, sy, &x0, &x1, &y0, &y1);
+		/* the mosaic copy and the kernel's output for it */
+		scratch_size = std::max(scratch_size, (size_t)(x1 - x0) * (y1 - y0) * 4);
+	}
+	if (!scratch_size)
+		return DC1394_SUCCESS;
+
+	scratch = (uint8_t *)malloc(scratch_size);
+	if (!scratch)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+	for (i = 0; i < num_rois; i++) {
+		const dc1394bayer_roi_t *r = &rois[i];
+		uint8_t *mosaic = scratch;
+		uint8_t *out;
+		int x0, x1, y0, y1;
+		int w, h, step, y;
+
+		if (!r->width || !r->height)
+			continue;
+		roi_window(r, scale, halo, sx, sy, &x0, &x1, &y0, &y1);
+		w = x1 - x0;
+		h = y1 - y0;
+		out = scratch + w * h;
+		step = bayer_packed_step(method, w);
+
+		for (y = y0; y < y1; y++)
+			memcpy(mosaic + (y - y0) * w, bayer + y * sx + x0, w);
+
+		err = kernel(mosaic, out, w, h, bayer_shift_tile(tile, x0, y0), w, step, order,
+			r->y * scale - y0, (r->y + r->height) * scale - y0);
+		if (err != DC1394_SUCCESS)
+			break;
+
+		for (y = r->y; y < (int)(r->y + r->height); y++)
+			memcpy(rgb + y * rgb_pitch + 3 * r->x, out + (y - y0 / scale) * step + 3 * (r->x - x0 / scale), 3 * r->width);
+	}
+
+	free(scratch);
+	return err;
+}
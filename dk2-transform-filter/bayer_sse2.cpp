@@ -0,0 +1,565 @@
+/*
+* SSE2 Bayer decoding kernels
+*
+* Vectorized versions of the reference decoders in bayer.cpp. Each one
+* computes whole rows sixteen pixels at a time and matches the scalar
+* output byte for byte; the row tails fall back to the scalar per-pixel
+* helpers in bayer_internal.h.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <emmintrin.h>
+#include "bayer_internal.h"
+
+/* select a where mask is set, b elsewhere */
+static inline __m128i
+blend_sse2(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* (a + b + c + d + 2) >> 2 on unsigned bytes, exact */
+static inline __m128i
+avg4_sse2(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+	__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+	return _mm_packus_epi16(lo, hi);
+}
+
+/* four R,G,B,0 dwords -> twelve packed bytes in the low part of the register */
+static inline __m128i
+pack_rgb0_sse2(__m128i v)
+{
+	const __m128i lo24 = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+	const __m128i hi24 = _mm_set_epi32(0x0000ffff, 0xff000000, 0x0000ffff, 0xff000000);
+	__m128i x = _mm_or_si128(_mm_and_si128(v, lo24), _mm_and_si128(_mm_srli_epi64(v, 8), hi24));
+	return _mm_or_si128(_mm_move_epi64(x), _mm_slli_si128(_mm_unpackhi_epi64(x, _mm_setzero_si128()), 6));
+}
+
+/* one vector store, aligned when the caller can vouch for dst */
+template <bool ALIGNED>
+static inline void
+store_sse2(uint8_t *dst, __m128i v)
+{
+	if (ALIGNED)
+		_mm_store_si128((__m128i *)dst, v);
+	else
+		_mm_storeu_si128((__m128i *)dst, v);
+}
+
+/* interleave sixteen R, G and B bytes into 48 bytes of packed RGB24 */
+template <bool ALIGNED = false>
+static inline void
+store_rgb24_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i rg_lo = _mm_unpacklo_epi8(r, g);
+	__m128i rg_hi = _mm_unpackhi_epi8(r, g);
+	__m128i bz_lo = _mm_unpacklo_epi8(b, zero);
+	__m128i bz_hi = _mm_unpackhi_epi8(b, zero);
+	__m128i p0 = pack_rgb0_sse2(_mm_unpacklo_epi16(rg_lo, bz_lo));
+	__m128i p1 = pack_rgb0_sse2(_mm_unpackhi_epi16(rg_lo, bz_lo));
+	__m128i p2 = pack_rgb0_sse2(_mm_unpacklo_epi16(rg_hi, bz_hi));
+	__m128i p3 = pack_rgb0_sse2(_mm_unpackhi_epi16(rg_hi, bz_hi));
+
+	store_sse2<ALIGNED>(dst, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+	store_sse2<ALIGNED>(dst + 16, _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+	store_sse2<ALIGNED>(dst + 32, _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+/* even and odd bytes of the 32 at p */
+static inline void
+deinterleave_sse2(const uint8_t *p, __m128i *even, __m128i *odd)
+{
+	const __m128i lo = _mm_set1_epi16(0x00ff);
+	__m128i a = _mm_loadu_si128((const __m128i *)p);
+	__m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+
+	*even = _mm_packus_epi16(_mm_and_si128(a, lo), _mm_and_si128(b, lo));
+	*odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+/* (a + b) >> 1 on unsigned bytes: pavgb rounds up, so take back the carry of odd sums */
+static inline __m128i
+avg_floor_sse2(__m128i a, __m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+/*
+* BT.601 luma of sixteen pixels from their bilinear colours, weighting
+* own and opp with w_own and w_opp. Exact in 16-bit lanes: the weights
+* sum to 256, so the largest sum is 255 * 256 + 128.
+*/
+static inline __m128i
+luma_sse2(__m128i own, __m128i g, __m128i opp, __m128i w_own, __m128i w_opp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w_g = _mm_set1_epi16(BAYER_LUMA_G);
+	const __m128i half = _mm_set1_epi16(128);
+	__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(own, zero), w_own),
+		_mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), w_g)),
+		_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(opp, zero), w_opp), half));
+	__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(own, zero), w_own),
+		_mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), w_g)),
+		_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(opp, zero), w_opp), half));
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+/*
+* Bilinear colours of the sixteen pixels starting at p: the colour of the
+* row's non-green sites (own), green, and the opposite colour. green has
+* 0xff in the bytes of green sites.
+*/
+static inline void
+bilinear_sse2(const uint8_t *p, int step, __m128i green, __m128i *own, __m128i *g, __m128i *opp)
+{
+	const uint8_t *above = p - step;
+	const uint8_t *below = p + step;
+	__m128i a = _mm_loadu_si128((const __m128i *)above);
+	__m128i d = _mm_loadu_si128((const __m128i *)below);
+	__m128i cl = _mm_loadu_si128((const __m128i *)(p - 1));
+	__m128i c = _mm_loadu_si128((const __m128i *)p);
+	__m128i cr = _mm_loadu_si128((const __m128i *)(p + 1));
+	__m128i diag = avg4_sse2(_mm_loadu_si128((const __m128i *)(above - 1)),
+		_mm_loadu_si128((const __m128i *)(above + 1)),
+		_mm_loadu_si128((const __m128i *)(below - 1)),
+		_mm_loadu_si128((const __m128i *)(below + 1)));
+	__m128i cross = avg4_sse2(a, d, cl, cr);
+	__m128i vert = _mm_avg_epu8(a, d);
+	__m128i horiz = _mm_avg_epu8(cl, cr);
+
+	*own = blend_sse2(green, horiz, c);
+	*g = blend_sse2(green, c, cross);
+	*opp = blend_sse2(green, vert, diag);
+}
+
+/* OpenCV's Bayer decoding, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_border_rows(bayer, rgb, sx, sy, tile, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m128i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		/* B,G,R output is a red row written as if it were a blue one */
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		/* the vector loop starts at x = 1, so lane i holds column 1 + i */
+		green = ((1 + green_x) & 1) ? _mm_set1_epi16((short)0xff00) : _mm_set1_epi16(0x00ff);
+
+		for (x = 1; x + 16 <= sx - 1; x += 16) {
+			__m128i own, g, opp;
+
+			bilinear_sse2(cur + x, bayerStep, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb24_sse2(out + 3 * x, own, g, opp);
+			else
+				store_rgb24_sse2(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_bilinear_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* dc1394_bayer_Bilinear_luma, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_sse2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_luma_border_rows(bayer, luma, sx, sy, tile, bayerStep, lumaStep, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = luma + y * lumaStep;
+		int green_x, red_row;
+		__m128i green, w_own, w_opp;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		green = ((1 + green_x) & 1) ? _mm_set1_epi16((short)0xff00) : _mm_set1_epi16(0x00ff);
+		w_own = _mm_set1_epi16(red_row ? BAYER_LUMA_R : BAYER_LUMA_B);
+		w_opp = _mm_set1_epi16(red_row ? BAYER_LUMA_B : BAYER_LUMA_R);
+
+		for (x = 1; x + 16 <= sx - 1; x += 16) {
+			__m128i own, g, opp;
+
+			bilinear_sse2(cur + x, bayerStep, green, &own, &g, &opp);
+			_mm_storeu_si128((__m128i *)(out + x), luma_sse2(own, g, opp, w_own, w_opp));
+		}
+
+		for (; x < sx - 1; x++)
+			out[x] = bayer_bilinear_luma_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* the sixteen output pixels of the 2x2 cells in the 32 columns at p */
+static inline void
+downsample_sse2(const uint8_t *p, int step, int green_first, int r_out, uint8_t *out)
+{
+	__m128i e0, o0, e1, o1, g, other;
+
+	deinterleave_sse2(p, &e0, &o0);
+	deinterleave_sse2(p + step, &e1, &o1);
+	if (green_first) {
+		g = avg_floor_sse2(e0, o1);
+		other = e1;
+	}
+	else {
+		g = avg_floor_sse2(e1, o0);
+		other = e0;
+	}
+	if (r_out == 0)
+		store_rgb24_sse2(out, o1, g, other);
+	else
+		store_rgb24_sse2(out, other, g, o1);
+}
+
+/* coriander's Bayer decoding, sixteen output pixels per step */
+dc1394error_t
+dc1394_bayer_Downsample_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int last = y1 < sy ? y1 : sy;
+	int green_first, r_out;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_downsample_phase(tile, order, &green_first, &r_out);
+
+	for (y = y0; y < last; y += 2) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + (y >> 1) * rgbStep;
+
+		for (x = 0; x + 32 <= sx; x += 32)
+			downsample_sse2(cur + x, bayerStep, green_first, r_out, out + 3 * (x >> 1));
+
+		for (; x < sx; x += 2)
+			bayer_downsample_pixel(cur + x, bayerStep, green_first, r_out, out + 3 * (x >> 1));
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/*
+* The 5x5 neighbourhood HQLinear reads around eight sites of one colour,
+* every other column, widened to 16 bits: n2/s2 are two rows up and
+* down, nw..se the 3x3 ring and w2/e2 two columns left and right.
+*/
+typedef struct {
+	__m128i n2, nw, n, ne, w2, w, c, e, e2, sw, s, se, s2;
+} hq_sites_sse2_t;
+
+/* bytes 0, 2, .. 14 and 1, 3, .. 15 of the sixteen at p as 16-bit lanes */
+static inline void
+widen_pairs_sse2(const uint8_t *p, __m128i *even, __m128i *odd)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *)p);
+
+	*even = _mm_and_si128(v, _mm_set1_epi16(0x00ff));
+	*odd = _mm_srli_epi16(v, 8);
+}
+
+/* neighbourhoods of the sixteen sites at p: a gets the even ones, b the odd */
+static inline void
+hq_sites_sse2(const uint8_t *p, int step, hq_sites_sse2_t *a, hq_sites_sse2_t *b)
+{
+	__m128i l0, l1, m0, m1, r0, r1;
+
+	widen_pairs_sse2(p - 2 * step, &a->n2, &b->n2);
+	widen_pairs_sse2(p + 2 * step, &a->s2, &b->s2);
+
+	widen_pairs_sse2(p - step - 2, &l0, &l1);
+	widen_pairs_sse2(p - step, &m0, &m1);
+	widen_pairs_sse2(p - step + 2, &r0, &r1);
+	a->nw = l1; a->n = m0; a->ne = m1;
+	b->nw = m0; b->n = m1; b->ne = r0;
+
+	widen_pairs_sse2(p + step - 2, &l0, &l1);
+	widen_pairs_sse2(p + step, &m0, &m1);
+	widen_pairs_sse2(p + step + 2, &r0, &r1);
+	a->sw = l1; a->s = m0; a->se = m1;
+	b->sw = m0; b->s = m1; b->se = r0;
+
+	widen_pairs_sse2(p - 2, &l0, &l1);
+	widen_pairs_sse2(p, &m0, &m1);
+	widen_pairs_sse2(p + 2, &r0, &r1);
+	a->w2 = l0; a->w = l1; a->c = m0; a->e = m1; a->e2 = r0;
+	b->w2 = l1; b->w = m0; b->c = m1; b->e = r0; b->e2 = r1;
+}
+
+/*
+* bayer_hqlinear_pixel() at eight green sites, before clamping. Every
+* partial sum stays within -1530 .. 3574, so 16-bit lanes are exact and
+* the arithmetic shift rounds like the scalar >> 3.
+*/
+static inline void
+hq_green_sse2(const hq_sites_sse2_t *q, __m128i *vert, __m128i *horiz)
+{
+	__m128i diag = _mm_add_epi16(_mm_add_epi16(q->nw, q->ne), _mm_add_epi16(q->sw, q->se));
+	__m128i base = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(q->c, 2), q->c), _mm_set1_epi16(4)), diag);
+	__m128i v = _mm_add_epi16(base, _mm_slli_epi16(_mm_add_epi16(q->n, q->s), 2));
+	__m128i h = _mm_add_epi16(base, _mm_slli_epi16(_mm_add_epi16(q->w, q->e), 2));
+
+	v = _mm_add_epi16(_mm_sub_epi16(v, _mm_add_epi16(q->n2, q->s2)), _mm_avg_epu16(q->w2, q->e2));
+	h = _mm_add_epi16(_mm_sub_epi16(h, _mm_add_epi16(q->w2, q->e2)), _mm_avg_epu16(q->n2, q->s2));
+	*vert = _mm_srai_epi16(v, 3);
+	*horiz = _mm_srai_epi16(h, 3);
+}
+
+/* bayer_hqlinear_pixel() at eight red or blue sites, before clamping */
+static inline void
+hq_colour_sse2(const hq_sites_sse2_t *q, __m128i *opp, __m128i *g)
+{
+	__m128i diag = _mm_add_epi16(_mm_add_epi16(q->nw, q->ne), _mm_add_epi16(q->sw, q->se));
+	__m128i cross = _mm_add_epi16(_mm_add_epi16(q->n, q->w), _mm_add_epi16(q->e, q->s));
+	__m128i far = _mm_add_epi16(_mm_add_epi16(q->n2, q->w2), _mm_add_epi16(q->e2, q->s2));
+	__m128i far3 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(far, _mm_slli_epi16(far, 1)), _mm_set1_epi16(1)), 1);
+	__m128i c4 = _mm_add_epi16(_mm_slli_epi16(q->c, 2), _mm_set1_epi16(4));
+	__m128i o = _mm_add_epi16(_mm_sub_epi16(_mm_slli_epi16(diag, 1), far3), _mm_add_epi16(c4, _mm_slli_epi16(q->c, 1)));
+	__m128i t = _mm_add_epi16(_mm_sub_epi16(_mm_slli_epi16(cross, 1), far), c4);
+
+	*opp = _mm_srai_epi16(o, 3);
+	*g = _mm_srai_epi16(t, 3);
+}
+
+/* clamp two sets of eight 16-bit values to bytes and interleave them, a first */
+static inline __m128i
+interleave_sse2(__m128i a, __m128i b)
+{
+	return _mm_unpacklo_epi8(_mm_packus_epi16(a, a), _mm_packus_epi16(b, b));
+}
+
+/* Malvar-He-Cutler as in dc1394_bayer_HQLinear, sixteen pixels per step */
+dc1394error_t
+dc1394_bayer_HQLinear_rows_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_HQLinear_border_rows(bayer, rgb, sx, sy, tile, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint8_t *cur = bayer + y * bayerStep;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row, own;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		own = (red_row ^ (order == DC1394_BAYER_ORDER_BGR)) ? 0 : 2;
+
+		for (x = 2; x + 16 <= sx - 2; x += 16) {
+			hq_sites_sse2_t a, b;
+			__m128i vert, horiz, opp, g, own_v, opp_v, green_v;
+
+			/* x is even, so the even sites are the green ones when green_x is 0 */
+			hq_sites_sse2(cur + x, bayerStep, &a, &b);
+			if (green_x == 0) {
+				hq_green_sse2(&a, &vert, &horiz);
+				hq_colour_sse2(&b, &opp, &g);
+				own_v = interleave_sse2(horiz, b.c);
+				opp_v = interleave_sse2(vert, opp);
+				green_v = interleave_sse2(a.c, g);
+			}
+			else {
+				hq_colour_sse2(&a, &opp, &g);
+				hq_green_sse2(&b, &vert, &horiz);
+				own_v = interleave_sse2(a.c, horiz);
+				opp_v = interleave_sse2(opp, vert);
+				green_v = interleave_sse2(g, b.c);
+			}
+			if (own == 0)
+				store_rgb24_sse2(out + 3 * x, own_v, green_v, opp_v);
+			else
+				store_rgb24_sse2(out + 3 * x, opp_v, green_v, own_v);
+		}
+
+		for (; x < sx - 2; x++)
+			bayer_hqlinear_pixel(cur + x, bayerStep, (x & 1) == green_x, own, 255, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/*
+* Kernels for one frame size, given as template arguments so that the
+* strides and trip counts are constants and every row is whole vectors.
+* Rows 2 .. SY - 3 are decoded from column 0 rather than 1: the vectors
+* at the ends then read the last pixel of the row above and the first of
+* the row below, which only spoils columns 0 and SX - 1, both border
+* pixels decoded afterwards. In exchange every vector starts on a
+* multiple of sixteen pixels, so with 16-byte aligned output rows every
+* store is aligned.
+* Other output rows, unaligned output and mosaics whose rows are not
+* SX apart go through the generic kernel.
+*/
+template <int SX, int SY>
+static dc1394error_t
+bilinear_rows_fixed_sse2(const uint8_t * bayer, uint8_t * rgb, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int m0, m1, x, y;
+
+	static_assert(SX % 16 == 0, "rows must be whole vectors");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_wrap_rows(SY, y0, y1, &m0, &m1);
+	if (bayerStep != SX || !bayer_aligned16(rgb, rgbStep) || m0 >= m1)
+		return dc1394_bayer_Bilinear_rows_sse2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, y1);
+	dc1394_bayer_Bilinear_rows_sse2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, m0);
+	dc1394_bayer_Bilinear_rows_sse2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, m1, y1);
+
+	for (y = m0; y < m1; y++) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m128i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		/* lane i holds column x + i, x even */
+		green = green_x ? _mm_set1_epi16((short)0xff00) : _mm_set1_epi16(0x00ff);
+
+		for (x = 0; x < SX; x += 16) {
+			__m128i own, g, opp;
+
+			bilinear_sse2(cur + x, SX, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb24_sse2<true>(out + 3 * x, own, g, opp);
+			else
+				store_rgb24_sse2<true>(out + 3 * x, opp, g, own);
+		}
+	}
+
+	dc1394_bayer_Bilinear_border_rows(bayer, rgb, SX, SY, tile, SX, rgbStep, order, m0, m1);
+	return DC1394_SUCCESS;
+}
+
+template <int SX, int SY>
+static dc1394error_t
+bilinear_luma_rows_fixed_sse2(const uint8_t * bayer, uint8_t * luma, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	int m0, m1, x, y;
+
+	static_assert(SX % 16 == 0, "rows must be whole vectors");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	bayer_wrap_rows(SY, y0, y1, &m0, &m1);
+	if (bayerStep != SX || !bayer_aligned16(luma, lumaStep) || m0 >= m1)
+		return dc1394_bayer_Bilinear_luma_rows_sse2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, y0, y1);
+	dc1394_bayer_Bilinear_luma_rows_sse2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, y0, m0);
+	dc1394_bayer_Bilinear_luma_rows_sse2(bayer, luma, SX, SY, tile, bayerStep, lumaStep, order, m1, y1);
+
+	for (y = m0; y < m1; y++) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = luma + y * lumaStep;
+		int green_x, red_row;
+		__m128i green, w_own, w_opp;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		green = green_x ? _mm_set1_epi16((short)0xff00) : _mm_set1_epi16(0x00ff);
+		w_own = _mm_set1_epi16(red_row ? BAYER_LUMA_R : BAYER_LUMA_B);
+		w_opp = _mm_set1_epi16(red_row ? BAYER_LUMA_B : BAYER_LUMA_R);
+
+		for (x = 0; x < SX; x += 16) {
+			__m128i own, g, opp;
+
+			bilinear_sse2(cur + x, SX, green, &own, &g, &opp);
+			_mm_store_si128((__m128i *)(out + x), luma_sse2(own, g, opp, w_own, w_opp));
+		}
+	}
+
+	dc1394_bayer_Bilinear_luma_border_rows(bayer, luma, SX, SY, tile, SX, lumaStep, m0, m1);
+	return DC1394_SUCCESS;
+}
+
+/* a half-size row is whole vectors but for the last one, which overlaps
+   its predecessor instead of leaving a scalar tail */
+template <int SX, int SY>
+static dc1394error_t
+downsample_rows_fixed_sse2(const uint8_t * bayer, uint8_t * rgb, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int last = y1 < SY ? y1 : SY;
+	int green_first, r_out;
+	int x, y;
+
+	static_assert(SX % 2 == 0 && SX >= 32, "rows must hold a vector of cells");
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if (bayerStep != SX)
+		return dc1394_bayer_Downsample_rows_sse2(bayer, rgb, SX, SY, tile, bayerStep, rgbStep, order, y0, y1);
+
+	bayer_downsample_phase(tile, order, &green_first, &r_out);
+
+	for (y = y0; y < last; y += 2) {
+		const uint8_t *cur = bayer + y * SX;
+		uint8_t *out = rgb + (y >> 1) * rgbStep;
+
+		for (x = 0; x + 32 <= SX; x += 32)
+			downsample_sse2(cur + x, SX, green_first, r_out, out + 3 * (x >> 1));
+		if (SX % 32)
+			downsample_sse2(cur + SX - 32, SX, green_first, r_out, out + 3 * ((SX - 32) >> 1));
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/* the DK2 sensor */
+
+dc1394error_t
+dc1394_bayer_Bilinear_rows_752x480_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return bilinear_rows_fixed_sse2<752, 480>(bayer, rgb, tile, bayerStep, rgbStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_Bilinear_luma_rows_752x480_sse2(const uint8_t * bayer, uint8_t * luma, int sx, int sy, int tile, int bayerStep, int lumaStep, int order, int y0, int y1)
+{
+	return bilinear_luma_rows_fixed_sse2<752, 480>(bayer, luma, tile, bayerStep, lumaStep, order, y0, y1);
+}
+
+dc1394error_t
+dc1394_bayer_Downsample_rows_752x480_sse2(const uint8_t * bayer, uint8_t * rgb, int sx, int sy, int tile, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	return downsample_rows_fixed_sse2<752, 480>(bayer, rgb, tile, bayerStep, rgbStep, order, y0, y1);
+}
@@ -0,0 +1,350 @@
+/*
+* SSE4.1 Bayer decoding kernels for 16-bit mosaics
+*
+* Vectorized versions of the 16-bit Simple, Bilinear and HQLinear
+* decoders in bayer.cpp, eight pixels per step. They match the scalar
+* output exactly for any bit depth: the clamps to (1 << bits) - 1 are
+* unsigned minima, and the averages are built from pavgw so that no sum
+* of 16-bit samples has to fit in 16 bits. The row tails fall back to the
+* scalar per-pixel helpers in bayer_internal.h.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <smmintrin.h>
+#include "bayer_internal.h"
+
+static inline __m128i
+load_sse41(const uint16_t *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+/* select a where mask is set, b elsewhere */
+static inline __m128i
+blend_sse41(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_blendv_epi8(b, a, mask);
+}
+
+/* (a + b) >> 1 on unsigned 16-bit lanes: pavgw rounds up, so take back the carry of odd sums */
+static inline __m128i
+avg_floor_sse41(__m128i a, __m128i b)
+{
+	return _mm_sub_epi16(_mm_avg_epu16(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi16(1)));
+}
+
+/*
+* (a + b + c + d + 2) >> 2 on unsigned 16-bit lanes, exact. With
+* p = (a + b) >> 1 and q = (c + d) >> 1 the sum is 2p + 2q plus the two
+* dropped low bits, so the result is (p + q + 1) >> 1 but for one more
+* when both low bits are set and p + q is even.
+*/
+static inline __m128i
+avg4_sse41(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i p = avg_floor_sse41(a, b);
+	__m128i q = avg_floor_sse41(c, d);
+	__m128i low = _mm_and_si128(_mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(c, d)), one);
+
+	return _mm_add_epi16(_mm_avg_epu16(p, q), _mm_andnot_si128(_mm_xor_si128(p, q), low));
+}
+
+/* interleave eight R, G and B samples into 24 samples of packed RGB48 */
+static inline void
+store_rgb48_sse41(uint16_t *dst, __m128i r, __m128i g, __m128i b)
+{
+	const __m128i r0 = _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1);
+	const __m128i g0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5);
+	const __m128i b0 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11);
+	const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1);
+	const __m128i b1 = _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1);
+	const __m128i b2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15);
+
+	_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0),
+		_mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0)));
+	_mm_storeu_si128((__m128i *)(dst + 8), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1),
+		_mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1)));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2),
+		_mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2)));
+}
+
+/* lanes of the green sites among eight starting at column x, for rows whose greens sit at green_x */
+static inline __m128i
+green_lanes_sse41(int x, int green_x)
+{
+	return ((x + green_x) & 1) ? _mm_set1_epi32((int)0xffff0000) : _mm_set1_epi32(0x0000ffff);
+}
+
+/* coriander's Bayer decoding, eight pixels per step */
+dc1394error_t
+dc1394_bayer_Simple_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	const int maxval = (1 << bits) - 1;
+	const __m128i maxv = _mm_set1_epi16((short)maxval);
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Simple_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = y0; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m128i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = green_lanes_sse41(0, green_x);
+
+		/* each pixel reads the 2x2 cell it opens, so the last column is left to the border */
+		for (x = 0; x + 8 <= sx - 1; x += 8) {
+			__m128i a = load_sse41(cur + x);
+			__m128i b = load_sse41(cur + x + 1);
+			__m128i c = load_sse41(cur + bayerStep + x);
+			__m128i d = load_sse41(cur + bayerStep + x + 1);
+			__m128i g = blend_sse41(green, avg_floor_sse41(a, d), avg_floor_sse41(b, c));
+			__m128i own = _mm_min_epu16(blend_sse41(green, b, a), maxv);
+			__m128i opp = _mm_min_epu16(blend_sse41(green, c, d), maxv);
+
+			g = _mm_min_epu16(g, maxv);
+			if (red_row)
+				store_rgb48_sse41(out + 3 * x, own, g, opp);
+			else
+				store_rgb48_sse41(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_simple_uint16_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, maxval, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/*
+* Bilinear colours of the eight pixels starting at p: the colour of the
+* row's non-green sites (own), green, and the opposite colour. green has
+* 0xffff in the lanes of green sites. The 16-bit decoder does not clamp.
+*/
+static inline void
+bilinear_sse41(const uint16_t *p, int step, __m128i green, __m128i *own, __m128i *g, __m128i *opp)
+{
+	const uint16_t *above = p - step;
+	const uint16_t *below = p + step;
+	__m128i a = load_sse41(above);
+	__m128i d = load_sse41(below);
+	__m128i cl = load_sse41(p - 1);
+	__m128i c = load_sse41(p);
+	__m128i cr = load_sse41(p + 1);
+	__m128i diag = avg4_sse41(load_sse41(above - 1), load_sse41(above + 1),
+		load_sse41(below - 1), load_sse41(below + 1));
+	__m128i cross = avg4_sse41(a, d, cl, cr);
+
+	*own = blend_sse41(green, _mm_avg_epu16(cl, cr), c);
+	*g = blend_sse41(green, c, cross);
+	*opp = blend_sse41(green, _mm_avg_epu16(a, d), diag);
+}
+
+/* OpenCV's Bayer decoding, eight pixels per step */
+dc1394error_t
+dc1394_bayer_Bilinear_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	int first = y0 > 1 ? y0 : 1;
+	int last = y1 < sy - 1 ? y1 : sy - 1;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_Bilinear_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row;
+		__m128i green;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		/* B,G,R output is a red row written as if it were a blue one */
+		red_row ^= order == DC1394_BAYER_ORDER_BGR;
+		green = green_lanes_sse41(1, green_x);
+
+		for (x = 1; x + 8 <= sx - 1; x += 8) {
+			__m128i own, g, opp;
+
+			bilinear_sse41(cur + x, bayerStep, green, &own, &g, &opp);
+			if (red_row)
+				store_rgb48_sse41(out + 3 * x, own, g, opp);
+			else
+				store_rgb48_sse41(out + 3 * x, opp, g, own);
+		}
+
+		for (; x < sx - 1; x++)
+			bayer_bilinear_pixel(cur + x, bayerStep, (x & 1) == green_x, red_row, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
+
+/*
+* The 5x5 neighbourhood HQLinear reads around four sites of one colour,
+* every other column, widened to 32 bits: n2/s2 are two rows up and
+* down, nw..se the 3x3 ring and w2/e2 two columns left and right.
+*/
+typedef struct {
+	__m128i n2, nw, n, ne, w2, w, c, e, e2, sw, s, se, s2;
+} hq_sites_sse41_t;
+
+/* samples 0, 2, 4, 6 and 1, 3, 5, 7 of the eight at p as 32-bit lanes */
+static inline void
+widen_pairs_sse41(const uint16_t *p, __m128i *even, __m128i *odd)
+{
+	__m128i v = load_sse41(p);
+
+	*even = _mm_blend_epi16(v, _mm_setzero_si128(), 0xaa);
+	*odd = _mm_srli_epi32(v, 16);
+}
+
+/* neighbourhoods of the eight sites at p: a gets the even ones, b the odd */
+static inline void
+hq_sites_sse41(const uint16_t *p, int step, hq_sites_sse41_t *a, hq_sites_sse41_t *b)
+{
+	__m128i l0, l1, m0, m1, r0, r1;
+
+	widen_pairs_sse41(p - 2 * step, &a->n2, &b->n2);
+	widen_pairs_sse41(p + 2 * step, &a->s2, &b->s2);
+
+	widen_pairs_sse41(p - step - 2, &l0, &l1);
+	widen_pairs_sse41(p - step, &m0, &m1);
+	widen_pairs_sse41(p - step + 2, &r0, &r1);
+	a->nw = l1; a->n = m0; a->ne = m1;
+	b->nw = m0; b->n = m1; b->ne = r0;
+
+	widen_pairs_sse41(p + step - 2, &l0, &l1);
+	widen_pairs_sse41(p + step, &m0, &m1);
+	widen_pairs_sse41(p + step + 2, &r0, &r1);
+	a->sw = l1; a->s = m0; a->se = m1;
+	b->sw = m0; b->s = m1; b->se = r0;
+
+	widen_pairs_sse41(p - 2, &l0, &l1);
+	widen_pairs_sse41(p, &m0, &m1);
+	widen_pairs_sse41(p + 2, &r0, &r1);
+	a->w2 = l0; a->w = l1; a->c = m0; a->e = m1; a->e2 = r0;
+	b->w2 = l1; b->w = m0; b->c = m1; b->e = r0; b->e2 = r1;
+}
+
+/*
+* bayer_hqlinear_pixel() at four green sites, before clamping. The
+* partial sums need 20 bits and a sign; the lanes hold zero-extended
+* samples, so pavgw on them is the rounded average of the samples.
+*/
+static inline void
+hq_green_sse41(const hq_sites_sse41_t *q, __m128i *vert, __m128i *horiz)
+{
+	__m128i diag = _mm_add_epi32(_mm_add_epi32(q->nw, q->ne), _mm_add_epi32(q->sw, q->se));
+	__m128i base = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(q->c, 2), q->c), _mm_set1_epi32(4)), diag);
+	__m128i v = _mm_add_epi32(base, _mm_slli_epi32(_mm_add_epi32(q->n, q->s), 2));
+	__m128i h = _mm_add_epi32(base, _mm_slli_epi32(_mm_add_epi32(q->w, q->e), 2));
+
+	v = _mm_add_epi32(_mm_sub_epi32(v, _mm_add_epi32(q->n2, q->s2)), _mm_avg_epu16(q->w2, q->e2));
+	h = _mm_add_epi32(_mm_sub_epi32(h, _mm_add_epi32(q->w2, q->e2)), _mm_avg_epu16(q->n2, q->s2));
+	*vert = _mm_srai_epi32(v, 3);
+	*horiz = _mm_srai_epi32(h, 3);
+}
+
+/* bayer_hqlinear_pixel() at four red or blue sites, before clamping */
+static inline void
+hq_colour_sse41(const hq_sites_sse41_t *q, __m128i *opp, __m128i *g)
+{
+	__m128i diag = _mm_add_epi32(_mm_add_epi32(q->nw, q->ne), _mm_add_epi32(q->sw, q->se));
+	__m128i cross = _mm_add_epi32(_mm_add_epi32(q->n, q->w), _mm_add_epi32(q->e, q->s));
+	__m128i far = _mm_add_epi32(_mm_add_epi32(q->n2, q->w2), _mm_add_epi32(q->e2, q->s2));
+	__m128i far3 = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(far, _mm_slli_epi32(far, 1)), _mm_set1_epi32(1)), 1);
+	__m128i c4 = _mm_add_epi32(_mm_slli_epi32(q->c, 2), _mm_set1_epi32(4));
+	__m128i o = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(diag, 1), far3), _mm_add_epi32(c4, _mm_slli_epi32(q->c, 1)));
+	__m128i t = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(cross, 1), far), c4);
+
+	*opp = _mm_srai_epi32(o, 3);
+	*g = _mm_srai_epi32(t, 3);
+}
+
+/* v clamped to 0 .. maxv */
+static inline __m128i
+clamp_sse41(__m128i v, __m128i maxv)
+{
+	return _mm_min_epi32(_mm_max_epi32(v, _mm_setzero_si128()), maxv);
+}
+
+/* interleave two sets of four samples in 32-bit lanes, a first */
+static inline __m128i
+interleave_sse41(__m128i a, __m128i b)
+{
+	return _mm_or_si128(a, _mm_slli_epi32(b, 16));
+}
+
+/* Malvar-He-Cutler as in dc1394_bayer_HQLinear_uint16, eight pixels per step */
+dc1394error_t
+dc1394_bayer_HQLinear_uint16_rows_sse41(const uint16_t * bayer, uint16_t * rgb, int sx, int sy, int tile, int bits, int bayerStep, int rgbStep, int order, int y0, int y1)
+{
+	const int maxval = (1 << bits) - 1;
+	const __m128i maxv = _mm_set1_epi32(maxval);
+	int first = y0 > 2 ? y0 : 2;
+	int last = y1 < sy - 2 ? y1 : sy - 2;
+	int x, y;
+
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+
+	dc1394_bayer_HQLinear_uint16_border_rows(bayer, rgb, sx, sy, tile, bits, bayerStep, rgbStep, order, y0, y1);
+
+	for (y = first; y < last; y++) {
+		const uint16_t *cur = bayer + y * bayerStep;
+		uint16_t *out = rgb + y * rgbStep;
+		int green_x, red_row, own;
+
+		bayer_row_phase(tile, y, &green_x, &red_row);
+		own = (red_row ^ (order == DC1394_BAYER_ORDER_BGR)) ? 0 : 2;
+
+		for (x = 2; x + 8 <= sx - 2; x += 8) {
+			hq_sites_sse41_t a, b;
+			__m128i vert, horiz, opp, g, own_v, opp_v, green_v;
+
+			/* x is even, so the even sites are the green ones when green_x is 0;
+			   the sites' own samples are copied unclamped */
+			hq_sites_sse41(cur + x, bayerStep, &a, &b);
+			if (green_x == 0) {
+				hq_green_sse41(&a, &vert, &horiz);
+				hq_colour_sse41(&b, &opp, &g);
+				own_v = interleave_sse41(clamp_sse41(horiz, maxv), b.c);
+				opp_v = interleave_sse41(clamp_sse41(vert, maxv), clamp_sse41(opp, maxv));
+				green_v = interleave_sse41(a.c, clamp_sse41(g, maxv));
+			}
+			else {
+				hq_colour_sse41(&a, &opp, &g);
+				hq_green_sse41(&b, &vert, &horiz);
+				own_v = interleave_sse41(a.c, clamp_sse41(horiz, maxv));
+				opp_v = interleave_sse41(clamp_sse41(opp, maxv), clamp_sse41(vert, maxv));
+				green_v = interleave_sse41(clamp_sse41(g, maxv), b.c);
+			}
+			if (own == 0)
+				store_rgb48_sse41(out + 3 * x, own_v, green_v, opp_v);
+			else
+				store_rgb48_sse41(out + 3 * x, opp_v, green_v, own_v);
+		}
+
+		for (; x < sx - 2; x++)
+			bayer_hqlinear_pixel(cur + x, bayerStep, (x & 1) == green_x, own, maxval, out + 3 * x);
+	}
+
+	return DC1394_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/*
+* Packed RAW10 / RAW12 Bayer decoding
+*
+* The 16-bit kernels read their mosaic from memory, so a packed mosaic
+* has to be unpacked first; what this file avoids is unpacking the whole
+* frame before decoding any of it. The output rows are decoded in strips
+* instead, each from a window holding just the mosaic rows the strip
+* needs, halo included, unpacked right before. The window is small
+* enough to still be in the cache when the kernel reads it, and the halo
+* rows at its end, which the next strip reads again, are moved to its
+* start rather than unpacked twice. The kernel decodes the window as a
+* frame of its own, as the ROI decoder does with its copies: the
+* window's first and last rows are borders to it, but the strip's rows
+* are far enough from them to come out exactly as in the whole frame.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "bayer.h"
+#include "bayer_internal.h"
+
+/* unpacked mosaic a strip aims for, in bytes; a few times this, with
+   the output rows, stays well inside the L2 cache */
+#define UNPACK_WINDOW_BYTES (64 << 10)
+
+typedef struct {
+	dc1394bayer_kernel16_t kernel;
+	dc1394bayer_unpack_t unpack;
+	const uint8_t *bayer;
+	uint16_t *rgb;
+	int sx, sy, tile, bits;
+	int bayerPitch, rgbStep, order;
+	int halo;
+	int out_shift;	/* output rows are mosaic rows >> out_shift */
+	int strip_rows;
+	int band_rows;
+	std::atomic<int> err;
+} unpack_job_t;
+
+void
+dc1394_bayer_unpack_raw10(const uint8_t * packed, uint16_t * out, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i += 4, packed += 5, out += 4) {
+		int low = packed[4];
+
+		out[0] = (uint16_t)(packed[0] << 2 | (low & 3));
+		out[1] = (uint16_t)(packed[1] << 2 | (low >> 2 & 3));
+		out[2] = (uint16_t)(packed[2] << 2 | (low >> 4 & 3));
+		out[3] = (uint16_t)(packed[3] << 2 | low >> 6);
+	}
+}
+
+void
+dc1394_bayer_unpack_raw12(const uint8_t * packed, uint16_t * out, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i += 2, packed += 3, out += 2) {
+		int low = packed[2];
+
+		out[0] = (uint16_t)(packed[0] << 4 | (low & 15));
+		out[1] = (uint16_t)(packed[1] << 4 | low >> 4);
+	}
+}
+
+size_t
+dc1394_bayer_packed_row_bytes(dc1394bayer_packing_t packing, uint32_t sx)
+{
+	switch (packing) {
+	case DC1394_BAYER_PACKING_RAW10:
+		return sx % 4 ? 0 : (size_t)sx / 4 * 5;
+	case DC1394_BAYER_PACKING_RAW12:
+		return sx % 2 ? 0 : (size_t)sx / 2 * 3;
+	default:
+		return 0;
+	}
+}
+
+/* whether rows of row_bytes bytes pitch bytes apart do not overlap */
+static int
+valid_pitch(int pitch, size_t row_bytes)
+{
+	return (pitch < 0 ? -(int64_t)pitch : (int64_t)pitch) >= (int64_t)row_bytes;
+}
+
+dc1394error_t
+dc1394_bayer_unpack(const uint8_t * packed, int packed_pitch, uint16_t * out, int out_pitch, uint32_t sx, uint32_t sy, dc1394bayer_packing_t packing)
+{
+	dc1394bayer_unpack_t unpack = dc1394_bayer_get_unpack(packing);
+	size_t row_bytes = dc1394_bayer_packed_row_bytes(packing, sx);
+	uint32_t y;
+
+	if (!unpack || row_bytes == 0)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!valid_pitch(packed_pitch, row_bytes) || out_pitch % (int)sizeof(uint16_t) || !valid_pitch(out_pitch, sx * sizeof(uint16_t)))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	for (y = 0; y < sy; y++)
+		unpack(packed + (ptrdiff_t)y * packed_pitch, (uint16_t *)((uint8_t *)out + (ptrdiff_t)y * out_pitch), (int)sx);
+	return DC1394_SUCCESS;
+}
+
+/* output rows per strip: as many as keep the window within its budget,
+   even so that Downsample strips start on a cell */
+static int
+strip_rows(int sx, int halo)
+{
+	return bayer_strip_rows(UNPACK_WINDOW_BYTES / (sx * (int)sizeof(uint16_t)), halo, 2);
+}
+
+/* decode the output rows [y0, y1) a strip at a time */
+static dc1394error_t
+decode_span(const unpack_job_t *j, int y0, int y1)
+{
+	const int sx = j->sx;
+	int capacity = bayer_strip_capacity(j->strip_rows, y1 - y0, j->halo);
+	uint16_t *window = (uint16_t *)malloc((size_t)capacity * sx * sizeof(uint16_t));
+	int w0 = 0, w1 = 0;	/* mosaic rows in the window */
+	int s0, s1;
+	dc1394error_t err = DC1394_SUCCESS;
+
+	if (!window)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+	for (s0 = y0; s0 < y1 && err == DC1394_SUCCESS; s0 = s1) {
+		int r0, r1, r;
+
+		s1 = std::min(s0 + j->strip_rows, y1);
+		r0 = s0;
+		r1 = s1;
+		bayer_window(&r0, &r1, j->halo, j->sy);
+
+		r = r0;
+		if (r0 >= w0 && r0 < w1) {
+			memmove(window, window + (size_t)(r0 - w0) * sx, (size_t)(w1 - r0) * sx * sizeof(uint16_t));
+			r = w1;
+		}
+		for (; r < r1; r++)
+			j->unpack(j->bayer + (ptrdiff_t)r * j->bayerPitch, window + (size_t)(r - r0) * sx, sx);
+		w0 = r0;
+		w1 = r1;
+
+		err = j->kernel(window, j->rgb + (ptrdiff_t)(r0 >> j->out_shift) * j->rgbStep, sx, r1 - r0,
+			bayer_shift_tile(j->tile, 0, r0), j->bits, sx, j->rgbStep, j->order, s0 - r0, s1 - r0);
+	}
+
+	free(window);
+	return err;
+}
+
+static void
+decode_band(void *ctx, int index)
+{
+	unpack_job_t *j = (unpack_job_t *)ctx;
+	int y0 = index * j->band_rows;
+	dc1394error_t err = decode_span(j, y0, std::min(y0 + j->band_rows, j->sy));
+
+	if (err != DC1394_SUCCESS)
+		j->err = err;
+}
+
+dc1394error_t
+dc1394_bayer_decoding_packed(const uint8_t * bayer, int bayer_pitch, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_packing_t packing, dc1394bayer_order_t order)
+{
+	return dc1394_bayer_decoding_packed_parallel(NULL, bayer, bayer_pitch, rgb, rgb_pitch, sx, sy, tile, method, packing, order);
+}
+
+dc1394error_t
+dc1394_bayer_decoding_packed_parallel(dc1394bayer_pool_t *pool, const uint8_t * bayer, int bayer_pitch, uint16_t * rgb, int rgb_pitch, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, dc1394bayer_method_t method, dc1394bayer_packing_t packing, dc1394bayer_order_t order)
+{
+	unpack_job_t j;
+	size_t row_bytes = dc1394_bayer_packed_row_bytes(packing, sx);
+
+	j.kernel = dc1394_bayer_get_kernel16(method, &j.halo);
+	if (!j.kernel)
+		return DC1394_INVALID_BAYER_METHOD;
+	if ((tile>DC1394_COLOR_FILTER_MAX) || (tile<DC1394_COLOR_FILTER_MIN))
+		return DC1394_INVALID_COLOR_FILTER;
+	if ((order > DC1394_BAYER_ORDER_MAX) || (order < DC1394_BAYER_ORDER_MIN))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	j.unpack = dc1394_bayer_get_unpack(packing);
+	if (!j.unpack || row_bytes == 0)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (!valid_pitch(bayer_pitch, row_bytes) || rgb_pitch % (int)sizeof(uint16_t))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	j.bayer = bayer;
+	j.rgb = rgb;
+	j.sx = sx;
+	j.sy = sy;
+	j.tile = tile;
+	j.bits = packing == DC1394_BAYER_PACKING_RAW10 ? 10 : 12;
+	j.bayerPitch = bayer_pitch;
+	j.rgbStep = rgb_pitch / (int)sizeof(uint16_t);
+	j.order = order;
+	j.out_shift = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? 1 : 0;
+	j.strip_rows = strip_rows(sx, j.halo);
+	j.band_rows = dc1394_bayer_band_rows(pool, sy, j.halo);
+	j.err = DC1394_SUCCESS;
+	dc1394_bayer_pool_run(pool, (sy + j.band_rows - 1) / j.band_rows, decode_band, &j);
+	return (dc1394error_t)j.err.load();
+}
@@ -0,0 +1,271 @@
+/*
+* Bright blob detection on raw sensor frames
+*
+* One pass over the image: each row is thresholded into a bit mask by
+* the widest kernel the CPU supports, the mask is cut into runs of set
+* bits, and every run is joined to the runs of the row above that it
+* touches (8-connected). Runs carry the label of their blob; when a run
+* touches two blobs they are merged with union-find. The moments of a
+* blob are accumulated as its runs are found, so no label image is ever
+* written and nothing is read twice.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <string.h>
+#include <new>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "blob.h"
+#include "blob_internal.h"
+
+typedef struct {
+	int start, end;		/* columns [start, end) */
+	int label;
+} blob_run_t;
+
+typedef struct {
+	int parent;		/* union-find link, itself for a root */
+	uint32_t area, sum;
+	uint64_t sum_x, sum_y;	/* value-weighted coordinate sums */
+	int left, top, right, bottom;
+} blob_acc_t;
+
+struct dc1394blob_detector_t {
+	std::vector<uint32_t> mask;
+	std::vector<blob_run_t> above, runs;
+	std::vector<blob_acc_t> blobs;
+};
+
+void
+dc1394_blob_threshold_row(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask)
+{
+	memset(mask, 0, ((sx + 31) >> 5) * sizeof(*mask));
+	blob_threshold_tail(row, 0, sx, threshold, mask);
+}
+
+static dc1394blob_threshold_t
+get_threshold_kernel(void)
+{
+	uint32_t usable = dc1394_bayer_get_cpu_features() & ((2u << dc1394_bayer_get_max_isa()) - 1);
+
+	if (usable & (1u << DC1394_BAYER_ISA_AVX2))
+		return dc1394_blob_threshold_row_avx2;
+	if (usable & (1u << DC1394_BAYER_ISA_SSE2))
+		return dc1394_blob_threshold_row_sse2;
+	return dc1394_blob_threshold_row;
+}
+
+static inline int
+lowest_bit(uint32_t v)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward(&i, v);
+	return (int)i;
+#else
+	return __builtin_ctz(v);
+#endif
+}
+
+/* runs of set bits in a row mask; bits past the row end are clear */
+static void
+find_runs(const uint32_t *mask, int words, std::vector<blob_run_t> &runs)
+{
+	uint32_t carry = 0;
+	int start = 0;
+	int w;
+
+	runs.clear();
+	for (w = 0; w < words; w++) {
+		uint32_t bits = mask[w];
+		/* a set bit marks every column where the mask changes */
+		uint32_t edges = bits ^ ((bits << 1) | carry);
+
+		carry = bits >> 31;
+		while (edges) {
+			int x = lowest_bit(edges);
+
+			if ((bits >> x) & 1) {
+				start = (w << 5) + x;
+			}
+			else {
+				blob_run_t run = { start, (w << 5) + x, -1 };
+				runs.push_back(run);
+			}
+			edges &= edges - 1;
+		}
+	}
+	if (carry) {
+		blob_run_t run = { start, words << 5, -1 };
+		runs.push_back(run);
+	}
+}
+
+static int
+find_root(std::vector<blob_acc_t> &blobs, int i)
+{
+	while (blobs[i].parent != i) {
+		blobs[i].parent = blobs[blobs[i].parent].parent;
+		i = blobs[i].parent;
+	}
+	return i;
+}
+
+/* fold root b into root a */
+static void
+merge_blobs(blob_acc_t *a, blob_acc_t *b, int ia)
+{
+	a->area += b->area;
+	a->sum += b->sum;
+	a->sum_x += b->sum_x;
+	a->sum_y += b->sum_y;
+	if (b->left < a->left)
+		a->left = b->left;
+	if (b->top < a->top)
+		a->top = b->top;
+	if (b->right > a->right)
+		a->right = b->right;
+	if (b->bottom > a->bottom)
+		a->bottom = b->bottom;
+	b->parent = ia;
+}
+
+static void
+add_run(blob_acc_t *a, const uint8_t *row, int y, const blob_run_t *run)
+{
+	uint32_t sum = 0;
+	uint64_t sum_x = 0;
+	int x;
+
+	for (x = run->start; x < run->end; x++) {
+		sum += row[x];
+		sum_x += (uint64_t)row[x] * x;
+	}
+	a->area += run->end - run->start;
+	a->sum += sum;
+	a->sum_x += sum_x;
+	a->sum_y += (uint64_t)sum * y;
+	if (run->start < a->left)
+		a->left = run->start;
+	if (run->end - 1 > a->right)
+		a->right = run->end - 1;
+	a->bottom = y;
+}
+
+dc1394blob_detector_t *
+dc1394_blob_detector_new(void)
+{
+	return new (std::nothrow) dc1394blob_detector_t;
+}
+
+void
+dc1394_blob_detector_free(dc1394blob_detector_t *detector)
+{
+	delete detector;
+}
+
+dc1394error_t
+dc1394_blob_detect(dc1394blob_detector_t *detector, const uint8_t * image, uint32_t sx, uint32_t sy, int stride, uint8_t threshold, uint32_t min_area, dc1394blob_t *blobs, uint32_t max_blobs, uint32_t *num_blobs)
+{
+	dc1394blob_threshold_t threshold_row = get_threshold_kernel();
+	const int words = (int)((sx + 31) >> 5);
+	uint32_t found = 0;
+	size_t i, j, k;
+	int y;
+
+	if (!detector || !image || !num_blobs || (max_blobs && !blobs))
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if (sx > 65535 || sy > 65535)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	try {
+		std::vector<blob_acc_t> &acc = detector->blobs;
+		std::vector<blob_run_t> &above = detector->above;
+		std::vector<blob_run_t> &runs = detector->runs;
+
+		detector->mask.resize(words + 1);
+		acc.clear();
+		above.clear();
+
+		for (y = 0; y < (int)sy; y++) {
+			const uint8_t *row = image + y * stride;
+
+			threshold_row(row, sx, threshold, &detector->mask[0]);
+			find_runs(&detector->mask[0], words, runs);
+
+			/* both run lists are sorted, so the candidates for each run
+			   start where the previous run's left off */
+			for (i = 0, j = 0; i < runs.size(); i++) {
+				blob_run_t *run = &runs[i];
+				int label = -1;
+
+				while (j < above.size() && above[j].end < run->start)
+					j++;
+				for (k = j; k < above.size() && above[k].start <= run->end; k++) {
+					int root = find_root(acc, above[k].label);
+
+					if (label < 0) {
+						label = root;
+					}
+					else if (root != label) {
+						/* the older blob survives, keeping the output in first-row order */
+						if (root < label) {
+							merge_blobs(&acc[root], &acc[label], root);
+							label = root;
+						}
+						else {
+							merge_blobs(&acc[label], &acc[root], label);
+						}
+					}
+				}
+
+				if (label < 0) {
+					blob_acc_t a;
+
+					memset(&a, 0, sizeof(a));
+					label = (int)acc.size();
+					a.parent = label;
+					a.left = run->start;
+					a.right = run->end - 1;
+					a.top = y;
+					acc.push_back(a);
+				}
+				add_run(&acc[label], row, y, run);
+				run->label = label;
+			}
+			above.swap(runs);
+		}
+	}
+	catch (const std::bad_alloc &) {
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+	}
+
+	for (i = 0; i < detector->blobs.size(); i++) {
+		const blob_acc_t *a = &detector->blobs[i];
+
+		if (a->parent != (int)i || a->area < min_area)
+			continue;
+		if (found < max_blobs) {
+			dc1394blob_t *b = &blobs[found];
+
+			b->x = (float)((double)a->sum_x / a->sum);
+			b->y = (float)((double)a->sum_y / a->sum);
+			b->area = a->area;
+			b->sum = a->sum;
+			b->left = (uint16_t)a->left;
+			b->top = (uint16_t)a->top;
+			b->right = (uint16_t)a->right;
+			b->bottom = (uint16_t)a->bottom;
+		}
+		found++;
+	}
+	*num_blobs = found;
+
+	return DC1394_SUCCESS;
+}
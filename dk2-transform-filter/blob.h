@@ -0,0 +1,53 @@
+/*
+* Bright blob detection on raw sensor frames
+*
+* Finds the connected groups of pixels brighter than a threshold in an
+* 8-bit frame, typically the raw Bayer mosaic straight from the camera,
+* and reports their intensity-weighted centroid, area and bounding box.
+* Nothing is demosaiced: for LED tracking the blob list is the product,
+* not the image.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef __DC1394_BLOB_H__
+#define __DC1394_BLOB_H__
+
+#include <stdint.h>
+#include "bayer.h"
+
+typedef struct {
+	float x, y;		/* centroid, weighted by pixel value; pixel centres are at integer coordinates */
+	uint32_t area;		/* pixels above the threshold */
+	uint32_t sum;		/* sum of their values */
+	uint16_t left, top;	/* bounding box, inclusive */
+	uint16_t right, bottom;
+} dc1394blob_t;
+
+/*
+* Scratch state reused from frame to frame, so that detection does not
+* allocate once it has seen a frame of the same size. A detector must
+* not be used by two threads at once.
+*/
+typedef struct dc1394blob_detector_t dc1394blob_detector_t;
+
+dc1394blob_detector_t *
+dc1394_blob_detector_new(void);
+
+void
+dc1394_blob_detector_free(dc1394blob_detector_t *detector);
+
+/*
+* Pixels with a value above threshold are grouped 8-connected. Blobs
+* smaller than min_area pixels are dropped; the others are stored in
+* blobs in top to bottom order of their first row, at most max_blobs of
+* them. num_blobs receives the number found, which may exceed max_blobs.
+* Row y of the image starts stride * y bytes after image.
+*/
+dc1394error_t
+dc1394_blob_detect(dc1394blob_detector_t *detector, const uint8_t * image, uint32_t sx, uint32_t sy, int stride, uint8_t threshold, uint32_t min_area, dc1394blob_t *blobs, uint32_t max_blobs, uint32_t *num_blobs);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+* AVX2 blob threshold kernel
+*
+* dc1394_blob_threshold_row_sse2() with one mask word per load.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <immintrin.h>
+#include "blob_internal.h"
+
+void
+dc1394_blob_threshold_row_avx2(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask)
+{
+	const __m256i thr = _mm256_set1_epi8((char)threshold);
+	const __m256i zero = _mm256_setzero_si256();
+	int x;
+
+	for (x = 0; x + 32 <= sx; x += 32) {
+		__m256i v = _mm256_subs_epu8(_mm256_loadu_si256((const __m256i *)(row + x)), thr);
+
+		mask[x >> 5] = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+	}
+
+	if (x < sx) {
+		mask[x >> 5] = 0;
+		blob_threshold_tail(row, x, sx, threshold, mask);
+	}
+}
@@ -0,0 +1,39 @@
+/*
+* Internal declarations shared by the blob detector.
+*
+* A threshold kernel turns one image row into a bit mask, bit (x & 31)
+* of word x / 32 being set when pixel x is above the threshold. Bits
+* past the end of the row are cleared. The SIMD versions live in their
+* own translation units like the Bayer kernels and are picked with the
+* same CPU feature mask and ISA cap.
+*/
+
+#ifndef __DC1394_BLOB_INTERNAL_H__
+#define __DC1394_BLOB_INTERNAL_H__
+
+#include "blob.h"
+
+typedef void(*dc1394blob_threshold_t)(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask);
+
+/* pixels x0 .. sx-1, for the kernels' row tails; mask words from x0 / 32 on must be zero */
+static inline void
+blob_threshold_tail(const uint8_t *row, int x0, int sx, uint8_t threshold, uint32_t *mask)
+{
+	int x;
+
+	for (x = x0; x < sx; x++) {
+		if (row[x] > threshold)
+			mask[x >> 5] |= 1u << (x & 31);
+	}
+}
+
+void
+dc1394_blob_threshold_row(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask);
+
+void
+dc1394_blob_threshold_row_sse2(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask);
+
+void
+dc1394_blob_threshold_row_avx2(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+* SSE2 blob threshold kernel
+*
+* There is no unsigned byte compare in SSE2, so a pixel is above the
+* threshold when the saturating difference is non-zero.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <emmintrin.h>
+#include "blob_internal.h"
+
+void
+dc1394_blob_threshold_row_sse2(const uint8_t *row, int sx, uint8_t threshold, uint32_t *mask)
+{
+	const __m128i thr = _mm_set1_epi8((char)threshold);
+	const __m128i zero = _mm_setzero_si128();
+	int x;
+
+	for (x = 0; x + 32 <= sx; x += 32) {
+		__m128i lo = _mm_subs_epu8(_mm_loadu_si128((const __m128i *)(row + x)), thr);
+		__m128i hi = _mm_subs_epu8(_mm_loadu_si128((const __m128i *)(row + x + 16)), thr);
+		uint32_t dark = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, zero))
+			| ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, zero)) << 16);
+
+		mask[x >> 5] = ~dark;
+	}
+
+	if (x < sx) {
+		mask[x >> 5] = 0;
+		blob_threshold_tail(row, x, sx, threshold, mask);
+	}
+}
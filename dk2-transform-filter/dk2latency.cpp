@@ -0,0 +1,287 @@
+/*
+* Latency histograms
+*
+* Bucket i below 16 holds the time of i ns. Above that, bucket
+* k * 16 + m, k >= 1, holds the times from (16 + m) << (k - 1) up to
+* (17 + m) << (k - 1): the top five bits of a time pick its bucket.
+*
+* A lane's counters are atomics only so that readers may look at them
+* while the lane's thread writes; the writer itself loads and stores
+* them relaxed, as the only thread that changes them. The lanes are
+* padded apart so that two recording threads never share a cache line.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include "dk2latency.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+#if defined(_MSC_VER)
+#define format_text sprintf_s
+#else
+#define format_text snprintf
+#endif
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+/* times of 2^36 ns, about 69 s, and more share the last bucket */
+#define LATENCY_TOP_BIT 36
+#define LATENCY_BUCKETS ((LATENCY_TOP_BIT - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+#define LATENCY_CACHE_LINE 64
+
+typedef struct {
+	std::atomic<uint64_t> total_ns;
+	std::atomic<uint64_t> min_ns;
+	std::atomic<uint64_t> max_ns;
+	std::atomic<uint32_t> buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+typedef struct {
+	latency_histogram_t stages[DK2LATENCY_STAGES];
+	uint8_t pad[LATENCY_CACHE_LINE];
+} latency_lane_t;
+
+struct dk2latency_t {
+	uint32_t lanes;
+	latency_lane_t *lane;
+};
+
+static const char *const stage_names[DK2LATENCY_STAGES] = {
+	"receive", "wait", "convert", "age", "deliver"
+};
+
+#ifdef _WIN32
+/* the steady_clock of older runtimes only ticks with the scheduler */
+static uint64_t
+performance_frequency(void)
+{
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)frequency.QuadPart;
+}
+
+static const uint64_t frequency = performance_frequency();
+
+uint64_t
+dk2latency_now(void)
+{
+	LARGE_INTEGER counter;
+	uint64_t ticks;
+
+	QueryPerformanceCounter(&counter);
+	ticks = (uint64_t)counter.QuadPart;
+	return ticks / frequency * 1000000000u + ticks % frequency * 1000000000u / frequency;
+}
+#else
+uint64_t
+dk2latency_now(void)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+static uint32_t
+top_bit(uint64_t n)
+{
+	uint32_t bit = 0;
+
+	if (n >> 32) { n >>= 32; bit += 32; }
+	if (n >> 16) { n >>= 16; bit += 16; }
+	if (n >> 8) { n >>= 8; bit += 8; }
+	if (n >> 4) { n >>= 4; bit += 4; }
+	if (n >> 2) { n >>= 2; bit += 2; }
+	if (n >> 1) bit += 1;
+	return bit;
+}
+
+static uint32_t
+bucket_of(uint64_t ns)
+{
+	uint32_t bit;
+
+	if (ns < LATENCY_SUB)
+		return (uint32_t)ns;
+	bit = top_bit(ns);
+	if (bit >= LATENCY_TOP_BIT)
+		return LATENCY_BUCKETS - 1;
+	return (bit - LATENCY_SUB_BITS + 1) * LATENCY_SUB + (uint32_t)(ns >> (bit - LATENCY_SUB_BITS)) - LATENCY_SUB;
+}
+
+/* the largest time that falls into bucket */
+static uint64_t
+bucket_top(uint32_t bucket)
+{
+	uint32_t k = bucket / LATENCY_SUB, m = bucket % LATENCY_SUB;
+
+	if (k == 0)
+		return bucket;
+	return ((uint64_t)(LATENCY_SUB + m + 1) << (k - 1)) - 1;
+}
+
+dk2latency_t *
+dk2latency_new(uint32_t lanes)
+{
+	dk2latency_t *latency;
+	uint32_t i, s, b;
+
+	if (lanes == 0)
+		return NULL;
+	latency = new (std::nothrow) dk2latency_t;
+	if (latency == NULL)
+		return NULL;
+	latency->lanes = lanes;
+	latency->lane = new (std::nothrow) latency_lane_t[lanes];
+	if (latency->lane == NULL) {
+		delete latency;
+		return NULL;
+	}
+	for (i = 0; i < lanes; i++)
+		for (s = 0; s < DK2LATENCY_STAGES; s++) {
+			latency_histogram_t *h = &latency->lane[i].stages[s];
+
+			h->total_ns.store(0);
+			h->min_ns.store(UINT64_MAX);
+			h->max_ns.store(0);
+			for (b = 0; b < LATENCY_BUCKETS; b++)
+				h->buckets[b].store(0);
+		}
+	return latency;
+}
+
+void
+dk2latency_free(dk2latency_t *latency)
+{
+	if (latency == NULL)
+		return;
+	delete[] latency->lane;
+	delete latency;
+}
+
+void
+dk2latency_record(dk2latency_t *latency, uint32_t lane, dk2latency_stage_t stage, uint64_t ns)
+{
+	latency_histogram_t *h;
+	std::atomic<uint32_t> *bucket;
+
+	if (lane >= latency->lanes || stage < 0 || stage >= DK2LATENCY_STAGES)
+		return;
+	h = &latency->lane[lane].stages[stage];
+	bucket = &h->buckets[bucket_of(ns)];
+	bucket->store(bucket->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	h->total_ns.store(h->total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	if (ns < h->min_ns.load(std::memory_order_relaxed))
+		h->min_ns.store(ns, std::memory_order_relaxed);
+	if (ns > h->max_ns.load(std::memory_order_relaxed))
+		h->max_ns.store(ns, std::memory_order_relaxed);
+}
+
+/* the time below which permille thousandths of the count fall */
+static uint64_t
+percentile(const uint64_t *counts, uint64_t count, uint32_t permille)
+{
+	uint64_t rank = (count * permille + 999) / 1000, seen = 0;
+	uint32_t b;
+
+	if (rank == 0)
+		rank = 1;
+	for (b = 0; b < LATENCY_BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= rank)
+			return bucket_top(b);
+	}
+	return bucket_top(LATENCY_BUCKETS - 1);
+}
+
+/* keeps a percentile from the top of a bucket within the times actually seen */
+static uint64_t
+clamp(uint64_t ns, uint64_t min, uint64_t max)
+{
+	return ns < min ? min : ns > max ? max : ns;
+}
+
+void
+dk2latency_summarize(const dk2latency_t *latency, dk2latency_stage_t stage, dk2latency_summary_t *summary)
+{
+	uint64_t counts[LATENCY_BUCKETS], total = 0, min = UINT64_MAX, max = 0;
+	uint32_t i, b;
+
+	memset(summary, 0, sizeof(*summary));
+	if (stage < 0 || stage >= DK2LATENCY_STAGES)
+		return;
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < latency->lanes; i++) {
+		const latency_histogram_t *h = &latency->lane[i].stages[stage];
+		uint64_t lane_min = h->min_ns.load(std::memory_order_relaxed);
+		uint64_t lane_max = h->max_ns.load(std::memory_order_relaxed);
+
+		for (b = 0; b < LATENCY_BUCKETS; b++)
+			counts[b] += h->buckets[b].load(std::memory_order_relaxed);
+		total += h->total_ns.load(std::memory_order_relaxed);
+		if (lane_min < min)
+			min = lane_min;
+		if (lane_max > max)
+			max = lane_max;
+	}
+	for (b = 0; b < LATENCY_BUCKETS; b++)
+		summary->count += counts[b];
+	if (summary->count == 0)
+		return;
+	summary->min_ns = min;
+	summary->max_ns = max;
+	summary->mean_ns = total / summary->count;
+	summary->p50_ns = clamp(percentile(counts, summary->count, 500), min, max);
+	summary->p99_ns = clamp(percentile(counts, summary->count, 990), min, max);
+	summary->p999_ns = clamp(percentile(counts, summary->count, 999), min, max);
+}
+
+const char *
+dk2latency_stage_name(dk2latency_stage_t stage)
+{
+	if (stage < 0 || stage >= DK2LATENCY_STAGES)
+		return "unknown";
+	return stage_names[stage];
+}
+
+size_t
+dk2latency_format(const dk2latency_t *latency, char *text, size_t size)
+{
+	size_t length = 0;
+	int s;
+
+	if (size > 0)
+		text[0] = '\0';
+	for (s = 0; s < DK2LATENCY_STAGES; s++) {
+		dk2latency_summary_t sum;
+		char line[256];
+		size_t n;
+
+		dk2latency_summarize(latency, (dk2latency_stage_t)s, &sum);
+		format_text(line, sizeof(line),
+			"%-8s %10llu  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f  mean %9.1f us\n",
+			stage_names[s], (unsigned long long)sum.count, sum.p50_ns / 1e3, sum.p99_ns / 1e3,
+			sum.p999_ns / 1e3, sum.max_ns / 1e3, sum.mean_ns / 1e3);
+		n = strlen(line);
+		if (length + n < size)
+			memcpy(text + length, line, n + 1);
+		else if (length + 1 < size) {
+			memcpy(text + length, line, size - length - 1);
+			text[size - 1] = '\0';
+		}
+		length += n;
+	}
+	return length;
+}
@@ -0,0 +1,89 @@
+/*
+* Latency histograms
+*
+* Times taken by the stages a frame goes through, from its arrival to
+* its delivery downstream, kept as histograms so that the rare slow
+* frame shows up in the p99 and p99.9 instead of vanishing in a mean.
+* Each thread that records does so in a lane of its own, and a lane has
+* a single writer at a time: recording takes no lock and only writes
+* memory no other thread writes, so the threads never wait for each
+* other nor fight over cache lines.
+* Readers add the lanes up whenever they like, while the writers go on.
+*
+* The buckets split every power of two into 16, so a percentile comes
+* out within about 6% of the true value, from 1 ns up to about a minute;
+* longer times all fall into the last bucket.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef __DK2LATENCY_H__
+#define __DK2LATENCY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+	DK2LATENCY_RECEIVE = 0,	/* the capture thread held up by one frame */
+	DK2LATENCY_WAIT,	/* arrival to the start of the conversion */
+	DK2LATENCY_CONVERT,	/* the demosaic, or whatever the output format asks for */
+	DK2LATENCY_AGE,		/* arrival to the hand-over downstream */
+	DK2LATENCY_DELIVER,	/* downstream's time with the frame */
+	DK2LATENCY_STAGES
+} dk2latency_stage_t;
+
+typedef struct {
+	uint64_t count;		/* times recorded */
+	uint64_t min_ns;	/* exact */
+	uint64_t max_ns;	/* exact */
+	uint64_t mean_ns;	/* exact */
+	uint64_t p50_ns;	/* upper bounds of the buckets the percentiles fall into */
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+} dk2latency_summary_t;
+
+typedef struct dk2latency_t dk2latency_t;
+
+/* Nanoseconds on a monotonic clock of the best resolution the system has. */
+uint64_t
+dk2latency_now(void);
+
+/* Histograms for lanes recording threads; NULL when out of memory. */
+dk2latency_t *
+dk2latency_new(uint32_t lanes);
+
+/* A NULL set of histograms is ignored. */
+void
+dk2latency_free(dk2latency_t *latency);
+
+/*
+* Count one time of ns for stage, in lane. Only one thread may record
+* in a lane at a time; a lane may change threads when something else,
+* such as a lock, orders the two.
+*/
+void
+dk2latency_record(dk2latency_t *latency, uint32_t lane, dk2latency_stage_t stage, uint64_t ns);
+
+/*
+* The times recorded for stage so far, over all lanes. A summary taken
+* while threads record may miss the times being recorded just then.
+*/
+void
+dk2latency_summarize(const dk2latency_t *latency, dk2latency_stage_t stage, dk2latency_summary_t *summary);
+
+/* "receive", "wait", "convert", "age", "deliver" */
+const char *
+dk2latency_stage_name(dk2latency_stage_t stage);
+
+/*
+* One line per stage with its count and times in microseconds, as a
+* terminated string of at most size bytes. Returns the length the text
+* has in full, which is size or more when it was cut short.
+*/
+size_t
+dk2latency_format(const dk2latency_t *latency, char *text, size_t size);
+
+#endif
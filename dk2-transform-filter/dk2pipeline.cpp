@@ -0,0 +1,482 @@
+/*
+* Asynchronous frame pipeline
+*
+* Frame n lives in slot n % depth. Three counters, which only ever
+* grow, track the frames through the ring: tail (pushed, written by the
+* producer alone), claimed (taken by a worker, advanced by compare and
+* swap) and retired (delivered, skipped, failed or discarded, advanced by
+* whichever worker holds the delivery lock). The producer may refill
+* slot n % depth once frame n - depth has retired. Besides the counters
+* the producer and the workers only share a state per slot; neither
+* side takes a lock to hand a frame over. Locks are only taken to park
+* an idle worker, to wake one, to deliver, and to make the producer
+* wait under DK2PIPELINE_PROCESS_ALL.
+*
+* Workers skip the frames the policy has no room for as they claim
+* them: a claimed frame with limit newer frames behind it is retired
+* unprocessed. That costs a worker no more than a look at the counters,
+* and keeps retiring, and so freeing slots, the workers' business alone.
+* When the producer finds every slot taken it may still overwrite the
+* newest queued frame; the worker that claims that slot meanwhile waits
+* for the copy to finish, and then converts the newer frame.
+*
+* A worker that finishes a frame marks its slot done and then retires
+* every done frame from retired onwards, unless another worker is
+* already at it, in which case that one will. After letting go of the
+* delivery lock a worker looks at the next slot once more, so that a
+* frame finished while it was delivering is not left behind.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "dk2latency.h"
+#include "dk2pipeline.h"
+
+#define PIPELINE_MAX_WORKERS 64
+#define PIPELINE_ALIGN 64
+
+enum {
+	SLOT_FREE,		/* retired, or never used */
+	SLOT_WRITING,		/* the producer is copying a frame in */
+	SLOT_QUEUED,		/* waiting for a worker */
+	SLOT_BUSY,		/* claimed by a worker */
+	SLOT_DONE		/* processed or passed over, waiting to retire */
+};
+
+enum {
+	FATE_PROCESSED,
+	FATE_SKIPPED,		/* the policy passed it over for newer frames */
+	FATE_FAILED,		/* process left it without a result */
+	FATE_DISCARDED		/* a discarding flush threw it away */
+};
+
+typedef struct {
+	dk2pipeline_frame_t frame;
+	uint8_t *buffer;
+	std::atomic<int> state;
+	int fate;		/* set by the worker that claims the slot */
+} pipeline_slot_t;
+
+struct dk2pipeline_t {
+	dk2pipeline_callbacks_t cb;
+	dk2pipeline_policy_t policy;
+	uint32_t limit;
+	uint32_t frame_size;
+	uint32_t depth;
+	pipeline_slot_t *slots;
+	uint8_t *memory;
+
+	std::atomic<uint64_t> tail;
+	std::atomic<uint64_t> claimed;
+	std::atomic<uint64_t> retired;
+	std::atomic<uint64_t> pushed;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> skipped;
+	std::atomic<uint64_t> delivered;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> discarded;
+	std::atomic<uint64_t> age_last_ns;
+	std::atomic<uint64_t> age_max_ns;
+	std::atomic<uint64_t> age_total_ns;
+	std::atomic<uint32_t> queued_max;	/* written by the producer alone */
+	std::atomic<bool> discarding;
+
+	std::mutex park;			/* idle workers wait here for frames */
+	std::condition_variable wake;
+	std::atomic<int> sleepers;
+	bool stopping;				/* guarded by park */
+
+	std::mutex deliver_lock;
+
+	std::mutex retire_wait;			/* flushes and a producer short of slots wait here */
+	std::condition_variable retired_more;
+	std::atomic<int> waiters;
+
+	std::vector<std::thread> workers;
+};
+
+static pipeline_slot_t *
+slot_of(dk2pipeline_t *p, uint64_t n)
+{
+	return &p->slots[n % p->depth];
+}
+
+static void
+account_delivery(dk2pipeline_t *p, uint64_t age)
+{
+	uint64_t max = p->age_max_ns.load();
+
+	p->age_last_ns.store(age);
+	p->age_total_ns += age;
+	while (age > max && !p->age_max_ns.compare_exchange_weak(max, age))
+		;
+	p->delivered++;
+}
+
+/* retire the done frames from retired onwards, if nobody else is */
+static void
+retire_frames(dk2pipeline_t *p)
+{
+	for (;;) {
+		pipeline_slot_t *slot;
+
+		if (!p->deliver_lock.try_lock())
+			return;
+		for (;;) {
+			uint64_t n = p->retired.load();
+
+			slot = slot_of(p, n);
+			if (slot->state.load() != SLOT_DONE)
+				break;
+			if (slot->fate == FATE_SKIPPED)
+				p->skipped++;
+			else if (slot->fate == FATE_DISCARDED)
+				p->discarded++;
+			else if (slot->fate == FATE_FAILED)
+				p->failed++;
+			else {
+				slot->frame.age_ns = dk2latency_now() - slot->frame.pushed_ns;
+				p->cb.deliver(p->cb.ctx, &slot->frame);
+				account_delivery(p, slot->frame.age_ns);
+			}
+			slot->state.store(SLOT_FREE);
+			/* hands the slot back to the producer */
+			p->retired.store(n + 1);
+		}
+		p->deliver_lock.unlock();
+
+		if (p->waiters.load() > 0) {
+			std::lock_guard<std::mutex> guard(p->retire_wait);
+			p->retired_more.notify_all();
+		}
+		if (slot_of(p, p->retired.load())->state.load() != SLOT_DONE)
+			return;
+	}
+}
+
+/* whether the policy passes frame n over, with the frames pushed so far */
+static bool
+is_stale(const dk2pipeline_t *p, uint64_t n)
+{
+	return p->policy != DK2PIPELINE_PROCESS_ALL && p->tail.load() - 1 - n >= p->limit;
+}
+
+/* gives a result no frame used back, so the consumer can reuse or free it */
+static void
+release_held(dk2pipeline_t *p, void **held)
+{
+	if (*held != NULL && p->cb.release) {
+		p->cb.release(p->cb.ctx, *held);
+		*held = NULL;
+	}
+}
+
+static void
+worker_main(dk2pipeline_t *p, uint32_t worker)
+{
+	void *held = NULL;
+
+	for (;;) {
+		uint64_t n = p->claimed.load();
+
+		if (n < p->tail.load()) {
+			pipeline_slot_t *slot;
+			int queued = SLOT_QUEUED;
+
+			/* wait for the consumer before choosing the frame, not after */
+			if (p->cb.acquire && held == NULL && !p->discarding.load() && !is_stale(p, n)) {
+				held = p->cb.acquire(p->cb.ctx, worker);
+				/* newer frames may have come in while it waited */
+				n = p->claimed.load();
+				if (n >= p->tail.load())
+					continue;
+			}
+			if (!p->claimed.compare_exchange_weak(n, n + 1))
+				continue;
+			slot = slot_of(p, n);
+			/* the producer may be putting a newer frame in its place */
+			while (!slot->state.compare_exchange_weak(queued, SLOT_BUSY)) {
+				queued = SLOT_QUEUED;
+				std::this_thread::yield();
+			}
+
+			if (p->discarding.load()) {
+				slot->fate = FATE_DISCARDED;
+				/* the consumer may be about to free or resize its buffers */
+				release_held(p, &held);
+			}
+			else if (is_stale(p, n))
+				slot->fate = FATE_SKIPPED;
+			else {
+				slot->fate = FATE_PROCESSED;
+				slot->frame.result = held;
+				held = NULL;
+				p->cb.process(p->cb.ctx, worker, &slot->frame);
+				/* no output, or the conversion failed: nothing to deliver */
+				if (slot->frame.result == NULL)
+					slot->fate = FATE_FAILED;
+			}
+			slot->state.store(SLOT_DONE);
+			retire_frames(p);
+			continue;
+		}
+
+		/* an idle worker holds nothing, so a stop finds every result
+		   back with the consumer */
+		release_held(p, &held);
+
+		/* the producer looks at sleepers after publishing a frame, so
+		   one of the two sees the other */
+		std::unique_lock<std::mutex> guard(p->park);
+		p->sleepers++;
+		while (!p->stopping && p->claimed.load() >= p->tail.load())
+			p->wake.wait(guard);
+		p->sleepers--;
+		if (p->stopping)
+			break;
+	}
+}
+
+dk2pipeline_t *
+dk2pipeline_new(uint32_t frame_size, dk2pipeline_policy_t policy, uint32_t limit, uint32_t workers, const dk2pipeline_callbacks_t *callbacks)
+{
+	dk2pipeline_t *p;
+	size_t stride = ((size_t)frame_size + PIPELINE_ALIGN - 1) & ~(size_t)(PIPELINE_ALIGN - 1);
+	uintptr_t base;
+	uint32_t i;
+
+	if (callbacks == NULL || callbacks->process == NULL || callbacks->deliver == NULL)
+		return NULL;
+	if (policy < DK2PIPELINE_PROCESS_ALL || policy > DK2PIPELINE_QUEUE)
+		return NULL;
+	if (workers == 0)
+		workers = std::thread::hardware_concurrency();
+	if (workers == 0)
+		workers = 1;
+	if (workers > PIPELINE_MAX_WORKERS)
+		workers = PIPELINE_MAX_WORKERS;
+	if (policy == DK2PIPELINE_LATEST)
+		limit = 1;
+	else if (policy == DK2PIPELINE_PROCESS_ALL || limit == 0)
+		limit = workers;
+
+	p = new (std::nothrow) dk2pipeline_t;
+	if (p == NULL)
+		return NULL;
+	p->cb = *callbacks;
+	p->policy = policy;
+	p->limit = limit;
+	p->frame_size = frame_size;
+	/* room for the waiting frames, one in each worker, and one being
+	   delivered while the next comes in */
+	p->depth = limit + workers + 2;
+	p->slots = new (std::nothrow) pipeline_slot_t[p->depth];
+	p->memory = (uint8_t *)malloc(p->depth * stride + PIPELINE_ALIGN);
+	if (p->slots == NULL || p->memory == NULL) {
+		delete[] p->slots;
+		free(p->memory);
+		delete p;
+		return NULL;
+	}
+	base = ((uintptr_t)p->memory + PIPELINE_ALIGN - 1) & ~(uintptr_t)(PIPELINE_ALIGN - 1);
+	for (i = 0; i < p->depth; i++) {
+		p->slots[i].buffer = (uint8_t *)base + i * stride;
+		p->slots[i].state.store(SLOT_FREE);
+		p->slots[i].fate = FATE_PROCESSED;
+	}
+
+	p->tail.store(0);
+	p->claimed.store(0);
+	p->retired.store(0);
+	p->pushed.store(0);
+	p->dropped.store(0);
+	p->skipped.store(0);
+	p->delivered.store(0);
+	p->failed.store(0);
+	p->discarded.store(0);
+	p->age_last_ns.store(0);
+	p->age_max_ns.store(0);
+	p->age_total_ns.store(0);
+	p->queued_max.store(0);
+	p->discarding.store(false);
+	p->sleepers.store(0);
+	p->waiters.store(0);
+	p->stopping = false;
+
+	/* if the system runs out of threads, make do with the workers already started */
+	try {
+		p->workers.reserve(workers);
+		for (i = 0; i < workers; i++)
+			p->workers.push_back(std::thread(worker_main, p, i));
+	}
+	catch (const std::system_error &) {
+	}
+	catch (const std::bad_alloc &) {
+	}
+	if (p->workers.empty()) {
+		delete[] p->slots;
+		free(p->memory);
+		delete p;
+		return NULL;
+	}
+	return p;
+}
+
+void
+dk2pipeline_free(dk2pipeline_t *pipeline)
+{
+	size_t i;
+
+	if (pipeline == NULL)
+		return;
+
+	dk2pipeline_flush(pipeline, DC1394_TRUE);
+	{
+		std::lock_guard<std::mutex> guard(pipeline->park);
+		pipeline->stopping = true;
+	}
+	pipeline->wake.notify_all();
+	for (i = 0; i < pipeline->workers.size(); i++)
+		pipeline->workers[i].join();
+	delete[] pipeline->slots;
+	free(pipeline->memory);
+	delete pipeline;
+}
+
+uint32_t
+dk2pipeline_get_workers(const dk2pipeline_t *pipeline)
+{
+	return (uint32_t)pipeline->workers.size();
+}
+
+static void
+fill_slot(pipeline_slot_t *slot, const void *frame, uint32_t size, uint64_t sequence, int64_t timestamp, int64_t duration, const dk2pipeline_tags_t *tags)
+{
+	memcpy(slot->buffer, frame, size);
+	slot->frame.data = slot->buffer;
+	slot->frame.size = size;
+	slot->frame.sequence = sequence;
+	slot->frame.timestamp = timestamp;
+	slot->frame.duration = duration;
+	if (tags)
+		slot->frame.tags = *tags;
+	else
+		memset(&slot->frame.tags, 0, sizeof(slot->frame.tags));
+	slot->frame.result = NULL;
+	slot->frame.age_ns = 0;
+	slot->frame.pushed_ns = dk2latency_now();
+}
+
+/* wait until frame n can have its slot, or the queue is being discarded */
+static void
+wait_for_slot(dk2pipeline_t *p, uint64_t n)
+{
+	p->waiters++;
+	{
+		std::unique_lock<std::mutex> guard(p->retire_wait);
+		while (n - p->retired.load() >= p->depth && !p->discarding.load())
+			p->retired_more.wait(guard);
+	}
+	p->waiters--;
+}
+
+dc1394bool_t
+dk2pipeline_push(dk2pipeline_t *pipeline, const void *frame, uint32_t size, uint64_t sequence, int64_t timestamp, int64_t duration, const dk2pipeline_tags_t *tags)
+{
+	dk2pipeline_t *p = pipeline;
+	uint64_t n = p->tail.load(std::memory_order_relaxed);
+	pipeline_slot_t *slot;
+	uint32_t waiting;
+
+	if (size > p->frame_size) {
+		p->dropped++;
+		return DC1394_FALSE;
+	}
+
+	if (n - p->retired.load() >= p->depth) {
+		int queued = SLOT_QUEUED;
+
+		if (p->policy == DK2PIPELINE_PROCESS_ALL)
+			wait_for_slot(p, n);
+		/* every slot taken: a newer frame is worth more than the one waiting */
+		else if (n > 0 && slot_of(p, n - 1)->state.compare_exchange_strong(queued, SLOT_WRITING)) {
+			slot = slot_of(p, n - 1);
+			fill_slot(slot, frame, size, sequence, timestamp, duration, tags);
+			slot->state.store(SLOT_QUEUED);
+			p->skipped++;
+			p->pushed++;
+			return DC1394_TRUE;
+		}
+		if (n - p->retired.load() >= p->depth) {
+			p->dropped++;
+			return DC1394_FALSE;
+		}
+	}
+
+	slot = slot_of(p, n);
+	slot->state.store(SLOT_WRITING);
+	fill_slot(slot, frame, size, sequence, timestamp, duration, tags);
+	slot->state.store(SLOT_QUEUED);
+	p->tail.store(n + 1);
+	p->pushed++;
+	waiting = (uint32_t)(n + 1 - p->retired.load());
+	if (waiting > p->queued_max.load(std::memory_order_relaxed))
+		p->queued_max.store(waiting, std::memory_order_relaxed);
+
+	if (p->sleepers.load() > 0) {
+		std::lock_guard<std::mutex> guard(p->park);
+		p->wake.notify_one();
+	}
+	return DC1394_TRUE;
+}
+
+void
+dk2pipeline_flush(dk2pipeline_t *pipeline, dc1394bool_t discard)
+{
+	dk2pipeline_t *p = pipeline;
+
+	if (discard) {
+		p->discarding.store(true);
+		/* a producer waiting for a slot gives up */
+		std::lock_guard<std::mutex> guard(p->retire_wait);
+		p->retired_more.notify_all();
+	}
+	p->waiters++;
+	{
+		std::unique_lock<std::mutex> guard(p->retire_wait);
+		while (p->retired.load() < p->tail.load())
+			p->retired_more.wait(guard);
+	}
+	p->waiters--;
+	p->discarding.store(false);
+}
+
+void
+dk2pipeline_get_stats(const dk2pipeline_t *pipeline, dk2pipeline_stats_t *stats)
+{
+	uint64_t tail = pipeline->tail.load();
+
+	stats->pushed = pipeline->pushed.load();
+	stats->dropped = pipeline->dropped.load();
+	stats->skipped = pipeline->skipped.load();
+	stats->delivered = pipeline->delivered.load();
+	stats->failed = pipeline->failed.load();
+	stats->discarded = pipeline->discarded.load();
+	stats->queued = (uint32_t)(tail - pipeline->retired.load());
+	stats->queued_max = pipeline->queued_max.load();
+	stats->age_last_ns = pipeline->age_last_ns.load();
+	stats->age_max_ns = pipeline->age_max_ns.load();
+	stats->age_total_ns = pipeline->age_total_ns.load();
+}
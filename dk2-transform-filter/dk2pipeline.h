@@ -0,0 +1,152 @@
+/*
+* Asynchronous frame pipeline
+*
+* Takes raw frames from a capture thread and converts them on a set of
+* worker threads, so that the capture thread does not do the
+* conversions itself. Pushing a frame copies it into a free slot of a bounded
+* ring and returns. The workers each convert one frame at a time, in
+* parallel, and the converted frames are delivered one at a time in the
+* order they were pushed, on whichever worker finished the frame that
+* was next due.
+*
+* What happens when the workers fall behind is the delivery policy's
+* choice. Process-all converts every frame and makes the producer wait
+* for a free slot. The other policies never wait: they let only the
+* newest few frames queue for a worker and skip the older ones before
+* anything is spent on them, so that what is delivered is as recent as
+* the workers allow. For head tracking a late frame is worse than none.
+*
+* Nothing here knows about DirectShow: the caller supplies the work and
+* the delivery as callbacks, so the pipeline runs the same with the
+* filter's samples as with a synthetic source.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef __DK2PIPELINE_H__
+#define __DK2PIPELINE_H__
+
+#include <stdint.h>
+#include "bayer.h"
+
+/*
+* Whatever else the caller wants to go with a frame, such as the flags
+* and media times of the sample it came in, for deliver to put on the
+* sample it sends on. The pipeline only copies them.
+*/
+typedef struct {
+	uint32_t flags;
+	uint32_t type_flags;
+	int64_t media_start, media_stop;
+	int has_media_time;
+} dk2pipeline_tags_t;
+
+typedef struct {
+	const uint8_t *data;	/* the pipeline's copy of the frame */
+	uint32_t size;
+	uint64_t sequence;	/* as pushed */
+	int64_t timestamp;
+	int64_t duration;
+	dk2pipeline_tags_t tags;	/* as pushed */
+	void *result;		/* from acquire, or set by process; passed to deliver */
+	uint64_t pushed_ns;	/* dk2latency_now() at the push */
+	uint64_t age_ns;	/* time since the push, when delivered */
+} dk2pipeline_frame_t;
+
+typedef enum {
+	DK2PIPELINE_PROCESS_ALL = 0,	/* every frame; push waits for a free slot */
+	DK2PIPELINE_LATEST,		/* only the newest frame waits for a worker */
+	DK2PIPELINE_QUEUE		/* the newest limit frames wait for a worker */
+} dk2pipeline_policy_t;
+
+typedef struct {
+	/*
+	* Optional. Called on a worker when there is a frame for it, before
+	* it picks the frame to convert, to get whatever the conversion
+	* writes to; the result lands in frame->result. Anything that makes
+	* the worker wait for the consumer belongs here, so that the frame
+	* is chosen once the worker can go ahead with it. The worker keeps
+	* the result for its next frame if another worker took this one,
+	* but gives it back through release before it waits for more
+	* frames and when a discarding flush throws its frame away.
+	*/
+	void *(*acquire)(void *ctx, uint32_t worker);
+	/* Optional. Gives back a result that acquire returned and no frame used. */
+	void (*release)(void *ctx, void *result);
+	/*
+	* Convert a frame, on worker thread worker (0 .. workers - 1).
+	* Different frames are processed at the same time on different
+	* workers, but never two on the same worker. Owns frame->result
+	* from here on: it is passed to deliver as process leaves it. A
+	* frame left with a NULL result, because acquire had none or the
+	* conversion failed, counts as failed and is not delivered.
+	*/
+	void (*process)(void *ctx, uint32_t worker, dk2pipeline_frame_t *frame);
+	/*
+	* Hand a converted frame on. Called in push order, for one frame
+	* at a time. frame->data is reused once this returns.
+	*/
+	void (*deliver)(void *ctx, dk2pipeline_frame_t *frame);
+	void *ctx;
+} dk2pipeline_callbacks_t;
+
+typedef struct {
+	uint64_t pushed;	/* frames accepted by dk2pipeline_push() */
+	uint64_t dropped;	/* frames refused by dk2pipeline_push() */
+	uint64_t skipped;	/* frames passed over unprocessed for newer ones */
+	uint64_t delivered;	/* frames processed and passed to deliver */
+	uint64_t failed;	/* frames processed without a result, not delivered */
+	uint64_t discarded;	/* frames thrown away unprocessed by a discarding flush */
+	uint32_t queued;	/* frames accepted but not yet delivered, skipped, failed or discarded */
+	uint32_t queued_max;	/* the most there have been at once */
+	uint64_t age_last_ns;	/* push to delivery of the last frame delivered */
+	uint64_t age_max_ns;	/* the largest of those */
+	uint64_t age_total_ns;	/* their sum, for the mean age */
+} dk2pipeline_stats_t;
+
+typedef struct dk2pipeline_t dk2pipeline_t;
+
+/*
+* A pipeline for frames of up to frame_size bytes, with the given
+* number of workers, 0 meaning one per processor. limit is the number of
+* frames DK2PIPELINE_QUEUE lets wait for a worker, 0 meaning one per
+* worker; the other policies ignore it. Returns NULL when it cannot
+* allocate the slots or start any worker.
+*/
+dk2pipeline_t *
+dk2pipeline_new(uint32_t frame_size, dk2pipeline_policy_t policy, uint32_t limit, uint32_t workers, const dk2pipeline_callbacks_t *callbacks);
+
+/* Discard the frames not yet processed and stop the workers. A NULL pipeline is ignored. */
+void
+dk2pipeline_free(dk2pipeline_t *pipeline);
+
+uint32_t
+dk2pipeline_get_workers(const dk2pipeline_t *pipeline);
+
+/*
+* Queue a copy of frame. Only one thread may push. When every slot is
+* taken, DK2PIPELINE_PROCESS_ALL waits for one to free up; the other
+* policies never wait, but put the frame in place of the newest frame
+* still waiting, which then counts as skipped, or when none is waiting
+* drop this one and return DC1394_FALSE. A frame larger than the frame
+* size is dropped too. tags may be NULL, for all zero.
+*/
+dc1394bool_t
+dk2pipeline_push(dk2pipeline_t *pipeline, const void *frame, uint32_t size, uint64_t sequence, int64_t timestamp, int64_t duration, const dk2pipeline_tags_t *tags);
+
+/*
+* Wait until every frame pushed so far has been delivered, or with
+* discard until it has been delivered or thrown away: frames a worker
+* has not started on yet are then retired without calling process or
+* deliver. Must not run on a worker, nor in two threads at once.
+*/
+void
+dk2pipeline_flush(dk2pipeline_t *pipeline, dc1394bool_t discard);
+
+void
+dk2pipeline_get_stats(const dk2pipeline_t *pipeline, dk2pipeline_stats_t *stats);
+
+#endif
@@ -0,0 +1,353 @@
+/*
+* Raw frame capture files (.dk2raw)
+*
+* Writing goes through stdio with a large buffer, so that recording costs
+* the streaming thread one copy per frame and an occasional write of
+* several frames at once. Reading maps the file, with CreateFileMapping
+* on Windows and mmap elsewhere, and never copies a frame.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dk2raw.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(dk2raw_header_t) == DK2RAW_ALIGN, "dk2raw header must fill one alignment unit");
+static_assert(sizeof(dk2raw_record_t) == DK2RAW_ALIGN, "dk2raw record header must fill one alignment unit");
+
+/* the stream buffer holds a few frames of the DK2 sensor */
+#define WRITER_BUFFER (2 << 20)
+
+struct dk2raw_writer_t {
+	FILE *file;
+	dk2raw_header_t header;
+	char *buffer;
+};
+
+struct dk2raw_reader_t {
+	dk2raw_header_t header;
+	const uint8_t *base;
+	uint64_t length;
+	uint64_t frames;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+static uint32_t
+align_up(uint32_t n)
+{
+	return (n + DK2RAW_ALIGN - 1) & ~(uint32_t)(DK2RAW_ALIGN - 1);
+}
+
+/* zero bytes written to pad records */
+static dc1394error_t
+write_zeros(FILE *file, uint64_t n)
+{
+	static const uint8_t zeros[4096] = { 0 };
+
+	while (n > 0) {
+		size_t chunk = n < sizeof(zeros) ? (size_t)n : sizeof(zeros);
+
+		if (fwrite(zeros, 1, chunk, file) != chunk)
+			return DC1394_FAILURE;
+		n -= chunk;
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dk2raw_writer_open(const char *path, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, uint32_t bits, dk2raw_writer_t **writer)
+{
+	dk2raw_writer_t *w;
+	uint32_t sample_size = bits > 8 ? 2 : 1;
+	uint64_t frame_size = (uint64_t)sx * sy * sample_size;
+
+	*writer = NULL;
+	if (path == NULL || sx == 0 || sy == 0 || bits == 0 || bits > 16)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	if ((tile < DC1394_COLOR_FILTER_MIN) || (tile > DC1394_COLOR_FILTER_MAX))
+		return DC1394_INVALID_COLOR_FILTER;
+	/* record_size must fit the header's 32 bits */
+	if (frame_size > UINT32_MAX - 2 * DK2RAW_ALIGN)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	w = (dk2raw_writer_t *)calloc(1, sizeof(dk2raw_writer_t));
+	if (w == NULL)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+	w->buffer = (char *)malloc(WRITER_BUFFER);
+	if (w->buffer == NULL) {
+		free(w);
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+	}
+	w->file = fopen(path, "wb");
+	if (w->file == NULL) {
+		free(w->buffer);
+		free(w);
+		return DC1394_FAILURE;
+	}
+	setvbuf(w->file, w->buffer, _IOFBF, WRITER_BUFFER);
+
+	memcpy(w->header.magic, DK2RAW_MAGIC, sizeof(w->header.magic));
+	w->header.version = DK2RAW_VERSION;
+	w->header.header_size = sizeof(dk2raw_header_t);
+	w->header.width = sx;
+	w->header.height = sy;
+	w->header.tile = tile;
+	w->header.bits = bits;
+	w->header.sample_size = sample_size;
+	w->header.frame_size = (uint32_t)frame_size;
+	w->header.record_size = DK2RAW_ALIGN + align_up((uint32_t)frame_size);
+
+	if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1) {
+		dk2raw_writer_close(w);
+		return DC1394_FAILURE;
+	}
+	*writer = w;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t
+dk2raw_writer_append(dk2raw_writer_t *writer, const void *frame, uint32_t size, uint64_t sequence, int64_t timestamp)
+{
+	dk2raw_record_t record;
+
+	if (writer == NULL || (frame == NULL && size > 0) || size > writer->header.frame_size)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	memset(&record, 0, sizeof(record));
+	record.sequence = sequence;
+	record.timestamp = timestamp;
+	record.size = size;
+
+	if (fwrite(&record, sizeof(record), 1, writer->file) != 1)
+		return DC1394_FAILURE;
+	if (size > 0 && fwrite(frame, 1, size, writer->file) != size)
+		return DC1394_FAILURE;
+	return write_zeros(writer->file, writer->header.record_size - sizeof(record) - size);
+}
+
+dc1394error_t
+dk2raw_writer_close(dk2raw_writer_t *writer)
+{
+	dc1394error_t err = DC1394_SUCCESS;
+
+	if (writer == NULL)
+		return DC1394_SUCCESS;
+	if (fclose(writer->file) != 0)
+		err = DC1394_FAILURE;
+	free(writer->buffer);
+	free(writer);
+	return err;
+}
+
+/* whether a header read from a file of length bytes describes a usable file */
+static bool
+header_valid(const dk2raw_header_t *h, uint64_t length)
+{
+	uint64_t frame_size = (uint64_t)h->width * h->height * h->sample_size;
+
+	if (memcmp(h->magic, DK2RAW_MAGIC, sizeof(h->magic)) != 0 || h->version != DK2RAW_VERSION)
+		return false;
+	if (h->header_size < sizeof(dk2raw_header_t) || h->header_size % DK2RAW_ALIGN != 0 || h->header_size > length)
+		return false;
+	if (h->width == 0 || h->height == 0 || h->bits == 0 || h->bits > 16)
+		return false;
+	if ((h->tile < DC1394_COLOR_FILTER_MIN) || (h->tile > DC1394_COLOR_FILTER_MAX))
+		return false;
+	if (h->sample_size != (h->bits > 8 ? 2u : 1u) || h->frame_size != frame_size)
+		return false;
+	return h->record_size % DK2RAW_ALIGN == 0 && h->record_size >= DK2RAW_ALIGN + frame_size;
+}
+
+dc1394error_t
+dk2raw_reader_open(const char *path, dk2raw_reader_t **reader)
+{
+	dk2raw_reader_t *r;
+
+	*reader = NULL;
+	if (path == NULL)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	r = (dk2raw_reader_t *)calloc(1, sizeof(dk2raw_reader_t));
+	if (r == NULL)
+		return DC1394_MEMORY_ALLOCATION_FAILURE;
+
+#ifdef _WIN32
+	LARGE_INTEGER length;
+
+	/* shared for writing, so that a file still being recorded can be replayed */
+	r->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (r->file == INVALID_HANDLE_VALUE) {
+		free(r);
+		return DC1394_FAILURE;
+	}
+	if (!GetFileSizeEx(r->file, &length) || (uint64_t)length.QuadPart < sizeof(dk2raw_header_t)
+	    || (uint64_t)length.QuadPart > (size_t)-1) {
+		CloseHandle(r->file);
+		free(r);
+		return DC1394_FAILURE;
+	}
+	r->length = (uint64_t)length.QuadPart;
+	r->mapping = CreateFileMappingA(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (r->mapping != NULL)
+		r->base = (const uint8_t *)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (r->base == NULL) {
+		if (r->mapping != NULL)
+			CloseHandle(r->mapping);
+		CloseHandle(r->file);
+		free(r);
+		return DC1394_FAILURE;
+	}
+#else
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	void *base;
+
+	if (fd < 0) {
+		free(r);
+		return DC1394_FAILURE;
+	}
+	if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(dk2raw_header_t)
+	    || (uint64_t)st.st_size > (size_t)-1) {
+		close(fd);
+		free(r);
+		return DC1394_FAILURE;
+	}
+	r->length = (uint64_t)st.st_size;
+	base = mmap(NULL, (size_t)r->length, PROT_READ, MAP_SHARED, fd, 0);
+	/* the mapping keeps the file open */
+	close(fd);
+	if (base == MAP_FAILED) {
+		free(r);
+		return DC1394_FAILURE;
+	}
+	r->base = (const uint8_t *)base;
+#endif
+
+	memcpy(&r->header, r->base, sizeof(r->header));
+	if (!header_valid(&r->header, r->length)) {
+		dk2raw_reader_close(r);
+		return DC1394_FAILURE;
+	}
+	r->frames = (r->length - r->header.header_size) / r->header.record_size;
+	*reader = r;
+	return DC1394_SUCCESS;
+}
+
+void
+dk2raw_reader_close(dk2raw_reader_t *reader)
+{
+	if (reader == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(reader->base);
+	CloseHandle(reader->mapping);
+	CloseHandle(reader->file);
+#else
+	munmap((void *)reader->base, (size_t)reader->length);
+#endif
+	free(reader);
+}
+
+const dk2raw_header_t *
+dk2raw_reader_header(const dk2raw_reader_t *reader)
+{
+	return &reader->header;
+}
+
+uint64_t
+dk2raw_reader_frame_count(const dk2raw_reader_t *reader)
+{
+	return reader->frames;
+}
+
+static const uint8_t *
+record_at(const dk2raw_reader_t *reader, uint64_t index)
+{
+	return reader->base + reader->header.header_size + index * reader->header.record_size;
+}
+
+dc1394error_t
+dk2raw_reader_frame(const dk2raw_reader_t *reader, uint64_t index, dk2raw_frame_t *frame)
+{
+	dk2raw_record_t record;
+	const uint8_t *p;
+
+	if (index >= reader->frames)
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	p = record_at(reader, index);
+	memcpy(&record, p, sizeof(record));
+	if (record.size > reader->header.frame_size)
+		return DC1394_FAILURE;
+
+	frame->sequence = record.sequence;
+	frame->timestamp = record.timestamp;
+	frame->size = record.size;
+	frame->data = p + DK2RAW_ALIGN;
+	return DC1394_SUCCESS;
+}
+
+static int64_t
+timestamp_at(const dk2raw_reader_t *reader, uint64_t index)
+{
+	dk2raw_record_t record;
+
+	memcpy(&record, record_at(reader, index), sizeof(record));
+	return record.timestamp;
+}
+
+uint64_t
+dk2raw_reader_seek(const dk2raw_reader_t *reader, int64_t timestamp)
+{
+	uint64_t lo = 0, hi = reader->frames;
+
+	/* only the record headers of the probed frames are paged in */
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (timestamp_at(reader, mid) < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void
+dk2raw_reader_prefetch(const dk2raw_reader_t *reader, uint64_t index, uint64_t count)
+{
+#ifdef _WIN32
+	/* PrefetchVirtualMemory would do, but needs Windows 8 */
+	(void)reader;
+	(void)index;
+	(void)count;
+#else
+	uintptr_t start, end;
+	long page = sysconf(_SC_PAGESIZE);
+
+	if (index >= reader->frames || count == 0)
+		return;
+	if (count > reader->frames - index)
+		count = reader->frames - index;
+	start = (uintptr_t)record_at(reader, index);
+	end = (uintptr_t)record_at(reader, index + count);
+	start &= ~(uintptr_t)(page - 1);
+	madvise((void *)start, end - start, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,140 @@
+/*
+* Raw frame capture files (.dk2raw)
+*
+* A .dk2raw file holds the undecoded mosaics exactly as the filter
+* received them, so that tracking problems can be replayed and the
+* decoders benchmarked offline. It is a fixed header followed by one
+* fixed-size record per frame; all fields are little-endian. Because
+* every record has the same size, frame i is found without reading the
+* frames before it, and a file cut short by a crash still reads back up
+* to its last whole record. What a crash loses is what the writer had
+* not yet handed to the system: records go through a 2 MB stream buffer,
+* so up to that much, about five DK2 frames, besides a torn last record.
+*
+*   offset 0            dk2raw_header_t
+*   header_size         record 0: dk2raw_record_t, then frame_size bytes
+*                       of mosaic, padded to record_size
+*   header_size + i * record_size
+*                       record i
+*
+* The mosaic of each record starts DK2RAW_ALIGN bytes into it, and both
+* header_size and record_size are multiples of DK2RAW_ALIGN, so a mapped
+* file hands the decoders aligned rows whenever the row length is.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef __DK2RAW_H__
+#define __DK2RAW_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bayer.h"
+
+#define DK2RAW_MAGIC "DK2RAW\r\n"
+#define DK2RAW_VERSION 1
+#define DK2RAW_ALIGN 64
+/* timestamp of a frame that came without one */
+#define DK2RAW_NO_TIME INT64_MIN
+
+typedef struct {
+	char magic[8];		/* DK2RAW_MAGIC */
+	uint32_t version;	/* DK2RAW_VERSION */
+	uint32_t header_size;	/* bytes before record 0 */
+	uint32_t width;		/* mosaic size in samples */
+	uint32_t height;
+	uint32_t tile;		/* dc1394color_filter_t */
+	uint32_t bits;		/* significant bits per sample */
+	uint32_t sample_size;	/* 1, or 2 for bits > 8 */
+	uint32_t frame_size;	/* width * height * sample_size */
+	uint32_t record_size;	/* bytes from one record to the next */
+	uint32_t reserved[5];
+} dk2raw_header_t;
+
+typedef struct {
+	uint64_t sequence;	/* frame number, counted by the recorder */
+	int64_t timestamp;	/* stream time in 100 ns units, or DK2RAW_NO_TIME */
+	uint32_t size;		/* bytes of mosaic stored, at most frame_size */
+	uint32_t reserved[11];
+} dk2raw_record_t;
+
+/* one frame of an open file, as handed out by dk2raw_reader_frame() */
+typedef struct {
+	uint64_t sequence;
+	int64_t timestamp;
+	uint32_t size;
+	const uint8_t *data;	/* the mosaic, inside the file mapping */
+} dk2raw_frame_t;
+
+/*
+* Writing. Records are appended through a buffered stream on the
+* caller's thread, and reach the file when the buffer fills or the
+* writer is closed; a writer must not be used by two threads at once.
+*/
+typedef struct dk2raw_writer_t dk2raw_writer_t;
+
+/*
+* Create path, replacing any file of that name, for frames of sx * sy
+* samples in the given tile with bits significant bits. Samples of more
+* than 8 bits are stored as 16-bit words.
+*/
+dc1394error_t
+dk2raw_writer_open(const char *path, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, uint32_t bits, dk2raw_writer_t **writer);
+
+/*
+* Append one frame. size may be less than the header's frame_size for a
+* short buffer; the rest of the record is zero filled.
+*/
+dc1394error_t
+dk2raw_writer_append(dk2raw_writer_t *writer, const void *frame, uint32_t size, uint64_t sequence, int64_t timestamp);
+
+/* Flush and close the file. A NULL writer is ignored. */
+dc1394error_t
+dk2raw_writer_close(dk2raw_writer_t *writer);
+
+/*
+* Reading. The whole file is mapped read-only when it is opened, and the
+* frames point straight into the mapping: nothing is read or copied until
+* the decoder touches the rows. The pointers stay valid until the reader
+* is closed. A 32-bit process can only open files that fit into its
+* address space.
+*/
+typedef struct dk2raw_reader_t dk2raw_reader_t;
+
+dc1394error_t
+dk2raw_reader_open(const char *path, dk2raw_reader_t **reader);
+
+/* Unmap and close the file. A NULL reader is ignored. */
+void
+dk2raw_reader_close(dk2raw_reader_t *reader);
+
+const dk2raw_header_t *
+dk2raw_reader_header(const dk2raw_reader_t *reader);
+
+/* complete records in the file; a trailing partial record is not counted */
+uint64_t
+dk2raw_reader_frame_count(const dk2raw_reader_t *reader);
+
+dc1394error_t
+dk2raw_reader_frame(const dk2raw_reader_t *reader, uint64_t index, dk2raw_frame_t *frame);
+
+/*
+* Index of the first frame whose timestamp is at or after timestamp,
+* assuming the recorded timestamps never go backwards; frame_count when
+* there is none.
+*/
+uint64_t
+dk2raw_reader_seek(const dk2raw_reader_t *reader, int64_t timestamp);
+
+/*
+* Hint that frames index .. index + count - 1 are about to be decoded, so
+* that the system can start paging them in. A hint only; it may do
+* nothing.
+*/
+void
+dk2raw_reader_prefetch(const dk2raw_reader_t *reader, uint64_t index, uint64_t count);
+
+#endif
@@ -0,0 +1,807 @@
+/*
+* Conformance of the optimized Bayer decoders with the scalar reference
+*
+* Every mosaic is decoded once by the scalar reference functions of
+* bayer.cpp, with the registry capped at DC1394_BAYER_ISA_SCALAR so that
+* VNG and AHD also start from the scalar Bilinear kernel, and then by each
+* optimized path in turn:
+*
+*   isa-<name>   the serial decoder with the registry capped at each
+*                instruction set the CPU has a kernel of the method for,
+*                which includes the kernels built for one frame size
+*   threads-<n>  the band-parallel decoder on a pool of n threads
+*   stride       the stride decoder reading a padded mosaic through a
+*                negative pitch and writing a padded, offset output
+*   roi          the region-of-interest decoder on random rectangles
+*   luma         the luma decoder against the luma of the reference
+*                Bilinear colours
+*   unpack-<isa> the 10- and 12-bit mosaics packed as RAW10 and RAW12
+*                and unpacked again, scalar and AVX2
+*   packed-...   the packed decoder on those, serial with the registry
+*                capped at scalar and AVX2, band-parallel, and through a
+*                negative pitch into a padded output; extra sizes cut
+*                the frame into several strips, the last one short
+*   layout-...   the layout decoder writing BGRX, planar, planar float,
+*                NV12 and I420 output, serial with the registry capped at scalar and
+*                at the widest instruction set, band-parallel, and from
+*                a negative mosaic pitch into bottom-up planes; checked
+*                against the reference colours laid out by hand, floats
+*                to the bit, with the row padding left untouched
+*
+* The mosaics are random and adversarial (flat black and white, lone
+* bright sites, site and line checkerboards, ramps and noise near full
+* scale), of odd and even sizes down to a few pixels, on all four tiles,
+* at 8 bits and at 16 bits with 8 to 16 significant bits. Each path gets
+* one line with the number of cases, how many were bit-exact and the
+* largest difference of any sample; the program fails when that exceeds
+* --tolerance, which is 0, so every path has to be bit-exact.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "bayer.h"
+#include "test_util.h"
+
+static const char *const method_names[DC1394_BAYER_METHOD_NUM] = {
+	"nearest", "simple", "bilinear", "hqlinear", "downsample", "edgesense", "vng", "ahd"
+};
+
+static const char *const tile_names[DC1394_COLOR_FILTER_NUM] = {
+	"rggb", "gbrg", "grbg", "bggr"
+};
+
+enum {
+	PATTERN_NOISE,
+	PATTERN_BLACK,
+	PATTERN_WHITE,
+	PATTERN_IMPULSES,
+	PATTERN_SITE_CHECKER,
+	PATTERN_LINE_CHECKER,
+	PATTERN_RAMP,
+	PATTERN_NEAR_FULL,
+	PATTERN_NUM
+};
+
+static const char *const pattern_names[PATTERN_NUM] = {
+	"noise", "black", "white", "impulses", "site-checker", "line-checker", "ramp", "near-full"
+};
+
+typedef struct {
+	uint32_t sx, sy;
+} conf_size_t;
+
+/* frame sizes, down to frames narrower than the HQLinear neighbourhood;
+   only the first pattern is decoded at the last, full size */
+static const conf_size_t sizes[] = {
+	{ 2, 9 }, { 3, 9 }, { 4, 9 }, { 3, 3 }, { 4, 4 }, { 7, 5 }, { 8, 6 }, { 16, 9 }, { 33, 17 }, { 64, 35 }, { 130, 67 }, { 752, 480 }
+};
+static const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+/* sizes whose strips in the packed decoder do not divide them evenly */
+static const conf_size_t strip_sizes[] = {
+	{ 1000, 70 }, { 2048, 24 }
+};
+static const int num_strip_sizes = sizeof(strip_sizes) / sizeof(strip_sizes[0]);
+
+static const char *const packing_names[DC1394_BAYER_PACKING_NUM] = {
+	"raw10", "raw12"
+};
+
+static const uint32_t pool_threads[] = { 2, 3, 8 };
+static const int num_pools = sizeof(pool_threads) / sizeof(pool_threads[0]);
+
+typedef struct {
+	long cases;
+	long exact;
+	long max_err;
+	std::string worst;
+} conf_stats_t;
+
+static std::map<std::string, conf_stats_t> results;
+static int verbose = 0;
+
+template <typename T>
+static void
+fill_mosaic(T *p, uint32_t sx, uint32_t sy, int pattern, uint32_t maxval)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < sy; y++)
+	for (x = 0; x < sx; x++) {
+		uint32_t v;
+
+		switch (pattern) {
+		case PATTERN_BLACK:
+			v = 0;
+			break;
+		case PATTERN_WHITE:
+			v = maxval;
+			break;
+		case PATTERN_IMPULSES:
+			v = rng() % 17 == 0 ? maxval : 0;
+			break;
+		case PATTERN_SITE_CHECKER:
+			v = (x ^ y) & 1 ? maxval : 0;
+			break;
+		case PATTERN_LINE_CHECKER:
+			v = ((x >> 1) ^ (y >> 1)) & 1 ? maxval : 0;
+			break;
+		case PATTERN_RAMP:
+			v = (uint32_t)((uint64_t)(x * 7 + y * 3) * maxval / (7 * sx + 3 * sy));
+			break;
+		case PATTERN_NEAR_FULL:
+			v = maxval - rng() % 4;
+			break;
+		default:
+			v = rng() & maxval;
+			break;
+		}
+		p[y * sx + x] = (T)v;
+	}
+}
+
+template <typename T>
+static void
+record(const std::string &path, const char *method, int depth, const T *ref, const T *out, size_t n, dc1394error_t ref_err, dc1394error_t err, const std::string &where)
+{
+	conf_stats_t &s = results[path + " " + method + " " + (depth == 8 ? "8" : "16")];
+	long diff = 0;
+	size_t i;
+
+	if (err != ref_err)
+		diff = -1;
+	else if (err == DC1394_SUCCESS)
+		for (i = 0; i < n; i++)
+			diff = std::max(diff, labs((long)ref[i] - (long)out[i]));
+
+	s.cases++;
+	if (!diff)
+		s.exact++;
+	/* a different status is worse than any difference in value */
+	if (diff < 0 ? s.max_err >= 0 : diff > s.max_err && s.max_err >= 0) {
+		s.max_err = diff;
+		s.worst = where;
+	}
+	if (diff && verbose)
+		printf("  %s %s %d: %s: %s %ld\n", path.c_str(), method, depth, where.c_str(),
+			diff < 0 ? "status" : "error", diff < 0 ? (long)err : diff);
+}
+
+static dc1394error_t
+reference8(const uint8_t *in, uint8_t *out, uint32_t sx, uint32_t sy, int tile, int method)
+{
+	switch (method) {
+	case DC1394_BAYER_METHOD_NEAREST:
+		return dc1394_bayer_NearestNeighbor(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_SIMPLE:
+		return dc1394_bayer_Simple(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_BILINEAR:
+		return dc1394_bayer_Bilinear(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_HQLINEAR:
+		return dc1394_bayer_HQLinear(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_DOWNSAMPLE:
+		return dc1394_bayer_Downsample(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_EDGESENSE:
+		return dc1394_bayer_EdgeSense(in, out, sx, sy, tile);
+	case DC1394_BAYER_METHOD_VNG:
+		return dc1394_bayer_VNG(in, out, sx, sy, tile);
+	default:
+		return dc1394_bayer_AHD(in, out, sx, sy, tile);
+	}
+}
+
+static dc1394error_t
+reference16(const uint16_t *in, uint16_t *out, uint32_t sx, uint32_t sy, int tile, int method, int bits)
+{
+	switch (method) {
+	case DC1394_BAYER_METHOD_NEAREST:
+		return dc1394_bayer_NearestNeighbor_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_SIMPLE:
+		return dc1394_bayer_Simple_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_BILINEAR:
+		return dc1394_bayer_Bilinear_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_HQLINEAR:
+		return dc1394_bayer_HQLinear_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_DOWNSAMPLE:
+		return dc1394_bayer_Downsample_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_EDGESENSE:
+		return dc1394_bayer_EdgeSense_uint16(in, out, sx, sy, tile, bits);
+	case DC1394_BAYER_METHOD_VNG:
+		return dc1394_bayer_VNG_uint16(in, out, sx, sy, tile, bits);
+	default:
+		return dc1394_bayer_AHD_uint16(in, out, sx, sy, tile, bits);
+	}
+}
+
+/* the instruction sets above scalar the CPU has a kernel of method at depth for */
+static std::vector<dc1394bayer_isa_t>
+kernel_isas(int method, int depth)
+{
+	std::vector<dc1394bayer_isa_t> isas;
+	uint32_t features = dc1394_bayer_get_cpu_features();
+	int isa;
+
+	for (isa = DC1394_BAYER_ISA_MIN + 1; isa <= DC1394_BAYER_ISA_MAX; isa++) {
+		dc1394bayer_isa_t got;
+
+		if (!(features & (1u << isa)))
+			continue;
+		dc1394_bayer_set_max_isa((dc1394bayer_isa_t)isa);
+		if (dc1394_bayer_get_kernel_isa((dc1394bayer_method_t)method, depth, &got) == DC1394_SUCCESS && got == isa)
+			isas.push_back((dc1394bayer_isa_t)isa);
+	}
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+	return isas;
+}
+
+/* output image of the stride and roi paths: rows padded and offset */
+template <typename T>
+struct padded_t {
+	std::vector<T> buf;
+	size_t offset;
+	int pitch;
+	uint32_t ox, oy;
+
+	padded_t(uint32_t w, uint32_t h)
+		: buf((3 * w + 5) * h + 7, (T)0x5a5a), offset(7), pitch((int)(3 * w + 5)), ox(w), oy(h) {}
+
+	/* the ox x oy image without its padding */
+	std::vector<T>
+	crop(void) const
+	{
+		std::vector<T> out(3 * ox * oy);
+		uint32_t y;
+
+		for (y = 0; y < oy; y++)
+			memcpy(&out[3 * ox * y], &buf[offset + pitch * y], 3 * ox * sizeof(T));
+		return out;
+	}
+};
+
+/* the mosaic bottom-up in a padded buffer, for a negative bayer pitch */
+template <typename T>
+static std::vector<T>
+flip_mosaic(const T *in, uint32_t sx, uint32_t sy, int *pitch)
+{
+	std::vector<T> out((sx + 3) * sy);
+	uint32_t y;
+
+	*pitch = -(int)((sx + 3) * sizeof(T));
+	for (y = 0; y < sy; y++)
+		memcpy(&out[(sx + 3) * (sy - 1 - y)], in + sx * y, sx * sizeof(T));
+	return out;
+}
+
+static void
+check8(dc1394bayer_pool_t **pools, const conf_size_t *size, int tile, int method, int pattern)
+{
+	const uint32_t sx = size->sx, sy = size->sy;
+	const uint32_t ox = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sx / 2 : sx;
+	const uint32_t oy = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sy / 2 : sy;
+	const size_t n = 3 * (size_t)ox * oy;
+	const dc1394color_filter_t filter = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + tile);
+	const char *name = method_names[method];
+	std::vector<uint8_t> in(sx * sy), ref(n + 1), out(n + 1);
+	std::vector<dc1394bayer_isa_t> isas = kernel_isas(method, 8);
+	dc1394error_t ref_err, err;
+	char where[96];
+	size_t i;
+	int k;
+
+	fill_mosaic(&in[0], sx, sy, pattern, 255);
+	snprintf(where, sizeof(where), "%ux%u %s %s", sx, sy, tile_names[tile], pattern_names[pattern]);
+
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_SCALAR);
+	ref_err = reference8(&in[0], &ref[0], sx, sy, filter, method);
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+	for (i = 0; i < isas.size(); i++) {
+		dc1394_bayer_set_max_isa(isas[i]);
+		err = dc1394_bayer_decoding_8bit(&in[0], &out[0], sx, sy, filter, (dc1394bayer_method_t)method);
+		record(std::string("isa-") + dc1394_bayer_isa_name(isas[i]), name, 8, &ref[0], &out[0], n, ref_err, err, where);
+	}
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+	for (k = 0; k < num_pools; k++) {
+		err = dc1394_bayer_decoding_8bit_parallel(pools[k], &in[0], &out[0], sx, sy, filter, (dc1394bayer_method_t)method);
+		record("threads-" + std::to_string(pool_threads[k]), name, 8, &ref[0], &out[0], n, ref_err, err, where);
+	}
+
+	{
+		padded_t<uint8_t> dst(ox, oy);
+		int pitch;
+		std::vector<uint8_t> flipped = flip_mosaic(&in[0], sx, sy, &pitch);
+		std::vector<uint8_t> got;
+
+		err = dc1394_bayer_decoding_8bit_stride(&flipped[0], (size_t)-pitch * (sy - 1), pitch, &dst.buf[0], dst.offset, dst.pitch,
+			sx, sy, filter, (dc1394bayer_method_t)method, DC1394_BAYER_ORDER_RGB);
+		got = dst.crop();
+		record("stride", name, 8, &ref[0], &got[0], n, ref_err, err, where);
+	}
+
+	if (ref_err == DC1394_SUCCESS) {
+		padded_t<uint8_t> dst(ox, oy);
+		dc1394bayer_roi_t rois[3];
+		std::vector<uint8_t> got, want(ref);
+		uint32_t y, x;
+
+		for (k = 0; k < 3; k++) {
+			rois[k].x = rng() % ox;
+			rois[k].y = rng() % oy;
+			rois[k].width = 1 + rng() % (ox - rois[k].x);
+			rois[k].height = 1 + rng() % (oy - rois[k].y);
+		}
+		/* outside the rectangles the output keeps its fill */
+		for (y = 0; y < oy; y++)
+		for (x = 0; x < ox; x++) {
+			int inside = 0;
+
+			for (k = 0; k < 3; k++)
+				inside |= x >= rois[k].x && x < rois[k].x + rois[k].width && y >= rois[k].y && y < rois[k].y + rois[k].height;
+			if (!inside)
+				memset(&want[3 * (ox * y + x)], 0x5a, 3);
+		}
+		err = dc1394_bayer_decoding_8bit_roi(&in[0], &dst.buf[dst.offset], dst.pitch, sx, sy, filter, (dc1394bayer_method_t)method,
+			DC1394_BAYER_ORDER_RGB, rois, 3);
+		got = dst.crop();
+		record("roi", name, 8, &want[0], &got[0], n, ref_err, err, where);
+	}
+}
+
+static void
+check16(dc1394bayer_pool_t **pools, const conf_size_t *size, int tile, int method, int pattern, int bits)
+{
+	const uint32_t sx = size->sx, sy = size->sy;
+	const uint32_t ox = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sx / 2 : sx;
+	const uint32_t oy = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sy / 2 : sy;
+	const size_t n = 3 * (size_t)ox * oy;
+	const dc1394color_filter_t filter = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + tile);
+	const char *name = method_names[method];
+	std::vector<uint16_t> in(sx * sy), ref(n + 1), out(n + 1);
+	std::vector<dc1394bayer_isa_t> isas = kernel_isas(method, 16);
+	dc1394error_t ref_err, err;
+	char where[96];
+	size_t i;
+	int k;
+
+	fill_mosaic(&in[0], sx, sy, pattern, (1u << bits) - 1);
+	snprintf(where, sizeof(where), "%ux%u %s %s %d bits", sx, sy, tile_names[tile], pattern_names[pattern], bits);
+
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_SCALAR);
+	ref_err = reference16(&in[0], &ref[0], sx, sy, filter, method, bits);
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+	for (i = 0; i < isas.size(); i++) {
+		dc1394_bayer_set_max_isa(isas[i]);
+		err = dc1394_bayer_decoding_16bit(&in[0], &out[0], sx, sy, filter, (dc1394bayer_method_t)method, bits);
+		record(std::string("isa-") + dc1394_bayer_isa_name(isas[i]), name, 16, &ref[0], &out[0], n, ref_err, err, where);
+	}
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+	for (k = 0; k < num_pools; k++) {
+		err = dc1394_bayer_decoding_16bit_parallel(pools[k], &in[0], &out[0], sx, sy, filter, (dc1394bayer_method_t)method, bits);
+		record("threads-" + std::to_string(pool_threads[k]), name, 16, &ref[0], &out[0], n, ref_err, err, where);
+	}
+
+	{
+		padded_t<uint16_t> dst(ox, oy);
+		int pitch;
+		std::vector<uint16_t> flipped = flip_mosaic(&in[0], sx, sy, &pitch);
+		std::vector<uint16_t> got;
+
+		err = dc1394_bayer_decoding_16bit_stride(&flipped[0], (size_t)-pitch * (sy - 1), pitch, &dst.buf[0], dst.offset * 2, dst.pitch * 2,
+			sx, sy, filter, (dc1394bayer_method_t)method, bits, DC1394_BAYER_ORDER_RGB);
+		got = dst.crop();
+		record("stride", name, 16, &ref[0], &got[0], n, ref_err, err, where);
+	}
+}
+
+/* the mosaic packed, in rows pitch bytes apart; sx must fit the packing */
+static std::vector<uint8_t>
+pack_mosaic(const uint16_t *in, uint32_t sx, uint32_t sy, dc1394bayer_packing_t packing, size_t pitch)
+{
+	std::vector<uint8_t> out(pitch * sy, 0xa5);
+	uint32_t x, y;
+
+	for (y = 0; y < sy; y++) {
+		const uint16_t *src = in + sx * y;
+		uint8_t *dst = &out[pitch * y];
+
+		if (packing == DC1394_BAYER_PACKING_RAW10)
+			for (x = 0; x < sx; x += 4, src += 4, dst += 5) {
+				dst[0] = (uint8_t)(src[0] >> 2);
+				dst[1] = (uint8_t)(src[1] >> 2);
+				dst[2] = (uint8_t)(src[2] >> 2);
+				dst[3] = (uint8_t)(src[3] >> 2);
+				dst[4] = (uint8_t)((src[0] & 3) | (src[1] & 3) << 2 | (src[2] & 3) << 4 | (src[3] & 3) << 6);
+			}
+		else
+			for (x = 0; x < sx; x += 2, src += 2, dst += 3) {
+				dst[0] = (uint8_t)(src[0] >> 4);
+				dst[1] = (uint8_t)(src[1] >> 4);
+				dst[2] = (uint8_t)((src[0] & 15) | (src[1] & 15) << 4);
+			}
+	}
+	return out;
+}
+
+static void
+check_packed(dc1394bayer_pool_t **pools, const conf_size_t *size, int tile, int method, int pattern, dc1394bayer_packing_t packing)
+{
+	static const dc1394bayer_isa_t unpack_isas[] = { DC1394_BAYER_ISA_SCALAR, DC1394_BAYER_ISA_AVX2 };
+	const int bits = packing == DC1394_BAYER_PACKING_RAW10 ? 10 : 12;
+	const uint32_t sx = size->sx, sy = size->sy;
+	const uint32_t ox = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sx / 2 : sx;
+	const uint32_t oy = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sy / 2 : sy;
+	const size_t n = 3 * (size_t)ox * oy;
+	const size_t row_bytes = dc1394_bayer_packed_row_bytes(packing, sx);
+	const size_t pitch = row_bytes + 3;
+	const dc1394color_filter_t filter = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + tile);
+	const char *name = method_names[method];
+	std::vector<uint16_t> in(sx * sy), ref(n + 1), out(n + 1);
+	std::vector<uint8_t> packed;
+	dc1394error_t ref_err, err;
+	char where[96];
+	size_t i;
+	int k;
+
+	if (row_bytes == 0)
+		return;
+	fill_mosaic(&in[0], sx, sy, pattern, (1u << bits) - 1);
+	packed = pack_mosaic(&in[0], sx, sy, packing, pitch);
+	snprintf(where, sizeof(where), "%ux%u %s %s %s", sx, sy, tile_names[tile], pattern_names[pattern], packing_names[packing]);
+
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_SCALAR);
+	ref_err = reference16(&in[0], &ref[0], sx, sy, filter, method, bits);
+
+	for (i = 0; i < sizeof(unpack_isas) / sizeof(unpack_isas[0]); i++) {
+		std::string isa = dc1394_bayer_isa_name(unpack_isas[i]);
+
+		if (!(dc1394_bayer_get_cpu_features() & (1u << unpack_isas[i])))
+			continue;
+		dc1394_bayer_set_max_isa(unpack_isas[i]);
+		/* the unpacked mosaic is the same whatever the method */
+		if (method == DC1394_BAYER_METHOD_NEAREST) {
+			std::vector<uint16_t> unpacked(sx * sy);
+
+			err = dc1394_bayer_unpack(&packed[0], (int)pitch, &unpacked[0], (int)(sx * sizeof(uint16_t)), sx, sy, packing);
+			record("unpack-" + isa, packing_names[packing], 16, &in[0], &unpacked[0], in.size(), DC1394_SUCCESS, err, where);
+		}
+		err = dc1394_bayer_decoding_packed(&packed[0], (int)pitch, &out[0], (int)(3 * ox * sizeof(uint16_t)), sx, sy, filter,
+			(dc1394bayer_method_t)method, packing, DC1394_BAYER_ORDER_RGB);
+		record("packed-" + isa, name, 16, &ref[0], &out[0], n, ref_err, err, where);
+	}
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+	for (k = 0; k < num_pools; k++) {
+		err = dc1394_bayer_decoding_packed_parallel(pools[k], &packed[0], (int)pitch, &out[0], (int)(3 * ox * sizeof(uint16_t)), sx, sy, filter,
+			(dc1394bayer_method_t)method, packing, DC1394_BAYER_ORDER_RGB);
+		record("packed-threads-" + std::to_string(pool_threads[k]), name, 16, &ref[0], &out[0], n, ref_err, err, where);
+	}
+
+	{
+		padded_t<uint16_t> dst(ox, oy);
+		std::vector<uint8_t> flipped(packed.size());
+		std::vector<uint16_t> got;
+		uint32_t y;
+
+		for (y = 0; y < sy; y++)
+			memcpy(&flipped[pitch * (sy - 1 - y)], &packed[pitch * y], pitch);
+		err = dc1394_bayer_decoding_packed(&flipped[pitch * (sy - 1)], -(int)pitch, &dst.buf[dst.offset], dst.pitch * 2, sx, sy, filter,
+			(dc1394bayer_method_t)method, packing, DC1394_BAYER_ORDER_RGB);
+		got = dst.crop();
+		record("packed-stride", name, 16, &ref[0], &got[0], n, ref_err, err, where);
+	}
+}
+
+static const char *const layout_names[DC1394_BAYER_LAYOUT_NUM] = {
+	"rgb", "rgbx", "planar", "float", "nv12", "i420"
+};
+
+/* an output of layout in padded planes, bottom-up when flip is set */
+struct layout_buffer_t {
+	std::vector<uint8_t> buf[3];
+	dc1394bayer_output_t out;
+	int planes, elem, pad;
+	size_t row[3];
+	uint32_t rows[3];
+
+	layout_buffer_t(dc1394bayer_layout_t layout, int depth, uint32_t ox, uint32_t oy, int flip)
+		: planes(layout == DC1394_BAYER_LAYOUT_RGBX ? 1 : layout == DC1394_BAYER_LAYOUT_NV12 ? 2 : 3),
+		elem(layout == DC1394_BAYER_LAYOUT_PLANAR_FLOAT ? 4 : depth / 8), pad(12)
+	{
+		int i;
+
+		memset(&out, 0, sizeof(out));
+		out.layout = layout;
+		out.order = DC1394_BAYER_ORDER_BGR;
+		for (i = 0; i < planes; i++) {
+			int pitch;
+
+			row[i] = (size_t)ox * elem * (layout == DC1394_BAYER_LAYOUT_RGBX ? 4 : 1);
+			rows[i] = oy;
+			if (i && layout >= DC1394_BAYER_LAYOUT_NV12) {
+				row[i] = (layout == DC1394_BAYER_LAYOUT_NV12 ? 2 : 1) * (size_t)((ox + 1) / 2);
+				rows[i] = (oy + 1) / 2;
+			}
+			pitch = (int)row[i] + pad;
+			buf[i].assign((size_t)pitch * rows[i], 0xcd);
+			out.plane[i] = flip ? &buf[i][(size_t)pitch * (rows[i] - 1)] : &buf[i][0];
+			out.pitch[i] = flip ? -pitch : pitch;
+		}
+	}
+
+	/* the samples plane by plane, row by row, and 1 when the padding is intact */
+	std::vector<uint32_t>
+	read(void) const
+	{
+		std::vector<uint32_t> v;
+		uint32_t y;
+		size_t x;
+		int i, intact = 1;
+
+		for (i = 0; i < planes; i++)
+		for (y = 0; y < rows[i]; y++) {
+			const uint8_t *p = (const uint8_t *)out.plane[i] + (ptrdiff_t)y * out.pitch[i];
+
+			for (x = 0; x < row[i]; x += elem) {
+				uint32_t sample = 0;
+
+				memcpy(&sample, p + x, elem);
+				v.push_back(sample);
+			}
+			for (x = row[i]; x < row[i] + pad; x++)
+				intact &= p[x] == 0xcd;
+		}
+		v.push_back(intact);
+		return v;
+	}
+};
+
+/* the BT.601 studio-swing conversion documented with dc1394bayer_layout_t */
+template <typename T>
+static void
+layout_expected_yuv(const T *rgb, uint32_t ox, uint32_t oy, dc1394bayer_layout_t layout, std::vector<uint32_t> &v)
+{
+	std::vector<uint32_t> cb, cr;
+	uint32_t x, y;
+
+	for (y = 0; y < oy * ox; y++)
+		v.push_back(16 + ((66 * rgb[3 * y] + 129 * rgb[3 * y + 1] + 25 * rgb[3 * y + 2] + 128) >> 8));
+	for (y = 0; y < oy; y += 2)
+	for (x = 0; x < ox; x += 2) {
+		const uint32_t x1 = std::min(x + 1, ox - 1), y1 = std::min(y + 1, oy - 1);
+		const uint32_t at[4] = { y * ox + x, y * ox + x1, y1 * ox + x, y1 * ox + x1 };
+		int sum[3] = { 0, 0, 0 }, k, c;
+
+		for (k = 0; k < 4; k++)
+			for (c = 0; c < 3; c++)
+				sum[c] += rgb[3 * at[k] + c];
+		cb.push_back(128 + ((-38 * sum[0] - 74 * sum[1] + 112 * sum[2] + 512 + 1024 * 256) / 1024 - 256));
+		cr.push_back(128 + ((112 * sum[0] - 94 * sum[1] - 18 * sum[2] + 512 + 1024 * 256) / 1024 - 256));
+	}
+	if (layout == DC1394_BAYER_LAYOUT_NV12) {
+		for (x = 0; x < cb.size(); x++) {
+			v.push_back(cb[x]);
+			v.push_back(cr[x]);
+		}
+	}
+	else {
+		v.insert(v.end(), cb.begin(), cb.end());
+		v.insert(v.end(), cr.begin(), cr.end());
+	}
+}
+
+/* the reference colours, R,G,B pixels, as layout_buffer_t::read() should find them */
+template <typename T>
+static std::vector<uint32_t>
+layout_expected(const T *rgb, uint32_t ox, uint32_t oy, dc1394bayer_layout_t layout, uint32_t maxval)
+{
+	const size_t pixels = (size_t)ox * oy;
+	std::vector<uint32_t> v;
+	size_t i;
+	int c;
+
+	if (layout == DC1394_BAYER_LAYOUT_RGBX) {
+		for (i = 0; i < pixels; i++) {
+			v.push_back(rgb[3 * i + 2]);
+			v.push_back(rgb[3 * i + 1]);
+			v.push_back(rgb[3 * i]);
+			v.push_back(maxval);
+		}
+	}
+	else if (layout >= DC1394_BAYER_LAYOUT_NV12)
+		layout_expected_yuv(rgb, ox, oy, layout, v);
+	else {
+		for (c = 0; c < 3; c++)
+		for (i = 0; i < pixels; i++) {
+			if (layout == DC1394_BAYER_LAYOUT_PLANAR_FLOAT) {
+				float f = (float)rgb[3 * i + c] / (float)maxval;
+				uint32_t bits;
+
+				memcpy(&bits, &f, sizeof(bits));
+				v.push_back(bits);
+			}
+			else
+				v.push_back(rgb[3 * i + c]);
+		}
+	}
+	v.push_back(1);
+	return v;
+}
+
+static dc1394error_t
+decode_layout(dc1394bayer_pool_t *pool, const uint8_t *in, int pitch, const dc1394bayer_output_t *out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, int method, int bits)
+{
+	return dc1394_bayer_decoding_8bit_layout_parallel(pool, in, pitch, out, sx, sy, tile, (dc1394bayer_method_t)method);
+}
+
+static dc1394error_t
+decode_layout(dc1394bayer_pool_t *pool, const uint16_t *in, int pitch, const dc1394bayer_output_t *out, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, int method, int bits)
+{
+	return dc1394_bayer_decoding_16bit_layout_parallel(pool, in, pitch, out, sx, sy, tile, (dc1394bayer_method_t)method, bits);
+}
+
+/* T is uint8_t at 8 bits, uint16_t at any other */
+template <typename T>
+static void
+check_layout(dc1394bayer_pool_t **pools, const conf_size_t *size, int tile, int method, int pattern, int bits)
+{
+	static const dc1394bayer_isa_t isas[] = { DC1394_BAYER_ISA_SCALAR, DC1394_BAYER_ISA_MAX };
+	const int depth = sizeof(T) * 8;
+	const uint32_t maxval = (1u << bits) - 1;
+	const uint32_t sx = size->sx, sy = size->sy;
+	const uint32_t ox = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sx / 2 : sx;
+	const uint32_t oy = method == DC1394_BAYER_METHOD_DOWNSAMPLE ? sy / 2 : sy;
+	const dc1394color_filter_t filter = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + tile);
+	const char *name = method_names[method];
+	std::vector<T> in(sx * sy), ref(3 * (size_t)ox * oy + 1);
+	dc1394error_t ref_err, err;
+	char where[96];
+	size_t i;
+	int layout, k;
+
+	fill_mosaic(&in[0], sx, sy, pattern, maxval);
+	snprintf(where, sizeof(where), "%ux%u %s %s %d bits", sx, sy, tile_names[tile], pattern_names[pattern], bits);
+
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_SCALAR);
+	ref_err = depth == 8 ? reference8((const uint8_t *)&in[0], (uint8_t *)&ref[0], sx, sy, filter, method)
+		: reference16((const uint16_t *)&in[0], (uint16_t *)&ref[0], sx, sy, filter, method, bits);
+
+	/* YCbCr is 8-bit only */
+	for (layout = DC1394_BAYER_LAYOUT_RGBX; layout <= (depth == 8 ? DC1394_BAYER_LAYOUT_MAX : DC1394_BAYER_LAYOUT_PLANAR_FLOAT); layout++) {
+		const dc1394bayer_layout_t l = (dc1394bayer_layout_t)layout;
+		std::vector<uint32_t> expected = layout_expected(&ref[0], ox, oy, l, maxval);
+		std::string path = std::string("layout-") + layout_names[layout];
+
+		for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+			layout_buffer_t dst(l, depth, ox, oy, 0);
+
+			dc1394_bayer_set_max_isa(isas[i]);
+			err = decode_layout(NULL, &in[0], (int)(sx * sizeof(T)), &dst.out, sx, sy, filter, method, bits);
+			record(path + "-" + (i ? "max" : "scalar"), name, depth, &expected[0], &dst.read()[0], expected.size(), ref_err, err, where);
+		}
+		dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+
+		for (k = 0; k < num_pools; k++) {
+			layout_buffer_t dst(l, depth, ox, oy, 0);
+
+			err = decode_layout(pools[k], &in[0], (int)(sx * sizeof(T)), &dst.out, sx, sy, filter, method, bits);
+			record(path + "-threads", name, depth, &expected[0], &dst.read()[0], expected.size(), ref_err, err, where);
+		}
+
+		{
+			layout_buffer_t dst(l, depth, ox, oy, 1);
+			int pitch;
+			std::vector<T> flipped = flip_mosaic(&in[0], sx, sy, &pitch);
+
+			err = decode_layout(pools[0], &flipped[(size_t)-pitch / sizeof(T) * (sy - 1)], pitch, &dst.out, sx, sy, filter, method, bits);
+			record(path + "-stride", name, depth, &expected[0], &dst.read()[0], expected.size(), ref_err, err, where);
+		}
+	}
+}
+
+static void
+check_luma(dc1394bayer_pool_t **pools, const conf_size_t *size, int tile, int pattern)
+{
+	const uint32_t sx = size->sx, sy = size->sy;
+	const dc1394color_filter_t filter = (dc1394color_filter_t)(DC1394_COLOR_FILTER_MIN + tile);
+	std::vector<uint8_t> in(sx * sy), rgb(3 * sx * sy), ref(sx * sy), out(sx * sy);
+	char where[96];
+	size_t i;
+	int k;
+
+	fill_mosaic(&in[0], sx, sy, pattern, 255);
+	snprintf(where, sizeof(where), "%ux%u %s %s", sx, sy, tile_names[tile], pattern_names[pattern]);
+
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_SCALAR);
+	dc1394_bayer_Bilinear(&in[0], &rgb[0], sx, sy, filter);
+	dc1394_bayer_set_max_isa(DC1394_BAYER_ISA_MAX);
+	/* the BT.601 weights documented with dc1394_bayer_decoding_luma8() */
+	for (i = 0; i < ref.size(); i++)
+		ref[i] = (uint8_t)((77 * rgb[3 * i] + 150 * rgb[3 * i + 1] + 29 * rgb[3 * i + 2] + 128) >> 8);
+
+	record("luma", "bilinear", 8, &ref[0], &out[0], ref.size(), DC1394_SUCCESS,
+		dc1394_bayer_decoding_luma8(&in[0], &out[0], sx, sx, sy, filter), where);
+	for (k = 0; k < num_pools; k++)
+		record("luma-threads-" + std::to_string(pool_threads[k]), "bilinear", 8, &ref[0], &out[0], ref.size(), DC1394_SUCCESS,
+			dc1394_bayer_decoding_luma8_parallel(pools[k], &in[0], &out[0], sx, sx, sy, filter), where);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int bit_depths[] = { 8, 10, 12, 14, 16 };
+	dc1394bayer_pool_t *pools[num_pools];
+	std::map<std::string, conf_stats_t>::const_iterator it;
+	long tolerance = 0;
+	int failed = 0;
+	int s, tile, method, pattern, b, p, i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+			tolerance = atol(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			rng_state = (uint32_t)strtoul(argv[++i], NULL, 0) | 1;
+		else if (!strcmp(argv[i], "--verbose"))
+			verbose = 1;
+		else {
+			fprintf(stderr, "usage: %s [--tolerance N] [--seed N] [--verbose]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	for (i = 0; i < num_pools; i++)
+		pools[i] = dc1394_bayer_pool_new(pool_threads[i]);
+
+	for (s = 0; s < num_sizes; s++)
+	for (tile = 0; tile < DC1394_COLOR_FILTER_NUM; tile++)
+	for (pattern = 0; pattern < (s == num_sizes - 1 ? 1 : PATTERN_NUM); pattern++) {
+		for (method = 0; method < DC1394_BAYER_METHOD_NUM; method++) {
+			/* the half-size output needs whole 2x2 cells */
+			if (method == DC1394_BAYER_METHOD_DOWNSAMPLE && ((sizes[s].sx | sizes[s].sy) & 1))
+				continue;
+			check8(pools, &sizes[s], tile, method, pattern);
+			for (b = 0; b < (int)(sizeof(bit_depths) / sizeof(bit_depths[0])); b++)
+				check16(pools, &sizes[s], tile, method, pattern, bit_depths[b]);
+			for (p = DC1394_BAYER_PACKING_MIN; p <= DC1394_BAYER_PACKING_MAX; p++)
+				check_packed(pools, &sizes[s], tile, method, pattern, (dc1394bayer_packing_t)p);
+			check_layout<uint8_t>(pools, &sizes[s], tile, method, pattern, 8);
+			check_layout<uint16_t>(pools, &sizes[s], tile, method, pattern, 12);
+		}
+		check_luma(pools, &sizes[s], tile, pattern);
+	}
+	for (s = 0; s < num_strip_sizes; s++)
+	for (tile = 0; tile < DC1394_COLOR_FILTER_NUM; tile++)
+	for (method = 0; method < DC1394_BAYER_METHOD_NUM; method++)
+	for (p = DC1394_BAYER_PACKING_MIN; p <= DC1394_BAYER_PACKING_MAX; p++)
+		check_packed(pools, &strip_sizes[s], tile, method, PATTERN_NOISE, (dc1394bayer_packing_t)p);
+
+	for (i = 0; i < num_pools; i++)
+		dc1394_bayer_pool_free(pools[i]);
+
+	printf("%-18s %-10s %5s %7s %7s %7s  %s\n", "path", "method", "depth", "cases", "exact", "max_err", "worst case");
+	for (it = results.begin(); it != results.end(); ++it) {
+		const conf_stats_t &st = it->second;
+		char path[64], method_name[32];
+		int depth;
+		int bad = st.max_err < 0 || st.max_err > tolerance;
+
+		sscanf(it->first.c_str(), "%63s %31s %d", path, method_name, &depth);
+		printf("%-18s %-10s %5d %7ld %7ld %7s  %s%s\n", path, method_name, depth, st.cases, st.exact,
+			st.max_err < 0 ? "status" : std::to_string(st.max_err).c_str(), st.worst.c_str(), bad ? "  FAIL" : "");
+		failed |= bad;
+	}
+	printf("%s\n", failed ? "FAIL" : "all paths within tolerance");
+	return failed;
+}
@@ -0,0 +1,264 @@
+/*
+* Blob detector against simple references
+*
+* Checks the SSE2 and AVX2 threshold kernels, where the CPU has them,
+* against the scalar one over row widths with and without a tail of
+* fewer than 32 pixels, and the blobs found at every instruction set cap
+* against a flood fill of the same frame: random frames of several
+* densities, U shapes whose arms only meet at the bottom, and diagonal
+* lines that are only 8-connected. Prints one line per failed check and
+* exits 1 when there was any.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bayer.h"
+#include "blob.h"
+#include "blob_internal.h"
+#include "test_util.h"
+
+#define RANDOM_FRAMES 300
+#define PAD 7			/* bytes past the end of each row */
+
+typedef struct {
+	uint32_t sx, sy;
+	int stride;
+	std::vector<uint8_t> pixels;
+} frame_t;
+
+static void
+make_frame(frame_t *f, uint32_t sx, uint32_t sy)
+{
+	f->sx = sx;
+	f->sy = sy;
+	f->stride = (int)sx + PAD;
+	f->pixels.assign((size_t)f->stride * sy, 0);
+	/* the padding is bright, and must not be seen */
+	for (uint32_t y = 0; y < sy; y++)
+		memset(&f->pixels[(size_t)y * f->stride + sx], 255, PAD);
+}
+
+static uint8_t &
+at(frame_t *f, uint32_t x, uint32_t y)
+{
+	return f->pixels[(size_t)y * f->stride + x];
+}
+
+/* values above threshold are bright, with probability bright in 256 */
+static void
+random_frame(frame_t *f, uint32_t sx, uint32_t sy, uint8_t threshold, uint32_t bright)
+{
+	make_frame(f, sx, sy);
+	for (uint32_t y = 0; y < sy; y++)
+		for (uint32_t x = 0; x < sx; x++) {
+			uint32_t r = rng();
+
+			at(f, x, y) = (r & 255) < bright
+				? (uint8_t)(threshold + 1 + (r >> 8) % (255 - threshold))
+				: (uint8_t)((r >> 8) % (threshold + 1u));
+		}
+}
+
+/* U shapes of several sizes, each arm found as its own blob until the bottom joins them */
+static void
+u_frame(frame_t *f, uint32_t sx, uint32_t sy)
+{
+	make_frame(f, sx, sy);
+	for (uint32_t x0 = 1, w = 3; x0 + w < sx; x0 += w + 2, w = w % 9 + 3) {
+		uint32_t h = 2 + (x0 * 7) % (sy - 3);
+
+		for (uint32_t y = 1; y <= h; y++) {
+			at(f, x0, y) = (uint8_t)(100 + y);
+			at(f, x0 + w, y) = (uint8_t)(150 + y % 50);
+		}
+		for (uint32_t x = x0; x <= x0 + w; x++)
+			at(f, x, h) = 200;
+	}
+}
+
+/*
+* lines at 45 degrees both ways in the top half and a checkerboard in the
+* bottom half, each one blob only through its diagonal neighbours; the
+* lines stay apart when sx > sy + 1
+*/
+static void
+diagonal_frame(frame_t *f, uint32_t sx, uint32_t sy)
+{
+	make_frame(f, sx, sy);
+	for (uint32_t i = 0; i < sy / 2; i++) {
+		at(f, i, i) = 90;
+		at(f, sx - 1 - i, i) = 220;
+	}
+	for (uint32_t y = sy / 2 + 2; y < sy; y++)
+		for (uint32_t x = 2; x < sx / 4 + 2; x++)
+			if ((x + y) % 2 == 0)
+				at(f, x, y) = 180;
+}
+
+/* 8-connected components in order of their first pixel in raster order */
+static std::vector<dc1394blob_t>
+flood_fill(frame_t *f, uint8_t threshold, uint32_t min_area)
+{
+	std::vector<int> seen(f->sx * f->sy, 0);
+	std::vector<uint32_t> stack;
+	std::vector<dc1394blob_t> blobs;
+
+	for (uint32_t start = 0; start < f->sx * f->sy; start++) {
+		uint64_t sum_x = 0, sum_y = 0;
+		dc1394blob_t b;
+
+		if (seen[start] || at(f, start % f->sx, start / f->sx) <= threshold)
+			continue;
+		memset(&b, 0, sizeof(b));
+		b.left = b.right = (uint16_t)(start % f->sx);
+		b.top = b.bottom = (uint16_t)(start / f->sx);
+		seen[start] = 1;
+		stack.assign(1, start);
+		while (!stack.empty()) {
+			uint32_t p = stack.back(), x = p % f->sx, y = p / f->sx;
+			uint8_t v = at(f, x, y);
+
+			stack.pop_back();
+			b.area++;
+			b.sum += v;
+			sum_x += (uint64_t)v * x;
+			sum_y += (uint64_t)v * y;
+			b.left = (uint16_t)(x < b.left ? x : b.left);
+			b.right = (uint16_t)(x > b.right ? x : b.right);
+			b.bottom = (uint16_t)(y > b.bottom ? y : b.bottom);
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++) {
+					int nx = (int)x + dx, ny = (int)y + dy;
+					uint32_t n = (uint32_t)ny * f->sx + (uint32_t)nx;
+
+					if (nx < 0 || ny < 0 || nx >= (int)f->sx || ny >= (int)f->sy || seen[n])
+						continue;
+					if (at(f, nx, ny) > threshold) {
+						seen[n] = 1;
+						stack.push_back(n);
+					}
+				}
+		}
+		b.x = (float)((double)sum_x / b.sum);
+		b.y = (float)((double)sum_y / b.sum);
+		if (b.area >= min_area)
+			blobs.push_back(b);
+	}
+	return blobs;
+}
+
+static bool
+same_blob(const dc1394blob_t *a, const dc1394blob_t *b)
+{
+	return a->x == b->x && a->y == b->y && a->area == b->area && a->sum == b->sum
+		&& a->left == b->left && a->top == b->top && a->right == b->right && a->bottom == b->bottom;
+}
+
+/* the detector at every instruction set cap against the flood fill; returns whether all agreed */
+static bool
+check_frame(dc1394blob_detector_t *detector, frame_t *f, uint8_t threshold, uint32_t min_area)
+{
+	std::vector<dc1394blob_t> expected = flood_fill(f, threshold, min_area);
+	std::vector<dc1394blob_t> found(expected.size() + 1);
+	bool ok = true;
+	int isa;
+
+	for (isa = DC1394_BAYER_ISA_MIN; isa <= DC1394_BAYER_ISA_MAX; isa++) {
+		uint32_t n = 0, i;
+
+		dc1394_bayer_set_max_isa((dc1394bayer_isa_t)isa);
+		if (dc1394_blob_detect(detector, &f->pixels[0], f->sx, f->sy, f->stride, threshold, min_area,
+			&found[0], (uint32_t)found.size(), &n) != DC1394_SUCCESS || n != expected.size()) {
+			ok = false;
+			continue;
+		}
+		for (i = 0; i < n; i++)
+			ok &= same_blob(&found[i], &expected[i]);
+	}
+	return ok;
+}
+
+/* the vector threshold kernels against the scalar one, bits past the row included */
+static void
+check_threshold(void)
+{
+	static const int widths[] = { 1, 5, 31, 32, 33, 63, 64, 65, 96, 100, 752, 767 };
+	static const uint8_t thresholds[] = { 0, 1, 100, 254, 255 };
+	const uint32_t features = dc1394_bayer_get_cpu_features();
+	int w, t, k;
+
+	for (w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); w++)
+	for (t = 0; t < (int)(sizeof(thresholds) / sizeof(thresholds[0])); t++) {
+		const int sx = widths[w], words = (sx + 31) / 32;
+		std::vector<uint8_t> row(sx);
+		std::vector<uint32_t> ref(words), mask(words + 1);
+
+		for (k = 0; k < sx; k++) {
+			/* values on both sides of the threshold, and the extremes */
+			uint32_t r = rng();
+
+			row[k] = (uint8_t)(r % 5 == 0 ? r >> 8 : thresholds[t] + (int)(r >> 8) % 3 - 1);
+		}
+		dc1394_blob_threshold_row(&row[0], sx, thresholds[t], &ref[0]);
+		if (features & (1u << DC1394_BAYER_ISA_SSE2)) {
+			mask.assign(words + 1, 0xdeadbeefu);
+			dc1394_blob_threshold_row_sse2(&row[0], sx, thresholds[t], &mask[0]);
+			CHECK(memcmp(&mask[0], &ref[0], words * sizeof(uint32_t)) == 0 && mask[words] == 0xdeadbeefu);
+		}
+		if (features & (1u << DC1394_BAYER_ISA_AVX2)) {
+			mask.assign(words + 1, 0xdeadbeefu);
+			dc1394_blob_threshold_row_avx2(&row[0], sx, thresholds[t], &mask[0]);
+			CHECK(memcmp(&mask[0], &ref[0], words * sizeof(uint32_t)) == 0 && mask[words] == 0xdeadbeefu);
+		}
+	}
+}
+
+int
+main(void)
+{
+	static const uint32_t sizes[][2] = { { 1, 1 }, { 7, 5 }, { 32, 8 }, { 33, 17 }, { 64, 40 }, { 95, 31 }, { 160, 120 } };
+	static const uint32_t densities[] = { 20, 80, 128, 200 };
+	dc1394blob_detector_t *detector = dc1394_blob_detector_new();
+	const dc1394bayer_isa_t max_isa = dc1394_bayer_get_max_isa();
+	frame_t f;
+	uint32_t n;
+	int i, bad_random = 0;
+
+	CHECK(detector != NULL);
+	if (detector == NULL)
+		return 1;
+	check_threshold();
+
+	for (i = 0; i < RANDOM_FRAMES; i++) {
+		const uint32_t *size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+		uint8_t threshold = (uint8_t)(rng() % 255);
+
+		random_frame(&f, size[0], size[1], threshold, densities[i % 4]);
+		bad_random += !check_frame(detector, &f, threshold, i % 3);
+	}
+	CHECK(bad_random == 0);
+
+	u_frame(&f, 96, 40);
+	CHECK(check_frame(detector, &f, 50, 1));
+	u_frame(&f, 127, 33);
+	CHECK(check_frame(detector, &f, 120, 1));
+	diagonal_frame(&f, 65, 40);
+	CHECK(check_frame(detector, &f, 50, 1));
+	CHECK(flood_fill(&f, 50, 1).size() == 3);
+	diagonal_frame(&f, 752, 480);
+	CHECK(check_frame(detector, &f, 0, 2));
+
+	/* a frame too wide for the 16-bit bounding box */
+	CHECK(dc1394_blob_detect(detector, &f.pixels[0], 65536, 1, 65536, 0, 1, NULL, 0, &n) == DC1394_INVALID_ARGUMENT_VALUE);
+
+	dc1394_bayer_set_max_isa(max_isa);
+	dc1394_blob_detector_free(detector);
+	return test_report("blob");
+}
@@ -0,0 +1,198 @@
+/*
+* Latency histograms
+*
+* Records known times and checks that the counts, minimum, maximum and
+* mean come out exact and the percentiles no lower than the true ones
+* and less than one bucket above; that lanes filled by several threads
+* at once, while another thread keeps summarizing, add up to every time
+* recorded; that times out of range land in the last bucket and bad
+* lanes and stages are ignored; that the text dump is cut short safely;
+* and that the clock advances with real time. Prints one line per
+* failed check and exits 1 when there was any.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "dk2latency.h"
+#include "test_util.h"
+
+#define THREADS 4
+#define PER_THREAD 200000
+
+/* a percentile is the top of its bucket: no lower than the truth, at most 1/16 above */
+static bool
+close_above(uint64_t got, uint64_t truth)
+{
+	return got >= truth && got <= truth + truth / 16;
+}
+
+/* the times 1 .. 100000 ns, once each */
+static void
+uniform(void)
+{
+	dk2latency_t *l = dk2latency_new(1);
+	dk2latency_summary_t sum;
+	uint64_t ns;
+
+	CHECK(l != NULL);
+	if (l == NULL)
+		return;
+	dk2latency_summarize(l, DK2LATENCY_CONVERT, &sum);
+	CHECK(sum.count == 0 && sum.min_ns == 0 && sum.max_ns == 0 && sum.p999_ns == 0);
+
+	for (ns = 1; ns <= 100000; ns++)
+		dk2latency_record(l, 0, DK2LATENCY_CONVERT, ns);
+	dk2latency_summarize(l, DK2LATENCY_CONVERT, &sum);
+	CHECK(sum.count == 100000);
+	CHECK(sum.min_ns == 1);
+	CHECK(sum.max_ns == 100000);
+	CHECK(sum.mean_ns == 50000);
+	CHECK(close_above(sum.p50_ns, 50000));
+	CHECK(close_above(sum.p99_ns, 99000));
+	CHECK(close_above(sum.p999_ns, 99900));
+	CHECK(sum.p999_ns <= sum.max_ns);
+
+	/* other stages are untouched */
+	dk2latency_summarize(l, DK2LATENCY_WAIT, &sum);
+	CHECK(sum.count == 0);
+	dk2latency_free(l);
+}
+
+/* a rare spike shows in the p99.9 and the maximum, not in the median */
+static void
+spikes(void)
+{
+	dk2latency_t *l = dk2latency_new(2);
+	dk2latency_summary_t sum;
+	int i;
+
+	CHECK(l != NULL);
+	if (l == NULL)
+		return;
+	for (i = 0; i < 9980; i++)
+		dk2latency_record(l, i & 1, DK2LATENCY_AGE, 2000000);
+	for (i = 0; i < 20; i++)
+		dk2latency_record(l, 1, DK2LATENCY_AGE, 45000000);
+	/* longer than the last bucket starts */
+	dk2latency_record(l, 0, DK2LATENCY_AGE, 600000000000ull);
+	dk2latency_summarize(l, DK2LATENCY_AGE, &sum);
+	CHECK(sum.count == 10001);
+	CHECK(close_above(sum.p50_ns, 2000000));
+	CHECK(close_above(sum.p99_ns, 2000000));
+	CHECK(close_above(sum.p999_ns, 45000000));
+	CHECK(sum.max_ns == 600000000000ull);
+
+	/* out of range, ignored */
+	dk2latency_record(l, 2, DK2LATENCY_AGE, 1);
+	dk2latency_record(l, 0, DK2LATENCY_STAGES, 1);
+	dk2latency_summarize(l, DK2LATENCY_AGE, &sum);
+	CHECK(sum.count == 10001 && sum.min_ns == 2000000);
+	dk2latency_summarize(l, DK2LATENCY_STAGES, &sum);
+	CHECK(sum.count == 0);
+	dk2latency_free(l);
+}
+
+/* one writer per lane, a reader summing them all the while */
+static void
+threads(void)
+{
+	dk2latency_t *l = dk2latency_new(THREADS);
+	std::vector<std::thread> writers;
+	std::atomic<bool> done(false);
+	dk2latency_summary_t sum;
+	uint64_t last = 0;
+	bool monotonic = true;
+	int i;
+
+	CHECK(l != NULL);
+	if (l == NULL)
+		return;
+	for (i = 0; i < THREADS; i++)
+		writers.push_back(std::thread([l, i]() {
+			uint64_t n;
+
+			for (n = 0; n < PER_THREAD; n++)
+				dk2latency_record(l, i, DK2LATENCY_CONVERT, 1000 + n % 5000);
+		}));
+	std::thread reader([&]() {
+		dk2latency_summary_t s;
+
+		while (!done.load()) {
+			dk2latency_summarize(l, DK2LATENCY_CONVERT, &s);
+			if (s.count < last)
+				monotonic = false;
+			last = s.count;
+		}
+	});
+	for (i = 0; i < THREADS; i++)
+		writers[i].join();
+	done.store(true);
+	reader.join();
+
+	dk2latency_summarize(l, DK2LATENCY_CONVERT, &sum);
+	CHECK(monotonic);
+	CHECK(sum.count == (uint64_t)THREADS * PER_THREAD);
+	CHECK(sum.min_ns == 1000 && sum.max_ns == 5999);
+	CHECK(close_above(sum.p50_ns, 3499));
+	dk2latency_free(l);
+}
+
+static void
+format(void)
+{
+	dk2latency_t *l = dk2latency_new(1);
+	char text[1024], small[40];
+	size_t n;
+	int s;
+
+	CHECK(l != NULL);
+	if (l == NULL)
+		return;
+	dk2latency_record(l, 0, DK2LATENCY_DELIVER, 1500);
+	n = dk2latency_format(l, text, sizeof(text));
+	CHECK(n == strlen(text));
+	for (s = 0; s < DK2LATENCY_STAGES; s++)
+		CHECK(strstr(text, dk2latency_stage_name((dk2latency_stage_t)s)) != NULL);
+	CHECK(strstr(text, "1.5 us") != NULL);
+
+	memset(small, 'x', sizeof(small));
+	CHECK(dk2latency_format(l, small, sizeof(small)) == n);
+	CHECK(strlen(small) == sizeof(small) - 1);
+	CHECK(strncmp(small, text, sizeof(small) - 1) == 0);
+	dk2latency_free(l);
+}
+
+static void
+clock_advances(void)
+{
+	uint64_t a = dk2latency_now(), b;
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	b = dk2latency_now();
+	CHECK(b - a >= 19000000u);
+	CHECK(b - a < 2000000000u);
+}
+
+int
+main(void)
+{
+	CHECK(dk2latency_new(0) == NULL);
+	dk2latency_free(NULL);
+	uniform();
+	spikes();
+	threads();
+	format();
+	clock_advances();
+
+	return test_report("dk2latency");
+}
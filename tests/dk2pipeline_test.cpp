@@ -0,0 +1,511 @@
+/*
+* Asynchronous frame pipeline on a synthetic source
+*
+* Feeds DK2-sized mosaics through dk2pipeline with Bilinear decoding as
+* the work and checks that with the process-all policy every frame comes
+* out once, in push order, decoded exactly as the serial decoder does and
+* with the tags it was pushed with, for several worker counts; that with
+* the other policies pushing never waits for a slow worker, the frames
+* the workers have no time for are skipped unprocessed and the newest
+* frame is always delivered; that workers acquire their output before
+* choosing a frame and give back what they did not use before they go
+* idle; that a frame with no output counts as failed, not delivered; and
+* that a discarding flush retires the queued frames without processing
+* them. Prints the frame rate of each worker count, and one
+* line per failed check; exits 1 when there was any.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bayer.h"
+#include "dk2pipeline.h"
+#include "test_util.h"
+
+#define SX 752
+#define SY 480
+#define NUM_MOSAICS 4
+
+typedef std::chrono::steady_clock test_clock;
+
+static std::vector<uint8_t> mosaics[NUM_MOSAICS];
+static uint64_t expected_hash[NUM_MOSAICS];
+static double decode_seconds;		/* the longest of the reference decodes */
+
+static uint64_t
+fnv1a(const uint8_t *p, size_t n)
+{
+	uint64_t h = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		h = (h ^ p[i]) * 1099511628211ull;
+	return h;
+}
+
+static void
+make_mosaics(void)
+{
+	std::vector<uint8_t> rgb(3 * SX * SY);
+	int m;
+	size_t i;
+
+	rng_state = 2463534242u;
+	for (m = 0; m < NUM_MOSAICS; m++) {
+		mosaics[m].resize(SX * SY);
+		for (i = 0; i < mosaics[m].size(); i++)
+			mosaics[m][i] = (uint8_t)rng();
+		test_clock::time_point start = test_clock::now();
+		dc1394_bayer_decoding_8bit(&mosaics[m][0], &rgb[0], SX, SY, DC1394_COLOR_FILTER_RGGB, DC1394_BAYER_METHOD_BILINEAR);
+		decode_seconds = std::max(decode_seconds, std::chrono::duration<double>(test_clock::now() - start).count());
+		expected_hash[m] = fnv1a(&rgb[0], rgb.size());
+	}
+}
+
+typedef struct {
+	std::vector<std::vector<uint8_t> > out;	/* one image per worker */
+	std::atomic<int> busy[64];		/* frames being processed per worker, at most one */
+	uint64_t next;				/* deliver expects sequences from here on */
+	int bad_order, bad_image, bad_tags, overlapped;
+	int sleep_ms;				/* extra time each frame takes */
+	int use_acquire;
+	std::mutex gate_lock;			/* process waits here while gated, acquire for tickets */
+	std::condition_variable gate_opened;
+	bool gated;
+	int tickets;				/* acquires let through, -1 for all */
+	int fail_every;				/* every so many acquires return NULL, 0 for none */
+	std::atomic<int> deliveries;		/* calls to deliver so far */
+	std::atomic<int> entered;		/* calls to process so far */
+	std::atomic<int> acquiring;		/* calls to acquire so far */
+	std::atomic<int> acquired, released, bad_result;
+} test_ctx_t;
+
+static int token;
+static int good_image, bad_image;	/* what process leaves in the result */
+
+static void *
+acquire(void *ctx, uint32_t worker)
+{
+	test_ctx_t *t = (test_ctx_t *)ctx;
+
+	(void)worker;
+	if (++t->acquiring % (t->fail_every ? t->fail_every : INT_MAX) == 0)
+		return NULL;
+	{
+		std::unique_lock<std::mutex> guard(t->gate_lock);
+		while (t->tickets == 0)
+			t->gate_opened.wait(guard);
+		if (t->tickets > 0)
+			t->tickets--;
+	}
+	t->acquired++;
+	return &token;
+}
+
+static void
+release(void *ctx, void *result)
+{
+	test_ctx_t *t = (test_ctx_t *)ctx;
+
+	if (result != &token)
+		t->bad_result++;
+	t->released++;
+}
+
+static void
+process(void *ctx, uint32_t worker, dk2pipeline_frame_t *frame)
+{
+	test_ctx_t *t = (test_ctx_t *)ctx;
+
+	if (t->busy[worker]++ != 0)
+		t->overlapped++;
+	t->entered++;
+	{
+		std::unique_lock<std::mutex> guard(t->gate_lock);
+		while (t->gated)
+			t->gate_opened.wait(guard);
+	}
+	if (t->use_acquire && frame->result == NULL) {
+		/* nothing to convert into, as when the filter gets no sample */
+		t->busy[worker]--;
+		return;
+	}
+	if (frame->result != (t->use_acquire ? (void *)&token : NULL))
+		t->bad_result++;
+	if (t->sleep_ms)
+		std::this_thread::sleep_for(std::chrono::milliseconds(t->sleep_ms));
+	dc1394_bayer_decoding_8bit(frame->data, &t->out[worker][0], SX, SY, DC1394_COLOR_FILTER_RGGB, DC1394_BAYER_METHOD_BILINEAR);
+	/* the hash stands in for an output sample */
+	frame->result = fnv1a(&t->out[worker][0], t->out[worker].size()) == expected_hash[frame->sequence % NUM_MOSAICS]
+		? &good_image : &bad_image;
+	t->busy[worker]--;
+}
+
+static void
+deliver(void *ctx, dk2pipeline_frame_t *frame)
+{
+	test_ctx_t *t = (test_ctx_t *)ctx;
+
+	t->deliveries++;
+	if (frame->sequence < t->next)
+		t->bad_order++;
+	if (frame->result != &good_image)
+		t->bad_image++;
+	if (frame->tags.flags != (uint32_t)frame->sequence || frame->tags.media_start != (int64_t)frame->sequence * 3
+		|| !frame->tags.has_media_time)
+		t->bad_tags++;
+	t->next = frame->sequence + 1;
+}
+
+static dk2pipeline_t *
+make_pipeline(test_ctx_t *t, dk2pipeline_policy_t policy, uint32_t limit, uint32_t workers, int sleep_ms, int use_acquire)
+{
+	dk2pipeline_callbacks_t cb = { NULL, NULL, process, deliver, t };
+	uint32_t i;
+
+	if (use_acquire) {
+		cb.acquire = acquire;
+		cb.release = release;
+	}
+	t->out.assign(workers, std::vector<uint8_t>(3 * SX * SY));
+	for (i = 0; i < 64; i++)
+		t->busy[i].store(0);
+	t->next = 0;
+	t->bad_order = t->bad_image = t->bad_tags = t->overlapped = 0;
+	t->sleep_ms = sleep_ms;
+	t->use_acquire = use_acquire;
+	t->gated = false;
+	t->tickets = -1;
+	t->fail_every = 0;
+	t->deliveries.store(0);
+	t->entered.store(0);
+	t->acquiring.store(0);
+	t->acquired.store(0);
+	t->released.store(0);
+	t->bad_result.store(0);
+	return dk2pipeline_new(SX * SY, policy, limit, workers, &cb);
+}
+
+/* a frame tagged after its sequence number, for deliver to check */
+static dc1394bool_t
+push_frame(dk2pipeline_t *p, const uint8_t *mosaic, uint32_t size, uint64_t sequence)
+{
+	dk2pipeline_tags_t tags;
+
+	tags.flags = (uint32_t)sequence;
+	tags.type_flags = 0;
+	tags.media_start = (int64_t)sequence * 3;
+	tags.media_stop = tags.media_start + 3;
+	tags.has_media_time = 1;
+	return dk2pipeline_push(p, mosaic, size, sequence, 0, 0, &tags);
+}
+
+/* every frame delivered once, in order and intact; a full ring makes the source wait */
+static void
+ordered(uint32_t workers, int frames)
+{
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_PROCESS_ALL, 0, workers, 0, 0);
+	dk2pipeline_stats_t stats;
+	test_clock::time_point start = test_clock::now();
+	double seconds;
+	int f;
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	CHECK(dk2pipeline_get_workers(p) == workers);
+	for (f = 0; f < frames; f++)
+		CHECK(push_frame(p, &mosaics[f % NUM_MOSAICS][0], SX * SY, f));
+	dk2pipeline_flush(p, DC1394_FALSE);
+	seconds = std::chrono::duration<double>(test_clock::now() - start).count();
+
+	dk2pipeline_get_stats(p, &stats);
+	CHECK(stats.pushed == (uint64_t)frames);
+	CHECK(stats.delivered == (uint64_t)frames);
+	CHECK(stats.discarded == 0 && stats.skipped == 0 && stats.dropped == 0);
+	CHECK(stats.queued == 0);
+	CHECK(stats.queued_max >= 1 && stats.queued_max <= 2 * workers + 2);
+	CHECK(stats.age_max_ns >= stats.age_last_ns && stats.age_total_ns >= stats.age_max_ns);
+	CHECK(t.next == (uint64_t)frames);
+	CHECK(t.bad_order == 0);
+	CHECK(t.bad_tags == 0);
+	CHECK(t.bad_result == 0);
+	CHECK(t.bad_image == 0);
+	CHECK(t.overlapped == 0);
+	dk2pipeline_free(p);
+	printf("%u workers: %d frames, %.1f frames/s\n", workers, frames, frames / seconds);
+}
+
+static void
+open_gate(test_ctx_t *t)
+{
+	{
+		std::lock_guard<std::mutex> guard(t->gate_lock);
+		t->gated = false;
+	}
+	t->gate_opened.notify_all();
+}
+
+static void
+add_tickets(test_ctx_t *t, int n)
+{
+	{
+		std::lock_guard<std::mutex> guard(t->gate_lock);
+		t->tickets += n;
+	}
+	t->gate_opened.notify_all();
+}
+
+/* whether count reaches n within two seconds */
+static bool
+reaches(const std::atomic<int> &count, int n)
+{
+	test_clock::time_point give_up = test_clock::now() + std::chrono::seconds(2);
+
+	while (count.load() < n)
+		if (test_clock::now() > give_up)
+			return false;
+		else
+			std::this_thread::yield();
+	return true;
+}
+
+/*
+* A slow consumer costs frames, not capture time: with two workers stuck
+* on their first frames, the queue keeps the newest two frames and the
+* newest of all replaces the last one once every slot is taken. The
+* workers stay stuck until every frame is pushed, so a push that waited
+* for them would never return.
+*/
+static void
+never_stalls(void)
+{
+	const uint32_t limit = 2, workers = 2;
+	const int frames = 20;
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_QUEUE, limit, workers, 0, 0);
+	dk2pipeline_stats_t stats;
+	int f, accepted = 0;
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	t.gated = true;
+	for (f = 0; f < frames; f++) {
+		accepted += push_frame(p, &mosaics[f % NUM_MOSAICS][0], SX * SY, f);
+		/* the workers take the first two frames, one each */
+		if (f < (int)workers)
+			CHECK(reaches(t.entered, f + 1));
+	}
+	CHECK(accepted == frames);
+	CHECK(push_frame(p, &mosaics[0][0], SX * SY + 1, 0) == DC1394_FALSE);
+	/* every frame delivered has waited at least this long */
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	open_gate(&t);
+
+	dk2pipeline_flush(p, DC1394_FALSE);
+	dk2pipeline_get_stats(p, &stats);
+	/* frames 0 and 1, the two queued when the ring filled, the last in place of the third */
+	CHECK(stats.pushed == (uint64_t)frames);
+	CHECK(stats.delivered == workers + limit);
+	CHECK(stats.skipped == frames - workers - limit);
+	CHECK(stats.dropped == 1);
+	CHECK(stats.queued_max == limit + workers + 2);
+	CHECK(stats.delivered + stats.skipped + stats.discarded == stats.pushed);
+	CHECK(t.next == (uint64_t)frames);
+	CHECK(stats.age_max_ns >= 20000000u);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0 && t.bad_result == 0);
+	dk2pipeline_free(p);
+}
+
+/* with the newest frame winning, a slow worker is always handed the latest one */
+static void
+latest_wins(void)
+{
+	const int frames = 12;
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_LATEST, 0, 1, 20, 1);
+	dk2pipeline_stats_t stats;
+	int f;
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	for (f = 0; f < frames; f++) {
+		CHECK(push_frame(p, &mosaics[f % NUM_MOSAICS][0], SX * SY, f));
+		std::this_thread::sleep_for(std::chrono::milliseconds(7));
+	}
+	dk2pipeline_flush(p, DC1394_FALSE);
+	dk2pipeline_get_stats(p, &stats);
+	CHECK(stats.delivered + stats.skipped == (uint64_t)frames);
+	CHECK(stats.skipped > 0);
+	CHECK(stats.dropped == 0);
+	CHECK(t.next == (uint64_t)frames);
+	/*
+	* a frame waits for at most one conversion, plus the one it gets;
+	* leave room for a slow machine, but well short of the backlog that
+	* converting every frame would build up
+	*/
+	CHECK(stats.age_max_ns < (4 * (0.020 + decode_seconds) + 0.050) * 1e9);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0 && t.bad_result == 0);
+	dk2pipeline_free(p);
+	/* one output per delivered frame, the rest given back */
+	CHECK((uint64_t)t.acquired.load() == stats.delivered + t.released.load());
+	CHECK(t.released.load() <= 1);
+}
+
+/*
+* whether every result acquired went to a frame or was given back, once
+* the workers are idle
+*/
+static bool
+all_given_back(test_ctx_t *t, dk2pipeline_t *p)
+{
+	test_clock::time_point give_up = test_clock::now() + std::chrono::seconds(2);
+	dk2pipeline_stats_t stats;
+
+	do {
+		dk2pipeline_get_stats(p, &stats);
+		if ((uint64_t)t->acquired.load() == stats.delivered + t->released.load())
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	} while (test_clock::now() < give_up);
+	return false;
+}
+
+/*
+* a discarding flush does not wait for the frames nobody has started on,
+* and the workers do not keep the outputs they acquired for them
+*/
+static void
+discards(void)
+{
+	const uint32_t depth = 8, workers = 2;
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_QUEUE, depth, workers, 50, 1);
+	dk2pipeline_stats_t stats;
+	uint32_t f;
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	for (f = 0; f < depth; f++)
+		CHECK(push_frame(p, &mosaics[f % NUM_MOSAICS][0], SX * SY, f));
+	/* let the workers pick up their first frames */
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	dk2pipeline_flush(p, DC1394_TRUE);
+
+	dk2pipeline_get_stats(p, &stats);
+	CHECK(stats.delivered + stats.discarded == depth);
+	CHECK(stats.delivered <= workers);
+	CHECK(stats.queued == 0 && stats.skipped == 0);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0);
+	CHECK(all_given_back(&t, p));
+
+	/* and the pipeline carries on afterwards */
+	t.sleep_ms = 0;
+	CHECK(push_frame(p, &mosaics[t.next % NUM_MOSAICS][0], SX * SY, t.next));
+	dk2pipeline_flush(p, DC1394_FALSE);
+	dk2pipeline_get_stats(p, &stats);
+	CHECK(stats.delivered + stats.discarded == depth + 1);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0 && t.bad_result == 0);
+	CHECK(all_given_back(&t, p));
+	dk2pipeline_free(p);
+}
+
+/*
+* A worker that acquired an output for a frame another worker then took
+* gives the output back before it goes idle, rather than keep it while
+* the consumer stops and reallocates its buffers
+*/
+static void
+gives_back(void)
+{
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_PROCESS_ALL, 0, 2, 0, 1);
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	t.tickets = 0;
+	/* both workers waiting in acquire, one for each frame */
+	CHECK(push_frame(p, &mosaics[0][0], SX * SY, 0));
+	CHECK(reaches(t.acquiring, 1));
+	CHECK(push_frame(p, &mosaics[1][0], SX * SY, 1));
+	CHECK(reaches(t.acquiring, 2));
+	/* one of them converts frame 0 and waits again for frame 1 */
+	add_tickets(&t, 1);
+	CHECK(reaches(t.acquiring, 3));
+	/* both get an output, but there is only frame 1 left */
+	add_tickets(&t, 2);
+	dk2pipeline_flush(p, DC1394_FALSE);
+	CHECK(reaches(t.acquired, 3));
+	CHECK(all_given_back(&t, p));
+	CHECK(t.released.load() == 1);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0 && t.bad_result == 0);
+	dk2pipeline_free(p);
+}
+
+/*
+* A frame whose worker got no output from acquire is not delivered: it
+* counts as failed, with no age, and the frames around it still go out
+*/
+static void
+counts_failures(void)
+{
+	const int frames = 30, fail_every = 3;
+	test_ctx_t t;
+	dk2pipeline_t *p = make_pipeline(&t, DK2PIPELINE_PROCESS_ALL, 0, 1, 0, 1);
+	dk2pipeline_stats_t stats;
+	int f;
+
+	CHECK(p != NULL);
+	if (p == NULL)
+		return;
+	t.fail_every = fail_every;
+	for (f = 0; f < frames; f++)
+		CHECK(push_frame(p, &mosaics[f % NUM_MOSAICS][0], SX * SY, f));
+	dk2pipeline_flush(p, DC1394_FALSE);
+	dk2pipeline_get_stats(p, &stats);
+	/* one worker acquires once per frame, so every third frame fails */
+	CHECK(stats.failed == (uint64_t)(frames / fail_every));
+	CHECK(stats.delivered == (uint64_t)(frames - frames / fail_every));
+	CHECK(stats.delivered == (uint64_t)t.deliveries.load());
+	CHECK(stats.delivered + stats.failed == stats.pushed);
+	CHECK(stats.skipped == 0 && stats.discarded == 0 && stats.queued == 0);
+	/* the last frame failed, so the one before it was the last delivered */
+	CHECK(t.next == (uint64_t)frames - 1);
+	CHECK(t.bad_order == 0 && t.bad_image == 0 && t.bad_tags == 0 && t.bad_result == 0);
+	CHECK(all_given_back(&t, p));
+	dk2pipeline_free(p);
+}
+
+int
+main(void)
+{
+	make_mosaics();
+	ordered(1, 60);
+	ordered(2, 60);
+	ordered(4, 60);
+	never_stalls();
+	latest_wins();
+	discards();
+	gives_back();
+	counts_failures();
+
+	return test_report("dk2pipeline");
+}
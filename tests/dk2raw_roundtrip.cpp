@@ -0,0 +1,198 @@
+/*
+* Round trip of .dk2raw capture files
+*
+* Records a few frames of 8- and 16-bit mosaics, a short one among them,
+* reads them back through the mapping and checks the index, the frame
+* contents and their alignment, that a frame decodes from the mapping to
+* the same image as from the buffer it was recorded from, that seeking
+* by timestamp finds the right frame, that a file cut off in the middle
+* of a record loses only that record, and that files with a damaged
+* header are refused. Prints one line per failed check and exits 1 when
+* there was any.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "bayer.h"
+#include "dk2raw.h"
+#include "test_util.h"
+
+#define NUM_FRAMES 5
+
+/* a random frame, as the bytes it would be stored as */
+static std::vector<uint8_t>
+make_frame(uint32_t sx, uint32_t sy, uint32_t bits)
+{
+	std::vector<uint8_t> frame((size_t)sx * sy * (bits > 8 ? 2 : 1));
+	size_t i;
+
+	if (bits > 8)
+		for (i = 0; i < frame.size() / 2; i++) {
+			uint16_t v = (uint16_t)(rng() & ((1u << bits) - 1));
+			memcpy(&frame[2 * i], &v, 2);
+		}
+	else
+		for (i = 0; i < frame.size(); i++)
+			frame[i] = (uint8_t)rng();
+	return frame;
+}
+
+static void
+truncate_copy(const std::string &from, const std::string &to, long length)
+{
+	FILE *in = fopen(from.c_str(), "rb"), *out = fopen(to.c_str(), "wb");
+	std::vector<char> buf(length);
+
+	CHECK(in != NULL && out != NULL);
+	if (in == NULL || out == NULL)
+		return;
+	CHECK(fread(&buf[0], 1, length, in) == (size_t)length);
+	fwrite(&buf[0], 1, length, out);
+	fclose(in);
+	fclose(out);
+}
+
+static void
+roundtrip(const std::string &path, uint32_t sx, uint32_t sy, dc1394color_filter_t tile, uint32_t bits)
+{
+	std::vector<std::vector<uint8_t> > frames;
+	dk2raw_writer_t *writer;
+	dk2raw_reader_t *reader;
+	const dk2raw_header_t *h;
+	dk2raw_frame_t frame;
+	uint32_t header_size, record_size;
+	uint64_t f;
+
+	CHECK(dk2raw_writer_open(path.c_str(), sx, sy, tile, bits, &writer) == DC1394_SUCCESS);
+	if (writer == NULL)
+		return;
+	for (f = 0; f < NUM_FRAMES; f++) {
+		frames.push_back(make_frame(sx, sy, bits));
+		/* frame 2 came in short */
+		if (f == 2)
+			frames.back().resize(frames.back().size() / 3);
+		CHECK(dk2raw_writer_append(writer, &frames.back()[0], (uint32_t)frames.back().size(),
+			100 + f, 333333 * (int64_t)f) == DC1394_SUCCESS);
+	}
+	CHECK(dk2raw_writer_append(writer, &frames[0][0], (uint32_t)frames[0].size() + 1, 0, 0) == DC1394_INVALID_ARGUMENT_VALUE);
+	CHECK(dk2raw_writer_close(writer) == DC1394_SUCCESS);
+
+	CHECK(dk2raw_reader_open(path.c_str(), &reader) == DC1394_SUCCESS);
+	if (reader == NULL)
+		return;
+	h = dk2raw_reader_header(reader);
+	CHECK(h->width == sx && h->height == sy && h->tile == (uint32_t)tile && h->bits == bits);
+	CHECK(h->frame_size == frames[0].size());
+	header_size = h->header_size;
+	record_size = h->record_size;
+	CHECK(dk2raw_reader_frame_count(reader) == NUM_FRAMES);
+	dk2raw_reader_prefetch(reader, 1, NUM_FRAMES);
+
+	for (f = 0; f < NUM_FRAMES; f++) {
+		CHECK(dk2raw_reader_frame(reader, f, &frame) == DC1394_SUCCESS);
+		CHECK(frame.sequence == 100 + f);
+		CHECK(frame.timestamp == 333333 * (int64_t)f);
+		CHECK(frame.size == frames[f].size());
+		CHECK(((uintptr_t)frame.data & (DK2RAW_ALIGN - 1)) == 0);
+		CHECK(memcmp(frame.data, &frames[f][0], frame.size) == 0);
+	}
+	CHECK(dk2raw_reader_frame(reader, NUM_FRAMES, &frame) == DC1394_INVALID_ARGUMENT_VALUE);
+
+	CHECK(dk2raw_reader_seek(reader, 0) == 0);
+	CHECK(dk2raw_reader_seek(reader, 333333) == 1);
+	CHECK(dk2raw_reader_seek(reader, 333334) == 2);
+	CHECK(dk2raw_reader_seek(reader, 333333 * (int64_t)NUM_FRAMES) == NUM_FRAMES);
+
+	/* the mapping is as good a decoder input as the buffer it was recorded from */
+	CHECK(dk2raw_reader_frame(reader, 0, &frame) == DC1394_SUCCESS);
+	{
+		std::vector<uint16_t> a(3 * (size_t)sx * sy), b(3 * (size_t)sx * sy);
+
+		if (bits > 8) {
+			std::vector<uint16_t> copy(sx * sy);
+			memcpy(&copy[0], &frames[0][0], frames[0].size());
+			CHECK(dc1394_bayer_decoding_16bit((const uint16_t *)frame.data, &a[0], sx, sy, tile,
+				DC1394_BAYER_METHOD_BILINEAR, bits) == DC1394_SUCCESS);
+			CHECK(dc1394_bayer_decoding_16bit(&copy[0], &b[0], sx, sy, tile,
+				DC1394_BAYER_METHOD_BILINEAR, bits) == DC1394_SUCCESS);
+		}
+		else {
+			CHECK(dc1394_bayer_decoding_8bit(frame.data, (uint8_t *)&a[0], sx, sy, tile,
+				DC1394_BAYER_METHOD_BILINEAR) == DC1394_SUCCESS);
+			CHECK(dc1394_bayer_decoding_8bit(&frames[0][0], (uint8_t *)&b[0], sx, sy, tile,
+				DC1394_BAYER_METHOD_BILINEAR) == DC1394_SUCCESS);
+		}
+		CHECK(a == b);
+	}
+	dk2raw_reader_close(reader);
+
+	/* a recording cut off by a crash keeps its complete records */
+	truncate_copy(path, path + ".cut", (long)(header_size + 3 * record_size + 100));
+	CHECK(dk2raw_reader_open((path + ".cut").c_str(), &reader) == DC1394_SUCCESS);
+	if (reader != NULL) {
+		CHECK(dk2raw_reader_frame_count(reader) == 3);
+		dk2raw_reader_close(reader);
+	}
+	remove((path + ".cut").c_str());
+	remove(path.c_str());
+}
+
+/* a header damaged in any of these ways is refused */
+static void
+bad_headers(const std::string &path)
+{
+	static const size_t fields[] = {
+		0,		/* magic */
+		8,		/* version */
+		24,		/* tile */
+		28,		/* bits */
+		36,		/* frame_size */
+		40,		/* record_size */
+	};
+	dk2raw_writer_t *writer;
+	dk2raw_reader_t *reader;
+	std::vector<uint8_t> frame = make_frame(16, 8, 8);
+	size_t k;
+
+	for (k = 0; k < sizeof(fields) / sizeof(fields[0]); k++) {
+		FILE *file;
+		uint32_t junk = 0x7fffffff;
+
+		CHECK(dk2raw_writer_open(path.c_str(), 16, 8, DC1394_COLOR_FILTER_GBRG, 8, &writer) == DC1394_SUCCESS);
+		CHECK(dk2raw_writer_append(writer, &frame[0], (uint32_t)frame.size(), 0, DK2RAW_NO_TIME) == DC1394_SUCCESS);
+		CHECK(dk2raw_writer_close(writer) == DC1394_SUCCESS);
+		file = fopen(path.c_str(), "r+b");
+		CHECK(file != NULL);
+		if (file == NULL)
+			continue;
+		fseek(file, (long)fields[k], SEEK_SET);
+		fwrite(&junk, sizeof(junk), 1, file);
+		fclose(file);
+		CHECK(dk2raw_reader_open(path.c_str(), &reader) == DC1394_FAILURE);
+		CHECK(reader == NULL);
+	}
+	CHECK(dk2raw_reader_open((path + ".missing").c_str(), &reader) == DC1394_FAILURE);
+	CHECK(dk2raw_writer_open(path.c_str(), 16, 8, DC1394_COLOR_FILTER_GBRG, 17, &writer) == DC1394_INVALID_ARGUMENT_VALUE);
+	remove(path.c_str());
+}
+
+int
+main(int argc, char **argv)
+{
+	std::string path = std::string(argc > 1 ? argv[1] : "dk2raw_roundtrip") + ".dk2raw";
+
+	roundtrip(path, 752, 480, DC1394_COLOR_FILTER_RGGB, 8);
+	roundtrip(path, 33, 17, DC1394_COLOR_FILTER_BGGR, 8);
+	roundtrip(path, 64, 48, DC1394_COLOR_FILTER_GRBG, 12);
+	bad_headers(path);
+
+	return test_report("dk2raw round trip");
+}
@@ -0,0 +1,50 @@
+/*
+* Checks and random numbers shared by the test programs
+*
+* CHECK counts a failed condition and prints it with its line, so that
+* a program runs every check and then reports how many failed through
+* test_report, which gives its exit status. rng is a xorshift32 whose
+* sequence only depends on rng_state, which a test may seed.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef __DK2_TEST_UTIL_H__
+#define __DK2_TEST_UTIL_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+/* prints the number of failed checks after name, and returns the exit status */
+static inline int
+test_report(const char *name)
+{
+	printf("%s: %d failed checks\n", name, failures);
+	return failures ? 1 : 0;
+}
+
+static uint32_t rng_state = 1;
+
+static inline uint32_t
+rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+#endif